@@ -0,0 +1,487 @@
+//=============================================================================================
+// encoder.c
+//=============================================================================================
+//
+// Wheel encoder backends, see encoder.h.
+//
+//=============================================================================================
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "encoder.h"
+#include <string.h>
+#include "driver/pulse_cnt.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+
+// The ISR runs from IRAM; its table goes to DRAM rather than flash
+#define ENCODER_DECODE_TABLE_ATTR DRAM_ATTR
+#include "encoder_decode.h"
+#include "encoder_velocity.h"
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+static const char *TAG = "ENCODER";
+
+// ESP32 pulse counters are 16-bit signed; the driver accumulates every time a limit is
+// reached (accum_count), giving a 32-bit count that is extended to 64 bits here
+#define PCNT_LIMIT 32767
+
+#define WHEEL_LEFT  0
+#define WHEEL_RIGHT 1
+#define WHEEL_COUNT 2
+
+typedef struct {
+    gpio_num_t pin_a, pin_b;
+    // PCNT backend
+    pcnt_unit_handle_t unit;
+    pcnt_channel_handle_t chan_a, chan_b;
+    // ISR backend: input register holding both channels, decoder state
+    uint32_t in_reg;
+    encoder_decoder_t dec;
+    // 64-bit extension of the backend count (scaled by 4, wrapping at 2^32)
+    uint32_t last_raw;
+    int64_t count;
+    // Edge timing: log written by the ISR while timing is set, estimator run by the task
+    volatile bool timing;
+    encoder_edge_log_t edges;
+    uint32_t timing_a, timing_n;    // PCNT: last level of A and count of the timing ISR
+    encoder_rate_t rate;
+} wheel_t;
+
+static wheel_t s_wheels[WHEEL_COUNT];
+static encoder_backend_t s_backend = ENCODER_BACKEND_PCNT;
+static bool s_initialized = false;
+static volatile uint32_t s_interrupts = 0;
+static uint32_t s_edge_rate_max = 0;
+static uint32_t s_edge_timeout_ms = 0;
+
+//-------------------------------------------------------------------------------------------
+// ISR backend
+
+// ----- ENCODER QUADRATURE X4 ISR -----
+// One handler per wheel (arg: its wheel_t); one register read gives both channels
+static void IRAM_ATTR encoder_isr_handler(void *arg)
+{
+    wheel_t *w = (wheel_t *)arg;
+    uint32_t before = encoder_decode_load(&w->dec);
+    encoder_decode_edge(&w->dec, REG_READ(w->in_reg));
+    uint32_t after = encoder_decode_load(&w->dec);
+    if (w->timing && ((after ^ before) & ~3u)) {
+        encoder_edge_log_record(&w->edges, (uint32_t)esp_timer_get_time(), after & ~3u);
+    }
+    s_interrupts++;
+}
+
+// ----- ENCODER EDGE TIMING ISR (PCNT) -----
+// Channel A only: the count moves by 2 per edge, forward when A takes the level of B
+static void IRAM_ATTR encoder_timing_isr_handler(void *arg)
+{
+    wheel_t *w = (wheel_t *)arg;
+    uint32_t in = REG_READ(w->in_reg);
+    uint32_t a = (in >> w->dec.shift_a) & 1u;
+    uint32_t b = (in >> w->dec.shift_b) & 1u;
+    if (a != w->timing_a) {
+        w->timing_a = a;
+        w->timing_n += (a == b) ? 8u : (uint32_t)-8;
+        encoder_edge_log_record(&w->edges, (uint32_t)esp_timer_get_time(), w->timing_n);
+    }
+    s_interrupts++;
+}
+
+// GPIO input register holding a pin
+static uint32_t pin_in_reg(gpio_num_t pin) {
+#ifdef GPIO_IN1_REG
+    if (pin >= 32) {
+        return GPIO_IN1_REG;
+    }
+#endif
+    return GPIO_IN_REG;
+}
+
+// Input register and bit of both channels, for either backend's interrupt
+static esp_err_t wheel_setup_pins(wheel_t *w) {
+    w->in_reg = pin_in_reg(w->pin_a);
+    if (pin_in_reg(w->pin_b) != w->in_reg) {
+        return ESP_ERR_NOT_SUPPORTED;   // channels must share one input register
+    }
+    encoder_decode_init(&w->dec, w->pin_a % 32, w->pin_b % 32, REG_READ(w->in_reg));
+    return ESP_OK;
+}
+
+static esp_err_t install_isr_service(void) {
+    // Already installed by another driver (e.g. the Arduino attachInterrupt()) is fine
+    esp_err_t ret = gpio_install_isr_service(0);
+    return ret == ESP_ERR_INVALID_STATE ? ESP_OK : ret;
+}
+
+static esp_err_t isr_start(void) {
+    esp_err_t ret = install_isr_service();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    for (int i = 0; i < WHEEL_COUNT; i++) {
+        wheel_t *w = &s_wheels[i];
+        ret = wheel_setup_pins(w);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        gpio_set_intr_type(w->pin_a, GPIO_INTR_ANYEDGE);
+        gpio_set_intr_type(w->pin_b, GPIO_INTR_ANYEDGE);
+        ret = gpio_isr_handler_add(w->pin_a, encoder_isr_handler, w);
+        if (ret == ESP_OK) {
+            ret = gpio_isr_handler_add(w->pin_b, encoder_isr_handler, w);
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+static void isr_stop(void) {
+    for (int i = 0; i < WHEEL_COUNT; i++) {
+        gpio_isr_handler_remove(s_wheels[i].pin_a);
+        gpio_isr_handler_remove(s_wheels[i].pin_b);
+        gpio_set_intr_type(s_wheels[i].pin_a, GPIO_INTR_DISABLE);
+        gpio_set_intr_type(s_wheels[i].pin_b, GPIO_INTR_DISABLE);
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+// PCNT backend
+
+// Counter limit reached: the driver has already added it to the accumulated count
+static bool IRAM_ATTR on_limit(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata,
+                               void *user_ctx) {
+    s_interrupts++;
+    return false;
+}
+
+static void pcnt_stop_wheel(wheel_t *w) {
+    if (w->unit == NULL) {
+        return;
+    }
+    pcnt_unit_stop(w->unit);
+    pcnt_unit_disable(w->unit);
+    if (w->chan_a != NULL) {
+        pcnt_del_channel(w->chan_a);
+    }
+    if (w->chan_b != NULL) {
+        pcnt_del_channel(w->chan_b);
+    }
+    pcnt_del_unit(w->unit);
+    w->unit = NULL;
+    w->chan_a = NULL;
+    w->chan_b = NULL;
+}
+
+// One unit, two channels: each pin's edges count with the direction given by the level
+// of the other pin, which is x4 decoding with the same sign as the ISR decoder
+static esp_err_t pcnt_start_wheel(wheel_t *w, uint32_t glitch_ns) {
+    pcnt_unit_config_t unit_cfg = {
+        .low_limit = -PCNT_LIMIT,
+        .high_limit = PCNT_LIMIT,
+        .flags.accum_count = true,
+    };
+    esp_err_t ret = pcnt_new_unit(&unit_cfg, &w->unit);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (glitch_ns > 0) {
+        pcnt_glitch_filter_config_t filter_cfg = {
+            .max_glitch_ns = glitch_ns,
+        };
+        ret = pcnt_unit_set_glitch_filter(w->unit, &filter_cfg);
+    }
+
+    // A edges, B level: A rising counts up while B is high
+    pcnt_chan_config_t chan_cfg = {
+        .edge_gpio_num = w->pin_a,
+        .level_gpio_num = w->pin_b,
+    };
+    if (ret == ESP_OK) {
+        ret = pcnt_new_channel(w->unit, &chan_cfg, &w->chan_a);
+    }
+    if (ret == ESP_OK) {
+        ret = pcnt_channel_set_edge_action(w->chan_a, PCNT_CHANNEL_EDGE_ACTION_INCREASE,
+                                           PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+    }
+    if (ret == ESP_OK) {
+        ret = pcnt_channel_set_level_action(w->chan_a, PCNT_CHANNEL_LEVEL_ACTION_KEEP,
+                                            PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    }
+
+    // B edges, A level: B rising counts up while A is low
+    chan_cfg.edge_gpio_num = w->pin_b;
+    chan_cfg.level_gpio_num = w->pin_a;
+    if (ret == ESP_OK) {
+        ret = pcnt_new_channel(w->unit, &chan_cfg, &w->chan_b);
+    }
+    if (ret == ESP_OK) {
+        ret = pcnt_channel_set_edge_action(w->chan_b, PCNT_CHANNEL_EDGE_ACTION_DECREASE,
+                                           PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+    }
+    if (ret == ESP_OK) {
+        ret = pcnt_channel_set_level_action(w->chan_b, PCNT_CHANNEL_LEVEL_ACTION_KEEP,
+                                            PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    }
+
+    // Watch points on the limits: needed for the accumulation, and the only interrupts
+    if (ret == ESP_OK) {
+        ret = pcnt_unit_add_watch_point(w->unit, PCNT_LIMIT);
+    }
+    if (ret == ESP_OK) {
+        ret = pcnt_unit_add_watch_point(w->unit, -PCNT_LIMIT);
+    }
+    pcnt_event_callbacks_t cbs = {
+        .on_reach = on_limit,
+    };
+    if (ret == ESP_OK) {
+        ret = pcnt_unit_register_event_callbacks(w->unit, &cbs, NULL);
+    }
+
+    if (ret == ESP_OK) {
+        ret = pcnt_unit_enable(w->unit);
+    }
+    if (ret == ESP_OK) {
+        ret = pcnt_unit_clear_count(w->unit);
+    }
+    if (ret == ESP_OK) {
+        ret = pcnt_unit_start(w->unit);
+    }
+    if (ret != ESP_OK) {
+        pcnt_stop_wheel(w);
+    }
+    return ret;
+}
+
+// Edge timing: a GPIO interrupt on channel A of each wheel, enabled while in use
+static esp_err_t pcnt_timing_start(void) {
+    esp_err_t ret = install_isr_service();
+    for (int i = 0; i < WHEEL_COUNT && ret == ESP_OK; i++) {
+        wheel_t *w = &s_wheels[i];
+        ret = wheel_setup_pins(w);
+        if (ret == ESP_OK) {
+            gpio_set_intr_type(w->pin_a, GPIO_INTR_ANYEDGE);
+            ret = gpio_isr_handler_add(w->pin_a, encoder_timing_isr_handler, w);
+        }
+        if (ret == ESP_OK) {
+            gpio_intr_disable(w->pin_a);
+        }
+    }
+    return ret;
+}
+
+static void pcnt_timing_stop(void) {
+    for (int i = 0; i < WHEEL_COUNT; i++) {
+        gpio_isr_handler_remove(s_wheels[i].pin_a);
+        gpio_set_intr_type(s_wheels[i].pin_a, GPIO_INTR_DISABLE);
+    }
+}
+
+static esp_err_t pcnt_start(uint32_t glitch_ns) {
+    for (int i = 0; i < WHEEL_COUNT; i++) {
+        esp_err_t ret = pcnt_start_wheel(&s_wheels[i], glitch_ns);
+        if (ret != ESP_OK) {
+            for (int j = 0; j < i; j++) {
+                pcnt_stop_wheel(&s_wheels[j]);
+            }
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+//-------------------------------------------------------------------------------------------
+// Counts and timing
+
+// Backend count times 4, wrapping at 2^32 (the decoder state layout)
+static uint32_t read_raw(wheel_t *w) {
+    if (s_backend == ENCODER_BACKEND_PCNT) {
+        int value = 0;
+        pcnt_unit_get_count(w->unit, &value);
+        return (uint32_t)value << 2;
+    }
+    return encoder_decode_load(&w->dec) & ~3u;
+}
+
+// Start or stop timestamping the edges of a wheel
+static void wheel_set_timing(wheel_t *w, bool on) {
+    if (s_backend == ENCODER_BACKEND_PCNT && s_edge_rate_max > 0) {
+        if (on) {
+            // Current level, so that an edge latched while disabled is not counted
+            w->timing_a = (REG_READ(w->in_reg) >> w->dec.shift_a) & 1u;
+            gpio_intr_enable(w->pin_a);
+        } else {
+            gpio_intr_disable(w->pin_a);
+        }
+    }
+    w->timing = on;
+}
+
+//-------------------------------------------------------------------------------------------
+// API
+
+esp_err_t encoder_init(const encoder_config_t *config) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(s_wheels, 0, sizeof(s_wheels));
+    s_wheels[WHEEL_LEFT].pin_a = config->left_a;
+    s_wheels[WHEEL_LEFT].pin_b = config->left_b;
+    s_wheels[WHEEL_RIGHT].pin_a = config->right_a;
+    s_wheels[WHEEL_RIGHT].pin_b = config->right_b;
+    s_interrupts = 0;
+    s_edge_rate_max = config->edge_rate_max;
+    s_edge_timeout_ms = config->edge_timeout_ms;
+
+    // Inputs with pull-ups (open collector Hall outputs), no interrupt yet
+    gpio_config_t io_conf = {
+        .intr_type = GPIO_INTR_DISABLE,
+        .mode = GPIO_MODE_INPUT,
+        .pin_bit_mask = ((1ULL<<config->left_a)|(1ULL<<config->left_b)|
+                         (1ULL<<config->right_a)|(1ULL<<config->right_b)),
+        .pull_up_en = 1,
+        .pull_down_en = 0
+    };
+    esp_err_t ret = gpio_config(&io_conf);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    s_backend = config->backend;
+    if (s_backend == ENCODER_BACKEND_PCNT) {
+        ret = pcnt_start(config->glitch_ns);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "PCNT not available (%s), using GPIO interrupts", esp_err_to_name(ret));
+            s_backend = ENCODER_BACKEND_ISR;
+        }
+    }
+    if (s_backend == ENCODER_BACKEND_ISR) {
+        ret = isr_start();
+        if (ret != ESP_OK) {
+            isr_stop();
+            ESP_LOGE(TAG, "Failed to install encoder interrupts: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+    if (s_backend == ENCODER_BACKEND_PCNT && s_edge_rate_max > 0) {
+        ret = pcnt_timing_start();
+        if (ret != ESP_OK) {
+            pcnt_timing_stop();
+            ESP_LOGW(TAG, "No edge timing (%s), rates from counts only", esp_err_to_name(ret));
+            s_edge_rate_max = 0;
+        }
+    }
+
+    // Standing still: rates start from edge timing (if enabled)
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    for (int i = 0; i < WHEEL_COUNT; i++) {
+        wheel_t *w = &s_wheels[i];
+        encoder_rate_init(&w->rate, (float)s_edge_rate_max, s_edge_timeout_ms * 1000u, now_us,
+                          read_raw(w), w->edges.head);
+        wheel_set_timing(w, w->rate.edge_mode);
+    }
+
+    s_initialized = true;
+    ESP_LOGI(TAG, "Encoders on %s", s_backend == ENCODER_BACKEND_PCNT ? "PCNT" : "GPIO interrupts");
+    return ESP_OK;
+}
+
+esp_err_t encoder_deinit(void) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (s_backend == ENCODER_BACKEND_PCNT) {
+        if (s_edge_rate_max > 0) {
+            pcnt_timing_stop();
+        }
+        for (int i = 0; i < WHEEL_COUNT; i++) {
+            pcnt_stop_wheel(&s_wheels[i]);
+        }
+    } else {
+        isr_stop();
+    }
+    s_initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t encoder_get_counts(int64_t *left, int64_t *right) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (int i = 0; i < WHEEL_COUNT; i++) {
+        wheel_t *w = &s_wheels[i];
+        uint32_t raw = read_raw(w);
+        // Difference modulo 2^30 counts: exact while less than 2^29 pass between calls
+        w->count += encoder_decode_count_delta(raw, w->last_raw);
+        w->last_raw = raw;
+    }
+    if (left != NULL) {
+        *left = s_wheels[WHEEL_LEFT].count;
+    }
+    if (right != NULL) {
+        *right = s_wheels[WHEEL_RIGHT].count;
+    }
+    return ESP_OK;
+}
+
+esp_err_t encoder_get_rates(float *left, float *right) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    float rates[WHEEL_COUNT];
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    for (int i = 0; i < WHEEL_COUNT; i++) {
+        wheel_t *w = &s_wheels[i];
+        bool was_timed = w->rate.edge_mode;
+        rates[i] = encoder_rate_update(&w->rate, &w->edges, now_us, read_raw(w));
+        if (w->rate.edge_mode != was_timed) {
+            wheel_set_timing(w, w->rate.edge_mode);
+        }
+    }
+    if (left != NULL) {
+        *left = rates[WHEEL_LEFT];
+    }
+    if (right != NULL) {
+        *right = rates[WHEEL_RIGHT];
+    }
+    return ESP_OK;
+}
+
+encoder_backend_t encoder_get_backend(void) {
+    return s_backend;
+}
+
+uint32_t encoder_get_interrupt_count(void) {
+    return s_interrupts;
+}
+
+esp_err_t encoder_get_illegal_count(uint32_t *left, uint32_t *right) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (left != NULL) {
+        *left = __atomic_load_n(&s_wheels[WHEEL_LEFT].dec.illegal, __ATOMIC_RELAXED);
+    }
+    if (right != NULL) {
+        *right = __atomic_load_n(&s_wheels[WHEEL_RIGHT].dec.illegal, __ATOMIC_RELAXED);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,141 @@
+//=============================================================================================
+// encoder.h
+//=============================================================================================
+//
+// Quadrature decoding (x4) of the two N20 wheel encoders behind one API, so that the
+// odometry task does not depend on how the edges are counted.
+//
+// Backends:
+//   ENCODER_BACKEND_PCNT  one ESP32 pulse counter unit per wheel, two channels in x4
+//                         quadrature mode with the glitch filter on. The hardware counts
+//                         every edge; the only interrupt is the 16-bit counter reaching
+//                         its limit (every 32767 counts, ~39 wheel turns).
+//   ENCODER_BACKEND_ISR   software decoding: a GPIO interrupt on every edge of the four
+//                         pins, one input register read and a table lookup per edge
+//                         (encoder_decode.h). Kept as a fallback, e.g. for pins or
+//                         chips without a free PCNT unit. Both channels of a wheel must
+//                         be in the same GPIO input register (GPIO 0-31 or 32-39).
+//
+// Both count the same direction for the same wiring. Counts are extended to 64 bits
+// in encoder_get_counts(), which must be called at least once per 2^29 counts (hours
+// at full speed) and from one task only.
+//
+// Speeds (encoder_get_rates()) come from edge timestamps below edge_rate_max and from
+// counts above it (encoder_velocity.h). Edges are only timestamped while edge timing is
+// in use: by the edge interrupt of the ISR backend, by an extra GPIO interrupt on
+// channel A (2 edges per cycle) with PCNT.
+//
+//=============================================================================================
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ENCODER_BACKEND_PCNT = 0,   // hardware pulse counter
+    ENCODER_BACKEND_ISR,        // GPIO interrupt per edge
+} encoder_backend_t;
+
+// Encoder configuration structure
+typedef struct {
+    gpio_num_t left_a, left_b;
+    gpio_num_t right_a, right_b;
+    encoder_backend_t backend;
+    uint32_t glitch_ns;         // PCNT: pulses shorter than this are ignored (0: no filter)
+    uint32_t edge_rate_max;     // counts/s below which speeds come from edge times (0: never)
+    uint32_t edge_timeout_ms;   // edge timing: no edge for this long reads as stopped
+} encoder_config_t;
+
+// Default configuration: rear encoder pins of the rover, PCNT backend. The glitch filter
+// is far below the ~140 µs between edges at the motors' top speed. Edge timing below
+// 500 counts/s (~12 cm/s, 50 counts per 100 ms); 250 ms without an edge is < 1 mm/s.
+#define ENCODER_DEFAULT_CONFIG() { \
+    .left_a = GPIO_NUM_23, \
+    .left_b = GPIO_NUM_17, \
+    .right_a = GPIO_NUM_18, \
+    .right_b = GPIO_NUM_19, \
+    .backend = ENCODER_BACKEND_PCNT, \
+    .glitch_ns = 1000, \
+    .edge_rate_max = 500, \
+    .edge_timeout_ms = 250 \
+}
+
+/**
+ * @brief Configure the pins and start counting
+ *
+ * Both encoders start at 0. If the PCNT backend cannot be set up (no free unit, pin
+ * not routable) the ISR backend is used instead, see encoder_get_backend().
+ *
+ * @param config Configuration structure
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t encoder_init(const encoder_config_t *config);
+
+/**
+ * @brief Stop counting and release the pins, units and interrupts
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t encoder_deinit(void);
+
+/**
+ * @brief Get the counts of both wheels since encoder_init()
+ *
+ * @param left Left wheel counts (may be NULL)
+ * @param right Right wheel counts (may be NULL)
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t encoder_get_counts(int64_t *left, int64_t *right);
+
+/**
+ * @brief Get the speed of both wheels
+ *
+ * From the time between the latest edges at low speed, from the counts since the
+ * previous call at high speed. Call periodically, from one task only.
+ *
+ * @param left Left wheel speed in counts/s (may be NULL)
+ * @param right Right wheel speed in counts/s (may be NULL)
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t encoder_get_rates(float *left, float *right);
+
+/**
+ * @brief Get the backend in use
+ *
+ * @return encoder_backend_t Backend chosen by encoder_init()
+ */
+encoder_backend_t encoder_get_backend(void);
+
+/**
+ * @brief Get the number of encoder interrupts since encoder_init()
+ *
+ * One per edge with the ISR backend, one per counter limit with PCNT.
+ *
+ * @return uint32_t Interrupt count
+ */
+uint32_t encoder_get_interrupt_count(void);
+
+/**
+ * @brief Get the number of undecodable steps (both channels changed at once)
+ *
+ * Each one is an edge the ISR backend missed, e.g. from interrupt latency at high
+ * speed; always 0 with PCNT.
+ *
+ * @param left Left wheel (may be NULL)
+ * @param right Right wheel (may be NULL)
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t encoder_get_illegal_count(uint32_t *left, uint32_t *right);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENCODER_H
@@ -9,188 +9,232 @@
  * 
  * Pin Configuration:
  * - Left Encoder A: GPIO 23
- * - Left Encoder B: GPIO 22
+ * - Left Encoder B: GPIO 17
  * - Right Encoder A: GPIO 18
  * - Right Encoder B: GPIO 19
  */
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
+#include "encoder.h"
+#include "odometry.h"
+#include "telemetry.h"
+// Readers of the shared pose may preempt the odometry task: let it finish its update
+#define ODOM_POSE_RELAX() vTaskDelay(1)
+#include "odom_pose.h"
 
 // ----- REAR ENCODER PINS -----
 #define ENC_LEFT_A      23
-#define ENC_LEFT_B      22
+#define ENC_LEFT_B      17
 #define ENC_RIGHT_A     18
 #define ENC_RIGHT_B     19
 
+// ENCODER_BACKEND_PCNT: hardware pulse counters (no interrupt per edge)
+// ENCODER_BACKEND_ISR: GPIO interrupt on every edge
+#define ENC_BACKEND     ENCODER_BACKEND_PCNT
+
 // ----- ROBOT PARAMETERS -----
 #define WHEEL_RADIUS    0.065/2    // meters
 #define WHEEL_BASE      0.138     // meters
 #define CPR             840       // counts per revolution (7x4xreduction)
-#define UPDATE_PERIOD_MS 100      // odometry update interval
 
-// ----- GLOBAL VARIABLES -----
-volatile int32_t count_left = 0;
-volatile int32_t count_right = 0;
+// ----- LOOP TIMING -----
+// The odometry loop runs from a periodic esp_timer: drift-free, independent of the
+// FreeRTOS tick; its records go out as binary telemetry (telemetry.h)
+#define ODOM_RATE_HZ    500       // odometry loop rate
+#define RATE_PERIOD_MS  50        // wheel rates (counts over this period at high speed)
+#define TELEMETRY_PERIOD_MS 20   // pose and counts records
+#define DIAG_PERIOD_MS  1000      // loop health record
 
-volatile int lastLA = 0, lastLB = 0;
-volatile int lastRA = 0, lastRB = 0;
+// ----- TELEMETRY PORT -----
+// Binary frames on Serial, decoded by codes/host/telemetry
+#define TELEMETRY_BAUD  115200
+#define SERIAL_TX_BUFFER 4096     // Serial TX ring buffer, drained by the UART interrupt
 
-// Robot pose
-float x = 0.0, y = 0.0, theta = 0.0;
+// Geometry, computed at compile time
+constexpr float WHEEL_BASE_M = WHEEL_BASE;
+constexpr float DIST_PER_COUNT = 2.0f * (float)PI * (float)(WHEEL_RADIUS) / CPR;
 
-// Estimated velocities
-float v = 0.0;      // linear (m/s)
-float omega = 0.0;   // angular (rad/s)
+// ----- GLOBAL VARIABLES -----
+// Robot pose and velocities, written by the odometry task only
+odom_pose_t pose = { 0 };
+odometry_t odom;
 
-// ----- ENCODER QUADRATURE X4 ISR -----
-void IRAM_ATTR encoder_isr_handler() {
-    // Left encoder
-    int a = digitalRead(ENC_LEFT_A);
-    int b = digitalRead(ENC_LEFT_B);
-    int transition = (lastLA << 3) | (lastLB << 2) | (a << 1) | b;
-    
-    switch (transition) {
-        case 0b0001: case 0b0111: case 0b1110: case 0b1000:
-            count_left++; 
-            break;
-        case 0b0010: case 0b0100: case 0b1101: case 0b1011:
-            count_left--; 
-            break;
-        default: 
-            break;
-    }
-    lastLA = a;
-    lastLB = b;
-}
+// Latest pose for other tasks: odom_pose_read(&odom_pose_shared, ...)
+odom_pose_snapshot_t odom_pose_shared = { 0 };
 
-void IRAM_ATTR encoder_right_isr_handler() {
-    // Right encoder
-    int a = digitalRead(ENC_RIGHT_A);
-    int b = digitalRead(ENC_RIGHT_B);
-    int transition = (lastRA << 3) | (lastRB << 2) | (a << 1) | b;
-    
-    switch (transition) {
-        case 0b0001: case 0b0111: case 0b1110: case 0b1000:
-            count_right++; 
-            break;
-        case 0b0010: case 0b0100: case 0b1101: case 0b1011:
-            count_right--; 
-            break;
-        default: 
-            break;
-    }
-    lastRA = a;
-    lastRB = b;
-}
+TaskHandle_t odometry_task_handle = NULL;
 
 // ----- ODOMETRY FUNCTION -----
-void update_odometry(int32_t delta_left, int32_t delta_right, float dt) {
-    float dist_per_count = 2.0 * PI * WHEEL_RADIUS / CPR;
-
-    float d_left  = delta_left * dist_per_count;
-    float d_right = delta_right * dist_per_count;
+// Pose from the count deltas, velocities from the wheel rates (counts/s)
+void update_odometry(int32_t delta_left, int32_t delta_right, float rate_left, float rate_right,
+                     int64_t now_us) {
+    // Exact arc per step (odometry.h)
+    odometry_step(&odom, delta_left, delta_right);
+    pose.x = odom.x;
+    pose.y = odom.y;
+    pose.theta = odom.theta;
+
+    // Velocities: edge-timed at low speed, so not quantized to counts per period
+    pose.v = (rate_right + rate_left) * (0.5f * DIST_PER_COUNT);
+    pose.omega = (rate_right - rate_left) * (DIST_PER_COUNT / WHEEL_BASE_M);
+    pose.stamp_us = now_us;
+
+    // One consistent update for the readers
+    odom_pose_publish(&odom_pose_shared, &pose);
+}
 
-    float ds = (d_right + d_left) / 2.0;
-    float dtheta = (d_right - d_left) / WHEEL_BASE;
+// ----- ODOMETRY TIMER -----
+void odometry_timer_callback(void *arg) {
+    xTaskNotifyGive(odometry_task_handle);
+}
 
-    x += ds * cos(theta + dtheta / 2.0);
-    y += ds * sin(theta + dtheta / 2.0);
-    theta += dtheta;
+// ----- TELEMETRY -----
+void telemetry_serial_write(const uint8_t *data, size_t len, void *ctx) {
+    Serial.write(data, len);
+}
 
-    // Velocities
-    v = ds / dt;
-    omega = dtheta / dt;
+// Pose and counts from the odometry loop
+void send_odometry(const odom_pose_t &p, int64_t count_left, int64_t count_right,
+                   float rate_left, float rate_right) {
+    telemetry_pose_t pose_rec;
+    pose_rec.x = p.x;
+    pose_rec.y = p.y;
+    pose_rec.theta = p.theta;
+    pose_rec.v = p.v;
+    pose_rec.omega = p.omega;
+    telemetry_send(TELEMETRY_POSE, &pose_rec, sizeof(pose_rec));
+
+    telemetry_counts_t counts_rec;
+    counts_rec.left = (int32_t)count_left;
+    counts_rec.right = (int32_t)count_right;
+    counts_rec.rate_left = rate_left;
+    counts_rec.rate_right = rate_right;
+    telemetry_send(TELEMETRY_COUNTS, &counts_rec, sizeof(counts_rec));
 }
 
 // ----- FREERTOS ODOMETRY TASK -----
 void odometry_task(void *parameter) {
-    int32_t last_count_left = 0;
-    int32_t last_count_right = 0;
+    int64_t count_left = 0, count_right = 0;
+    int64_t last_count_left = 0;
+    int64_t last_count_right = 0;
+    float rate_left = 0, rate_right = 0;
+    constexpr uint32_t rate_every = ODOM_RATE_HZ * RATE_PERIOD_MS / 1000;
+    constexpr uint32_t telemetry_every = ODOM_RATE_HZ * TELEMETRY_PERIOD_MS / 1000;
+    uint32_t loops = 0, telemetry_loops = 0, diag_loops = 0;
+    uint32_t dt_max_us = 0;
     
-    Serial.println("Odometry task started");
+    telemetry_text("Odometry task started");
+    
+    odometry_init(&odom, DIST_PER_COUNT, WHEEL_BASE_M);
+    odometry_task_handle = xTaskGetCurrentTaskHandle();
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = odometry_timer_callback;
+    timer_args.dispatch_method = ESP_TIMER_TASK;
+    timer_args.name = "odometry";
+    timer_args.skip_unhandled_events = true;
+    esp_timer_handle_t timer;
+    if (esp_timer_create(&timer_args, &timer) != ESP_OK ||
+        esp_timer_start_periodic(timer, 1000000 / ODOM_RATE_HZ) != ESP_OK) {
+        telemetry_text("Failed to start the odometry timer!");
+        vTaskDelete(NULL);
+    }
+    int64_t last_us = esp_timer_get_time();
+    int64_t diag_start_us = last_us;
     
     while (true) {
-        // Wait for the specified period
-        vTaskDelay(pdMS_TO_TICKS(UPDATE_PERIOD_MS));
+        // Wait for the next period; periods missed while late are caught up in one step
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int64_t now_us = esp_timer_get_time();
+        uint32_t dt_us = (uint32_t)(now_us - last_us);
+        last_us = now_us;
+        if (dt_us > dt_max_us) {
+            dt_max_us = dt_us;
+        }
         
         // Calculate deltas
-        int32_t delta_left  = count_left - last_count_left;
-        int32_t delta_right = count_right - last_count_right;
+        encoder_get_counts(&count_left, &count_right);
+        int32_t delta_left  = (int32_t)(count_left - last_count_left);
+        int32_t delta_right = (int32_t)(count_right - last_count_right);
 
         last_count_left  = count_left;
         last_count_right = count_right;
 
-        float dt = UPDATE_PERIOD_MS / 1000.0; // time in seconds
+        if (++loops >= rate_every) {
+            loops = 0;
+            encoder_get_rates(&rate_left, &rate_right);
+        }
 
         // Update odometry
-        update_odometry(delta_left, delta_right, dt);
-
-        // Print odometry
-        Serial.print("Pose: x=");
-        Serial.print(x, 4);
-        Serial.print(" m, y=");
-        Serial.print(y, 4);
-        Serial.print(" m, theta=");
-        Serial.print(theta, 3);
-        Serial.println(" rad");
-        
-        Serial.print("Velocity: v=");
-        Serial.print(v, 4);
-        Serial.print(" m/s, omega=");
-        Serial.print(omega, 4);
-        Serial.println(" rad/s");
-        
-        Serial.print("Counts: Left=");
-        Serial.print(count_left);
-        Serial.print(" Right=");
-        Serial.println(count_right);
-        Serial.println();
+        update_odometry(delta_left, delta_right, rate_left, rate_right, now_us);
+
+        // Records are queued, never waited on: the telemetry task writes them
+        if (++telemetry_loops >= telemetry_every) {
+            telemetry_loops = 0;
+            send_odometry(pose, count_left, count_right, rate_left, rate_right);
+        }
+        diag_loops++;
+        if (now_us - diag_start_us >= DIAG_PERIOD_MS * 1000) {
+            telemetry_diag_t diag;
+            diag.loop_hz = (uint16_t)(diag_loops * 1000000LL / (now_us - diag_start_us));
+            diag.dt_max_us = dt_max_us;
+            diag.interrupts = encoder_get_interrupt_count();
+            diag.dropped = telemetry_get_dropped();
+            telemetry_send(TELEMETRY_DIAG, &diag, sizeof(diag));
+            diag_loops = 0;
+            dt_max_us = 0;
+            diag_start_us = now_us;
+        }
     }
 }
 
 // ----- ARDUINO SETUP -----
 void setup() {
-    Serial.begin(115200);
+    Serial.setTxBufferSize(SERIAL_TX_BUFFER);
+    Serial.begin(TELEMETRY_BAUD);
     Serial.println("Encoder to Odometry - Starting...");
     
-    // Configure encoder pins
-    pinMode(ENC_LEFT_A, INPUT_PULLUP);
-    pinMode(ENC_LEFT_B, INPUT_PULLUP);
-    pinMode(ENC_RIGHT_A, INPUT_PULLUP);
-    pinMode(ENC_RIGHT_B, INPUT_PULLUP);
-    
-    // Initialize last states
-    lastLA = digitalRead(ENC_LEFT_A);
-    lastLB = digitalRead(ENC_LEFT_B);
-    lastRA = digitalRead(ENC_RIGHT_A);
-    lastRB = digitalRead(ENC_RIGHT_B);
-    
-    // Attach interrupts
-    attachInterrupt(digitalPinToInterrupt(ENC_LEFT_A), encoder_isr_handler, CHANGE);
-    attachInterrupt(digitalPinToInterrupt(ENC_LEFT_B), encoder_isr_handler, CHANGE);
-    attachInterrupt(digitalPinToInterrupt(ENC_RIGHT_A), encoder_right_isr_handler, CHANGE);
-    attachInterrupt(digitalPinToInterrupt(ENC_RIGHT_B), encoder_right_isr_handler, CHANGE);
+    // Start the wheel encoders
+    encoder_config_t enc_conf = ENCODER_DEFAULT_CONFIG();
+    enc_conf.left_a = (gpio_num_t)ENC_LEFT_A;
+    enc_conf.left_b = (gpio_num_t)ENC_LEFT_B;
+    enc_conf.right_a = (gpio_num_t)ENC_RIGHT_A;
+    enc_conf.right_b = (gpio_num_t)ENC_RIGHT_B;
+    enc_conf.backend = ENC_BACKEND;
+    if (encoder_init(&enc_conf) != ESP_OK) {
+        Serial.println("Failed to initialize encoders!");
+        while (1) {
+            delay(1000);
+        }
+    }
+    Serial.println(encoder_get_backend() == ENCODER_BACKEND_PCNT ? "Encoders on PCNT" : "Encoders on GPIO interrupts");
     
-    Serial.println("Encoder interrupts configured");
+    // Telemetry task: text ends here, binary frames follow
+    telemetry_config_t tel_conf = TELEMETRY_DEFAULT_CONFIG();
+    tel_conf.write = telemetry_serial_write;
+    if (telemetry_init(&tel_conf) != ESP_OK) {
+        Serial.println("Failed to start telemetry!");
+        while (1) {
+            delay(1000);
+        }
+    }
     
-    // Create FreeRTOS task for odometry processing
+    // Create FreeRTOS task for odometry processing (above the telemetry)
     xTaskCreate(
         odometry_task,           // Task function
         "OdometryTask",          // Task name
         2048,                    // Stack size (words)
         NULL,                    // Task parameters
-        1,                       // Task priority
+        5,                       // Task priority
         NULL                     // Task handle
     );
     
-    Serial.println("Odometry task created");
-    Serial.println("System ready!");
+    telemetry_text("System ready!");
 }
 
 // ----- ARDUINO MAIN LOOP -----
 void loop() {
-    // Main loop is now free for other tasks
-    // Odometry processing is handled by FreeRTOS task
-    delay(1000); // Small delay to prevent watchdog reset
+    // Odometry and its telemetry are handled by FreeRTOS tasks
+    delay(1000);
 }
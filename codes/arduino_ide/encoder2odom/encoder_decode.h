@@ -0,0 +1,118 @@
+//=============================================================================================
+// encoder_decode.h
+//=============================================================================================
+//
+// Table-driven x4 quadrature step of the ISR encoder backend (encoder.c), kept free of
+// ESP-IDF headers so that the host tools can check and time it.
+//
+// Each wheel keeps its whole decoder state in one 32-bit word:
+//
+//   state = count << 2 | AB      (AB: last levels of channel A and B)
+//
+// An edge is one lookup: the previous AB and the new AB index a 16-entry table of
+// count steps (+1, -1, 0). Both channels come from one read of the GPIO input
+// register, so the two levels always belong to the same instant. A step where both
+// channels changed at once cannot be decoded (an edge was missed); it counts 0 and is
+// reported in the illegal counter.
+//
+// The count wraps at 2^30; encoder_decode_count_delta() gives the difference between
+// two states modulo that.
+//
+// Handoff to the task: the ISR is the only writer of the word. The task loads it once
+// per period (encoder_decode_load()) and takes the difference to its previous load, so
+// an edge between two loads is never lost and the ISR needs no atomic read-modify-write
+// (no compare-and-swap, no critical section).
+//
+//=============================================================================================
+#ifndef ENCODER_DECODE_H
+#define ENCODER_DECODE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Placement of the transition table, e.g. DRAM_ATTR for an ISR that must not touch flash
+#ifndef ENCODER_DECODE_TABLE_ATTR
+#define ENCODER_DECODE_TABLE_ATTR
+#endif
+
+// Count step for (previous AB << 2) | new AB, same direction as the former switch decoder
+static const int8_t ENCODER_DECODE_TABLE_ATTR encoder_decode_table[16] = {
+     0, +1, -1,  0,     // 00 -> 00 01 10 11
+    -1,  0,  0, +1,     // 01 ->
+    +1,  0,  0, -1,     // 10 ->
+     0, -1, +1,  0,     // 11 ->
+};
+
+// Indices where A and B changed together
+#define ENCODER_DECODE_ILLEGAL_MASK ((1u << 0x3) | (1u << 0x6) | (1u << 0x9) | (1u << 0xC))
+
+// Per-wheel decoder
+typedef struct {
+    uint32_t state;                 // count << 2 | last AB, written by the ISR only
+    uint32_t illegal;               // undecodable steps, written by the ISR only
+    uint8_t shift_a, shift_b;       // bit of channel A and B in the input register
+} encoder_decoder_t;
+
+/**
+ * @brief Set up a decoder
+ *
+ * @param dec Decoder
+ * @param shift_a Bit of channel A in the input register
+ * @param shift_b Bit of channel B in the input register
+ * @param in Current input register value (initial levels, count 0)
+ */
+static inline void encoder_decode_init(encoder_decoder_t *dec, uint8_t shift_a, uint8_t shift_b,
+                                       uint32_t in) {
+    dec->shift_a = shift_a;
+    dec->shift_b = shift_b;
+    dec->state = (((in >> shift_a) & 1u) << 1) | ((in >> shift_b) & 1u);
+    dec->illegal = 0;
+}
+
+/**
+ * @brief Decode one edge
+ *
+ * @param dec Decoder
+ * @param in Input register value read in the interrupt
+ */
+static inline void encoder_decode_edge(encoder_decoder_t *dec, uint32_t in) {
+    uint32_t ab = (((in >> dec->shift_a) & 1u) << 1) | ((in >> dec->shift_b) & 1u);
+    uint32_t state = __atomic_load_n(&dec->state, __ATOMIC_RELAXED);
+    uint32_t idx = ((state & 3u) << 2) | ab;
+    state = ((state & ~3u) + (uint32_t)((int32_t)encoder_decode_table[idx] * 4)) | ab;
+    __atomic_store_n(&dec->state, state, __ATOMIC_RELAXED);
+    if ((ENCODER_DECODE_ILLEGAL_MASK >> idx) & 1u) {
+        __atomic_store_n(&dec->illegal, __atomic_load_n(&dec->illegal, __ATOMIC_RELAXED) + 1,
+                         __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Load the state once, from any task or core
+ *
+ * @param dec Decoder
+ * @return uint32_t State word for encoder_decode_count_delta()
+ */
+static inline uint32_t encoder_decode_load(const encoder_decoder_t *dec) {
+    return __atomic_load_n(&dec->state, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Count difference between two decoder states
+ *
+ * @param now Later state
+ * @param before Earlier state
+ * @return int32_t Counts from before to now, exact below 2^29 in either direction
+ */
+static inline int32_t encoder_decode_count_delta(uint32_t now, uint32_t before) {
+    return (int32_t)((now & ~3u) - (before & ~3u)) / 4;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENCODER_DECODE_H
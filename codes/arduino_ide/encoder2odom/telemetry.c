@@ -0,0 +1,128 @@
+//=============================================================================================
+// telemetry.c
+//=============================================================================================
+//
+// Telemetry queue and task, see telemetry.h.
+//
+//=============================================================================================
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "telemetry.h"
+#include <string.h>
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_timer.h"
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+// Queued item: type, t_us (little-endian), payload. The sequence number is given when
+// the frame is written, so that it counts frames on the wire
+#define ITEM_HEADER_LEN 5u
+
+// Frames written per port write
+#define BATCH_LEN 512u
+
+static RingbufHandle_t s_queue = NULL;
+static telemetry_write_t s_write = NULL;
+static void *s_write_ctx = NULL;
+static volatile uint32_t s_dropped = 0;
+
+//-------------------------------------------------------------------------------------------
+// Telemetry task
+
+static void telemetry_task(void *arg) {
+    static uint8_t batch[BATCH_LEN];
+    uint8_t seq = 0;
+
+    while (1) {
+        size_t len;
+        uint8_t *item = (uint8_t *)xRingbufferReceive(s_queue, &len, portMAX_DELAY);
+        if (item == NULL) {
+            continue;
+        }
+
+        // A delimiter first closes any text written to the port since the last batch
+        size_t n = 0;
+        batch[n++] = 0;
+        while (item != NULL) {
+            telemetry_header_t header = {
+                .type = item[0],
+                .seq = seq++,
+                .t_us = (uint32_t)item[1] | ((uint32_t)item[2] << 8) |
+                        ((uint32_t)item[3] << 16) | ((uint32_t)item[4] << 24),
+            };
+            n += telemetry_frame(&header, item + ITEM_HEADER_LEN, len - ITEM_HEADER_LEN,
+                                 batch + n);
+            vRingbufferReturnItem(s_queue, item);
+            if (n + TELEMETRY_MAX_FRAME > sizeof(batch)) {
+                break;
+            }
+            item = (uint8_t *)xRingbufferReceive(s_queue, &len, 0);
+        }
+        s_write(batch, n, s_write_ctx);
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+// API
+
+esp_err_t telemetry_init(const telemetry_config_t *config) {
+    if (config == NULL || config->write == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_write = config->write;
+    s_write_ctx = config->ctx;
+    s_dropped = 0;
+    s_queue = xRingbufferCreate(config->queue_size, RINGBUF_TYPE_NOSPLIT);
+    if (s_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(telemetry_task, "TelemetryTask", config->stack_size, NULL,
+                    config->priority, NULL) != pdPASS) {
+        vRingbufferDelete(s_queue);
+        s_queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool telemetry_send(telemetry_type_t type, const void *payload, size_t len) {
+    if (s_queue == NULL || len > TELEMETRY_MAX_PAYLOAD) {
+        __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    // Written in place in the queue: one copy of the payload
+    void *slot = NULL;
+    if (xRingbufferSendAcquire(s_queue, &slot, ITEM_HEADER_LEN + len, 0) != pdTRUE) {
+        __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    uint8_t *item = (uint8_t *)slot;
+    uint32_t t_us = (uint32_t)esp_timer_get_time();
+    item[0] = (uint8_t)type;
+    item[1] = (uint8_t)t_us;
+    item[2] = (uint8_t)(t_us >> 8);
+    item[3] = (uint8_t)(t_us >> 16);
+    item[4] = (uint8_t)(t_us >> 24);
+    memcpy(item + ITEM_HEADER_LEN, payload, len);
+    xRingbufferSendComplete(s_queue, slot);
+    return true;
+}
+
+bool telemetry_text(const char *text) {
+    size_t len = strlen(text);
+    return telemetry_send(TELEMETRY_TEXT, text,
+                          len < TELEMETRY_MAX_PAYLOAD ? len : TELEMETRY_MAX_PAYLOAD);
+}
+
+uint32_t telemetry_get_dropped(void) {
+    return s_dropped;
+}
@@ -1,134 +1,259 @@
 #include "MPU9250.h"
 #include <Arduino.h>
 #include <Wire.h>
+#include "esp_timer.h"
 
-MPU9250::MPU9250()
-    : gyroScale(GYRO_SCALE), accelScale(ACCEL_SCALE), magScale(0.15f) {}
+// endTransmission(): 0 success, 2 address NACK, 3 data NACK, 5 timeout, else error
+static i2c::Result wireResult(uint8_t code) {
+    switch (code) {
+    case 0:  return i2c::Result::Ok;
+    case 2:
+    case 3:  return i2c::Result::Nack;
+    case 5:  return i2c::Result::Timeout;
+    default: return i2c::Result::Error;
+    }
+}
+
+// Transactions are timed with esp_timer (µs): the task may move between the cores, whose
+// cycle counters differ
+static uint32_t now_us() {
+    return (uint32_t)esp_timer_get_time();
+}
+
+void WireBus::record(uint8_t addr, size_t bytes, uint32_t start, i2c::Result result) {
+    if (stats.record(addr, bytes, now_us() - start, result)) {
+        stats.recovered(recover());
+    }
+}
 
-bool MPU9250::writeRegister(uint8_t deviceAddr, uint8_t regAddr, uint8_t data) {
-    Wire.beginTransmission(deviceAddr);
-    Wire.write(regAddr);
-    Wire.write(data);
-    return (Wire.endTransmission() == 0);
+bool WireBus::write(uint8_t addr, uint8_t reg, uint8_t value) {
+    uint32_t start = now_us();
+    Wire.beginTransmission(addr);
+    Wire.write(reg);
+    Wire.write(value);
+    uint8_t code = Wire.endTransmission();
+    record(addr, 3, start, wireResult(code));
+    return (code == 0);
 }
 
-bool MPU9250::readRegister(uint8_t deviceAddr, uint8_t regAddr, uint8_t* data, uint8_t length) {
-    Wire.beginTransmission(deviceAddr);
-    Wire.write(regAddr);
-    if (Wire.endTransmission(false) != 0) {
+bool WireBus::read(uint8_t addr, uint8_t reg, uint8_t* data, size_t len) {
+    uint32_t start = now_us();
+    Wire.beginTransmission(addr);
+    Wire.write(reg);
+    uint8_t code = Wire.endTransmission(false);
+    if (code != 0) {
+        record(addr, 2, start, wireResult(code));
         return false;
     }
 
-    Wire.requestFrom(deviceAddr, length);
-    if (Wire.available() != length) {
+    Wire.requestFrom(addr, (uint8_t)len);
+    if (Wire.available() != (int)len) {
+        record(addr, 3 + len, start, i2c::Result::Error);  // short read
         return false;
     }
 
-    for (uint8_t i = 0; i < length; i++) {
+    for (size_t i = 0; i < len; i++) {
         data[i] = Wire.read();
     }
+    record(addr, 3 + len, start, i2c::Result::Ok);
     return true;
 }
 
-uint8_t MPU9250::readRegister(uint8_t deviceAddr, uint8_t regAddr) {
-    uint8_t data;
-    readRegister(deviceAddr, regAddr, &data, 1);
-    return data;
+bool WireBus::recover() {
+    int sda = sdaPin >= 0 ? sdaPin : SDA;
+    int scl = sclPin >= 0 ? sclPin : SCL;
+    uint32_t freq = Wire.getClock();
+    Wire.end();
+
+    // A slave interrupted mid-byte holds SDA low until it has clocked out its bits
+    pinMode(sda, INPUT_PULLUP);
+    pinMode(scl, OUTPUT_OPEN_DRAIN);
+    digitalWrite(scl, HIGH);
+    for (int i = 0; i < 9 && digitalRead(sda) == LOW; i++) {
+        digitalWrite(scl, LOW);
+        delayMicroseconds(5);
+        digitalWrite(scl, HIGH);
+        delayMicroseconds(5);
+    }
+
+    // STOP: SDA rises while SCL is high
+    pinMode(sda, OUTPUT_OPEN_DRAIN);
+    digitalWrite(sda, LOW);
+    delayMicroseconds(5);
+    digitalWrite(scl, HIGH);
+    delayMicroseconds(5);
+    digitalWrite(sda, HIGH);
+    delayMicroseconds(5);
+    pinMode(sda, INPUT_PULLUP);
+    bool released = (digitalRead(sda) == HIGH);
+
+    Wire.begin(sda, scl, freq);
+    return released;
 }
 
+void WireBus::delay_ms(uint32_t ms) {
+    delay(ms);
+}
+
+MPU9250::MPU9250()
+    : driver(bus), gyroScale(GYRO_SCALE), accelScale(ACCEL_SCALE), magScale(mpu9250::kMagUtPerLsb) {}
+
 bool MPU9250::mpu9250_init() {
-    if (!writeRegister(MPU9250_ADDR, PWR_MGMT_1, 0x00)) {
+    mpu9250::Config config;
+    config.accelRange = ACCEL_FS >> 3;
+    config.gyroRange = GYRO_FS >> 3;
+    config.dlpfCfg = DLPF_CFG;
+    config.sampleRateDiv = SAMPLE_RATE_DIV_100HZ;
+    if (driver.beginImu(config) != mpu9250::Status::Ok) {
         return false;
     }
-    delay(100);
 
-    if (!writeRegister(MPU9250_ADDR, ACCEL_CONFIG, ACCEL_FS)) {
-        return false;
-    }
     accelScale = ACCEL_SCALE;
-
-    if (!writeRegister(MPU9250_ADDR, GYRO_CONFIG, GYRO_FS)) {
-        return false;
-    }
     gyroScale = GYRO_SCALE;
+    return true;
+}
 
-    if (!writeRegister(MPU9250_ADDR, CONFIG_REG, 0x04)) {
+bool MPU9250::ak8963_init() {
+    if (driver.beginMag() != mpu9250::Status::Ok) {
         return false;
     }
 
-    if (!writeRegister(MPU9250_ADDR, SMPLRT_DIV, 0x09)) {
-        return false;
-    }
+    magScale = mpu9250::kMagUtPerLsb;
+    return true;
+}
 
-    if (!writeRegister(MPU9250_ADDR, INT_ENABLE, 0x01)) {
+bool MPU9250::readIMU(float* ax, float* ay, float* az, float* gx, float* gy, float* gz) {
+    mpu9250::RawSample raw;
+    if (driver.readImu(raw) != mpu9250::Status::Ok) {
         return false;
     }
 
+    *ax = raw.ax * accelScale;
+    *ay = raw.ay * accelScale;
+    *az = raw.az * accelScale;
+    *gx = raw.gx * gyroScale;
+    *gy = raw.gy * gyroScale;
+    *gz = raw.gz * gyroScale;
+
     return true;
 }
 
-bool MPU9250::ak8963_init() {
-    if (!writeRegister(MPU9250_ADDR, INT_PIN_CFG, 0x02)) {
+bool MPU9250::readMag(float* mx, float* my, float* mz) {
+    // Aux master copy, or ST1..ST2 from the AK8963; fails if not new or overflowed
+    mpu9250::RawSample raw;
+    if (driver.readMag(raw, esp_timer_get_time()) != mpu9250::Status::Ok) {
         return false;
     }
-    delay(10);
 
-    if (!writeRegister(AK8963_ADDR, CNTL1, 0x16)) {
+    *mx = raw.mx * magScale;
+    *my = raw.my * magScale;
+    *mz = raw.mz * magScale;
+
+    return true;
+}
+
+bool MPU9250::readAll(float* ax, float* ay, float* az, float* gx, float* gy, float* gz,
+                      float* mx, float* my, float* mz, bool* magValid) {
+    mpu9250::RawSample raw;
+    if (driver.readAll(raw, esp_timer_get_time(), magValid) != mpu9250::Status::Ok) {
         return false;
     }
-    delay(10);
 
-    magScale = 0.15f;
+    *ax = raw.ax * accelScale;
+    *ay = raw.ay * accelScale;
+    *az = raw.az * accelScale;
+    *gx = raw.gx * gyroScale;
+    *gy = raw.gy * gyroScale;
+    *gz = raw.gz * gyroScale;
+    if (*magValid) {
+        *mx = raw.mx * magScale;
+        *my = raw.my * magScale;
+        *mz = raw.mz * magScale;
+    }
     return true;
 }
 
-bool MPU9250::readIMU(float* ax, float* ay, float* az, float* gx, float* gy, float* gz) {
-    uint8_t data[14];
-    if (!readRegister(MPU9250_ADDR, ACCEL_XOUT_H, data, 14)) {
+bool MPU9250::magDue() const {
+    return driver.magDue(esp_timer_get_time());
+}
+
+bool MPU9250::lastMag(float* mx, float* my, float* mz, uint32_t* ageUs) const {
+    const mpu9250::MagCache& cache = driver.magCache();
+    if (!cache.valid) {
         return false;
     }
 
-    int16_t rawAX = (int16_t)((data[0] << 8) | data[1]);
-    int16_t rawAY = (int16_t)((data[2] << 8) | data[3]);
-    int16_t rawAZ = (int16_t)((data[4] << 8) | data[5]);
+    *mx = cache.mx * magScale;
+    *my = cache.my * magScale;
+    *mz = cache.mz * magScale;
+    *ageUs = (uint32_t)driver.magAgeUs(esp_timer_get_time());
+    return true;
+}
 
-    int16_t rawGX = (int16_t)((data[8] << 8) | data[9]);
-    int16_t rawGY = (int16_t)((data[10] << 8) | data[11]);
-    int16_t rawGZ = (int16_t)((data[12] << 8) | data[13]);
+float MPU9250::magRate() const {
+    return 1e6f / driver.magPeriodUs();
+}
 
-    *ax = rawAX * accelScale;
-    *ay = rawAY * accelScale;
-    *az = rawAZ * accelScale;
-    *gx = rawGX * gyroScale;
-    *gy = rawGY * gyroScale;
-    *gz = rawGZ * gyroScale;
+bool MPU9250::enableAuxMaster() {
+    return driver.enableAuxMaster() == mpu9250::Status::Ok;
+}
 
-    return true;
+bool MPU9250::setSampleRateDivider(uint8_t div) {
+    return driver.setSampleRateDivider(div) == mpu9250::Status::Ok;
 }
 
-bool MPU9250::readMag(float* mx, float* my, float* mz) {
-    uint8_t data[7];
-    if (!readRegister(AK8963_ADDR, ST1, data, 7)) {
-        return false;
-    }
+float MPU9250::sampleRate() const {
+    return driver.sampleRate();
+}
 
-    if (!(data[0] & 0x01)) {
-        return false;
-    }
+bool MPU9250::fifoEnable() {
+    return driver.fifoEnable() == mpu9250::Status::Ok;
+}
 
-    if (data[6] & 0x08) {
-        return false;
-    }
+bool MPU9250::fifoDisable() {
+    return driver.fifoDisable() == mpu9250::Status::Ok;
+}
 
-    int16_t rawX = (int16_t)((data[2] << 8) | data[1]);
-    int16_t rawY = (int16_t)((data[4] << 8) | data[3]);
-    int16_t rawZ = (int16_t)((data[6] << 8) | data[5]);
+bool MPU9250::fifoReset() {
+    return driver.fifoReset() == mpu9250::Status::Ok;
+}
+
+int MPU9250::readFIFO(MPU9250Sample* samples, int maxSamples, bool* overflow) {
+    *overflow = false;
+    if (maxSamples < 0) {
+        maxSamples = 0;
+    }
 
-    *mx = rawX * magScale;
-    *my = rawY * magScale;
-    *mz = rawZ * magScale;
+    // Frames are read in Wire-sized chunks and scaled as they arrive
+    MPU9250Sample* out = samples;
+    const float aScale = accelScale;
+    const float gScale = gyroScale;
+    auto store = [&out, aScale, gScale](const mpu9250::RawSample& raw) {
+        out->ax = raw.ax * aScale;
+        out->ay = raw.ay * aScale;
+        out->az = raw.az * aScale;
+        out->gx = raw.gx * gScale;
+        out->gy = raw.gy * gScale;
+        out->gz = raw.gz * gScale;
+        out++;
+    };
+    size_t count;
+    mpu9250::Status st = driver.fifoRead((size_t)maxSamples, store, &count, overflow);
 
-    return true;
+    // After an overflow the samples read are good even if the FIFO reset failed
+    if (st != mpu9250::Status::Ok && !*overflow) {
+        return -1;
+    }
+    return (int)count;
 }
 
+void MPU9250::setBusPins(int sda, int scl) {
+    bus.sdaPin = sda;
+    bus.sclPin = scl;
+}
 
+bool MPU9250::recoverBus() {
+    bool ok = bus.recover();
+    bus.stats.recovered(ok);
+    return ok;
+}
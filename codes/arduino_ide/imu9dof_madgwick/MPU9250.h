@@ -1,5 +1,8 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
+#include "mpu9250_driver.hpp"
+#include "i2c_telemetry.hpp"
 
 #define GYRO_FS_250 0x00
 #define GYRO_FS_500 0x08
@@ -16,6 +19,42 @@
 #define GYRO_SCALE 250.0f / 32768.0f
 #define ACCEL_SCALE 2.0f / 32768.0f
 
+// Sample rate divider (1kHz / (1 + div) with the 20Hz DLPF)
+#define SAMPLE_RATE_DIV_1KHZ 0
+#define SAMPLE_RATE_DIV_100HZ 9
+
+// On-chip FIFO: accelerometer + gyroscope frames of 12 bytes
+#define FIFO_SIZE 512
+#define FIFO_FRAME_SIZE 12
+#define FIFO_MAX_SAMPLES (FIFO_SIZE / FIFO_FRAME_SIZE)
+
+struct MPU9250Sample {
+    float ax, ay, az;  // g
+    float gx, gy, gz;  // deg/s
+};
+
+// Bus policy of the shared driver core: Arduino Wire. Every transaction is timed and
+// counted (i2c_telemetry.hpp); after three timeouts or bus errors in a row the bus is
+// recovered by clocking SCL until the slave holding SDA lets go.
+struct WireBus {
+    // Wire buffers 128 bytes; 120 is the most whole FIFO frames that fit
+    static constexpr size_t kMaxRead = 120;
+
+    i2c::Telemetry<2> stats;    // MPU9250 and AK8963
+    int sdaPin = -1;            // -1: the board's SDA / SCL
+    int sclPin = -1;
+
+    bool write(uint8_t addr, uint8_t reg, uint8_t value);
+    bool read(uint8_t addr, uint8_t reg, uint8_t* data, size_t len);
+    void delay_ms(uint32_t ms);
+    // Up to nine SCL pulses while SDA is held low, a STOP, then Wire restarted at the
+    // same clock. True if SDA is released.
+    bool recover();
+
+private:
+    void record(uint8_t addr, size_t bytes, uint32_t start, i2c::Result result);
+};
+
 class MPU9250 {
 public:
     MPU9250();
@@ -24,35 +63,52 @@ public:
     bool ak8963_init();
 
     bool readIMU(float* ax, float* ay, float* az, float* gx, float* gy, float* gz);
+    // Reads now and succeeds only for a new measurement (not one returned before)
     bool readMag(float* mx, float* my, float* mz);
 
+    // The AK8963 measures at ~100 Hz: magDue() says when a new measurement is expected,
+    // so the magnetometer is read at its own rate instead of with every IMU sample
+    bool magDue() const;
+    // Last valid reading and the time since it was read, without a bus transfer
+    bool lastMag(float* mx, float* my, float* mz, uint32_t* ageUs) const;
+    // AK8963 output rate measured from the readings (Hz)
+    float magRate() const;
+
+    // Hand the AK8963 (after ak8963_init) to the MPU9250's aux I2C master: bypass off,
+    // the magnetometer is copied into EXT_SENS_DATA at ~100 Hz and readMag/readAll no
+    // longer touch it directly
+    bool enableAuxMaster();
+    // Accel + gyro every call; the magnetometer only when due, in the same burst with
+    // the aux master (21 instead of 14 bytes) or a second read. *magValid is set, and
+    // mx..mz written, only for a new reading.
+    bool readAll(float* ax, float* ay, float* az, float* gx, float* gy, float* gz,
+                 float* mx, float* my, float* mz, bool* magValid);
+
+    bool setSampleRateDivider(uint8_t div);
+    float sampleRate() const;
+
+    // FIFO mode: samples queue on the chip and are drained in bursts on a timer
+    // instead of one data ready interrupt per sample
+    bool fifoEnable();
+    bool fifoDisable();
+    bool fifoReset();
+    // Reads up to maxSamples queued samples, oldest first. Returns the number read or
+    // -1 on a bus error. On overflow the FIFO is reset and *overflow is set.
+    int readFIFO(MPU9250Sample* samples, int maxSamples, bool* overflow);
+
+    // I2C pins for the bus recovery, as passed to Wire.begin()
+    void setBusPins(int sda, int scl);
+    bool recoverBus();
+    // Per-device transfer counters and latency histograms, stuck-bus recoveries
+    const i2c::Telemetry<2>& i2cStats() const { return bus.stats; }
+    void resetI2cStats() { bus.stats.reset(); }
+
 private:
-    // I2C addresses
-    static constexpr uint8_t MPU9250_ADDR = 0x68;
-    static constexpr uint8_t AK8963_ADDR = 0x0C;
-
-    // MPU9250 registers
-    static constexpr uint8_t PWR_MGMT_1   = 0x6B;
-    static constexpr uint8_t CONFIG_REG   = 0x1A;
-    static constexpr uint8_t GYRO_CONFIG  = 0x1B;
-    static constexpr uint8_t ACCEL_CONFIG = 0x1C;
-    static constexpr uint8_t SMPLRT_DIV   = 0x19;
-    static constexpr uint8_t INT_PIN_CFG  = 0x37;
-    static constexpr uint8_t INT_ENABLE   = 0x38;
-    static constexpr uint8_t ACCEL_XOUT_H = 0x3B;
-
-    // AK8963 registers
-    static constexpr uint8_t ST1   = 0x02;
-    static constexpr uint8_t HXL   = 0x03; // not used directly, kept for reference
-    static constexpr uint8_t CNTL1 = 0x0A;
+    static constexpr uint8_t DLPF_CFG = 0x04; // 20Hz
 
+    WireBus bus;
+    mpu9250::Driver<WireBus> driver;   // register sequences and decoding (mpu9250_driver.hpp)
     float gyroScale;
     float accelScale;
     float magScale;
-
-    bool writeRegister(uint8_t deviceAddr, uint8_t regAddr, uint8_t data);
-    bool readRegister(uint8_t deviceAddr, uint8_t regAddr, uint8_t* data, uint8_t length);
-    uint8_t readRegister(uint8_t deviceAddr, uint8_t regAddr);
 };
-
-
@@ -0,0 +1,207 @@
+//=============================================================================================
+// i2c_telemetry.hpp
+//=============================================================================================
+//
+// Header-only I2C bus telemetry shared by the ESP-IDF driver (mpu9250.cpp) and the Arduino
+// WireBus (MPU9250.cpp). The transport calls record() once per transaction with the
+// device address, the bytes moved, the duration in µs and the outcome; the telemetry
+// keeps per-device counters and a latency histogram, and tells the transport when the
+// bus looks stuck so that it can clock it free. Both ends of a transaction must be
+// stamped with the same clock: on a dual-core ESP32 that rules out the per-core cycle
+// counter when the completion is seen on the other core, so the transports use
+// esp_timer.
+//
+//   bucket b of the histogram holds transactions of [2^b, 2^(b+1)) µs (bucket 0 also
+//   those under 1 µs, the last one everything longer)
+//
+// The bus counts as stuck after kStuckAfter timeouts or bus errors in a row on any
+// device. NACKs do not count: an absent device NACKs without holding the bus.
+//
+// Counters are plain integers written by the task doing the transfers. Another task may
+// read or dump them at any time; a report can then be one transaction behind on some
+// fields, which does not matter for statistics.
+//
+// Requires C++11.
+//
+//=============================================================================================
+#ifndef I2C_TELEMETRY_HPP
+#define I2C_TELEMETRY_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace i2c {
+
+enum class Result : uint8_t {
+    Ok,
+    Nack,       // address or data not acknowledged
+    Timeout,    // the transfer did not finish in time
+    Error,      // anything else (arbitration lost, short read, driver error)
+};
+
+constexpr size_t kLatencyBuckets = 16;
+
+struct DeviceStats {
+    uint8_t addr;
+    uint32_t transactions;
+    uint32_t nacks;
+    uint32_t timeouts;
+    uint32_t errors;
+    uint64_t bytes;
+    uint64_t busyUs;                // sum of all transaction durations
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t latency[kLatencyBuckets];
+};
+
+struct BusStats {
+    uint32_t stuck;                 // stuck-bus detections
+    uint32_t recoveries;            // successful recoveries
+    uint32_t failedRecoveries;
+    uint32_t consecutiveFailures;   // timeouts and errors since the last success
+};
+
+template <size_t MaxDevices>
+class Telemetry {
+public:
+    static constexpr uint32_t kStuckAfter = 3;
+
+    Telemetry() { reset(); }
+
+    void reset() {
+        for (size_t i = 0; i < MaxDevices; i++) {
+            devices_[i] = DeviceStats();
+        }
+        count_ = 0;
+        bus_ = BusStats();
+    }
+
+    /**
+     * @brief Account one transaction
+     *
+     * @param addr 7-bit device address
+     * @param bytes Bytes on the wire, address and register bytes included
+     * @param us Duration in µs
+     * @param result Outcome
+     * @return true if the bus now counts as stuck and should be recovered
+     */
+    bool record(uint8_t addr, size_t bytes, uint32_t us, Result result) {
+        DeviceStats *d = find(addr, true);
+        if (d != NULL) {
+            if (d->transactions == 0 || us < d->minUs) d->minUs = us;
+            if (us > d->maxUs) d->maxUs = us;
+            d->transactions++;
+            d->bytes += bytes;
+            d->busyUs += us;
+            d->latency[bucket(us)]++;
+            switch (result) {
+            case Result::Ok:      break;
+            case Result::Nack:    d->nacks++; break;
+            case Result::Timeout: d->timeouts++; break;
+            case Result::Error:   d->errors++; break;
+            }
+        }
+
+        if (result == Result::Ok) {
+            bus_.consecutiveFailures = 0;
+            return false;
+        }
+        if (result == Result::Nack) {
+            return false;
+        }
+        if (++bus_.consecutiveFailures < kStuckAfter) {
+            return false;
+        }
+        bus_.stuck++;
+        bus_.consecutiveFailures = 0;   // give the recovery a fresh count
+        return true;
+    }
+
+    // Outcome of the recovery requested by record()
+    void recovered(bool ok) {
+        if (ok) {
+            bus_.recoveries++;
+        } else {
+            bus_.failedRecoveries++;
+        }
+    }
+
+    const DeviceStats *device(uint8_t addr) const {
+        for (size_t i = 0; i < count_; i++) {
+            if (devices_[i].addr == addr) return &devices_[i];
+        }
+        return NULL;
+    }
+    size_t deviceCount() const { return count_; }
+    const DeviceStats &deviceAt(size_t i) const { return devices_[i]; }
+    const BusStats &bus() const { return bus_; }
+
+    /**
+     * @brief Text report, one line per call of sink(const char *line)
+     *
+     * Per device: counters, latency min/mean/max and the non-empty histogram buckets;
+     * then the bus recovery counters.
+     */
+    template <typename Sink>
+    void dump(Sink sink) const {
+        char line[160];
+        for (size_t i = 0; i < count_; i++) {
+            const DeviceStats &d = devices_[i];
+            uint32_t mean = d.transactions ? (uint32_t)(d.busyUs / d.transactions) : 0;
+            snprintf(line, sizeof(line),
+                     "i2c 0x%02x: %lu tx, %llu B, nack %lu, timeout %lu, error %lu, "
+                     "busy %lu ms, latency %lu/%lu/%lu us (min/mean/max)",
+                     d.addr, (unsigned long)d.transactions, (unsigned long long)d.bytes,
+                     (unsigned long)d.nacks, (unsigned long)d.timeouts, (unsigned long)d.errors,
+                     (unsigned long)(d.busyUs / 1000), (unsigned long)d.minUs,
+                     (unsigned long)mean, (unsigned long)d.maxUs);
+            sink(line);
+
+            int len = snprintf(line, sizeof(line), "i2c 0x%02x: latency us", d.addr);
+            for (size_t b = 0; b < kLatencyBuckets && len < (int)sizeof(line); b++) {
+                if (d.latency[b] == 0) continue;
+                len += snprintf(line + len, sizeof(line) - len, " %s%lu:%lu",
+                                b + 1 == kLatencyBuckets ? ">=" : "<",
+                                (unsigned long)(b + 1 == kLatencyBuckets ? 1ul << b : 2ul << b),
+                                (unsigned long)d.latency[b]);
+            }
+            sink(line);
+        }
+        snprintf(line, sizeof(line), "i2c bus: stuck %lu, recovered %lu, recovery failed %lu",
+                 (unsigned long)bus_.stuck, (unsigned long)bus_.recoveries,
+                 (unsigned long)bus_.failedRecoveries);
+        sink(line);
+    }
+
+private:
+    DeviceStats *find(uint8_t addr, bool add) {
+        for (size_t i = 0; i < count_; i++) {
+            if (devices_[i].addr == addr) return &devices_[i];
+        }
+        if (!add || count_ == MaxDevices) {
+            return NULL;
+        }
+        DeviceStats *d = &devices_[count_++];
+        d->addr = addr;
+        return d;
+    }
+
+    // floor(log2(µs)), clamped to the histogram
+    static size_t bucket(uint32_t us) {
+        size_t b = 0;
+        while (us > 1 && b + 1 < kLatencyBuckets) {
+            us >>= 1;
+            b++;
+        }
+        return b;
+    }
+
+    DeviceStats devices_[MaxDevices];
+    size_t count_;
+    BusStats bus_;
+};
+
+} // namespace i2c
+
+#endif // I2C_TELEMETRY_HPP
@@ -13,16 +13,18 @@
  * - INT: GPIO 23 (optional, for interrupt-driven reading)
  * 
  * Libraries Required:
- * - MadgwickAHRS (by Paul Stoffregen)
  * - Wire (built-in)
+ * The Madgwick filter is the firmware's (madgwick_ahrs.h), which integrates over the
+ * sample timestamps.
  */
 
 #include <Wire.h>
-#include <MadgwickAHRS.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "esp_timer.h"
 #include "MPU9250.h"
+#include "madgwick_ahrs.h"
 
 // ----- I2C CONFIGURATION -----
 #define I2C_SDA_PIN 21
@@ -37,13 +39,13 @@
 #define MICROS_PER_READING (1000000 / SAMPLE_RATE_HZ)
 
 // ----- GLOBAL VARIABLES -----
-Madgwick filter;
+madgwick_ahrs_t filter;
 
-// Queue for communication between interrupt and task
+// Data ready timestamps (esp_timer, µs), from the interrupt to the task
 QueueHandle_t mpu_queue = NULL;
 
 // Timing variables
-unsigned long lastReadTime = 0;
+int64_t lastStamp = 0;
 
 // Data storage
 float ax, ay, az;  // Accelerometer (g)
@@ -57,10 +59,11 @@ float roll, pitch, yaw;
 MPU9250 imu;
 
 // ----- INTERRUPT HANDLER -----
+// Stamps the data ready edge, i.e. the sample, before the task is scheduled
 void IRAM_ATTR mpu_intr_handler() {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    uint32_t dummy = 1;
-    xQueueSendFromISR(mpu_queue, &dummy, &xHigherPriorityTaskWoken);
+    int64_t stamp = esp_timer_get_time();
+    xQueueSendFromISR(mpu_queue, &stamp, &xHigherPriorityTaskWoken);
     if (xHigherPriorityTaskWoken) {
         portYIELD_FROM_ISR();
     }
@@ -76,35 +79,32 @@ bool setup_interrupt_pin() {
 // ----- FREERTOS TASK FOR IMU PROCESSING -----
 void imu_task(void *parameter) {
     Serial.println("IMU task started");
-    uint32_t dummy;
+    int64_t stamp;
     
     while (true) {
-        // Wait for interrupt signal (same as ESP-IDF)
-        if (xQueueReceive(mpu_queue, &dummy, portMAX_DELAY)) {
-            unsigned long now = micros();
-            float dt = (now - lastReadTime) / 1000000.0f;
-            lastReadTime = now;
+        // Wait for interrupt signal, with the time of the sample (same as ESP-IDF)
+        if (xQueueReceive(mpu_queue, &stamp, portMAX_DELAY)) {
+            float dt = (stamp - lastStamp) / 1000000.0f;
+            lastStamp = stamp;
             
-            // Read IMU data (accelerometer + gyroscope) in one transaction
-            bool dataValid = imu.readIMU(&ax, &ay, &az, &gx, &gy, &gz);
-            
-            // Read magnetometer data
-            bool magValid = imu.readMag(&mx, &my, &mz);
+            // Read all 9 axes, one 21-byte transaction with the aux I2C master
+            bool magValid = false;
+            bool dataValid = imu.readAll(&ax, &ay, &az, &gx, &gy, &gz, &mx, &my, &mz, &magValid);
             
             if (dataValid) {
-                // Update Madgwick filter
+                // Update Madgwick filter over the interval since the previous sample
+                // (interrupt stamps); the magnetometer is read at its own rate and each
+                // new reading is fused once
                 if (magValid) {
                     // Use full 9DOF data (IMU + magnetometer)
-                    filter.update(gx, gy, gz, ax, ay, az, mx, my, mz);
+                    madgwick_ahrs_update_timestamped(&filter, stamp, gx, gy, gz, ax, ay, az, mx, my, mz);
                 } else {
-                    // Fallback to IMU-only mode
-                    filter.updateIMU(gx, gy, gz, ax, ay, az);
+                    // No new magnetometer reading: IMU-only mode
+                    madgwick_ahrs_update_imu_timestamped(&filter, stamp, gx, gy, gz, ax, ay, az);
                 }
                 
-                // Get Euler angles (in degrees)
-                roll = filter.getRoll();
-                pitch = filter.getPitch();
-                yaw = filter.getYaw();
+                // Get Euler angles (in degrees), all three from one angle computation
+                madgwick_ahrs_get_euler(&filter, &roll, &pitch, &yaw);
                 
                 // Calculate actual sampling frequency
                 float freq = (dt > 0) ? (1.0f / dt) : 0;
@@ -119,9 +119,9 @@ void imu_task(void *parameter) {
                 Serial.print("  Yaw: ");
                 Serial.print(yaw, 2);
                 Serial.print("  Mag: ");
-                Serial.println(magValid ? "OK" : "FAIL");
+                Serial.println(magValid ? "new" : "-");
             } else {
-                Serial.println("Failed to read IMU data");
+                Serial.println("Failed to read IMU data (send 'i' for I2C statistics)");
             }
         }
     }
@@ -135,6 +135,7 @@ void setup() {
     // Initialize I2C
     Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
     Wire.setClock(I2C_FREQ);
+    imu.setBusPins(I2C_SDA_PIN, I2C_SCL_PIN);   // for the stuck-bus recovery
     Serial.println("I2C initialized");
     
     // Initialize MPU9250
@@ -149,10 +150,13 @@ void setup() {
     if (!imu.ak8963_init()) {
         Serial.println("Failed to initialize AK8963 magnetometer!");
         // Continue without magnetometer
+    } else if (!imu.enableAuxMaster()) {
+        // The MPU9250 polls the AK8963 itself, bypass stays off
+        Serial.println("Failed to enable MPU9250 aux I2C master!");
     }
     
     // Create queue for interrupt communication
-    mpu_queue = xQueueCreate(10, sizeof(uint32_t));
+    mpu_queue = xQueueCreate(10, sizeof(int64_t));
     if (mpu_queue == NULL) {
         Serial.println("Failed to create queue");
         return;
@@ -166,12 +170,13 @@ void setup() {
     }
     Serial.println("Interrupt pin configured");
     
-    // Initialize Madgwick filter
-    filter.begin(SAMPLE_RATE_HZ);
+    // Initialize Madgwick filter (nominal rate; real intervals come from timestamps)
+    madgwick_ahrs_init(&filter);
+    madgwick_ahrs_begin(&filter, SAMPLE_RATE_HZ);
     Serial.println("Madgwick filter initialized");
     
     // Initialize timing
-    lastReadTime = micros();
+    lastStamp = esp_timer_get_time();
     
     // Create FreeRTOS task for IMU processing
     xTaskCreate(
@@ -191,5 +196,12 @@ void setup() {
 void loop() {
     // Main loop is free for other tasks
     // IMU processing is handled by FreeRTOS task
+    
+    // 'i': I2C transfer counters, latency histograms and bus recoveries
+    while (Serial.available() > 0) {
+        if (Serial.read() == 'i') {
+            imu.i2cStats().dump([](const char* line) { Serial.println(line); });
+        }
+    }
     delay(1000); // Small delay to prevent watchdog reset
 }
@@ -0,0 +1,429 @@
+//=============================================================================================
+// madgwick_ahrs.cpp
+//=============================================================================================
+//
+// Implementation of Madgwick IMU and AHRS algorithms for ESP-IDF.
+// Based on: http://www.x-io.co.uk/open-source-imu-and-ahrs-algorithms/
+//
+// From x-io website: "Open source resources available on this site are
+// provided under the GNU General Public License, unless an alternative
+// license is provided in the source code."
+//
+// Date			Author          Notes
+// 29/09/2011	SOH Madgwick    Initial release
+// 02/10/2011	SOH Madgwick	Optimized to reduce CPU load
+// 19/02/2012	SOH Madgwick	Magnetometer measurement is normalized
+// [Current date]	Adapted for ESP-IDF
+//
+//=============================================================================================
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "madgwick_ahrs.h"
+#include <math.h>
+#include <string.h>
+#include "madgwick_ahrs.hpp"
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+#define SAMPLE_FREQ_DEF   512.0f          // sampling frequency in Hz
+#define BETA_DEF          0.1f            // 2 * proportional gain
+#define DROP_THRESHOLD    1.5f            // gap, in nominal periods, that counts as dropped samples
+
+#if MADGWICK_AHRS_FIXED_POINT
+#define QUAT_TO_FLOAT(x)  ((float)(x) * (1.0f / 1073741824.0f))    // Q1.30 -> float
+#else
+#define QUAT_TO_FLOAT(x)  (x)
+#endif
+
+//-------------------------------------------------------------------------------------------
+// Helper functions
+
+/**
+ * @brief Calculate angles from quaternion
+ */
+static void compute_angles(madgwick_ahrs_t *filter) {
+    madgwick::Quaternion<float> q = {
+        QUAT_TO_FLOAT(filter->q0), QUAT_TO_FLOAT(filter->q1),
+        QUAT_TO_FLOAT(filter->q2), QUAT_TO_FLOAT(filter->q3)
+    };
+    madgwick::euler_angles<MADGWICK_AHRS_FAST_ANGLES != 0>(q, filter->roll, filter->pitch, filter->yaw);
+    filter->anglesComputed = 1;
+}
+
+/**
+ * @brief Clear the timing statistics
+ */
+static void clear_timing(madgwick_ahrs_t *filter) {
+    memset(&filter->timing, 0, sizeof(filter->timing));
+    filter->hasTimestamp = 0;
+    filter->lastTimestamp = 0;
+}
+
+//-------------------------------------------------------------------------------------------
+// Floating-point engine (see madgwick_ahrs_fixed.c for the Q1.30 one)
+
+#if !MADGWICK_AHRS_FIXED_POINT
+
+// The float engine is madgwick_ahrs.hpp; this file only adds the checks the C API has
+// always made (invalid accelerometer or magnetometer readings) on top of it
+typedef madgwick::Madgwick<madgwick::Mode::Imu> imu_filter_t;
+typedef madgwick::Madgwick<madgwick::Mode::Marg> marg_filter_t;
+typedef madgwick::Quaternion<float> quat_t;
+
+/**
+ * @brief Write a locally updated quaternion back to the filter
+ */
+static inline void store_quat(madgwick_ahrs_t *filter, const quat_t *q) {
+    filter->q0 = q->q0;
+    filter->q1 = q->q1;
+    filter->q2 = q->q2;
+    filter->q3 = q->q3;
+    filter->anglesComputed = 0;
+}
+
+/**
+ * @brief One IMU (gyroscope + accelerometer) filter step on a local quaternion
+ */
+static inline __attribute__((always_inline))
+void imu_step(quat_t *q, float beta, float dt,
+              float gx, float gy, float gz,
+              float ax, float ay, float az) {
+    // Calculate feedback only if accelerometer measurement is valid (avoids NaN in accelerometer normalization)
+    if((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)) {
+        imu_filter_t::propagate(*q, dt, gx, gy, gz);
+        return;
+    }
+    imu_filter_t::step(*q, beta, dt, gx, gy, gz, ax, ay, az);
+}
+
+/**
+ * @brief One MARG (gyroscope + accelerometer + magnetometer) filter step on a local quaternion
+ */
+static inline __attribute__((always_inline))
+void marg_step(quat_t *q, float beta, float dt,
+               float gx, float gy, float gz,
+               float ax, float ay, float az,
+               float mx, float my, float mz) {
+    // Use IMU algorithm if magnetometer measurement is invalid (avoids NaN in magnetometer normalization)
+    if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+        imu_step(q, beta, dt, gx, gy, gz, ax, ay, az);
+        return;
+    }
+    if((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)) {
+        marg_filter_t::propagate(*q, dt, gx, gy, gz);
+        return;
+    }
+    marg_filter_t::step(*q, beta, dt, gx, gy, gz, ax, ay, az, mx, my, mz);
+}
+
+esp_err_t madgwick_ahrs_update(madgwick_ahrs_t *filter, 
+                               float gx, float gy, float gz, 
+                               float ax, float ay, float az, 
+                               float mx, float my, float mz) {
+    if (filter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    quat_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    marg_step(&q, filter->beta, filter->invSampleFreq, gx, gy, gz, ax, ay, az, mx, my, mz);
+    store_quat(filter, &q);
+
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_update_imu(madgwick_ahrs_t *filter, 
+                                   float gx, float gy, float gz, 
+                                   float ax, float ay, float az) {
+    if (filter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    quat_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    imu_step(&q, filter->beta, filter->invSampleFreq, gx, gy, gz, ax, ay, az);
+    store_quat(filter, &q);
+
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_update_batch(madgwick_ahrs_t *filter,
+                                     const madgwick_ahrs_batch_t *batch,
+                                     size_t count) {
+    if (filter == NULL || batch == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (batch->gx == NULL || batch->gy == NULL || batch->gz == NULL ||
+        batch->ax == NULL || batch->ay == NULL || batch->az == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool has_mag = (batch->mx != NULL && batch->my != NULL && batch->mz != NULL);
+    if (!has_mag && (batch->mx != NULL || batch->my != NULL || batch->mz != NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Keep the quaternion and gain in locals for the whole block
+    quat_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    const float beta = filter->beta;
+    const float fixed_dt = filter->invSampleFreq;
+    const float *dt = batch->dt;
+
+    if (has_mag) {
+        for (size_t i = 0; i < count; i++) {
+            marg_step(&q, beta, dt ? dt[i] : fixed_dt,
+                      batch->gx[i], batch->gy[i], batch->gz[i],
+                      batch->ax[i], batch->ay[i], batch->az[i],
+                      batch->mx[i], batch->my[i], batch->mz[i]);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            imu_step(&q, beta, dt ? dt[i] : fixed_dt,
+                     batch->gx[i], batch->gy[i], batch->gz[i],
+                     batch->ax[i], batch->ay[i], batch->az[i]);
+        }
+    }
+
+    store_quat(filter, &q);
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_update_timestamped(madgwick_ahrs_t *filter, int64_t timestampUs,
+                                           float gx, float gy, float gz,
+                                           float ax, float ay, float az,
+                                           float mx, float my, float mz) {
+    float dt;
+    esp_err_t ret = madgwick_ahrs_timestamp_dt(filter, timestampUs, &dt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    quat_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    marg_step(&q, filter->beta, dt, gx, gy, gz, ax, ay, az, mx, my, mz);
+    store_quat(filter, &q);
+
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_update_imu_timestamped(madgwick_ahrs_t *filter, int64_t timestampUs,
+                                               float gx, float gy, float gz,
+                                               float ax, float ay, float az) {
+    float dt;
+    esp_err_t ret = madgwick_ahrs_timestamp_dt(filter, timestampUs, &dt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    quat_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    imu_step(&q, filter->beta, dt, gx, gy, gz, ax, ay, az);
+    store_quat(filter, &q);
+
+    return ESP_OK;
+}
+
+#endif // !MADGWICK_AHRS_FIXED_POINT
+
+//-------------------------------------------------------------------------------------------
+// Public functions implementation
+
+esp_err_t madgwick_ahrs_init(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    memset(filter, 0, sizeof(madgwick_ahrs_t));
+    filter->beta = BETA_DEF;
+    filter->q0 = MADGWICK_AHRS_QUAT_ONE;
+    filter->q1 = 0;
+    filter->q2 = 0;
+    filter->q3 = 0;
+    filter->invSampleFreq = 1.0f / SAMPLE_FREQ_DEF;
+    filter->anglesComputed = 0;
+    clear_timing(filter);
+    
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_begin(madgwick_ahrs_t *filter, float sampleFrequency) {
+    if (filter == NULL || sampleFrequency <= 0.0f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    filter->invSampleFreq = 1.0f / sampleFrequency;
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_timestamp_dt(madgwick_ahrs_t *filter, int64_t timestampUs, float *dt) {
+    if (filter == NULL || dt == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    madgwick_ahrs_timing_t *timing = &filter->timing;
+
+    if (!filter->hasTimestamp) {
+        // Nothing to measure against yet: assume one nominal period
+        filter->hasTimestamp = 1;
+        filter->lastTimestamp = timestampUs;
+        *dt = filter->invSampleFreq;
+        return ESP_OK;
+    }
+
+    int64_t elapsed = timestampUs - filter->lastTimestamp;
+    if (elapsed <= 0) {
+        timing->rejected++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    filter->lastTimestamp = timestampUs;
+
+    float interval = (float)elapsed * 1e-6f;
+
+    // Gaps longer than DROP_THRESHOLD periods hide samples that never arrived
+    float periods = interval / filter->invSampleFreq;
+    if (periods > DROP_THRESHOLD) {
+        timing->dropped += (uint32_t)(periods + 0.5f) - 1u;
+    }
+
+    // Running min/max/mean/variance (Welford)
+    timing->samples++;
+    if (timing->samples == 1) {
+        timing->dtMin = interval;
+        timing->dtMax = interval;
+    } else {
+        if (interval < timing->dtMin) timing->dtMin = interval;
+        if (interval > timing->dtMax) timing->dtMax = interval;
+    }
+    float delta = interval - timing->dtMean;
+    timing->dtMean += delta / (float)timing->samples;
+    timing->dtM2 += delta * (interval - timing->dtMean);
+
+    *dt = (interval > MADGWICK_AHRS_DT_MAX) ? MADGWICK_AHRS_DT_MAX : interval;
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_get_timing(const madgwick_ahrs_t *filter, madgwick_ahrs_timing_t *timing,
+                                   float *jitter) {
+    if (filter == NULL || timing == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *timing = filter->timing;
+    if (jitter != NULL) {
+        *jitter = (timing->samples > 1) ? sqrtf(timing->dtM2 / (float)(timing->samples - 1)) : 0.0f;
+    }
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_reset_timing(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    clear_timing(filter);
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_get_quaternion(const madgwick_ahrs_t *filter,
+                                       float *q0, float *q1, float *q2, float *q3) {
+    if (filter == NULL || q0 == NULL || q1 == NULL || q2 == NULL || q3 == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *q0 = QUAT_TO_FLOAT(filter->q0);
+    *q1 = QUAT_TO_FLOAT(filter->q1);
+    *q2 = QUAT_TO_FLOAT(filter->q2);
+    *q3 = QUAT_TO_FLOAT(filter->q3);
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_get_euler(madgwick_ahrs_t *filter, float *roll, float *pitch, float *yaw) {
+    if (filter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!filter->anglesComputed) {
+        compute_angles(filter);
+    }
+    if (roll != NULL) {
+        *roll = filter->roll * 57.29578f;
+    }
+    if (pitch != NULL) {
+        *pitch = filter->pitch * 57.29578f;
+    }
+    if (yaw != NULL) {
+        *yaw = filter->yaw * 57.29578f + 180.0f;
+    }
+    return ESP_OK;
+}
+
+float madgwick_ahrs_get_roll(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return 0.0f;
+    }
+    if (!filter->anglesComputed) {
+        compute_angles(filter);
+    }
+    return filter->roll * 57.29578f;
+}
+
+float madgwick_ahrs_get_pitch(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return 0.0f;
+    }
+    if (!filter->anglesComputed) {
+        compute_angles(filter);
+    }
+    return filter->pitch * 57.29578f;
+}
+
+float madgwick_ahrs_get_yaw(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return 0.0f;
+    }
+    if (!filter->anglesComputed) {
+        compute_angles(filter);
+    }
+    return filter->yaw * 57.29578f + 180.0f;
+}
+
+float madgwick_ahrs_get_roll_radians(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return 0.0f;
+    }
+    if (!filter->anglesComputed) {
+        compute_angles(filter);
+    }
+    return filter->roll;
+}
+
+float madgwick_ahrs_get_pitch_radians(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return 0.0f;
+    }
+    if (!filter->anglesComputed) {
+        compute_angles(filter);
+    }
+    return filter->pitch;
+}
+
+float madgwick_ahrs_get_yaw_radians(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return 0.0f;
+    }
+    if (!filter->anglesComputed) {
+        compute_angles(filter);
+    }
+    return filter->yaw;
+}
+
+esp_err_t madgwick_ahrs_set_beta(madgwick_ahrs_t *filter, float beta) {
+    if (filter == NULL || beta < 0.0f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    filter->beta = beta;
+    return ESP_OK;
+}
+
+float madgwick_ahrs_get_beta(madgwick_ahrs_t *filter) {
+    if (filter == NULL) {
+        return 0.0f;
+    }
+    return filter->beta;
+}
+
+
@@ -0,0 +1,424 @@
+//=============================================================================================
+// madgwick_ahrs_fixed.c
+//=============================================================================================
+//
+// Fixed-point version of the Madgwick update functions, built instead of the float engine
+// in madgwick_ahrs.cpp when MADGWICK_AHRS_FIXED_POINT is 1. Initialisation, timing and the
+// angle getters are shared with the float build.
+//
+// Number formats:
+//   quaternion            Q1.30 in int32_t (the madgwick_ahrs_t q0..q3 fields)
+//   sensor inputs         Q16 (deg/s, g, µT converted once on entry)
+//   normalised vectors    Q1.30
+//   gradient arithmetic   Q28 in int64_t, which leaves room for the x4/x8 Jacobian terms
+//
+// Every square root is replaced by an integer inverse square root: a 48-entry table
+// seeds two Newton-Raphson iterations, so no FPU instruction runs after the inputs have
+// been converted.
+//
+//=============================================================================================
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "madgwick_ahrs.h"
+
+#if MADGWICK_AHRS_FIXED_POINT
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+#define Q30_ONE         (1LL << 30)
+#define Q16_MAX         2147483647.0f
+#define DEG_TO_RAD      0.0174533f
+#define GYRO_GAIN_SHIFT 38              // Q of the per-step gyroscope gain 0.5 * dt * DEG_TO_RAD
+#define HALF_ANGLE_MAX  (Q30_ONE / 4)   // largest half-angle increment per step (rad, Q30)
+
+#define MUL28(a, b)     (((a) * (b)) >> 28)
+#define ROUND_SHR(x, n) (((x) + (1LL << ((n) - 1))) >> (n))   // shift with rounding, avoids a drift bias
+
+// round(2^30 / sqrt((i + 0.5) / 64)) for i = 16..63, i.e. the inverse square root at
+// the centre of each 1/64 wide bucket of [0.25, 1)
+static const int32_t rsqrt_lut[48] = {
+    2114695713, 2053387115, 1997119227, 1945237133, 1897199172, 1852552937,
+    1810917218, 1771968208, 1735428857, 1701060526, 1668656406, 1638036256,
+    1609042172, 1581535151, 1555392273, 1530504391, 1506774204, 1484114654,
+    1462447584, 1441702596, 1421816090, 1402730445, 1384393311, 1366757007,
+    1349778000, 1333416450, 1317635818, 1302402522, 1287685637, 1273456629,
+    1259689126, 1246358707, 1233442724, 1220920139, 1208771378, 1196978204,
+    1185523604, 1174391680, 1163567563, 1153037323, 1142787899, 1132807028,
+    1123083182, 1113605518, 1104363818, 1095348453, 1086550331, 1077960865
+};
+
+// Quaternion held in locals (registers) while the filter steps run
+typedef struct {
+    int32_t q0, q1, q2, q3;
+} quat_fx_t;
+
+// Per-step gains derived from beta and dt
+typedef struct {
+    int32_t gyro;       // 0.5 * dt * DEG_TO_RAD, Q38
+    int32_t betaDt;     // beta * dt, Q30
+} gains_fx_t;
+
+//-------------------------------------------------------------------------------------------
+// Private functions implementation
+
+/**
+ * @brief Convert a sensor reading to Q16, saturating instead of wrapping
+ */
+static inline int32_t to_q16(float x) {
+    x *= 65536.0f;
+    if (x >= Q16_MAX) {
+        return INT32_MAX;
+    }
+    if (x <= -Q16_MAX) {
+        return -INT32_MAX;
+    }
+    return (int32_t)x;
+}
+
+// The Q38 gyroscope gain overflows int32 above ~0.45 s: longer steps (a 1 Hz begin(),
+// a batch dt) are integrated as MADGWICK_AHRS_DT_MAX, like the timestamped updates
+static inline gains_fx_t make_gains(float beta, float dt) {
+    if (dt > MADGWICK_AHRS_DT_MAX) {
+        dt = MADGWICK_AHRS_DT_MAX;
+    } else if (dt < 0.0f) {
+        dt = 0.0f;
+    }
+    gains_fx_t g = {
+        .gyro = (int32_t)(0.5f * dt * DEG_TO_RAD * (float)(1LL << GYRO_GAIN_SHIFT)),
+        .betaDt = (int32_t)(beta * dt * (float)Q30_ONE),
+    };
+    return g;
+}
+
+/**
+ * @brief Integer inverse square root of x in [0.25, 1), both in Q30
+ */
+static inline int64_t rsqrt_q30(int64_t x) {
+    int64_t y = rsqrt_lut[(x >> 24) - 16];
+    for (int i = 0; i < 2; i++) {
+        int64_t y2 = (y * y) >> 30;
+        int64_t xy2 = (x * y2) >> 30;
+        y = (y * ((3LL << 30) - xy2)) >> 31;
+    }
+    return y;
+}
+
+/**
+ * @brief Scale a vector to unit length
+ *
+ * The input may use any fixed-point format; it is first shifted so that its largest
+ * component fills 30 bits, the sum of squares then fits in 62 bits and is brought
+ * into [0.25, 1) by an even shift so that its square root is a plain shift too.
+ *
+ * @param v Vector components, any common scale
+ * @param n Number of components (3 or 4)
+ * @param out Unit vector, Q30
+ * @return false if the vector is zero
+ */
+static bool normalize(const int64_t *v, int n, int32_t *out) {
+    int64_t max = 0;
+    for (int i = 0; i < n; i++) {
+        int64_t a = v[i] < 0 ? -v[i] : v[i];
+        if (a > max) {
+            max = a;
+        }
+    }
+    if (max == 0) {
+        return false;
+    }
+
+    // Bring the largest component into [2^29, 2^30)
+    int shift = (63 - __builtin_clzll((uint64_t)max)) - 29;
+    int64_t w[4];
+    uint64_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        w[i] = shift >= 0 ? v[i] >> shift : v[i] * (1LL << -shift);
+        sum += (uint64_t)(w[i] * w[i]);
+    }
+
+    // sum = m * 2^-sh with m in [2^60, 2^62) and sh even
+    int sh = 62 - (64 - __builtin_clzll(sum));
+    sh &= ~1;
+    int64_t x = (int64_t)((sum << sh) >> 32);
+    int64_t r = rsqrt_q30(x);
+    int down = 31 - sh / 2;
+    for (int i = 0; i < n; i++) {
+        out[i] = (int32_t)ROUND_SHR(w[i] * r, down);
+    }
+    return true;
+}
+
+static inline void store_quat(madgwick_ahrs_t *filter, const quat_fx_t *q) {
+    filter->q0 = q->q0;
+    filter->q1 = q->q1;
+    filter->q2 = q->q2;
+    filter->q3 = q->q3;
+    filter->anglesComputed = 0;
+}
+
+/**
+ * @brief Gyroscope increment dq = q (0, h), h = 0.5 * dt * w, all in Q30
+ */
+static inline void gyro_delta(const quat_fx_t *q, const gains_fx_t *g,
+                              float gx, float gy, float gz, int64_t dq[4]) {
+    int64_t h[3] = {
+        ROUND_SHR((int64_t)to_q16(gx) * g->gyro, 24),
+        ROUND_SHR((int64_t)to_q16(gy) * g->gyro, 24),
+        ROUND_SHR((int64_t)to_q16(gz) * g->gyro, 24),
+    };
+    for (int i = 0; i < 3; i++) {
+        if (h[i] > HALF_ANGLE_MAX) {
+            h[i] = HALF_ANGLE_MAX;
+        } else if (h[i] < -HALF_ANGLE_MAX) {
+            h[i] = -HALF_ANGLE_MAX;
+        }
+    }
+    dq[0] = ROUND_SHR(-q->q1 * h[0] - q->q2 * h[1] - q->q3 * h[2], 30);
+    dq[1] = ROUND_SHR(q->q0 * h[0] + q->q2 * h[2] - q->q3 * h[1], 30);
+    dq[2] = ROUND_SHR(q->q0 * h[1] - q->q1 * h[2] + q->q3 * h[0], 30);
+    dq[3] = ROUND_SHR(q->q0 * h[2] + q->q1 * h[1] - q->q2 * h[0], 30);
+}
+
+/**
+ * @brief Apply the normalised gradient step and the increment, then renormalise q
+ */
+static inline void integrate(quat_fx_t *q, const gains_fx_t *g, int64_t dq[4], const int64_t s[4]) {
+    int32_t step[4];
+    if (s != NULL && normalize(s, 4, step)) {
+        for (int i = 0; i < 4; i++) {
+            dq[i] -= ((int64_t)g->betaDt * step[i]) >> 30;
+        }
+    }
+
+    int64_t qn[4] = { q->q0 + dq[0], q->q1 + dq[1], q->q2 + dq[2], q->q3 + dq[3] };
+    int32_t out[4];
+    if (normalize(qn, 4, out)) {
+        q->q0 = out[0];
+        q->q1 = out[1];
+        q->q2 = out[2];
+        q->q3 = out[3];
+    }
+}
+
+/**
+ * @brief One IMU (gyroscope + accelerometer) filter step on a local quaternion
+ */
+static inline __attribute__((always_inline))
+void imu_step(quat_fx_t *q, const gains_fx_t *g,
+              float gx, float gy, float gz,
+              float ax, float ay, float az) {
+    int64_t dq[4];
+    int64_t s[4];
+    int32_t a[3];
+
+    gyro_delta(q, g, gx, gy, gz, dq);
+
+    // Calculate feedback only if accelerometer measurement is valid
+    int64_t acc[3] = { to_q16(ax), to_q16(ay), to_q16(az) };
+    if (!normalize(acc, 3, a)) {
+        integrate(q, g, dq, NULL);
+        return;
+    }
+
+    // Gradient in Q28
+    int64_t q0 = q->q0 >> 2, q1 = q->q1 >> 2, q2 = q->q2 >> 2, q3 = q->q3 >> 2;
+    int64_t fax = a[0] >> 2, fay = a[1] >> 2, faz = a[2] >> 2;
+    int64_t _2q0 = 2 * q0, _2q1 = 2 * q1, _2q2 = 2 * q2, _2q3 = 2 * q3;
+    int64_t _4q0 = 4 * q0, _4q1 = 4 * q1, _4q2 = 4 * q2;
+    int64_t _8q1 = 8 * q1, _8q2 = 8 * q2;
+    int64_t q0q0 = MUL28(q0, q0), q1q1 = MUL28(q1, q1), q2q2 = MUL28(q2, q2), q3q3 = MUL28(q3, q3);
+
+    s[0] = MUL28(_4q0, q2q2) + MUL28(_2q2, fax) + MUL28(_4q0, q1q1) - MUL28(_2q1, fay);
+    s[1] = MUL28(_4q1, q3q3) - MUL28(_2q3, fax) + MUL28(4 * q0q0, q1) - MUL28(_2q0, fay) - _4q1
+         + MUL28(_8q1, q1q1) + MUL28(_8q1, q2q2) + MUL28(_4q1, faz);
+    s[2] = MUL28(4 * q0q0, q2) + MUL28(_2q0, fax) + MUL28(_4q2, q3q3) - MUL28(_2q3, fay) - _4q2
+         + MUL28(_8q2, q1q1) + MUL28(_8q2, q2q2) + MUL28(_4q2, faz);
+    s[3] = MUL28(4 * q1q1, q3) - MUL28(_2q1, fax) + MUL28(4 * q2q2, q3) - MUL28(_2q2, fay);
+
+    integrate(q, g, dq, s);
+}
+
+/**
+ * @brief One MARG (gyroscope + accelerometer + magnetometer) filter step on a local quaternion
+ */
+static inline __attribute__((always_inline))
+void marg_step(quat_fx_t *q, const gains_fx_t *g,
+               float gx, float gy, float gz,
+               float ax, float ay, float az,
+               float mx, float my, float mz) {
+    int64_t dq[4];
+    int64_t s[4];
+    int32_t a[3], m[3];
+
+    // Use IMU algorithm if magnetometer measurement is invalid
+    int64_t mag[3] = { to_q16(mx), to_q16(my), to_q16(mz) };
+    if (!normalize(mag, 3, m)) {
+        imu_step(q, g, gx, gy, gz, ax, ay, az);
+        return;
+    }
+
+    gyro_delta(q, g, gx, gy, gz, dq);
+
+    int64_t acc[3] = { to_q16(ax), to_q16(ay), to_q16(az) };
+    if (!normalize(acc, 3, a)) {
+        integrate(q, g, dq, NULL);
+        return;
+    }
+
+    // Gradient in Q28
+    int64_t q0 = q->q0 >> 2, q1 = q->q1 >> 2, q2 = q->q2 >> 2, q3 = q->q3 >> 2;
+    int64_t fax = a[0] >> 2, fay = a[1] >> 2, faz = a[2] >> 2;
+    int64_t fmx = m[0] >> 2, fmy = m[1] >> 2, fmz = m[2] >> 2;
+    int64_t _2q0 = 2 * q0, _2q1 = 2 * q1, _2q2 = 2 * q2, _2q3 = 2 * q3;
+    int64_t q0q0 = MUL28(q0, q0), q0q1 = MUL28(q0, q1), q0q2 = MUL28(q0, q2), q0q3 = MUL28(q0, q3);
+    int64_t q1q1 = MUL28(q1, q1), q1q2 = MUL28(q1, q2), q1q3 = MUL28(q1, q3);
+    int64_t q2q2 = MUL28(q2, q2), q2q3 = MUL28(q2, q3), q3q3 = MUL28(q3, q3);
+
+    // Reference direction of Earth's magnetic field
+    int64_t hx = MUL28(fmx, q0q0 + q1q1 - q2q2 - q3q3) + 2 * MUL28(fmy, q1q2 - q0q3)
+               + 2 * MUL28(fmz, q0q2 + q1q3);
+    int64_t hy = 2 * MUL28(fmx, q0q3 + q1q2) + MUL28(fmy, q0q0 - q1q1 + q2q2 - q3q3)
+               + 2 * MUL28(fmz, q2q3 - q0q1);
+    int64_t _2bz = 2 * MUL28(fmx, q1q3 - q0q2) + 2 * MUL28(fmy, q0q1 + q2q3)
+                 + MUL28(fmz, q0q0 - q1q1 - q2q2 + q3q3);
+
+    // _2bx = |(hx, hy)|, projected on its own unit vector to avoid a square root
+    int64_t _2bx = 0;
+    int64_t hxy[2] = { hx, hy };
+    int32_t u[2];
+    if (normalize(hxy, 2, u)) {
+        _2bx = MUL28(hx, (int64_t)(u[0] >> 2)) + MUL28(hy, (int64_t)(u[1] >> 2));
+    }
+    int64_t _4bx = 2 * _2bx, _4bz = 2 * _2bz;
+
+    // Objective function residuals
+    int64_t f1 = 2 * q1q3 - 2 * q0q2 - fax;
+    int64_t f2 = 2 * q0q1 + 2 * q2q3 - fay;
+    int64_t f3 = (1LL << 28) - 2 * q1q1 - 2 * q2q2 - faz;
+    int64_t fm1 = MUL28(_2bx, (1LL << 27) - q2q2 - q3q3) + MUL28(_2bz, q1q3 - q0q2) - fmx;
+    int64_t fm2 = MUL28(_2bx, q1q2 - q0q3) + MUL28(_2bz, q0q1 + q2q3) - fmy;
+    int64_t fm3 = MUL28(_2bx, q0q2 + q1q3) + MUL28(_2bz, (1LL << 27) - q1q1 - q2q2) - fmz;
+
+    // Gradient descent step
+    s[0] = -MUL28(_2q2, f1) + MUL28(_2q1, f2) - MUL28(MUL28(_2bz, q2), fm1)
+         + MUL28(-MUL28(_2bx, q3) + MUL28(_2bz, q1), fm2) + MUL28(MUL28(_2bx, q2), fm3);
+    s[1] = MUL28(_2q3, f1) + MUL28(_2q0, f2) - MUL28(4 * q1, f3) + MUL28(MUL28(_2bz, q3), fm1)
+         + MUL28(MUL28(_2bx, q2) + MUL28(_2bz, q0), fm2) + MUL28(MUL28(_2bx, q3) - MUL28(_4bz, q1), fm3);
+    s[2] = -MUL28(_2q0, f1) + MUL28(_2q3, f2) - MUL28(4 * q2, f3)
+         + MUL28(-MUL28(_4bx, q2) - MUL28(_2bz, q0), fm1)
+         + MUL28(MUL28(_2bx, q1) + MUL28(_2bz, q3), fm2) + MUL28(MUL28(_2bx, q0) - MUL28(_4bz, q2), fm3);
+    s[3] = MUL28(_2q1, f1) + MUL28(_2q2, f2) + MUL28(-MUL28(_4bx, q3) + MUL28(_2bz, q1), fm1)
+         + MUL28(-MUL28(_2bx, q0) + MUL28(_2bz, q2), fm2) + MUL28(MUL28(_2bx, q1), fm3);
+
+    integrate(q, g, dq, s);
+}
+
+//-------------------------------------------------------------------------------------------
+// Public functions implementation
+
+esp_err_t madgwick_ahrs_update(madgwick_ahrs_t *filter,
+                               float gx, float gy, float gz,
+                               float ax, float ay, float az,
+                               float mx, float my, float mz) {
+    if (filter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    gains_fx_t g = make_gains(filter->beta, filter->invSampleFreq);
+    quat_fx_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    marg_step(&q, &g, gx, gy, gz, ax, ay, az, mx, my, mz);
+    store_quat(filter, &q);
+
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_update_imu(madgwick_ahrs_t *filter,
+                                   float gx, float gy, float gz,
+                                   float ax, float ay, float az) {
+    if (filter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    gains_fx_t g = make_gains(filter->beta, filter->invSampleFreq);
+    quat_fx_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    imu_step(&q, &g, gx, gy, gz, ax, ay, az);
+    store_quat(filter, &q);
+
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_update_batch(madgwick_ahrs_t *filter,
+                                     const madgwick_ahrs_batch_t *batch,
+                                     size_t count) {
+    if (filter == NULL || batch == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (batch->gx == NULL || batch->gy == NULL || batch->gz == NULL ||
+        batch->ax == NULL || batch->ay == NULL || batch->az == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool has_mag = (batch->mx != NULL && batch->my != NULL && batch->mz != NULL);
+    if (!has_mag && (batch->mx != NULL || batch->my != NULL || batch->mz != NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Keep the quaternion and gains in locals for the whole block
+    quat_fx_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    const gains_fx_t fixed_gains = make_gains(filter->beta, filter->invSampleFreq);
+    const float *dt = batch->dt;
+
+    for (size_t i = 0; i < count; i++) {
+        gains_fx_t g = dt ? make_gains(filter->beta, dt[i]) : fixed_gains;
+        if (has_mag) {
+            marg_step(&q, &g, batch->gx[i], batch->gy[i], batch->gz[i],
+                      batch->ax[i], batch->ay[i], batch->az[i],
+                      batch->mx[i], batch->my[i], batch->mz[i]);
+        } else {
+            imu_step(&q, &g, batch->gx[i], batch->gy[i], batch->gz[i],
+                     batch->ax[i], batch->ay[i], batch->az[i]);
+        }
+    }
+
+    store_quat(filter, &q);
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_update_timestamped(madgwick_ahrs_t *filter, int64_t timestampUs,
+                                           float gx, float gy, float gz,
+                                           float ax, float ay, float az,
+                                           float mx, float my, float mz) {
+    float dt;
+    esp_err_t ret = madgwick_ahrs_timestamp_dt(filter, timestampUs, &dt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    gains_fx_t g = make_gains(filter->beta, dt);
+    quat_fx_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    marg_step(&q, &g, gx, gy, gz, ax, ay, az, mx, my, mz);
+    store_quat(filter, &q);
+
+    return ESP_OK;
+}
+
+esp_err_t madgwick_ahrs_update_imu_timestamped(madgwick_ahrs_t *filter, int64_t timestampUs,
+                                               float gx, float gy, float gz,
+                                               float ax, float ay, float az) {
+    float dt;
+    esp_err_t ret = madgwick_ahrs_timestamp_dt(filter, timestampUs, &dt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    gains_fx_t g = make_gains(filter->beta, dt);
+    quat_fx_t q = { filter->q0, filter->q1, filter->q2, filter->q3 };
+    imu_step(&q, &g, gx, gy, gz, ax, ay, az);
+    store_quat(filter, &q);
+
+    return ESP_OK;
+}
+
+#endif // MADGWICK_AHRS_FIXED_POINT
@@ -0,0 +1,143 @@
+//=============================================================================================
+// micro_ros_batch.h
+//=============================================================================================
+//
+// Write coalescing for a micro-ROS custom transport. The XRCE-DDS client hands the
+// transport each framed message (often in several pieces) with its own write call;
+// sent one by one, every piece pays the cost of a driver call (a lock, a copy into
+// the TX ring buffer, a wake-up of the UART/USB interrupt) and reaches the agent as a
+// separate read. The batch collects the pieces in a buffer and passes them on in one
+// link write when the buffer is full, before the transport waits for input, and after
+// a publish cycle (micro_ros_batch_flush()).
+//
+// The XRCE serial framing delimits every message, so concatenated messages reach the
+// agent intact. The link write is all or nothing: the glue checks the room in the
+// driver and refuses the whole batch rather than block the publishing task. A refused
+// batch is counted as dropped; best-effort streams simply lose those messages.
+//
+// Not thread-safe: one transport, one task.
+//
+//=============================================================================================
+#ifndef MICRO_ROS_BATCH_H
+#define MICRO_ROS_BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Link write: all of the bytes, or fewer when the link is full
+ *
+ * @param ctx Context given to micro_ros_batch_init()
+ * @param buf Bytes
+ * @param len Length
+ * @return size_t Bytes written (a short count drops the batch)
+ */
+typedef size_t (*micro_ros_batch_write_t)(void *ctx, const uint8_t *buf, size_t len);
+
+// Link counters (wrap around)
+typedef struct {
+    uint32_t writes;            // writes of the XRCE client
+    uint32_t flushes;           // link writes
+    uint32_t bytes;             // bytes on the link
+    uint32_t dropped_writes;    // client writes lost to a full link
+    uint32_t dropped_bytes;
+    uint32_t max_flush;         // largest link write
+} micro_ros_batch_stats_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t capacity;
+    size_t len;
+    uint32_t pending;           // client writes in the buffer
+    micro_ros_batch_write_t write;
+    void *ctx;
+    micro_ros_batch_stats_t stats;
+} micro_ros_batch_t;
+
+/**
+ * @brief Set up a batch on a buffer
+ *
+ * @param batch Batch
+ * @param buffer Buffer, ideally a few messages long (up to the room of the TX driver)
+ * @param capacity Buffer size
+ * @param write Link write
+ * @param ctx Context of the link write
+ */
+static inline void micro_ros_batch_init(micro_ros_batch_t *batch, void *buffer, size_t capacity,
+                                        micro_ros_batch_write_t write, void *ctx) {
+    memset(batch, 0, sizeof(*batch));
+    batch->buf = (uint8_t *)buffer;
+    batch->capacity = capacity;
+    batch->write = write;
+    batch->ctx = ctx;
+}
+
+static inline bool micro_ros_batch_send(micro_ros_batch_t *batch, const uint8_t *buf, size_t len,
+                                        uint32_t writes) {
+    size_t sent = batch->write(batch->ctx, buf, len);
+    batch->stats.flushes++;
+    batch->stats.bytes += (uint32_t)sent;
+    if (len > batch->stats.max_flush) {
+        batch->stats.max_flush = (uint32_t)len;
+    }
+    if (sent < len) {
+        batch->stats.dropped_writes += writes;
+        batch->stats.dropped_bytes += (uint32_t)(len - sent);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Pass the buffered writes to the link
+ *
+ * @param batch Batch
+ * @return true if they went out (or there were none), false if they were dropped
+ */
+static inline bool micro_ros_batch_flush(micro_ros_batch_t *batch) {
+    if (batch->len == 0) {
+        return true;
+    }
+    bool ok = micro_ros_batch_send(batch, batch->buf, batch->len, batch->pending);
+    batch->len = 0;
+    batch->pending = 0;
+    return ok;
+}
+
+/**
+ * @brief Queue a client write (the transport write callback)
+ *
+ * Flushes first when it does not fit; a write larger than the buffer goes straight to
+ * the link.
+ *
+ * @param batch Batch
+ * @param buf Bytes
+ * @param len Length
+ * @return size_t len: dropped data is counted, not reported to the client
+ */
+static inline size_t micro_ros_batch_push(micro_ros_batch_t *batch, const uint8_t *buf, size_t len) {
+    batch->stats.writes++;
+    if (len > batch->capacity - batch->len) {
+        micro_ros_batch_flush(batch);
+    }
+    if (len > batch->capacity) {
+        micro_ros_batch_send(batch, buf, len, 1);
+        return len;
+    }
+    memcpy(batch->buf + batch->len, buf, len);
+    batch->len += len;
+    batch->pending++;
+    return len;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MICRO_ROS_BATCH_H
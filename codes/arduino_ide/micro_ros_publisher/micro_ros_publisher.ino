@@ -1,23 +1,69 @@
 #include <micro_ros_arduino.h>
 
-// ros2 run micro_ros_agent micro_ros_agent serial --dev /dev/ttyUSB0
+// ros2 run micro_ros_agent micro_ros_agent serial --dev /dev/ttyUSB0 -b 921600
+// ros2 topic echo /micro_ros_arduino_node_memory
+// ros2 topic echo /micro_ros_arduino_node_link
 
 #include <stdio.h>
 #include <rcl/rcl.h>
 #include <rcl/error_handling.h>
 #include <rclc/rclc.h>
 #include <rclc/executor.h>
+#include <rcutils/allocator.h>
+#include <rmw_microros/rmw_microros.h>
 
 #include <std_msgs/msg/int32.h>
+#include <std_msgs/msg/u_int32_multi_array.h>
+
+#include "esp_heap_caps.h"
+#include "micro_ros_arena.h"
+#include "micro_ros_batch.h"
+
+// ----- TRANSPORT -----
+// Serial at a higher rate than the default transport (115200), with the writes of the
+// XRCE client coalesced into one driver write (on an ESP32-S3 with "USB CDC On Boot",
+// Serial is the native USB port and the rate does not matter)
+#define TRANSPORT_BAUD 921600
+#define BATCH_SIZE 2048
+// Link report: bytes written, client writes, link writes, dropped writes, bytes read
+#define LINK_WORDS 5
+
+// ----- MEMORY -----
+// rcl/rmw allocate from this arena, never from the heap; the memory topic reports its
+// high-water mark to size it by
+#define ARENA_SIZE 16384
+// Memory report: arena size, arena high water, allocations after init, free heap after
+// init, free heap, lowest free heap
+#define MEMORY_WORDS 6
+
+// ----- EXECUTOR TASK -----
+#define SPIN_PERIOD_MS 10         // executor runs this often
+#define SPIN_BUDGET_US 1000       // longest executor wait per run
+#define ROS_CORE 0                // the executor task runs on this core only
 
 rcl_publisher_t publisher;
+rcl_publisher_t memory_publisher;
 std_msgs__msg__Int32 msg;
+rcl_publisher_t link_publisher;
+std_msgs__msg__UInt32MultiArray memory_msg;
+uint32_t memory_data[MEMORY_WORDS];
+std_msgs__msg__UInt32MultiArray link_msg;
+uint32_t link_data[LINK_WORDS];
 rclc_executor_t executor;
 rclc_support_t support;
 rcl_allocator_t allocator;
 rcl_node_t node;
 rcl_timer_t timer;
 
+uint8_t arena_buffer[ARENA_SIZE] __attribute__((aligned(MICRO_ROS_ARENA_ALIGN)));
+micro_ros_arena_t arena;
+uint32_t heap_free_after_init = 0;
+
+uint8_t batch_buffer[BATCH_SIZE];
+micro_ros_batch_t batch;
+bool batch_drop = false;
+uint32_t rx_bytes = 0;
+
 #define LED_PIN 2
 
 #define RCCHECK(fn) { rcl_ret_t temp_rc = fn; if((temp_rc != RCL_RET_OK)){error_loop();}}
@@ -31,23 +77,119 @@ void error_loop(){
   }
 }
 
+// ----- TRANSPORT -----
+// Once running, a batch that does not fit in the TX buffer is dropped, not waited for
+size_t link_write(void *ctx, const uint8_t *buf, size_t len) {
+  if (batch_drop && (size_t)Serial.availableForWrite() < len) {
+    return 0;
+  }
+  return Serial.write(buf, len);
+}
+
+bool transport_open(struct uxrCustomTransport *transport) {
+  Serial.setTxBufferSize(2 * BATCH_SIZE);
+  Serial.begin(TRANSPORT_BAUD);
+  return true;
+}
+
+bool transport_close(struct uxrCustomTransport *transport) {
+  micro_ros_batch_flush(&batch);
+  Serial.end();
+  return true;
+}
+
+size_t transport_write(struct uxrCustomTransport *transport, const uint8_t *buf, size_t len, uint8_t *err) {
+  return micro_ros_batch_push(&batch, buf, len);
+}
+
+// Before waiting for input, what was written goes out
+size_t transport_read(struct uxrCustomTransport *transport, uint8_t *buf, size_t len, int timeout, uint8_t *err) {
+  micro_ros_batch_flush(&batch);
+  Serial.setTimeout(timeout);
+  size_t n = Serial.readBytes((char *)buf, len);
+  rx_bytes += n;
+  return n;
+}
+
+// ----- ARENA ALLOCATOR -----
+void *arena_allocate(size_t size, void *state) {
+  return micro_ros_arena_alloc((micro_ros_arena_t *)state, size);
+}
+
+void arena_deallocate(void *pointer, void *state) {
+  micro_ros_arena_free((micro_ros_arena_t *)state, pointer);
+}
+
+void *arena_reallocate(void *pointer, size_t size, void *state) {
+  return micro_ros_arena_realloc((micro_ros_arena_t *)state, pointer, size);
+}
+
+void *arena_zero_allocate(size_t count, size_t size, void *state) {
+  return micro_ros_arena_calloc((micro_ros_arena_t *)state, count, size);
+}
+
 void timer_callback(rcl_timer_t * timer, int64_t last_call_time)
-{  
+{
   RCLC_UNUSED(last_call_time);
   if (timer != NULL) {
     RCSOFTCHECK(rcl_publish(&publisher, &msg, NULL));
     msg.data++;
+
+    // Memory report: allocations after init stay 0, the free heap stays put
+    memory_data[0] = arena.size;
+    memory_data[1] = arena.high_water;
+    memory_data[2] = arena.allocs_locked;
+    memory_data[3] = heap_free_after_init;
+    memory_data[4] = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    memory_data[5] = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    RCSOFTCHECK(rcl_publish(&memory_publisher, &memory_msg, NULL));
+
+    // Link report: dropped writes stay 0 while the link keeps up
+    link_data[0] = batch.stats.bytes;
+    link_data[1] = batch.stats.writes;
+    link_data[2] = batch.stats.flushes;
+    link_data[3] = batch.stats.dropped_writes;
+    link_data[4] = rx_bytes;
+    RCSOFTCHECK(rcl_publish(&link_publisher, &link_msg, NULL));
+  }
+}
+
+// ----- EXECUTOR TASK -----
+// Bounded runs at a fixed period, instead of a blocking spin in loop()
+void executor_task(void *parameter) {
+  TickType_t last_wake = xTaskGetTickCount();
+  while (true) {
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(SPIN_PERIOD_MS));
+    RCSOFTCHECK(rclc_executor_spin_some(&executor, SPIN_BUDGET_US * 1000ULL));
   }
 }
 
 void setup() {
-  set_microros_transports();
-  
+  micro_ros_batch_init(&batch, batch_buffer, sizeof(batch_buffer), link_write, NULL);
+  rmw_uros_set_custom_transport(
+    true,                    // XRCE serial framing
+    NULL,
+    transport_open,
+    transport_close,
+    transport_write,
+    transport_read);
+
   pinMode(LED_PIN, OUTPUT);
-  digitalWrite(LED_PIN, HIGH);  
-  
+  digitalWrite(LED_PIN, HIGH);
+
   delay(2000);
 
+  // Static arena as the default allocator, before anything is created
+  micro_ros_arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+  rcutils_allocator_t arena_allocator = rcutils_get_zero_initialized_allocator();
+  arena_allocator.allocate = arena_allocate;
+  arena_allocator.deallocate = arena_deallocate;
+  arena_allocator.reallocate = arena_reallocate;
+  arena_allocator.zero_allocate = arena_zero_allocate;
+  arena_allocator.state = &arena;
+  if (!rcutils_set_default_allocator(&arena_allocator)) {
+    error_loop();
+  }
   allocator = rcl_get_default_allocator();
 
   //create init_options
@@ -56,12 +198,22 @@ void setup() {
   // create node
   RCCHECK(rclc_node_init_default(&node, "micro_ros_arduino_node", "", &support));
 
-  // create publisher
+  // create publishers
   RCCHECK(rclc_publisher_init_default(
     &publisher,
     &node,
     ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, Int32),
     "micro_ros_arduino_node_publisher"));
+  RCCHECK(rclc_publisher_init_default(
+    &memory_publisher,
+    &node,
+    ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt32MultiArray),
+    "micro_ros_arduino_node_memory"));
+  RCCHECK(rclc_publisher_init_default(
+    &link_publisher,
+    &node,
+    ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt32MultiArray),
+    "micro_ros_arduino_node_link"));
 
   // create timer,
   const unsigned int timer_timeout = 1000;
@@ -75,10 +227,35 @@ void setup() {
   RCCHECK(rclc_executor_init(&executor, &support.context, 1, &allocator));
   RCCHECK(rclc_executor_add_timer(&executor, &timer));
 
+  // Preallocated messages: the array points at a static buffer
   msg.data = 0;
+  memset(&memory_msg, 0, sizeof(memory_msg));
+  memory_msg.data.data = memory_data;
+  memory_msg.data.size = MEMORY_WORDS;
+  memory_msg.data.capacity = MEMORY_WORDS;
+  memset(&link_msg, 0, sizeof(link_msg));
+  link_msg.data.data = link_data;
+  link_msg.data.size = LINK_WORDS;
+  link_msg.data.capacity = LINK_WORDS;
+
+  // Init done: from here on, allocations are counted in the memory report
+  micro_ros_arena_lock(&arena);
+  heap_free_after_init = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  batch_drop = true;
+
+  // Executor task, pinned so that it never migrates between cores
+  xTaskCreatePinnedToCore(
+    executor_task,           // Task function
+    "ExecutorTask",          // Task name
+    8192,                    // Stack size (words)
+    NULL,                    // Task parameters
+    2,                       // Task priority
+    NULL,                    // Task handle
+    ROS_CORE                 // Core
+  );
 }
 
 void loop() {
-  delay(100);
-  RCSOFTCHECK(rclc_executor_spin_some(&executor, RCL_MS_TO_NS(100)));
+  // micro-ROS runs in the executor task
+  delay(1000);
 }
@@ -0,0 +1,52 @@
+//=============================================================================================
+// bench_clock.h
+//=============================================================================================
+//
+// Timing helpers shared by the host benchmarks.
+// bench_now_ns() is a monotonic wall clock; bench_cycles() reads the CPU
+// time-stamp counter where one is available (x86) and returns 0 elsewhere.
+//
+//=============================================================================================
+#ifndef BENCH_CLOCK_H
+#define BENCH_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_CYCLES 1
+#else
+#define BENCH_HAVE_CYCLES 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t bench_cycles(void) {
+#if BENCH_HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Prevents the optimizer from discarding a benchmark result
+static volatile float bench_sink;
+
+static inline void bench_consume_float(float value) {
+    bench_sink = value;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BENCH_CLOCK_H
@@ -0,0 +1,278 @@
+//=============================================================================================
+// imu_log.c
+//=============================================================================================
+//
+// See imu_log.h for the file formats.
+//
+//=============================================================================================
+
+#include "imu_log.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMU_LOG_MAGIC       "IMUL"
+#define IMU_LOG_VERSION     1u
+#define IMU_LOG_FLAG_TRUTH  0x01u
+#define LINE_MAX_LEN        512
+
+//-------------------------------------------------------------------------------------------
+// Helper functions
+
+static bool has_extension(const char *path, const char *ext) {
+    size_t len = strlen(path);
+    size_t ext_len = strlen(ext);
+    return len >= ext_len && strcmp(path + len - ext_len, ext) == 0;
+}
+
+static int grow(void **buffer, size_t *capacity, size_t elem_size) {
+    size_t new_capacity = (*capacity == 0) ? 1024 : *capacity * 2;
+    void *p = realloc(*buffer, new_capacity * elem_size);
+    if (p == NULL) {
+        return -1;
+    }
+    *buffer = p;
+    *capacity = new_capacity;
+    return 0;
+}
+
+static int load_csv(const char *path, imu_log_t *log) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "imu_log: cannot open %s\n", path);
+        return -1;
+    }
+
+    char line[LINE_MAX_LEN];
+    size_t capacity = 0;
+    bool header = true;
+    log->has_truth = true;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (header) {
+            // Header line names the columns; nothing to parse
+            header = false;
+            continue;
+        }
+        if (line[0] == '\n' || line[0] == '\r' || line[0] == '\0') {
+            continue;
+        }
+
+        if (log->count == capacity &&
+            grow((void **)&log->samples, &capacity, sizeof(imu_log_sample_t)) != 0) {
+            fprintf(stderr, "imu_log: out of memory\n");
+            fclose(f);
+            return -1;
+        }
+
+        imu_log_sample_t *s = &log->samples[log->count];
+        memset(s, 0, sizeof(*s));
+        int n = sscanf(line, "%" SCNd64 ",%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f",
+                       &s->t_us, &s->gx, &s->gy, &s->gz, &s->ax, &s->ay, &s->az,
+                       &s->mx, &s->my, &s->mz, &s->q0, &s->q1, &s->q2, &s->q3);
+        if (n == 10) {
+            log->has_truth = false;
+        } else if (n != 14) {
+            fprintf(stderr, "imu_log: %s: malformed line %zu\n", path, log->count + 2);
+            fclose(f);
+            return -1;
+        }
+        log->count++;
+    }
+
+    fclose(f);
+    if (log->count == 0) {
+        log->has_truth = false;
+    }
+    return 0;
+}
+
+static int load_bin(const char *path, imu_log_t *log) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "imu_log: cannot open %s\n", path);
+        return -1;
+    }
+
+    char magic[4];
+    uint32_t header[3];
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, IMU_LOG_MAGIC, 4) != 0 ||
+        fread(header, sizeof(uint32_t), 3, f) != 3 || header[0] != IMU_LOG_VERSION) {
+        fprintf(stderr, "imu_log: %s is not a version %u IMU log\n", path, IMU_LOG_VERSION);
+        fclose(f);
+        return -1;
+    }
+
+    log->count = header[1];
+    log->has_truth = (header[2] & IMU_LOG_FLAG_TRUTH) != 0;
+    log->samples = calloc(log->count ? log->count : 1, sizeof(imu_log_sample_t));
+    if (log->samples == NULL) {
+        fprintf(stderr, "imu_log: out of memory\n");
+        fclose(f);
+        return -1;
+    }
+
+    for (size_t i = 0; i < log->count; i++) {
+        imu_log_sample_t *s = &log->samples[i];
+        float v[13];
+        if (fread(&s->t_us, sizeof(int64_t), 1, f) != 1 || fread(v, sizeof(float), 13, f) != 13) {
+            fprintf(stderr, "imu_log: %s truncated at record %zu\n", path, i);
+            fclose(f);
+            return -1;
+        }
+        s->gx = v[0];  s->gy = v[1];  s->gz = v[2];
+        s->ax = v[3];  s->ay = v[4];  s->az = v[5];
+        s->mx = v[6];  s->my = v[7];  s->mz = v[8];
+        s->q0 = v[9];  s->q1 = v[10]; s->q2 = v[11]; s->q3 = v[12];
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static int save_csv(const char *path, const imu_log_t *log) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "imu_log: cannot create %s\n", path);
+        return -1;
+    }
+
+    fprintf(f, "t_us,gx,gy,gz,ax,ay,az,mx,my,mz%s\n", log->has_truth ? ",q0,q1,q2,q3" : "");
+    for (size_t i = 0; i < log->count; i++) {
+        const imu_log_sample_t *s = &log->samples[i];
+        fprintf(f, "%" PRId64 ",%.4f,%.4f,%.4f,%.5f,%.5f,%.5f,%.3f,%.3f,%.3f",
+                s->t_us, s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+        if (log->has_truth) {
+            fprintf(f, ",%.7f,%.7f,%.7f,%.7f", s->q0, s->q1, s->q2, s->q3);
+        }
+        fputc('\n', f);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static int save_bin(const char *path, const imu_log_t *log) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "imu_log: cannot create %s\n", path);
+        return -1;
+    }
+
+    uint32_t header[3] = { IMU_LOG_VERSION, (uint32_t)log->count,
+                           log->has_truth ? IMU_LOG_FLAG_TRUTH : 0u };
+    fwrite(IMU_LOG_MAGIC, 1, 4, f);
+    fwrite(header, sizeof(uint32_t), 3, f);
+    for (size_t i = 0; i < log->count; i++) {
+        const imu_log_sample_t *s = &log->samples[i];
+        float v[13] = { s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz,
+                        s->q0, s->q1, s->q2, s->q3 };
+        fwrite(&s->t_us, sizeof(int64_t), 1, f);
+        fwrite(v, sizeof(float), 13, f);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------
+// Public functions implementation
+
+int imu_log_load(const char *path, imu_log_t *log) {
+    memset(log, 0, sizeof(*log));
+    int ret = has_extension(path, ".bin") ? load_bin(path, log) : load_csv(path, log);
+    if (ret != 0) {
+        imu_log_free(log);
+    }
+    return ret;
+}
+
+int imu_log_save(const char *path, const imu_log_t *log) {
+    return has_extension(path, ".bin") ? save_bin(path, log) : save_csv(path, log);
+}
+
+void imu_log_free(imu_log_t *log) {
+    free(log->samples);
+    memset(log, 0, sizeof(*log));
+}
+
+int quat_trace_load(const char *path, quat_trace_t *trace) {
+    memset(trace, 0, sizeof(*trace));
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "quat_trace: cannot open %s\n", path);
+        return -1;
+    }
+
+    char line[LINE_MAX_LEN];
+    size_t capacity = 0;
+    bool header = true;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (header) {
+            header = false;
+            continue;
+        }
+        if (line[0] == '\n' || line[0] == '\r' || line[0] == '\0') {
+            continue;
+        }
+
+        if (trace->count == capacity &&
+            grow((void **)&trace->samples, &capacity, sizeof(quat_trace_sample_t)) != 0) {
+            fprintf(stderr, "quat_trace: out of memory\n");
+            fclose(f);
+            quat_trace_free(trace);
+            return -1;
+        }
+
+        quat_trace_sample_t *s = &trace->samples[trace->count];
+        if (sscanf(line, "%" SCNd64 ",%f,%f,%f,%f", &s->t_us, &s->q0, &s->q1, &s->q2, &s->q3) != 5) {
+            fprintf(stderr, "quat_trace: %s: malformed line %zu\n", path, trace->count + 2);
+            fclose(f);
+            quat_trace_free(trace);
+            return -1;
+        }
+        trace->count++;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+int quat_trace_save(const char *path, const quat_trace_t *trace) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "quat_trace: cannot create %s\n", path);
+        return -1;
+    }
+
+    fprintf(f, "t_us,q0,q1,q2,q3\n");
+    for (size_t i = 0; i < trace->count; i++) {
+        const quat_trace_sample_t *s = &trace->samples[i];
+        fprintf(f, "%" PRId64 ",%.9g,%.9g,%.9g,%.9g\n", s->t_us, s->q0, s->q1, s->q2, s->q3);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+void quat_trace_free(quat_trace_t *trace) {
+    free(trace->samples);
+    memset(trace, 0, sizeof(*trace));
+}
+
+float quat_angle_deg(float a0, float a1, float a2, float a3,
+                     float b0, float b1, float b2, float b3) {
+    // Relative rotation conj(b) * a; atan2 stays accurate for tiny angles and does
+    // not depend on the inputs being exactly unit length
+    double r0 = (double)b0 * a0 + (double)b1 * a1 + (double)b2 * a2 + (double)b3 * a3;
+    double r1 = (double)b0 * a1 - (double)b1 * a0 - (double)b2 * a3 + (double)b3 * a2;
+    double r2 = (double)b0 * a2 + (double)b1 * a3 - (double)b2 * a0 - (double)b3 * a1;
+    double r3 = (double)b0 * a3 - (double)b1 * a2 + (double)b2 * a1 - (double)b3 * a0;
+    double vec = sqrt(r1 * r1 + r2 * r2 + r3 * r3);
+    // q and -q describe the same rotation, hence the absolute value
+    return (float)(2.0 * atan2(vec, fabs(r0)) * 180.0 / M_PI);
+}
@@ -0,0 +1,104 @@
+//=============================================================================================
+// imu_log.h
+//=============================================================================================
+//
+// Reader/writer for recorded 9-DOF sensor logs and quaternion traces used by the
+// host replay and benchmark tools.
+//
+// CSV log columns (header line required):
+//   t_us,gx,gy,gz,ax,ay,az,mx,my,mz[,q0,q1,q2,q3]
+// Units match what the firmware feeds the filter: deg/s, g and µT.
+// The optional q0..q3 columns hold a reference (truth) orientation.
+//
+// Binary log (.bin) layout, little endian:
+//   char magic[4] = "IMUL", uint32 version = 1, uint32 count, uint32 flags
+//   count x { int64 t_us, float gx..mz, float q0..q3 }
+// flags bit 0 set means the q0..q3 fields are valid.
+//
+// Quaternion trace CSV columns: t_us,q0,q1,q2,q3
+//
+//=============================================================================================
+#ifndef IMU_LOG_H
+#define IMU_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int64_t t_us;           // sample timestamp (µs)
+    float gx, gy, gz;       // Gyroscope (deg/s)
+    float ax, ay, az;       // Accelerometer (g)
+    float mx, my, mz;       // Magnetometer (µT), all zero when not available
+    float q0, q1, q2, q3;   // Reference orientation, valid when has_truth is set
+} imu_log_sample_t;
+
+typedef struct {
+    imu_log_sample_t *samples;
+    size_t count;
+    bool has_truth;
+} imu_log_t;
+
+typedef struct {
+    int64_t t_us;
+    float q0, q1, q2, q3;
+} quat_trace_sample_t;
+
+typedef struct {
+    quat_trace_sample_t *samples;
+    size_t count;
+} quat_trace_t;
+
+/**
+ * @brief Load a sensor log; the format is chosen from the extension (.bin or CSV)
+ *
+ * @return int 0 on success, -1 on error (message printed to stderr)
+ */
+int imu_log_load(const char *path, imu_log_t *log);
+
+/**
+ * @brief Save a sensor log; the format is chosen from the extension (.bin or CSV)
+ *
+ * @return int 0 on success, -1 on error (message printed to stderr)
+ */
+int imu_log_save(const char *path, const imu_log_t *log);
+
+/**
+ * @brief Release the memory owned by a sensor log
+ */
+void imu_log_free(imu_log_t *log);
+
+/**
+ * @brief Load a quaternion trace CSV
+ *
+ * @return int 0 on success, -1 on error (message printed to stderr)
+ */
+int quat_trace_load(const char *path, quat_trace_t *trace);
+
+/**
+ * @brief Save a quaternion trace CSV
+ *
+ * @return int 0 on success, -1 on error (message printed to stderr)
+ */
+int quat_trace_save(const char *path, const quat_trace_t *trace);
+
+/**
+ * @brief Release the memory owned by a quaternion trace
+ */
+void quat_trace_free(quat_trace_t *trace);
+
+/**
+ * @brief Angle (degrees) of the rotation between two unit quaternions
+ */
+float quat_angle_deg(float a0, float a1, float a2, float a3,
+                     float b0, float b1, float b2, float b3);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMU_LOG_H
@@ -0,0 +1,305 @@
+//=============================================================================================
+// bench_encoder.c
+//=============================================================================================
+//
+// Checks and times the table-driven quadrature step of the ISR encoder backend
+// (encoder_decode.h) against the switch decoder it replaced:
+//
+//   table     all 16 (previous, new) level pairs give the same step as the switch
+//             decoder, and the four double changes are counted as illegal
+//   walk      a random quadrature walk with skipped edges, through both decoders, ends
+//             on the expected count and illegal tally
+//   wrap      encoder_decode_count_delta() across the 2^30 wrap of the packed count
+//   time      ns (and cycles on x86) per edge of each decoder. The switch decoder
+//             reads the two levels through a non-inlined gpio_get_level() and picks
+//             the wheel from the pin number, as the former ISR did.
+//
+// Usage: bench_encoder [--edges N]
+// Exits 1 if a check fails.
+//
+//=============================================================================================
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_clock.h"
+#include "encoder_decode.h"
+
+#define DEFAULT_EDGES   20000000u
+#define WALK_STEPS      10000000u
+#define TRACE_LEN       65536u      // input words replayed by the timing loop
+
+// Rover wiring: left A/B on GPIO 23/17, right A/B on 18/19
+#define ENC_LEFT_A      23
+#define ENC_LEFT_B      17
+#define ENC_RIGHT_A     18
+#define ENC_RIGHT_B     19
+
+//-------------------------------------------------------------------------------------------
+// Former switch decoder
+
+static volatile uint32_t s_gpio_in;     // stands in for the GPIO input register
+
+static volatile int32_t count_left = 0;
+static volatile int32_t count_right = 0;
+static volatile int lastLA = 0, lastLB = 0;
+static volatile int lastRA = 0, lastRB = 0;
+
+// Out of line like the ESP-IDF function called from the ISR
+__attribute__((noinline)) static int gpio_get_level(int pin) {
+    return (int)((s_gpio_in >> pin) & 1u);
+}
+
+static void encoder_isr_handler(void *arg) {
+    int pin = (int)(intptr_t)arg;
+
+    if (pin == ENC_LEFT_A || pin == ENC_LEFT_B) {
+        int a = gpio_get_level(ENC_LEFT_A);
+        int b = gpio_get_level(ENC_LEFT_B);
+        int transition = (lastLA << 3) | (lastLB << 2) | (a << 1) | b;
+        switch (transition) {
+            case 0b0001: case 0b0111: case 0b1110: case 0b1000:
+                count_left++; break;
+            case 0b0010: case 0b0100: case 0b1101: case 0b1011:
+                count_left--; break;
+            default: break;
+        }
+        lastLA = a;
+        lastLB = b;
+    } else {
+        int a = gpio_get_level(ENC_RIGHT_A);
+        int b = gpio_get_level(ENC_RIGHT_B);
+        int transition = (lastRA << 3) | (lastRB << 2) | (a << 1) | b;
+        switch (transition) {
+            case 0b0001: case 0b0111: case 0b1110: case 0b1000:
+                count_right++; break;
+            case 0b0010: case 0b0100: case 0b1101: case 0b1011:
+                count_right--; break;
+            default: break;
+        }
+        lastRA = a;
+        lastRB = b;
+    }
+}
+
+static void switch_reset(uint32_t in) {
+    s_gpio_in = in;
+    count_left = 0;
+    count_right = 0;
+    lastLA = gpio_get_level(ENC_LEFT_A);
+    lastLB = gpio_get_level(ENC_LEFT_B);
+    lastRA = gpio_get_level(ENC_RIGHT_A);
+    lastRB = gpio_get_level(ENC_RIGHT_B);
+}
+
+//-------------------------------------------------------------------------------------------
+// Helpers
+
+static unsigned long long s_rng_state = 1;
+
+static uint32_t rng_next(void) {
+    s_rng_state = s_rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(s_rng_state >> 33);
+}
+
+// Input word with the left encoder at levels ab (A << 1 | B)
+static uint32_t left_word(uint32_t ab) {
+    return ((ab >> 1) << ENC_LEFT_A) | ((ab & 1u) << ENC_LEFT_B);
+}
+
+// Gray sequence of the forward direction: 00 -> 01 -> 11 -> 10
+static const uint32_t kForward[4] = { 0u, 1u, 3u, 2u };
+
+static int32_t packed_count(const encoder_decoder_t *dec) {
+    return encoder_decode_count_delta(dec->state, 0);
+}
+
+//-------------------------------------------------------------------------------------------
+// Checks
+
+static bool check_table(void) {
+    bool ok = true;
+    for (uint32_t prev = 0; prev < 4; prev++) {
+        for (uint32_t next = 0; next < 4; next++) {
+            encoder_decoder_t dec;
+            encoder_decode_init(&dec, ENC_LEFT_A, ENC_LEFT_B, left_word(prev));
+            encoder_decode_edge(&dec, left_word(next));
+
+            switch_reset(left_word(prev));
+            s_gpio_in = left_word(next);
+            encoder_isr_handler((void *)(intptr_t)ENC_LEFT_A);
+
+            bool illegal = (prev ^ next) == 3u;
+            if (packed_count(&dec) != count_left || dec.illegal != (illegal ? 1u : 0u) ||
+                (dec.state & 3u) != next) {
+                printf("  %u%u -> %u%u: table %d (illegal %u), switch %d\n", prev >> 1, prev & 1,
+                       next >> 1, next & 1, (int)packed_count(&dec), (unsigned)dec.illegal,
+                       (int)count_left);
+                ok = false;
+            }
+        }
+    }
+    printf("table: 16 transitions: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// Random forward/backward steps; one step in 1000 skips an edge (both channels change)
+static bool check_walk(void) {
+    encoder_decoder_t dec;
+    uint32_t phase = 0;
+    int64_t expected = 0;
+    uint32_t expected_illegal = 0;
+    encoder_decode_init(&dec, ENC_LEFT_A, ENC_LEFT_B, left_word(kForward[phase]));
+    switch_reset(left_word(kForward[phase]));
+
+    for (uint32_t i = 0; i < WALK_STEPS; i++) {
+        uint32_t r = rng_next();
+        if (r % 1000u == 0) {
+            phase = (phase + 2u) & 3u;
+            expected_illegal++;
+        } else if (r & 0x10000u) {
+            phase = (phase + 1u) & 3u;
+            expected++;
+        } else {
+            phase = (phase + 3u) & 3u;
+            expected--;
+        }
+        uint32_t in = left_word(kForward[phase]);
+        encoder_decode_edge(&dec, in);
+        s_gpio_in = in;
+        encoder_isr_handler((void *)(intptr_t)ENC_LEFT_A);
+    }
+
+    bool ok = packed_count(&dec) == (int32_t)expected && count_left == (int32_t)expected &&
+              dec.illegal == expected_illegal;
+    printf("walk: %u steps, count %d (expected %lld, switch %d), illegal %u (expected %u): %s\n",
+           WALK_STEPS, (int)packed_count(&dec), (long long)expected, (int)count_left,
+           (unsigned)dec.illegal, (unsigned)expected_illegal, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// Forward through the top of the 30-bit count and back
+static bool check_wrap(void) {
+    encoder_decoder_t dec;
+    encoder_decode_init(&dec, ENC_LEFT_A, ENC_LEFT_B, left_word(0));
+    dec.state = ((uint32_t)((1u << 29) - 100u) << 2) | (dec.state & 3u);   // 100 below 2^29
+
+    uint32_t start = dec.state;
+    uint32_t phase = 0;
+    for (int i = 0; i < 1000; i++) {
+        phase = (phase + 1u) & 3u;
+        encoder_decode_edge(&dec, left_word(kForward[phase]));
+    }
+    int32_t forward = encoder_decode_count_delta(dec.state, start);
+    uint32_t top = dec.state;
+    for (int i = 0; i < 3000; i++) {
+        phase = (phase + 3u) & 3u;
+        encoder_decode_edge(&dec, left_word(kForward[phase]));
+    }
+    int32_t backward = encoder_decode_count_delta(dec.state, top);
+
+    bool ok = forward == 1000 && backward == -3000;
+    printf("wrap: +1000 -> %d, -3000 -> %d: %s\n", (int)forward, (int)backward,
+           ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+//-------------------------------------------------------------------------------------------
+// Timing
+
+// Input words of a random walk on both wheels, and the wheel that moved in each
+static void make_trace(uint32_t *words, uint8_t *wheel) {
+    uint32_t phase[2] = { 0, 0 };
+    for (uint32_t i = 0; i < TRACE_LEN; i++) {
+        uint32_t r = rng_next();
+        uint32_t w = r & 1u;
+        phase[w] = (phase[w] + ((r & 2u) ? 1u : 3u)) & 3u;
+        uint32_t l = kForward[phase[0]];
+        uint32_t rt = kForward[phase[1]];
+        words[i] = ((l >> 1) << ENC_LEFT_A) | ((l & 1u) << ENC_LEFT_B) |
+                   ((rt >> 1) << ENC_RIGHT_A) | ((rt & 1u) << ENC_RIGHT_B);
+        wheel[i] = (uint8_t)w;
+    }
+}
+
+static double time_switch(const uint32_t *words, const uint8_t *wheel, size_t edges,
+                          double *cycles) {
+    static const int kPins[2] = { ENC_LEFT_A, ENC_RIGHT_A };
+    switch_reset(0);
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    size_t pos = 0;
+    for (size_t n = 0; n < edges; n++) {
+        s_gpio_in = words[pos];
+        encoder_isr_handler((void *)(intptr_t)kPins[wheel[pos]]);
+        if (++pos == TRACE_LEN) pos = 0;
+    }
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+    bench_consume_float((float)(count_left + count_right));
+    *cycles = (double)(c1 - c0) / edges;
+    return (double)(t1 - t0) / edges;
+}
+
+static double time_table(const uint32_t *words, const uint8_t *wheel, size_t edges,
+                         double *cycles) {
+    encoder_decoder_t dec[2];
+    encoder_decode_init(&dec[0], ENC_LEFT_A, ENC_LEFT_B, 0);
+    encoder_decode_init(&dec[1], ENC_RIGHT_A, ENC_RIGHT_B, 0);
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    size_t pos = 0;
+    for (size_t n = 0; n < edges; n++) {
+        s_gpio_in = words[pos];
+        encoder_decode_edge(&dec[wheel[pos]], s_gpio_in);   // one register read
+        if (++pos == TRACE_LEN) pos = 0;
+    }
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+    bench_consume_float((float)(dec[0].state + dec[1].state));
+    *cycles = (double)(c1 - c0) / edges;
+    return (double)(t1 - t0) / edges;
+}
+
+static void report(const char *name, double ns, double cycles) {
+    if (BENCH_HAVE_CYCLES) {
+        printf("%-28s %8.2f ns/edge  %8.1f cycles/edge\n", name, ns, cycles);
+    } else {
+        printf("%-28s %8.2f ns/edge\n", name, ns);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t edges = DEFAULT_EDGES;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--edges") == 0 && i + 1 < argc) {
+            edges = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--edges N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (edges == 0) {
+        fprintf(stderr, "nothing to benchmark\n");
+        return 1;
+    }
+
+    bool ok = check_table();
+    ok = check_walk() && ok;
+    ok = check_wrap() && ok;
+    printf("\n");
+
+    static uint32_t words[TRACE_LEN];
+    static uint8_t wheel[TRACE_LEN];
+    make_trace(words, wheel);
+
+    double cycles;
+    double ns_switch = time_switch(words, wheel, edges, &cycles);
+    report("switch + 2x gpio_get_level", ns_switch, cycles);
+    double ns_table = time_table(words, wheel, edges, &cycles);
+    report("table, one register read", ns_table, cycles);
+    printf("speedup: %.2fx\n", ns_switch / ns_table);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+//=============================================================================================
+// bench_odometry.c
+//=============================================================================================
+//
+// Checks the pose integration of the odometry (odometry.h) against a double precision
+// reference, at loop rates from 10 Hz to 1 kHz, next to the former step (midpoint
+// heading, plain float sums, unbounded theta):
+//
+//   circle    0.3 m/s on a 0.3 m radius for 10 minutes (180 m, 95 turns)
+//   tight     0.2 m/s at 3 rad/s for 1 minute (6.7 cm radius)
+//   straight  0.5 m/s for 10 minutes (300 m) at a 30 degree heading
+//
+// Wheel counts per loop come from the continuous wheel travel (N20 encoders, 840
+// counts/turn on 65 mm wheels); the reference integrates the same counts with exact
+// arcs in double. Prints the final position error of both steps and times one step.
+// Exits 1 if the error of odometry.h exceeds 1 mm.
+//
+// Usage: bench_odometry
+//
+//=============================================================================================
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "bench_clock.h"
+#include "odometry.h"
+
+#define WHEEL_RADIUS    (0.065 / 2)
+#define WHEEL_BASE      0.138
+#define CPR             840
+#define DIST_PER_COUNT  (2.0 * M_PI * WHEEL_RADIUS / CPR)
+#define MAX_ERROR_M     1e-3
+
+typedef struct {
+    const char *name;
+    double v, omega;    // m/s, rad/s
+    double seconds;
+    double theta0;      // rad
+} scenario_t;
+
+static const scenario_t kScenarios[] = {
+    { "circle",   0.3, 1.0,  600.0, 0.0 },
+    { "tight",    0.2, 3.0,   60.0, 0.0 },
+    { "straight", 0.5, 0.0,  600.0, M_PI / 6 },
+};
+
+static const int kRates[] = { 10, 100, 500, 1000 };
+
+// Former update_odometry(): midpoint heading, float sums
+typedef struct {
+    float x, y, theta;
+} former_t;
+
+static void former_step(former_t *f, int32_t dl, int32_t dr) {
+    float dist_per_count = 2.0 * M_PI * WHEEL_RADIUS / CPR;
+    float d_left  = dl * dist_per_count;
+    float d_right = dr * dist_per_count;
+    float ds = (d_right + d_left) / 2.0;
+    float dtheta = (d_right - d_left) / WHEEL_BASE;
+    f->x += ds * cos(f->theta + dtheta / 2.0);
+    f->y += ds * sin(f->theta + dtheta / 2.0);
+    f->theta += dtheta;
+}
+
+// Exact arc in double
+typedef struct {
+    double x, y, theta;
+} reference_t;
+
+static void reference_step(reference_t *r, int32_t dl, int32_t dr) {
+    double ds = 0.5 * (dl + dr) * DIST_PER_COUNT;
+    double dtheta = (dr - dl) * DIST_PER_COUNT / WHEEL_BASE;
+    double h = 0.5 * dtheta;
+    double sinc = fabs(h) > 1e-8 ? sin(h) / h : 1.0;
+    r->x += ds * sinc * cos(r->theta + h);
+    r->y += ds * sinc * sin(r->theta + h);
+    r->theta += dtheta;
+}
+
+static bool run(const scenario_t *s, int rate_hz) {
+    // Wheel speeds in counts/s
+    double left = (s->v - s->omega * WHEEL_BASE / 2) / DIST_PER_COUNT;
+    double right = (s->v + s->omega * WHEEL_BASE / 2) / DIST_PER_COUNT;
+    long steps = (long)(s->seconds * rate_hz);
+
+    odometry_t o;
+    odometry_init(&o, (float)DIST_PER_COUNT, (float)WHEEL_BASE);
+    o.theta = (float)s->theta0;
+    former_t f = { 0.0f, 0.0f, (float)s->theta0 };
+    reference_t r = { 0.0, 0.0, s->theta0 };
+
+    int64_t last_l = 0, last_r = 0;
+    for (long k = 1; k <= steps; k++) {
+        double t = (double)k / rate_hz;
+        int64_t cl = (int64_t)floor(left * t);
+        int64_t cr = (int64_t)floor(right * t);
+        int32_t dl = (int32_t)(cl - last_l);
+        int32_t dr = (int32_t)(cr - last_r);
+        last_l = cl;
+        last_r = cr;
+        odometry_step(&o, dl, dr);
+        former_step(&f, dl, dr);
+        reference_step(&r, dl, dr);
+    }
+
+    double err_new = hypot(o.x - r.x, o.y - r.y);
+    double err_former = hypot(f.x - r.x, f.y - r.y);
+    bool ok = err_new <= MAX_ERROR_M;
+    printf("  %-9s %5d Hz %12.3f %12.3f   %s\n", s->name, rate_hz, err_former * 1e3,
+           err_new * 1e3, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// ns per step with counts (the loop skips empty steps)
+static double time_step(void) {
+    odometry_t o;
+    odometry_init(&o, (float)DIST_PER_COUNT, (float)WHEEL_BASE);
+    const long n = 10000000;
+    uint64_t t0 = bench_now_ns();
+    for (long k = 0; k < n; k++) {
+        odometry_step(&o, 1 + (int32_t)(k & 1), 2 - (int32_t)(k & 1));
+    }
+    uint64_t t1 = bench_now_ns();
+    bench_consume_float(o.x + o.y + o.theta);
+    return (double)(t1 - t0) / n;
+}
+
+int main(void) {
+    bool ok = true;
+    printf("  %-9s %8s %12s %12s\n", "path", "rate", "former (mm)", "arc (mm)");
+    for (size_t i = 0; i < sizeof(kScenarios) / sizeof(kScenarios[0]); i++) {
+        for (size_t j = 0; j < sizeof(kRates) / sizeof(kRates[0]); j++) {
+            ok = run(&kScenarios[i], kRates[j]) && ok;
+        }
+    }
+    printf("\nodometry_step: %.1f ns per step with counts\n", time_step());
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
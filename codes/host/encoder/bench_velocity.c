@@ -0,0 +1,221 @@
+//=============================================================================================
+// bench_velocity.c
+//=============================================================================================
+//
+// Drives the wheel rate estimator of the encoder driver (encoder_velocity.h) with a
+// simulated wheel and compares it with the former rate, counts per 100 ms period:
+//
+//   profile   standstill, crawl at 37 counts/s (~1 cm/s), ramp to 2000 counts/s, back
+//             down to 93 counts/s, reverse at -43 counts/s, stop. The Hall edges are
+//             unevenly spaced within a quadrature cycle and timestamped with up to 5 µs
+//             of interrupt latency; the microsecond clock wraps during the run.
+//   variants  x4: every edge timed (ISR backend); A: channel A edges only (PCNT backend)
+//
+// Prints the RMS error of both rates against the true speed in each steady segment.
+// Checks that edge timing at least halves the error at crawl speeds, that rates come
+// from counts at high speed, and that a stopped wheel reads exactly 0 (exits 1 if not).
+//
+// Usage: bench_velocity
+//
+//=============================================================================================
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "encoder_velocity.h"
+
+#define SIM_STEP_US     5u
+#define PERIOD_US       100000u     // odometry task period
+#define EDGE_RATE_MAX   500.0f      // ENCODER_DEFAULT_CONFIG()
+#define EDGE_TIMEOUT_US 250000u
+#define CLOCK_START_US  (0xFFFFFFFFu - 3000000u)    // wraps 3 s into the run
+
+// Speed profile: linear from v0 to v1 counts/s between t0 and t1 seconds
+typedef struct {
+    double t0, t1, v0, v1;
+} segment_t;
+
+static const segment_t kProfile[] = {
+    {  0.0,  2.0,    0.0,    0.0 },
+    {  2.0,  6.0,   37.0,   37.0 },
+    {  6.0,  8.0,   37.0, 2000.0 },
+    {  8.0, 10.0, 2000.0, 2000.0 },
+    { 10.0, 12.0, 2000.0,   93.0 },
+    { 12.0, 14.0,   93.0,   93.0 },
+    { 14.0, 16.0,  -43.0,  -43.0 },
+    { 16.0, 18.0,    0.0,    0.0 },
+};
+#define PROFILE_LEN (sizeof(kProfile) / sizeof(kProfile[0]))
+#define PROFILE_END 18.0
+#define STOP_AT     16.0
+
+// Steady segments scored (from 0.5 s after the change)
+typedef struct {
+    const char *name;
+    double t0, t1;
+} window_t;
+
+static const window_t kWindows[] = {
+    { "standstill",     0.5,  2.0 },
+    { "crawl 37/s",     2.5,  6.0 },
+    { "fast 2000/s",    8.5, 10.0 },
+    { "slow 93/s",     12.5, 14.0 },
+    { "reverse -43/s", 14.5, 16.0 },
+    { "stopped",       16.5, 18.0 },
+};
+#define WINDOW_COUNT (sizeof(kWindows) / sizeof(kWindows[0]))
+enum { W_STANDSTILL, W_CRAWL, W_FAST, W_SLOW, W_REVERSE, W_STOPPED };
+
+// Edge k (between counts k-1 and k) sits at position k + kEdgeOffset[k & 3]: Hall duty
+// cycle and phase errors of the N20 encoders
+static const double kEdgeOffset[4] = { 0.0, 0.12, -0.05, 0.08 };
+
+typedef struct {
+    double sq_count, sq_edge;
+    double max_abs_edge;
+    int samples;
+    int timed;
+} score_t;
+
+static unsigned long long s_rng_state = 3;
+
+static uint32_t rng_next(void) {
+    s_rng_state = s_rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(s_rng_state >> 33);
+}
+
+static double speed_at(double t) {
+    for (size_t i = 0; i < PROFILE_LEN; i++) {
+        const segment_t *s = &kProfile[i];
+        if (t < s->t1) {
+            return s->v0 + (s->v1 - s->v0) * (t - s->t0) / (s->t1 - s->t0);
+        }
+    }
+    return 0.0;
+}
+
+// Runs the profile; a_only: log channel A edges only, 2 counts each (PCNT backend)
+// stop_ms: time from the stop at STOP_AT until each rate reads below 1 count/s
+static void run(bool a_only, score_t *scores, int *switches, double stop_ms[2]) {
+    static encoder_edge_log_t log;
+    memset(&log, 0, sizeof(log));
+    memset(scores, 0, sizeof(score_t) * WINDOW_COUNT);
+    *switches = 0;
+    stop_ms[0] = stop_ms[1] = -1.0;
+
+    double p = 0.0;
+    int64_t c = 0;
+    uint32_t timing_n = 0;
+    encoder_rate_t r;
+    encoder_rate_init(&r, EDGE_RATE_MAX, EDGE_TIMEOUT_US, CLOCK_START_US, 0, 0);
+    int64_t last_c = 0;
+    uint32_t next_update = PERIOD_US;
+
+    for (uint32_t us = 0; us < (uint32_t)(PROFILE_END * 1e6); us += SIM_STEP_US) {
+        double t = us * 1e-6;
+        p += speed_at(t) * SIM_STEP_US * 1e-6;
+
+        // Edges crossed during this step
+        for (;;) {
+            int64_t k;
+            bool up;
+            if (p >= (double)(c + 1) + kEdgeOffset[(c + 1) & 3]) {
+                k = ++c;
+                up = true;
+            } else if (p < (double)c + kEdgeOffset[c & 3]) {
+                k = c--;
+                up = false;
+            } else {
+                break;
+            }
+            if (!r.edge_mode) {
+                continue;   // timing interrupt off
+            }
+            uint32_t t_edge = CLOCK_START_US + us + rng_next() % 6u;
+            if (!a_only) {
+                encoder_edge_log_record(&log, t_edge, (uint32_t)c << 2);
+            } else if ((k & 1) == 0) {
+                timing_n += up ? 8u : (uint32_t)-8;
+                encoder_edge_log_record(&log, t_edge, timing_n);
+            }
+        }
+
+        if (us + SIM_STEP_US < next_update) {
+            continue;
+        }
+        next_update += PERIOD_US;
+
+        // Odometry task
+        double t_now = (us + SIM_STEP_US) * 1e-6;
+        bool was_edge = r.edge_mode;
+        float rate = encoder_rate_update(&r, &log, CLOCK_START_US + us + SIM_STEP_US,
+                                         (uint32_t)c << 2);
+        double count_rate = (double)(c - last_c) * 1e6 / PERIOD_US;
+        last_c = c;
+        if (r.edge_mode != was_edge) {
+            (*switches)++;
+        }
+
+        if (t_now > STOP_AT && stop_ms[0] < 0 && fabs(count_rate) < 1.0) {
+            stop_ms[0] = (t_now - STOP_AT) * 1e3;
+        }
+        if (t_now > STOP_AT && stop_ms[1] < 0 && fabsf(rate) < 1.0f) {
+            stop_ms[1] = (t_now - STOP_AT) * 1e3;
+        }
+
+        double truth = speed_at(t_now);
+        for (size_t w = 0; w < WINDOW_COUNT; w++) {
+            if (t_now >= kWindows[w].t0 && t_now < kWindows[w].t1) {
+                score_t *sc = &scores[w];
+                sc->sq_count += (count_rate - truth) * (count_rate - truth);
+                sc->sq_edge += (rate - truth) * (rate - truth);
+                if (fabs(rate - truth) > sc->max_abs_edge) {
+                    sc->max_abs_edge = fabs(rate - truth);
+                }
+                sc->samples++;
+                sc->timed += r.timed ? 1 : 0;
+            }
+        }
+    }
+}
+
+static bool report(const char *name, bool a_only) {
+    score_t scores[WINDOW_COUNT];
+    int switches;
+    double stop_ms[2];
+    run(a_only, scores, &switches, stop_ms);
+
+    printf("%s\n", name);
+    printf("  %-14s %16s %16s %8s\n", "segment", "counts/period", "edge-timed", "timed");
+    printf("  %-14s %16s %16s\n", "", "rms (counts/s)", "rms (counts/s)");
+    for (size_t w = 0; w < WINDOW_COUNT; w++) {
+        const score_t *sc = &scores[w];
+        printf("  %-14s %16.2f %16.2f %5d/%-3d\n", kWindows[w].name,
+               sqrt(sc->sq_count / sc->samples), sqrt(sc->sq_edge / sc->samples), sc->timed,
+               sc->samples);
+    }
+    printf("  mode switches: %d, stop seen after %.0f ms (counts), %.0f ms (edge-timed)\n",
+           switches, stop_ms[0], stop_ms[1]);
+
+    const score_t *crawl = &scores[W_CRAWL];
+    const score_t *slow = &scores[W_SLOW];
+    const score_t *rev = &scores[W_REVERSE];
+    bool better = crawl->sq_edge * 4.0 < crawl->sq_count && slow->sq_edge * 4.0 < slow->sq_count &&
+                  rev->sq_edge * 4.0 < rev->sq_count;
+    const score_t *fast = &scores[W_FAST];
+    bool counts_fast = fast->timed == 0 && fabs(sqrt(fast->sq_edge) - sqrt(fast->sq_count)) < 0.01;
+    bool zero = scores[W_STANDSTILL].max_abs_edge == 0.0 && scores[W_STOPPED].max_abs_edge == 0.0;
+    bool ok = better && counts_fast && zero && switches == 2;
+    printf("  edge timing halves the error at low speed: %s, counts at high speed: %s, "
+           "stopped reads 0: %s, 2 switches: %s\n\n", better ? "yes" : "NO",
+           counts_fast ? "yes" : "NO", zero ? "yes" : "NO", switches == 2 ? "yes" : "NO");
+    return ok;
+}
+
+int main(void) {
+    bool ok = report("x4: every edge timed (ISR backend)", false);
+    ok = report("A: channel A edges timed (PCNT backend)", true) && ok;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
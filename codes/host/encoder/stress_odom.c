@@ -0,0 +1,230 @@
+//=============================================================================================
+// stress_odom.c
+//=============================================================================================
+//
+// Hammers the two handoffs of the odometry from threads:
+//
+//   counts    an "ISR" thread decodes a random quadrature walk (encoder_decode.h) as
+//             fast as it can while a "task" thread loads the state word once per pass
+//             and sums the differences. The sum must equal the walk's final count.
+//             The former pattern (read the counter for the delta, read it again for
+//             the next period) runs on the same edges and reports how many it lost.
+//   pose      one writer publishes poses whose fields all derive from the update number
+//             (odom_pose.h over seqlock.h) while reader threads read them back. Every
+//             read must hold the fields of a single update, and update numbers must
+//             never go back.
+//
+// Usage: stress_odom [--edges N] [--updates N] [--readers N]
+// Exits 1 if a check fails. Build with -fsanitize=thread to also check for data races.
+//
+//=============================================================================================
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_clock.h"
+#include "encoder_decode.h"
+#include "odom_pose.h"
+
+#define DEFAULT_EDGES   50000000u
+#define DEFAULT_UPDATES 2000000u    // fields stay exact in float below 2^24
+#define DEFAULT_READERS 3u
+#define MAX_READERS     16u
+
+//-------------------------------------------------------------------------------------------
+// Counts
+
+typedef struct {
+    size_t edges;
+    encoder_decoder_t dec;
+    int32_t plain_count;            // counter of the former ISR (atomic accesses only)
+    int64_t expected;
+    int done;
+} counts_ctx_t;
+
+// Gray sequence of the forward direction: 00 -> 01 -> 11 -> 10
+static const uint32_t kForward[4] = { 0u, 1u, 3u, 2u };
+
+static void *isr_thread(void *arg) {
+    counts_ctx_t *ctx = (counts_ctx_t *)arg;
+    unsigned long long rng = 7;
+    uint32_t phase = 0;
+    int64_t expected = 0;
+    for (size_t i = 0; i < ctx->edges; i++) {
+        rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+        int step = ((rng >> 40) % 8u) < 5u ? 1 : -1;    // drifts forward
+        phase = (phase + (step > 0 ? 1u : 3u)) & 3u;
+        expected += step;
+        encoder_decode_edge(&ctx->dec, kForward[phase]);    // A on bit 1, B on bit 0
+        __atomic_fetch_add(&ctx->plain_count, step, __ATOMIC_RELAXED);
+    }
+    ctx->expected = expected;
+    __atomic_store_n(&ctx->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static bool check_counts(size_t edges) {
+    static counts_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.edges = edges;
+    encoder_decode_init(&ctx.dec, 1, 0, 0);
+
+    // Single load per period
+    int64_t total = 0;
+    uint32_t last = encoder_decode_load(&ctx.dec);
+
+    pthread_t isr;
+    pthread_create(&isr, NULL, isr_thread, &ctx);
+
+    // Former double read
+    int64_t former_total = 0;
+    int32_t former_last = 0;
+    size_t periods = 0;
+    bool finished = false;
+    while (!finished) {
+        finished = __atomic_load_n(&ctx.done, __ATOMIC_ACQUIRE) != 0;
+
+        uint32_t now = encoder_decode_load(&ctx.dec);
+        total += encoder_decode_count_delta(now, last);
+        last = now;
+
+        int32_t delta = __atomic_load_n(&ctx.plain_count, __ATOMIC_RELAXED) - former_last;
+        former_total += delta;
+        former_last = __atomic_load_n(&ctx.plain_count, __ATOMIC_RELAXED);
+        periods++;
+    }
+    pthread_join(isr, NULL);
+
+    bool ok = total == ctx.expected;
+    printf("counts: %zu edges, %zu periods, final %lld, single load %lld: %s\n", edges, periods,
+           (long long)ctx.expected, (long long)total, ok ? "PASS" : "FAIL");
+    printf("        former double read: %lld (%lld edges lost)\n", (long long)former_total,
+           (long long)(ctx.expected - former_total));
+    return ok;
+}
+
+//-------------------------------------------------------------------------------------------
+// Pose
+
+typedef struct {
+    odom_pose_snapshot_t snap;
+    uint32_t updates;
+    int writer_done;
+} pose_ctx_t;
+
+typedef struct {
+    pose_ctx_t *ctx;
+    uint64_t reads;
+    uint64_t torn;
+    uint64_t backwards;
+    uint32_t last_update;
+} reader_t;
+
+static void make_pose(uint32_t k, odom_pose_t *p) {
+    p->x = (float)k;
+    p->y = -(float)k;
+    p->theta = (float)k * 0.5f;
+    p->v = (float)k + 1.0f;
+    p->omega = (float)k + 2.0f;
+    p->stamp_us = (int64_t)k * 100000;
+}
+
+static void *writer_thread(void *arg) {
+    pose_ctx_t *ctx = (pose_ctx_t *)arg;
+    for (uint32_t k = 1; k <= ctx->updates; k++) {
+        odom_pose_t p;
+        make_pose(k, &p);
+        odom_pose_publish(&ctx->snap, &p);
+    }
+    __atomic_store_n(&ctx->writer_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *reader_thread(void *arg) {
+    reader_t *r = (reader_t *)arg;
+    bool finished = false;
+    while (!finished) {
+        finished = __atomic_load_n(&r->ctx->writer_done, __ATOMIC_ACQUIRE) != 0;
+        odom_pose_t p;
+        uint32_t update = odom_pose_read(&r->ctx->snap, &p);
+        odom_pose_t want;
+        make_pose(update, &want);
+        if (update == 0) {
+            memset(&want, 0, sizeof(want));
+        }
+        if (memcmp(&p, &want, sizeof(p)) != 0) {
+            r->torn++;
+        }
+        if (update < r->last_update) {
+            r->backwards++;
+        }
+        r->last_update = update;
+        r->reads++;
+    }
+    return NULL;
+}
+
+static bool check_pose(uint32_t updates, unsigned readers) {
+    static pose_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.updates = updates;
+
+    reader_t r[MAX_READERS];
+    pthread_t rt[MAX_READERS];
+    memset(r, 0, sizeof(r));
+    for (unsigned i = 0; i < readers; i++) {
+        r[i].ctx = &ctx;
+        pthread_create(&rt[i], NULL, reader_thread, &r[i]);
+    }
+    pthread_t wt;
+    uint64_t t0 = bench_now_ns();
+    pthread_create(&wt, NULL, writer_thread, &ctx);
+    pthread_join(wt, NULL);
+    uint64_t t1 = bench_now_ns();
+
+    uint64_t reads = 0, torn = 0, backwards = 0;
+    bool saw_last = false;
+    for (unsigned i = 0; i < readers; i++) {
+        pthread_join(rt[i], NULL);
+        reads += r[i].reads;
+        torn += r[i].torn;
+        backwards += r[i].backwards;
+        saw_last = saw_last || r[i].last_update == updates;
+    }
+
+    bool ok = torn == 0 && backwards == 0 && saw_last;
+    printf("pose: %u updates (%.0f ns each), %u readers, %llu reads, %llu torn, "
+           "%llu out of order: %s\n", updates, (double)(t1 - t0) / updates, readers,
+           (unsigned long long)reads, (unsigned long long)torn, (unsigned long long)backwards,
+           ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    size_t edges = DEFAULT_EDGES;
+    unsigned long updates = DEFAULT_UPDATES;
+    unsigned long readers = DEFAULT_READERS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--edges") == 0 && i + 1 < argc) {
+            edges = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--updates") == 0 && i + 1 < argc) {
+            updates = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--readers") == 0 && i + 1 < argc) {
+            readers = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--edges N] [--updates N] [--readers N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (updates == 0 || updates >= (1ul << 24) || readers == 0 || readers > MAX_READERS) {
+        fprintf(stderr, "--updates must be 1..%lu, --readers 1..%u\n", (1ul << 24) - 1,
+                MAX_READERS);
+        return 2;
+    }
+
+    bool ok = check_counts(edges);
+    ok = check_pose((uint32_t)updates, (unsigned)readers) && ok;
+    return ok ? 0 : 1;
+}
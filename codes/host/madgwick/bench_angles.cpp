@@ -0,0 +1,198 @@
+//=============================================================================================
+// bench_angles.cpp
+//=============================================================================================
+//
+// Checks the error bound of the fast atan2/asin used for the Euler angles
+// (MADGWICK_AHRS_FAST_ANGLES) against double precision libm, and times the quaternion to
+// Euler conversion with libm and with the polynomials. Exits 1 if an error exceeds
+// madgwick::fast_angle_max_error().
+//
+// Usage: bench_angles [--calls N]
+//
+//=============================================================================================
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "bench_clock.h"
+#include "madgwick_ahrs.h"
+#include "madgwick_ahrs.hpp"
+
+#define DEFAULT_CALLS   2000000u
+#define SWEEP_STEPS     2000000
+#define QUAT_COUNT      4096u
+#define RAD_TO_DEG      57.29577951308232
+
+using madgwick::Quaternion;
+
+namespace {
+
+double wrap_pi(double a) {
+    while (a > M_PI) a -= 2.0 * M_PI;
+    while (a < -M_PI) a += 2.0 * M_PI;
+    return a;
+}
+
+// Dense sweep over every direction at several radii
+double atan2_max_error() {
+    const float radii[] = { 1.0f, 0.3f, 1e-3f, 1e3f };
+    double max_err = 0.0;
+    for (float r : radii) {
+        for (int i = 0; i < SWEEP_STEPS; i++) {
+            double a = i * (2.0 * M_PI / SWEEP_STEPS) - M_PI;
+            float x = r * (float)cos(a);
+            float y = r * (float)sin(a);
+            double err = fabs(wrap_pi(madgwick::fast_atan2(y, x) - atan2((double)y, (double)x)));
+            if (err > max_err) max_err = err;
+        }
+    }
+    return max_err;
+}
+
+double asin_max_error() {
+    double max_err = 0.0;
+    for (int i = -SWEEP_STEPS; i <= SWEEP_STEPS; i++) {
+        float x = (float)i / SWEEP_STEPS;
+        double err = fabs(madgwick::fast_asin(x) - asin((double)x));
+        if (err > max_err) max_err = err;
+    }
+    return max_err;
+}
+
+// Deterministic, roughly uniform unit quaternions
+std::vector<Quaternion<float>> make_quaternions(size_t count) {
+    std::vector<Quaternion<float>> out;
+    unsigned long long state = 12345;
+    while (out.size() < count) {
+        double v[4];
+        double norm = 0.0;
+        for (double &c : v) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            c = ((state >> 11) / 9007199254740992.0) * 2.0 - 1.0;
+            norm += c * c;
+        }
+        if (norm > 1.0 || norm < 1e-6) continue;
+        norm = sqrt(norm);
+        Quaternion<float> q = { (float)(v[0] / norm), (float)(v[1] / norm),
+                                (float)(v[2] / norm), (float)(v[3] / norm) };
+        out.push_back(q);
+    }
+    return out;
+}
+
+template <bool Fast>
+double time_euler(const std::vector<Quaternion<float>> &quats, size_t calls, double *cycles) {
+    float acc = 0.0f;
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    size_t pos = 0;
+    for (size_t n = 0; n < calls; n++) {
+        float roll, pitch, yaw;
+        madgwick::euler_angles<Fast>(quats[pos], roll, pitch, yaw);
+        acc += roll + pitch + yaw;
+        if (++pos == quats.size()) pos = 0;
+    }
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+    bench_consume_float(acc);
+    *cycles = (double)(c1 - c0) / calls;
+    return (double)(t1 - t0) / calls;
+}
+
+// Three getters (one angle computation, cached) against one madgwick_ahrs_get_euler()
+double time_c_api(const std::vector<Quaternion<float>> &quats, size_t calls, bool combined,
+                  double *cycles) {
+    madgwick_ahrs_t filter;
+    madgwick_ahrs_init(&filter);
+    float acc = 0.0f;
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    size_t pos = 0;
+    for (size_t n = 0; n < calls; n++) {
+        filter.q0 = quats[pos].q0;
+        filter.q1 = quats[pos].q1;
+        filter.q2 = quats[pos].q2;
+        filter.q3 = quats[pos].q3;
+        filter.anglesComputed = 0;
+        if (combined) {
+            float roll, pitch, yaw;
+            madgwick_ahrs_get_euler(&filter, &roll, &pitch, &yaw);
+            acc += roll + pitch + yaw;
+        } else {
+            acc += madgwick_ahrs_get_roll(&filter) + madgwick_ahrs_get_pitch(&filter) +
+                   madgwick_ahrs_get_yaw(&filter);
+        }
+        if (++pos == quats.size()) pos = 0;
+    }
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+    bench_consume_float(acc);
+    *cycles = (double)(c1 - c0) / calls;
+    return (double)(t1 - t0) / calls;
+}
+
+void report(const char *name, double ns, double cycles) {
+    if (BENCH_HAVE_CYCLES) {
+        printf("%-34s %8.1f ns/call  %8.1f cycles/call\n", name, ns, cycles);
+    } else {
+        printf("%-34s %8.1f ns/call\n", name, ns);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t calls = DEFAULT_CALLS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--calls N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (calls == 0) {
+        fprintf(stderr, "nothing to benchmark\n");
+        return 1;
+    }
+
+    const double bound = madgwick::fast_angle_max_error();
+    double atan2_err = atan2_max_error();
+    double asin_err = asin_max_error();
+
+    std::vector<Quaternion<float>> quats = make_quaternions(QUAT_COUNT);
+    double euler_err = 0.0;
+    for (const Quaternion<float> &q : quats) {
+        float r0, p0, y0, r1, p1, y1;
+        madgwick::euler_angles<false>(q, r0, p0, y0);
+        madgwick::euler_angles<true>(q, r1, p1, y1);
+        double e[3] = { fabs(wrap_pi(r1 - r0)), fabs(p1 - p0), fabs(wrap_pi(y1 - y0)) };
+        for (double v : e) {
+            if (v > euler_err) euler_err = v;
+        }
+    }
+
+    printf("fast_atan2 max error: %.2e rad (%.5f deg)\n", atan2_err, atan2_err * RAD_TO_DEG);
+    printf("fast_asin  max error: %.2e rad (%.5f deg)\n", asin_err, asin_err * RAD_TO_DEG);
+    printf("Euler angles, fast vs libm float: %.2e rad (%.5f deg) over %zu quaternions\n",
+           euler_err, euler_err * RAD_TO_DEG, quats.size());
+    bool ok = atan2_err <= bound && asin_err <= bound;
+    printf("documented bound %.0e rad: %s\n\n", bound, ok ? "PASS" : "FAIL");
+
+    double cycles;
+    double ns = time_euler<false>(quats, calls, &cycles);
+    report("euler_angles<libm>", ns, cycles);
+    double ns_fast = time_euler<true>(quats, calls, &cycles);
+    report("euler_angles<fast>", ns_fast, cycles);
+    printf("speedup: %.2fx\n", ns / ns_fast);
+
+    ns = time_c_api(quats, calls, false, &cycles);
+    report("get_roll + get_pitch + get_yaw", ns, cycles);
+    ns = time_c_api(quats, calls, true, &cycles);
+    report("madgwick_ahrs_get_euler", ns, cycles);
+    printf("(C API built with MADGWICK_AHRS_FAST_ANGLES=%d)\n", MADGWICK_AHRS_FAST_ANGLES);
+
+    return ok ? 0 : 1;
+}
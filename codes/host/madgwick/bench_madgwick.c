@@ -0,0 +1,225 @@
+//=============================================================================================
+// bench_madgwick.c
+//=============================================================================================
+//
+// Measures the cost of one madgwick_ahrs_update / madgwick_ahrs_update_imu call on the
+// host. The samples come from a recorded log so that the branches taken inside the
+// filter match real data.
+//
+// Usage: bench_madgwick [log.csv|log.bin] [--calls N] [--block N]
+//
+//=============================================================================================
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_clock.h"
+#include "imu_log.h"
+#include "madgwick_ahrs.h"
+
+#ifndef HOST_DATA_DIR
+#define HOST_DATA_DIR "data"
+#endif
+
+#define DEFAULT_LOG     HOST_DATA_DIR "/imu_synthetic.csv"
+#define DEFAULT_CALLS   2000000u
+#define DEFAULT_BLOCK   32u
+
+typedef struct {
+    double ns_per_call;
+    double cycles_per_call;
+} bench_result_t;
+
+static void consume_quat(const madgwick_ahrs_t *filter) {
+    float q0, q1, q2, q3;
+    madgwick_ahrs_get_quaternion(filter, &q0, &q1, &q2, &q3);
+    bench_consume_float(q0 + q1 + q2 + q3);
+}
+
+static void report(const char *name, const bench_result_t *r) {
+    if (BENCH_HAVE_CYCLES) {
+        printf("%-28s %9.1f ns/call  %9.1f cycles/call\n", name, r->ns_per_call, r->cycles_per_call);
+    } else {
+        printf("%-28s %9.1f ns/call\n", name, r->ns_per_call);
+    }
+}
+
+static bench_result_t bench_update(const imu_log_t *log, size_t calls) {
+    madgwick_ahrs_t filter;
+    madgwick_ahrs_init(&filter);
+    madgwick_ahrs_begin(&filter, 100.0f);
+
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    for (size_t n = 0; n < calls; n++) {
+        const imu_log_sample_t *s = &log->samples[n % log->count];
+        madgwick_ahrs_update(&filter, s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+    }
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+    consume_quat(&filter);
+
+    bench_result_t r = { (double)(t1 - t0) / calls, (double)(c1 - c0) / calls };
+    return r;
+}
+
+static bench_result_t bench_update_imu(const imu_log_t *log, size_t calls) {
+    madgwick_ahrs_t filter;
+    madgwick_ahrs_init(&filter);
+    madgwick_ahrs_begin(&filter, 100.0f);
+
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    for (size_t n = 0; n < calls; n++) {
+        const imu_log_sample_t *s = &log->samples[n % log->count];
+        madgwick_ahrs_update_imu(&filter, s->gx, s->gy, s->gz, s->ax, s->ay, s->az);
+    }
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+    consume_quat(&filter);
+
+    bench_result_t r = { (double)(t1 - t0) / calls, (double)(c1 - c0) / calls };
+    return r;
+}
+
+// Structure-of-arrays copy of a log for the batch API
+typedef struct {
+    float *gx, *gy, *gz, *ax, *ay, *az, *mx, *my, *mz;
+    size_t count;
+} soa_log_t;
+
+static int soa_from_log(const imu_log_t *log, soa_log_t *soa) {
+    float **cols[9] = { &soa->gx, &soa->gy, &soa->gz, &soa->ax, &soa->ay, &soa->az,
+                        &soa->mx, &soa->my, &soa->mz };
+    memset(soa, 0, sizeof(*soa));
+    soa->count = log->count;
+    for (int c = 0; c < 9; c++) {
+        *cols[c] = malloc(log->count * sizeof(float));
+        if (*cols[c] == NULL) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < log->count; i++) {
+        const imu_log_sample_t *s = &log->samples[i];
+        soa->gx[i] = s->gx; soa->gy[i] = s->gy; soa->gz[i] = s->gz;
+        soa->ax[i] = s->ax; soa->ay[i] = s->ay; soa->az[i] = s->az;
+        soa->mx[i] = s->mx; soa->my[i] = s->my; soa->mz[i] = s->mz;
+    }
+    return 0;
+}
+
+static void soa_free(soa_log_t *soa) {
+    free(soa->gx); free(soa->gy); free(soa->gz);
+    free(soa->ax); free(soa->ay); free(soa->az);
+    free(soa->mx); free(soa->my); free(soa->mz);
+}
+
+static bench_result_t bench_update_batch(const soa_log_t *soa, size_t calls, size_t block, bool with_mag,
+                                         madgwick_ahrs_t *filter) {
+    madgwick_ahrs_init(filter);
+    madgwick_ahrs_begin(filter, 100.0f);
+
+    size_t done = 0;
+    size_t pos = 0;
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    while (done < calls) {
+        size_t n = block;
+        if (n > soa->count - pos) n = soa->count - pos;
+        if (n > calls - done) n = calls - done;
+        madgwick_ahrs_batch_t batch = {
+            .gx = soa->gx + pos, .gy = soa->gy + pos, .gz = soa->gz + pos,
+            .ax = soa->ax + pos, .ay = soa->ay + pos, .az = soa->az + pos,
+            .mx = with_mag ? soa->mx + pos : NULL,
+            .my = with_mag ? soa->my + pos : NULL,
+            .mz = with_mag ? soa->mz + pos : NULL,
+            .dt = NULL,
+        };
+        madgwick_ahrs_update_batch(filter, &batch, n);
+        done += n;
+        pos += n;
+        if (pos == soa->count) pos = 0;
+    }
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+    consume_quat(filter);
+
+    bench_result_t r = { (double)(t1 - t0) / calls, (double)(c1 - c0) / calls };
+    return r;
+}
+
+int main(int argc, char **argv) {
+    const char *log_path = DEFAULT_LOG;
+    size_t calls = DEFAULT_CALLS;
+    size_t block = DEFAULT_BLOCK;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--block") == 0 && i + 1 < argc) {
+            block = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-') {
+            log_path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [log.csv|log.bin] [--calls N] [--block N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    imu_log_t log;
+    if (imu_log_load(log_path, &log) != 0) {
+        return 1;
+    }
+    if (log.count == 0 || calls == 0 || block == 0) {
+        fprintf(stderr, "nothing to benchmark\n");
+        imu_log_free(&log);
+        return 1;
+    }
+
+    printf("log: %s (%zu samples), %zu calls per case, %s engine\n", log_path, log.count, calls,
+           MADGWICK_AHRS_FIXED_POINT ? "Q1.30 fixed-point" : "float");
+
+    // Warm up caches and the branch predictor
+    bench_update(&log, calls / 10 + 1);
+
+    bench_result_t r = bench_update(&log, calls);
+    report("madgwick_ahrs_update", &r);
+    r = bench_update_imu(&log, calls);
+    report("madgwick_ahrs_update_imu", &r);
+
+    soa_log_t soa;
+    if (soa_from_log(&log, &soa) != 0) {
+        fprintf(stderr, "out of memory\n");
+        soa_free(&soa);
+        imu_log_free(&log);
+        return 1;
+    }
+
+    char name[64];
+    madgwick_ahrs_t batch_filter;
+    snprintf(name, sizeof(name), "update_batch (block %zu)", block);
+    r = bench_update_batch(&soa, calls, block, true, &batch_filter);
+    report(name, &r);
+    snprintf(name, sizeof(name), "update_batch imu (block %zu)", block);
+    r = bench_update_batch(&soa, calls, block, false, &batch_filter);
+    report(name, &r);
+
+    // The batch path must produce exactly what per-sample calls produce
+    madgwick_ahrs_t single;
+    madgwick_ahrs_init(&single);
+    madgwick_ahrs_begin(&single, 100.0f);
+    for (size_t i = 0; i < log.count; i++) {
+        const imu_log_sample_t *s = &log.samples[i];
+        madgwick_ahrs_update(&single, s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+    }
+    bench_update_batch(&soa, log.count, block, true, &batch_filter);
+    bool match = single.q0 == batch_filter.q0 && single.q1 == batch_filter.q1 &&
+                 single.q2 == batch_filter.q2 && single.q3 == batch_filter.q3;
+    printf("batch vs per-sample result: %s\n", match ? "identical" : "MISMATCH");
+
+    soa_free(&soa);
+
+    imu_log_free(&log);
+    return match ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+//=============================================================================================
+// bench_madgwick_cpp.cpp
+//=============================================================================================
+//
+// Compares the C API with the madgwick_ahrs.hpp instantiations used directly, as a
+// sensor task written in C++ would. The MARG case only uses samples with a valid
+// magnetometer reading (the template does not fall back to the IMU path by itself)
+// and the Radians case is fed gyroscope data converted beforehand.
+//
+// Usage: bench_madgwick_cpp [log.csv|log.bin] [--calls N]
+//
+//=============================================================================================
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "bench_clock.h"
+#include "imu_log.h"
+#include "madgwick_ahrs.h"
+#include "madgwick_ahrs.hpp"
+
+#ifndef HOST_DATA_DIR
+#define HOST_DATA_DIR "data"
+#endif
+
+#define DEFAULT_LOG     HOST_DATA_DIR "/imu_synthetic.csv"
+#define DEFAULT_CALLS   2000000u
+#define SAMPLE_RATE     100.0f
+
+using madgwick::Madgwick;
+using madgwick::Mode;
+using madgwick::Units;
+
+namespace {
+
+struct bench_result_t {
+    double ns_per_call;
+    double cycles_per_call;
+};
+
+void report(const char *name, const bench_result_t &r) {
+    if (BENCH_HAVE_CYCLES) {
+        printf("%-36s %9.1f ns/call  %9.1f cycles/call\n", name, r.ns_per_call, r.cycles_per_call);
+    } else {
+        printf("%-36s %9.1f ns/call\n", name, r.ns_per_call);
+    }
+}
+
+// Times body(sample) over calls samples taken round-robin from the log
+template <typename Body>
+bench_result_t run(const std::vector<imu_log_sample_t> &samples, size_t calls, Body body) {
+    uint64_t c0 = bench_cycles();
+    uint64_t t0 = bench_now_ns();
+    size_t pos = 0;
+    for (size_t n = 0; n < calls; n++) {
+        body(samples[pos]);
+        if (++pos == samples.size()) pos = 0;
+    }
+    uint64_t t1 = bench_now_ns();
+    uint64_t c1 = bench_cycles();
+    bench_result_t r = { (double)(t1 - t0) / calls, (double)(c1 - c0) / calls };
+    return r;
+}
+
+bool same(const madgwick_ahrs_t &c, const Madgwick<Mode::Marg>::quat_type &q) {
+    return c.q0 == q.q0 && c.q1 == q.q1 && c.q2 == q.q2 && c.q3 == q.q3;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *log_path = DEFAULT_LOG;
+    size_t calls = DEFAULT_CALLS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-') {
+            log_path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [log.csv|log.bin] [--calls N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    imu_log_t log;
+    if (imu_log_load(log_path, &log) != 0) {
+        return 1;
+    }
+
+    std::vector<imu_log_sample_t> all(log.samples, log.samples + log.count);
+    std::vector<imu_log_sample_t> marg;
+    for (const imu_log_sample_t &s : all) {
+        if (s.mx != 0.0f || s.my != 0.0f || s.mz != 0.0f) {
+            marg.push_back(s);
+        }
+    }
+    imu_log_free(&log);
+    if (all.empty() || marg.empty() || calls == 0) {
+        fprintf(stderr, "nothing to benchmark\n");
+        return 1;
+    }
+
+    printf("log: %s (%zu samples, %zu with magnetometer), %zu calls per case\n",
+           log_path, all.size(), marg.size(), calls);
+
+    madgwick_ahrs_t c_filter;
+    madgwick_ahrs_init(&c_filter);
+    madgwick_ahrs_begin(&c_filter, SAMPLE_RATE);
+    bench_result_t r = run(marg, calls, [&](const imu_log_sample_t &s) {
+        madgwick_ahrs_update(&c_filter, s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.mx, s.my, s.mz);
+    });
+    report("madgwick_ahrs_update (C API)", r);
+
+    Madgwick<Mode::Marg> marg_filter(SAMPLE_RATE);
+    r = run(marg, calls, [&](const imu_log_sample_t &s) {
+        marg_filter.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.mx, s.my, s.mz);
+    });
+    report("Madgwick<Marg>::update", r);
+    bool marg_match = same(c_filter, marg_filter.quaternion());
+
+    madgwick_ahrs_init(&c_filter);
+    madgwick_ahrs_begin(&c_filter, SAMPLE_RATE);
+    r = run(all, calls, [&](const imu_log_sample_t &s) {
+        madgwick_ahrs_update_imu(&c_filter, s.gx, s.gy, s.gz, s.ax, s.ay, s.az);
+    });
+    report("madgwick_ahrs_update_imu (C API)", r);
+
+    Madgwick<Mode::Imu> imu_filter(SAMPLE_RATE);
+    r = run(all, calls, [&](const imu_log_sample_t &s) {
+        imu_filter.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az);
+    });
+    report("Madgwick<Imu>::update", r);
+    bool imu_match = same(c_filter, imu_filter.quaternion());
+
+    // Gyroscope already in rad/s, e.g. straight from a driver that scales to SI units
+    std::vector<imu_log_sample_t> rad = marg;
+    for (imu_log_sample_t &s : rad) {
+        s.gx *= Madgwick<Mode::Marg>::gyro_scale();
+        s.gy *= Madgwick<Mode::Marg>::gyro_scale();
+        s.gz *= Madgwick<Mode::Marg>::gyro_scale();
+    }
+    Madgwick<Mode::Marg, Units::Radians> rad_filter(SAMPLE_RATE);
+    r = run(rad, calls, [&](const imu_log_sample_t &s) {
+        rad_filter.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.mx, s.my, s.mz);
+    });
+    report("Madgwick<Marg, Radians>::update", r);
+    const Madgwick<Mode::Marg>::quat_type &q = rad_filter.quaternion();
+    bench_consume_float(q.q0 + q.q1 + q.q2 + q.q3);
+
+    printf("template vs C API result: MARG %s, IMU %s\n",
+           marg_match ? "identical" : "MISMATCH", imu_match ? "identical" : "MISMATCH");
+    return (marg_match && imu_match) ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+//=============================================================================================
+// gen_imu_log.c
+//=============================================================================================
+//
+// Generates a deterministic synthetic 9-DOF log with a known reference orientation.
+// The rover starts tilted and still (so convergence from the identity quaternion can
+// be observed), then turns in place while rocking in roll and pitch.
+// Measurements follow the Madgwick conventions: a = q* (0,0,1) q, m = q* b q with
+// b = (bx, 0, bz), q_dot = 0.5 q (0, w).
+//
+// Usage: gen_imu_log <out.csv|out.bin> [--rate HZ] [--seconds S] [--seed N] [--mag-gap N]
+//                    [--jitter-us J] [--drop-every N]
+//   --mag-gap N     zero the magnetometer every N-th sample, as the firmware does when
+//                   the AK8963 reports "not ready"
+//   --jitter-us J   add uniform +-J µs of jitter to every sample time
+//   --drop-every N  leave out every N-th sample, as when the sensor task misses one
+//
+//=============================================================================================
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imu_log.h"
+
+#define DEG_TO_RAD  0.017453292519943295
+
+// Earth magnetic field in the navigation frame (µT)
+#define MAG_BX      22.0
+#define MAG_BZ      -12.0
+
+// Sensor imperfections
+#define GYRO_NOISE_DPS  0.05
+#define ACCEL_NOISE_G   0.004
+#define MAG_NOISE_UT    0.3
+static const double gyro_bias_dps[3] = { 0.30, -0.20, 0.10 };
+
+//-------------------------------------------------------------------------------------------
+// Deterministic noise source (independent from the host libc rand())
+
+static unsigned long long s_rng_state;
+
+static double rng_uniform(void) {
+    s_rng_state = s_rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return ((s_rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double rng_gauss(void) {
+    double u1 = rng_uniform();
+    double u2 = rng_uniform();
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+//-------------------------------------------------------------------------------------------
+// Quaternion helpers
+
+static void quat_mul(const double a[4], const double b[4], double out[4]) {
+    double r0 = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+    double r1 = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+    double r2 = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+    double r3 = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+    out[0] = r0; out[1] = r1; out[2] = r2; out[3] = r3;
+}
+
+// Express a navigation frame vector in the sensor frame: q* (0, v) q
+static void rotate_to_sensor(const double q[4], const double v[3], double out[3]) {
+    double qc[4] = { q[0], -q[1], -q[2], -q[3] };
+    double pv[4] = { 0.0, v[0], v[1], v[2] };
+    double tmp[4], res[4];
+    quat_mul(qc, pv, tmp);
+    quat_mul(tmp, q, res);
+    out[0] = res[1]; out[1] = res[2]; out[2] = res[3];
+}
+
+static void quat_from_euler(double roll, double pitch, double yaw, double q[4]) {
+    double cr = cos(roll * 0.5), sr = sin(roll * 0.5);
+    double cp = cos(pitch * 0.5), sp = sin(pitch * 0.5);
+    double cy = cos(yaw * 0.5), sy = sin(yaw * 0.5);
+    q[0] = cr * cp * cy + sr * sp * sy;
+    q[1] = sr * cp * cy - cr * sp * sy;
+    q[2] = cr * sp * cy + sr * cp * sy;
+    q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+// True body rate profile (deg/s)
+static void body_rate(double t, double w[3]) {
+    if (t < 2.0) {
+        w[0] = w[1] = w[2] = 0.0;
+        return;
+    }
+    t -= 2.0;
+    w[0] = 15.0 * sin(2.0 * M_PI * 0.35 * t);
+    w[1] = 10.0 * sin(2.0 * M_PI * 0.21 * t + 0.6);
+    w[2] = 45.0 * sin(2.0 * M_PI * 0.08 * t) + 10.0;
+}
+
+//-------------------------------------------------------------------------------------------
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s <out.csv|out.bin> [--rate HZ] [--seconds S] [--seed N] [--mag-gap N]\n"
+                    "          [--jitter-us J] [--drop-every N]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const char *out_path = argv[1];
+    double rate = 100.0;
+    double seconds = 10.0;
+    unsigned long long seed = 1;
+    int mag_gap = 0;
+    double jitter_us = 0.0;
+    int drop_every = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mag-gap") == 0 && i + 1 < argc) {
+            mag_gap = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--jitter-us") == 0 && i + 1 < argc) {
+            jitter_us = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--drop-every") == 0 && i + 1 < argc) {
+            drop_every = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (rate <= 0.0 || seconds <= 0.0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    s_rng_state = seed;
+
+    imu_log_t log;
+    size_t slots = (size_t)(rate * seconds);
+    log.count = 0;
+    log.has_truth = true;
+    log.samples = calloc(slots ? slots : 1, sizeof(imu_log_sample_t));
+    if (log.samples == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    const double dt = 1.0 / rate;
+    const double gravity[3] = { 0.0, 0.0, 1.0 };
+    const double field[3] = { MAG_BX, 0.0, MAG_BZ };
+    double q[4];
+    quat_from_euler(10.0 * DEG_TO_RAD, -5.0 * DEG_TO_RAD, 30.0 * DEG_TO_RAD, q);
+
+    double t_prev = 0.0;
+    for (size_t i = 0; i < slots; i++) {
+        if (drop_every > 0 && (i % (size_t)drop_every) == (size_t)(drop_every - 1)) {
+            continue;
+        }
+        double t = i * dt;
+        if (jitter_us > 0.0 && i > 0) {
+            t += (2.0 * rng_uniform() - 1.0) * jitter_us * 1e-6;
+        }
+
+        // Propagate the true orientation from the previous sample with a few sub-steps
+        const int substeps = 10;
+        double h = (t - t_prev) / substeps;
+        for (int k = 0; k < substeps; k++) {
+            double wr[3];
+            body_rate(t_prev + k * h, wr);
+            double pw[4] = { 0.0, wr[0] * DEG_TO_RAD, wr[1] * DEG_TO_RAD, wr[2] * DEG_TO_RAD };
+            double qdot[4];
+            quat_mul(q, pw, qdot);
+            double norm = 0.0;
+            for (int j = 0; j < 4; j++) {
+                q[j] += 0.5 * qdot[j] * h;
+                norm += q[j] * q[j];
+            }
+            norm = 1.0 / sqrt(norm);
+            for (int j = 0; j < 4; j++) {
+                q[j] *= norm;
+            }
+        }
+        t_prev = t;
+
+        double w[3], a[3], m[3];
+        body_rate(t, w);
+        rotate_to_sensor(q, gravity, a);
+        rotate_to_sensor(q, field, m);
+
+        imu_log_sample_t *s = &log.samples[log.count++];
+        s->t_us = (int64_t)llround(t * 1e6);
+        s->gx = (float)(w[0] + gyro_bias_dps[0] + GYRO_NOISE_DPS * rng_gauss());
+        s->gy = (float)(w[1] + gyro_bias_dps[1] + GYRO_NOISE_DPS * rng_gauss());
+        s->gz = (float)(w[2] + gyro_bias_dps[2] + GYRO_NOISE_DPS * rng_gauss());
+        s->ax = (float)(a[0] + ACCEL_NOISE_G * rng_gauss());
+        s->ay = (float)(a[1] + ACCEL_NOISE_G * rng_gauss());
+        s->az = (float)(a[2] + ACCEL_NOISE_G * rng_gauss());
+        if (mag_gap > 0 && (i % (size_t)mag_gap) == (size_t)(mag_gap - 1)) {
+            s->mx = s->my = s->mz = 0.0f;
+        } else {
+            s->mx = (float)(m[0] + MAG_NOISE_UT * rng_gauss());
+            s->my = (float)(m[1] + MAG_NOISE_UT * rng_gauss());
+            s->mz = (float)(m[2] + MAG_NOISE_UT * rng_gauss());
+        }
+        s->q0 = (float)q[0];
+        s->q1 = (float)q[1];
+        s->q2 = (float)q[2];
+        s->q3 = (float)q[3];
+    }
+
+    int ret = imu_log_save(out_path, &log);
+    if (ret == 0) {
+        printf("wrote %zu samples (%.1f s @ %.1f Hz) to %s\n", log.count, seconds, rate, out_path);
+    }
+    imu_log_free(&log);
+    return ret == 0 ? 0 : 1;
+}
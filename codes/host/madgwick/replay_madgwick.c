@@ -0,0 +1,178 @@
+//=============================================================================================
+// replay_madgwick.c
+//=============================================================================================
+//
+// Feeds a recorded 9-DOF log through the madgwick_ahrs C API exactly like mpu_task does
+// (MARG update when the magnetometer is valid, IMU update otherwise) and either
+// records the resulting quaternion trace or checks it against a golden trace.
+//
+// Usage: replay_madgwick <log.csv|log.bin> [--rate HZ] [--beta B] [--imu-only] [--timestamps]
+//                        [--out trace.csv] [--check golden.csv] [--tol DEG]
+//   --timestamps  integrate over the intervals between the log timestamps
+//                 (madgwick_ahrs_update_timestamped) instead of the fixed --rate period
+//   --check   compare every sample against the golden trace; exits 1 when the
+//             rotation between the two quaternions exceeds --tol degrees
+//
+//=============================================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imu_log.h"
+#include "madgwick_ahrs.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s <log.csv|log.bin> [--rate HZ] [--beta B] [--imu-only] [--timestamps]\n"
+                    "          [--out trace.csv] [--check golden.csv] [--tol DEG]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const char *log_path = argv[1];
+    const char *out_path = NULL;
+    const char *golden_path = NULL;
+    float rate = 100.0f;
+    float beta = -1.0f;
+    float tol_deg = 0.01f;
+    int imu_only = 0;
+    int timestamps = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--beta") == 0 && i + 1 < argc) {
+            beta = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--imu-only") == 0) {
+            imu_only = 1;
+        } else if (strcmp(argv[i], "--timestamps") == 0) {
+            timestamps = 1;
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+            golden_path = argv[++i];
+        } else if (strcmp(argv[i], "--tol") == 0 && i + 1 < argc) {
+            tol_deg = (float)atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    imu_log_t log;
+    if (imu_log_load(log_path, &log) != 0) {
+        return 1;
+    }
+
+    madgwick_ahrs_t filter;
+    madgwick_ahrs_init(&filter);
+    if (madgwick_ahrs_begin(&filter, rate) != ESP_OK) {
+        fprintf(stderr, "invalid sample rate %f\n", rate);
+        imu_log_free(&log);
+        return 2;
+    }
+    if (beta >= 0.0f) {
+        madgwick_ahrs_set_beta(&filter, beta);
+    }
+
+    quat_trace_t trace;
+    trace.count = log.count;
+    trace.samples = calloc(log.count ? log.count : 1, sizeof(quat_trace_sample_t));
+    if (trace.samples == NULL) {
+        fprintf(stderr, "out of memory\n");
+        imu_log_free(&log);
+        return 1;
+    }
+
+    float max_truth_err = 0.0f;
+    for (size_t i = 0; i < log.count; i++) {
+        const imu_log_sample_t *s = &log.samples[i];
+        int mag_valid = !imu_only && (s->mx != 0.0f || s->my != 0.0f || s->mz != 0.0f);
+        if (timestamps && mag_valid) {
+            madgwick_ahrs_update_timestamped(&filter, s->t_us, s->gx, s->gy, s->gz,
+                                             s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+        } else if (timestamps) {
+            madgwick_ahrs_update_imu_timestamped(&filter, s->t_us, s->gx, s->gy, s->gz, s->ax, s->ay, s->az);
+        } else if (mag_valid) {
+            madgwick_ahrs_update(&filter, s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+        } else {
+            madgwick_ahrs_update_imu(&filter, s->gx, s->gy, s->gz, s->ax, s->ay, s->az);
+        }
+
+        quat_trace_sample_t *q = &trace.samples[i];
+        q->t_us = s->t_us;
+        madgwick_ahrs_get_quaternion(&filter, &q->q0, &q->q1, &q->q2, &q->q3);
+
+        if (log.has_truth) {
+            float err = quat_angle_deg(q->q0, q->q1, q->q2, q->q3, s->q0, s->q1, s->q2, s->q3);
+            if (err > max_truth_err && i >= log.count / 2) {
+                max_truth_err = err;
+            }
+        }
+    }
+
+    printf("replayed %zu samples from %s (%s engine)\n", log.count, log_path,
+           MADGWICK_AHRS_FIXED_POINT ? "Q1.30 fixed-point" : "float");
+    if (log.count > 0) {
+        const quat_trace_sample_t *last = &trace.samples[log.count - 1];
+        printf("final q = [%.6f %.6f %.6f %.6f]  roll=%.2f pitch=%.2f yaw=%.2f deg\n",
+               last->q0, last->q1, last->q2, last->q3,
+               madgwick_ahrs_get_roll(&filter), madgwick_ahrs_get_pitch(&filter),
+               madgwick_ahrs_get_yaw(&filter));
+    }
+    if (timestamps) {
+        madgwick_ahrs_timing_t timing;
+        float jitter;
+        madgwick_ahrs_get_timing(&filter, &timing, &jitter);
+        printf("timing: mean dt %.3f ms (min %.3f, max %.3f), jitter %.3f ms, dropped %u, rejected %u\n",
+               timing.dtMean * 1e3f, timing.dtMin * 1e3f, timing.dtMax * 1e3f, jitter * 1e3f,
+               timing.dropped, timing.rejected);
+    }
+    if (log.has_truth) {
+        printf("max error vs reference (second half of log): %.3f deg\n", max_truth_err);
+    }
+
+    int ret = 0;
+    if (out_path != NULL) {
+        if (quat_trace_save(out_path, &trace) != 0) {
+            ret = 1;
+        } else {
+            printf("trace written to %s\n", out_path);
+        }
+    }
+
+    if (golden_path != NULL) {
+        quat_trace_t golden;
+        if (quat_trace_load(golden_path, &golden) != 0) {
+            ret = 1;
+        } else if (golden.count != trace.count) {
+            fprintf(stderr, "golden trace has %zu samples, replay produced %zu\n", golden.count, trace.count);
+            ret = 1;
+        } else {
+            float max_err = 0.0f;
+            size_t worst = 0;
+            for (size_t i = 0; i < trace.count; i++) {
+                const quat_trace_sample_t *a = &trace.samples[i];
+                const quat_trace_sample_t *b = &golden.samples[i];
+                float err = quat_angle_deg(a->q0, a->q1, a->q2, a->q3, b->q0, b->q1, b->q2, b->q3);
+                if (err > max_err) {
+                    max_err = err;
+                    worst = i;
+                }
+            }
+            printf("max deviation from golden: %.6f deg at sample %zu (tolerance %.6f deg): %s\n",
+                   max_err, worst, tol_deg, max_err <= tol_deg ? "PASS" : "FAIL");
+            if (max_err > tol_deg) {
+                ret = 1;
+            }
+        }
+        quat_trace_free(&golden);
+    }
+
+    quat_trace_free(&trace);
+    imu_log_free(&log);
+    return ret;
+}
@@ -0,0 +1,229 @@
+//=============================================================================================
+// bench_arena.c
+//=============================================================================================
+//
+// Checks the static micro-ROS arena (micro_ros_arena.h):
+//
+//   random    50000 allocations, reallocations and frees in random order: blocks are
+//             aligned, inside the buffer, never overlap (each keeps its fill pattern)
+//             and reallocation keeps the contents
+//   reclaim   freeing the last block gives back its space and the freed blocks under
+//             it, in any free order; everything freed leaves the arena empty
+//   locked    after micro_ros_arena_lock(), scratch allocate/free pairs are counted and
+//             do not grow the arena
+//   full      a request that does not fit fails without touching the live blocks
+//
+// Then times an allocate/free pair against malloc. Exits 1 if a check fails.
+//
+// Usage: bench_arena
+//
+//=============================================================================================
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench_clock.h"
+#include "micro_ros_arena.h"
+
+#define ARENA_SIZE  65536
+#define MAX_LIVE    64
+#define OPS         50000
+
+typedef struct {
+    uint8_t *ptr;
+    size_t size;
+    uint8_t fill;
+} live_t;
+
+static uint8_t g_buffer[ARENA_SIZE] __attribute__((aligned(MICRO_ROS_ARENA_ALIGN)));
+
+static uint32_t g_rng = 12345;
+
+static uint32_t rng(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static bool intact(const live_t *b) {
+    for (size_t i = 0; i < b->size; i++) {
+        if (b->ptr[i] != b->fill) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool placed(const micro_ros_arena_t *a, const live_t *b) {
+    return ((uintptr_t)b->ptr % MICRO_ROS_ARENA_ALIGN) == 0 && b->ptr >= a->base &&
+           b->ptr + b->size <= a->base + a->size;
+}
+
+static bool check_random(void) {
+    micro_ros_arena_t a;
+    micro_ros_arena_init(&a, g_buffer, sizeof(g_buffer));
+    live_t live[MAX_LIVE];
+    int n = 0;
+    uint32_t fails = 0;
+
+    for (int op = 0; op < OPS; op++) {
+        uint32_t r = rng() % 10;
+        if (n < MAX_LIVE && (r < 5 || n == 0)) {
+            live_t b = { NULL, 1 + rng() % 300, (uint8_t)(1 + rng() % 255) };
+            b.ptr = r == 0 ? micro_ros_arena_calloc(&a, b.size, 1) : micro_ros_arena_alloc(&a, b.size);
+            if (b.ptr == NULL) {
+                fails++;
+                continue;
+            }
+            if (r == 0) {
+                for (size_t i = 0; i < b.size; i++) {
+                    if (b.ptr[i] != 0) {
+                        printf("random: calloc block not zeroed\n");
+                        return false;
+                    }
+                }
+            }
+            memset(b.ptr, b.fill, b.size);
+            live[n++] = b;
+        } else if (r < 8) {
+            // Mostly the newest blocks, like rcl's scratch buffers
+            int k = (rng() % 4 == 0) ? (int)(rng() % n) : n - 1;
+            micro_ros_arena_free(&a, live[k].ptr);
+            live[k] = live[--n];
+        } else {
+            int k = (int)(rng() % n);
+            size_t size = 1 + rng() % 400;
+            uint8_t *p = micro_ros_arena_realloc(&a, live[k].ptr, size);
+            if (p == NULL) {
+                fails++;
+                continue;
+            }
+            size_t kept = size < live[k].size ? size : live[k].size;
+            for (size_t i = 0; i < kept; i++) {
+                if (p[i] != live[k].fill) {
+                    printf("random: realloc lost the contents\n");
+                    return false;
+                }
+            }
+            live[k].ptr = p;
+            live[k].size = size;
+            memset(p, live[k].fill, size);
+        }
+        if (a.used > a.size) {
+            printf("random: used %zu beyond the arena\n", a.used);
+            return false;
+        }
+        for (int k = 0; k < n; k++) {
+            if (!placed(&a, &live[k]) || !intact(&live[k])) {
+                printf("random: block %d misplaced or overwritten at op %d\n", k, op);
+                return false;
+            }
+        }
+    }
+
+    // Free the rest in random order: the arena must end up empty
+    while (n > 0) {
+        int k = (int)(rng() % n);
+        micro_ros_arena_free(&a, live[k].ptr);
+        live[k] = live[--n];
+    }
+    bool ok = a.used == 0;
+    printf("random:  %d ops, high water %zu bytes, %u requests did not fit, %s\n", OPS,
+           a.high_water, (unsigned)fails, ok ? "empty at the end   ok" : "not empty   FAIL");
+    return ok;
+}
+
+static bool check_reclaim(void) {
+    micro_ros_arena_t a;
+    micro_ros_arena_init(&a, g_buffer, sizeof(g_buffer));
+    void *p1 = micro_ros_arena_alloc(&a, 10);
+    size_t after1 = a.used;
+    void *p2 = micro_ros_arena_alloc(&a, 20);
+    void *p3 = micro_ros_arena_alloc(&a, 30);
+    size_t after3 = a.used;
+
+    bool ok = true;
+    micro_ros_arena_free(&a, p2);           // out of order: kept
+    ok = ok && a.used == after3;
+    micro_ros_arena_free(&a, p3);           // last: gives back p3 and the freed p2
+    ok = ok && a.used == after1;
+
+    // Realloc of the last block stays in place, others move with their contents
+    uint8_t *q = micro_ros_arena_alloc(&a, 16);
+    memset(q, 0x5A, 16);
+    ok = ok && micro_ros_arena_realloc(&a, q, 64) == q;
+    uint8_t *r = micro_ros_arena_alloc(&a, 8);
+    uint8_t *q2 = micro_ros_arena_realloc(&a, q, 128);
+    ok = ok && q2 != q && q2[0] == 0x5A && q2[15] == 0x5A;
+    micro_ros_arena_free(&a, q2);
+    micro_ros_arena_free(&a, r);
+    micro_ros_arena_free(&a, p1);
+    ok = ok && a.used == 0;
+    printf("reclaim: %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static bool check_locked(void) {
+    micro_ros_arena_t a;
+    micro_ros_arena_init(&a, g_buffer, sizeof(g_buffer));
+    for (int i = 0; i < 20; i++) {
+        micro_ros_arena_alloc(&a, 100 + i);     // entities created at init
+    }
+    micro_ros_arena_lock(&a);
+    size_t used = a.used;
+    for (int i = 0; i < 10000; i++) {
+        void *p = micro_ros_arena_alloc(&a, 1 + i % 200);
+        micro_ros_arena_free(&a, p);
+    }
+    bool ok = a.used == used && a.allocs_locked == 10000;
+    printf("locked:  %u allocations counted after the lock, arena %s   %s\n",
+           (unsigned)a.allocs_locked, a.used == used ? "unchanged" : "grew", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static bool check_full(void) {
+    static uint8_t small[256] __attribute__((aligned(MICRO_ROS_ARENA_ALIGN)));
+    micro_ros_arena_t a;
+    micro_ros_arena_init(&a, small, sizeof(small));
+    uint8_t *p = micro_ros_arena_alloc(&a, 100);
+    memset(p, 0x33, 100);
+    bool ok = micro_ros_arena_alloc(&a, 200) == NULL;
+    ok = ok && micro_ros_arena_realloc(&a, p, 300) == NULL && p[99] == 0x33;
+    ok = ok && micro_ros_arena_calloc(&a, SIZE_MAX / 2, 4) == NULL;
+    ok = ok && a.failed == 3;
+    printf("full:    %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static void time_pairs(void) {
+    micro_ros_arena_t a;
+    micro_ros_arena_init(&a, g_buffer, sizeof(g_buffer));
+    const int n = 10000000;
+    uint64_t t0 = bench_now_ns();
+    for (int i = 0; i < n; i++) {
+        void *p = micro_ros_arena_alloc(&a, 16 + (i & 63));
+        ((volatile uint8_t *)p)[0] = 1;
+        micro_ros_arena_free(&a, p);
+    }
+    uint64_t t1 = bench_now_ns();
+    for (int i = 0; i < n; i++) {
+        void *p = malloc(16 + (i & 63));
+        ((volatile uint8_t *)p)[0] = 1;
+        free(p);
+    }
+    uint64_t t2 = bench_now_ns();
+    printf("\nallocate/free pair: arena %.1f ns, malloc %.1f ns\n", (double)(t1 - t0) / n,
+           (double)(t2 - t1) / n);
+}
+
+int main(void) {
+    bool ok = check_random();
+    ok = check_reclaim() && ok;
+    ok = check_locked() && ok;
+    ok = check_full() && ok;
+    time_pairs();
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+//=============================================================================================
+// bench_time_sync.c
+//=============================================================================================
+//
+// Stamp error of the local-to-host clock mapping (time_sync.h) on a simulated hour:
+//
+//   clock     the ESP32 crystal runs 30 ppm fast, wandering by 3 ppm with a 20 min
+//             period (temperature), plus 1 µs of timer resolution
+//   syncs     every 10 s or 60 s; the round trip is 1-3 ms, 5% of the exchanges are
+//             late (20-60 ms), and the offset of a sample is off by up to half of its
+//             round trip (asymmetric link)
+//
+// Each hour is run with the offset of the last sync alone (the former firmware) and with
+// the fitted drift, and the stamp error is measured every millisecond after the first
+// sync. The fitted drift must keep every stamp within 1.5 ms, half the longest round trip
+// it accepts (no mapping beats the asymmetry of its exchanges), and its 99th percentile
+// must be at least 5x below the offset-only one at the same sync period.
+//
+// Usage: bench_time_sync
+// Exits 1 if a check fails.
+//
+//=============================================================================================
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "time_sync.h"
+
+#define HOUR_MS          3600000
+#define EPOCH_NS         1760000000000000000LL  // host time at boot
+#define DRIFT_PPM        30.0
+#define WANDER_PPM       3.0
+#define WANDER_PERIOD_S  1200.0
+#define MAX_ERROR_US     1500.0
+
+static uint32_t g_rng;
+
+static double uniform(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return (double)g_rng / 4294967296.0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    double p50, p99, max;
+    uint32_t rejected;
+    uint32_t bound_us;
+} result_t;
+
+static result_t run(int sync_period_s, bool drift) {
+    static double errors[HOUR_MS];
+    g_rng = 99;     // same clock and link for every run
+    time_sync_t sync;
+    time_sync_init(&sync);
+    int64_t offset_only_ns = 0;
+    bool synced = false;
+
+    double local_ns = 0;        // simulated local clock
+    size_t n = 0;
+    for (int ms = 0; ms < HOUR_MS; ms++) {
+        double t = ms * 1e-3;
+        double rate = 1.0 + (DRIFT_PPM + WANDER_PPM * sin(2 * M_PI * t / WANDER_PERIOD_S)) * 1e-6;
+        local_ns += 1e6 * rate;
+        int64_t local_us = (int64_t)(local_ns * 1e-3);
+        int64_t host_ns = EPOCH_NS + (int64_t)ms * 1000000;
+
+        if (ms % (sync_period_s * 1000) == 0) {
+            double rtt_us = 1000 + 2000 * uniform();
+            if (uniform() < 0.05) {
+                rtt_us = 20000 + 40000 * uniform();
+            }
+            int64_t measured_ns = host_ns + (int64_t)((uniform() - 0.5) * rtt_us * 1e3);
+            if (drift) {
+                time_sync_add(&sync, local_us, measured_ns, (uint32_t)rtt_us);
+            } else {
+                offset_only_ns = measured_ns - local_us * 1000;
+            }
+            synced = true;
+        }
+        if (!synced) {
+            continue;
+        }
+        int64_t stamp_ns = drift ? time_sync_to_host_ns(&sync, local_us)
+                                 : local_us * 1000 + offset_only_ns;
+        errors[n++] = fabs((double)(stamp_ns - host_ns)) * 1e-3;
+    }
+
+    qsort(errors, n, sizeof(double), cmp_double);
+    result_t r = { errors[n / 2], errors[n * 99 / 100], errors[n - 1], sync.rejected,
+                   drift ? time_sync_error_bound_us(&sync) : 0 };
+    return r;
+}
+
+static void print_result(const char *name, int period_s, const result_t *r) {
+    printf("  %-12s %3d s   p50 %7.1f us   p99 %7.1f us   max %7.1f us", name, period_s,
+           r->p50, r->p99, r->max);
+    if (r->bound_us != 0) {
+        printf("   %u late syncs left out, bound %u us", r->rejected, r->bound_us);
+    }
+    printf("\n");
+}
+
+int main(void) {
+    printf("stamp error over an hour, by sync period:\n");
+    bool ok = true;
+    const int periods[2] = { 10, 60 };
+    for (int i = 0; i < 2; i++) {
+        result_t offset = run(periods[i], false);
+        result_t fitted = run(periods[i], true);
+        print_result("offset only", periods[i], &offset);
+        print_result("with drift", periods[i], &fitted);
+        bool period_ok = fitted.max < MAX_ERROR_US && fitted.p99 * 5 < offset.p99;
+        if (!period_ok) {
+            printf("  FAIL\n");
+        }
+        ok = ok && period_ok;
+    }
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,497 @@
+//=============================================================================================
+// bench_transport.c
+//=============================================================================================
+//
+// Loopback of the micro-ROS serial transport over a pseudo-terminal. A "firmware" thread
+// frames messages the way the XRCE serial transport does (0x7E flag, addresses, length,
+// escaped payload, CRC-16) and writes them to the pty master, one write per message
+// like the default transport, or coalesced (micro_ros_batch.h). An "agent" thread reads
+// the pty slave, unframes the stream and checks every message.
+//
+//   check       100000 messages of random sizes (some larger than the batch) with a link
+//               that refuses 1% of the batches: every message must arrive intact and in
+//               order except the dropped ones, and the drop counters must match
+//   throughput  the rover mix (Imu, Odometry, a report) as fast as the pty takes it:
+//               messages/s, MB/s and link writes per message
+//   latency     publish cycles paced like the firmware (one Imu, one Odometry, flush):
+//               percentiles of the time from the client write to the unframed message
+//   budget      bytes/s of the rover topics against the link rates
+//
+// The agent thread stands in for micro_ros_agent, which is not needed to measure the
+// transport; over a real UART the wire time comes on top (see the budget table).
+//
+// Usage: bench_transport [--messages N] [--cycles N]
+// Exits 1 if a check fails.
+//
+//=============================================================================================
+
+#include <errno.h>
+#include <pthread.h>
+#include <pty.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench_clock.h"
+#include "micro_ros_batch.h"
+
+#define DEFAULT_MESSAGES 100000u
+#define DEFAULT_CYCLES   10000u
+#define CYCLE_NS         200000u    // latency run: 5 kHz cycles instead of 100 Hz, same shape
+#define BATCH_SIZE       2048u
+#define MAX_PAYLOAD      4096u
+
+// XRCE serial framing
+#define FRAME_FLAG       0x7E
+#define FRAME_ESC        0x7D
+#define FRAME_XOR        0x20
+#define FRAME_OVERHEAD   7u         // flag, 2 addresses, 2 length, 2 CRC (before escaping)
+
+// Serialized sizes of the rover messages with the XRCE headers
+#define IMU_BYTES        340u
+#define ODOM_BYTES       748u
+#define REPORT_BYTES     64u        // memory, link and clock reports
+#define I2C_REPORT_BYTES 232u       // I2C report, 51 words
+#define END_SEQ          0xFFFFFFFFu
+
+//-------------------------------------------------------------------------------------------
+// Framing
+
+static uint16_t crc16_update(uint16_t crc, uint8_t byte) {
+    crc ^= byte;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 1u) ? (uint16_t)((crc >> 1) ^ 0xA001u) : (uint16_t)(crc >> 1);
+    }
+    return crc;
+}
+
+static size_t put_escaped(uint8_t *out, uint8_t byte) {
+    if (byte == FRAME_FLAG || byte == FRAME_ESC) {
+        out[0] = FRAME_ESC;
+        out[1] = byte ^ FRAME_XOR;
+        return 2;
+    }
+    out[0] = byte;
+    return 1;
+}
+
+// Frames a payload; out holds 2 * (len + FRAME_OVERHEAD) bytes
+static size_t frame(uint8_t *out, const uint8_t *payload, size_t len) {
+    size_t n = 0;
+    out[n++] = FRAME_FLAG;
+    const uint8_t head[4] = { 0x00, 0x00, (uint8_t)len, (uint8_t)(len >> 8) };
+    for (int i = 0; i < 4; i++) {
+        n += put_escaped(out + n, head[i]);
+    }
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc16_update(crc, payload[i]);
+        n += put_escaped(out + n, payload[i]);
+    }
+    n += put_escaped(out + n, (uint8_t)crc);
+    n += put_escaped(out + n, (uint8_t)(crc >> 8));
+    return n;
+}
+
+typedef struct {
+    uint8_t buf[MAX_PAYLOAD + 8];
+    size_t pos;
+    bool in_frame;
+    bool escaped;
+    uint32_t bad;               // CRC or length errors
+} unframer_t;
+
+// Feeds one byte; returns the payload length when a frame is complete, else 0
+static size_t unframe_byte(unframer_t *u, uint8_t byte) {
+    if (byte == FRAME_FLAG) {
+        u->in_frame = true;
+        u->escaped = false;
+        u->pos = 0;
+        return 0;
+    }
+    if (!u->in_frame) {
+        return 0;
+    }
+    if (byte == FRAME_ESC) {
+        u->escaped = true;
+        return 0;
+    }
+    if (u->escaped) {
+        byte ^= FRAME_XOR;
+        u->escaped = false;
+    }
+    if (u->pos >= sizeof(u->buf)) {
+        u->in_frame = false;
+        u->bad++;
+        return 0;
+    }
+    u->buf[u->pos++] = byte;
+    if (u->pos < 4) {
+        return 0;
+    }
+    size_t len = (size_t)u->buf[2] | ((size_t)u->buf[3] << 8);
+    if (u->pos < 4 + len + 2) {
+        return 0;
+    }
+    u->in_frame = false;
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc16_update(crc, u->buf[4 + i]);
+    }
+    if (u->buf[4 + len] != (uint8_t)crc || u->buf[5 + len] != (uint8_t)(crc >> 8)) {
+        u->bad++;
+        return 0;
+    }
+    return len;
+}
+
+//-------------------------------------------------------------------------------------------
+// Messages: sequence number, write time, then a pattern that also hits the escapes
+
+static void make_payload(uint8_t *p, size_t len, uint32_t seq, uint64_t now_ns) {
+    memcpy(p, &seq, 4);
+    memcpy(p + 4, &now_ns, 8);
+    for (size_t i = 12; i < len; i++) {
+        p[i] = (uint8_t)(seq + i);
+    }
+}
+
+static bool payload_ok(const uint8_t *p, size_t len, uint32_t seq) {
+    for (size_t i = 12; i < len; i++) {
+        if (p[i] != (uint8_t)(seq + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------
+// Link: firmware writes the master, agent reads the slave
+
+typedef struct {
+    int master;
+    int slave;
+    // Agent results
+    uint64_t *latency_ns;       // per sequence number
+    uint32_t received;
+    uint32_t out_of_order;
+    uint32_t corrupt;
+    uint32_t reads;
+    uint64_t last_ns;
+} link_t;
+
+static bool link_open(link_t *link, size_t max_messages) {
+    memset(link, 0, sizeof(*link));
+    if (openpty(&link->master, &link->slave, NULL, NULL, NULL) != 0) {
+        perror("openpty");
+        return false;
+    }
+    struct termios t;
+    tcgetattr(link->slave, &t);
+    cfmakeraw(&t);
+    tcsetattr(link->slave, TCSANOW, &t);
+    link->latency_ns = (uint64_t *)calloc(max_messages, sizeof(uint64_t));
+    return link->latency_ns != NULL;
+}
+
+static void link_close(link_t *link) {
+    close(link->master);
+    close(link->slave);
+    free(link->latency_ns);
+}
+
+static size_t write_all(int fd, const uint8_t *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += (size_t)n;
+    }
+    return done;
+}
+
+static void *agent_thread(void *arg) {
+    link_t *link = (link_t *)arg;
+    static unframer_t u;
+    memset(&u, 0, sizeof(u));
+    uint8_t buf[4096];
+    int64_t last_seq = -1;
+    while (true) {
+        ssize_t n = read(link->slave, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        link->reads++;
+        uint64_t now = bench_now_ns();
+        for (ssize_t i = 0; i < n; i++) {
+            size_t len = unframe_byte(&u, buf[i]);
+            if (len < 12) {
+                continue;
+            }
+            const uint8_t *p = u.buf + 4;
+            uint32_t seq;
+            uint64_t sent_ns;
+            memcpy(&seq, p, 4);
+            memcpy(&sent_ns, p + 4, 8);
+            if (seq == END_SEQ) {
+                link->corrupt += u.bad;
+                link->last_ns = now;
+                return NULL;
+            }
+            if (!payload_ok(p, len, seq)) {
+                link->corrupt++;
+                continue;
+            }
+            if ((int64_t)seq <= last_seq) {
+                link->out_of_order++;
+            }
+            last_seq = seq;
+            link->latency_ns[seq] = now - sent_ns;
+            link->received++;
+        }
+    }
+    return NULL;
+}
+
+// Firmware side
+typedef struct {
+    link_t *link;
+    micro_ros_batch_t batch;
+    uint8_t batch_buffer[BATCH_SIZE];
+    bool batched;
+    uint32_t refuse_every;      // refuse one batch in this many (0: never)
+    uint32_t link_writes;
+    uint32_t refused;
+    uint8_t payload[MAX_PAYLOAD];
+    uint8_t framed[2 * (MAX_PAYLOAD + FRAME_OVERHEAD)];
+} firmware_t;
+
+static size_t fw_link_write(void *ctx, const uint8_t *buf, size_t len) {
+    firmware_t *fw = (firmware_t *)ctx;
+    fw->link_writes++;
+    if (fw->refuse_every != 0 && fw->link_writes % fw->refuse_every == 0) {
+        fw->refused++;
+        return 0;
+    }
+    return write_all(fw->link->master, buf, len);
+}
+
+static void fw_init(firmware_t *fw, link_t *link, bool batched, uint32_t refuse_every) {
+    memset(fw, 0, sizeof(*fw));
+    fw->link = link;
+    fw->batched = batched;
+    fw->refuse_every = refuse_every;
+    micro_ros_batch_init(&fw->batch, fw->batch_buffer, sizeof(fw->batch_buffer), fw_link_write, fw);
+}
+
+// One client write per framed message, stamped at the write
+static void fw_publish(firmware_t *fw, uint32_t seq, size_t len) {
+    make_payload(fw->payload, len, seq, bench_now_ns());
+    size_t n = frame(fw->framed, fw->payload, len);
+    if (fw->batched) {
+        micro_ros_batch_push(&fw->batch, fw->framed, n);
+    } else {
+        fw->batch.stats.writes++;
+        fw_link_write(fw, fw->framed, n);
+    }
+}
+
+static void fw_flush(firmware_t *fw) {
+    if (fw->batched) {
+        micro_ros_batch_flush(&fw->batch);
+    }
+}
+
+static void fw_end(firmware_t *fw) {
+    fw_flush(fw);
+    make_payload(fw->payload, 12, END_SEQ, 0);
+    size_t n = frame(fw->framed, fw->payload, 12);
+    write_all(fw->link->master, fw->framed, n);
+}
+
+//-------------------------------------------------------------------------------------------
+// Runs
+
+static uint32_t g_rng = 2024;
+
+static uint32_t rng(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static bool check_stream(uint32_t messages) {
+    static firmware_t fw;
+    link_t link;
+    if (!link_open(&link, messages)) {
+        return false;
+    }
+    fw_init(&fw, &link, true, 100);
+    pthread_t agent;
+    pthread_create(&agent, NULL, agent_thread, &link);
+
+    uint32_t big = 0;
+    for (uint32_t seq = 0; seq < messages; seq++) {
+        size_t len = 12 + rng() % (rng() % 50 == 0 ? 2500 : 800);
+        big += len + FRAME_OVERHEAD > BATCH_SIZE;
+        fw_publish(&fw, seq, len);
+        if (rng() % 4 == 0) {
+            fw_flush(&fw);
+        }
+    }
+    fw_end(&fw);
+    pthread_join(agent, NULL);
+
+    const micro_ros_batch_stats_t *st = &fw.batch.stats;
+    bool ok = link.received + st->dropped_writes == messages && link.out_of_order == 0 &&
+              link.corrupt == 0 && st->writes == messages && st->dropped_writes > 0;
+    printf("check:      %u messages (%u larger than the batch), %u link writes, %u dropped "
+           "with %u refused writes, %u received, %u out of order, %u corrupt   %s\n",
+           messages, big, st->flushes, st->dropped_writes, fw.refused,
+           link.received, link.out_of_order, link.corrupt, ok ? "ok" : "FAIL");
+    link_close(&link);
+    return ok;
+}
+
+// Rover mix: Imu, Odometry every second Imu, a report every hundred
+static size_t mix_size(uint32_t i) {
+    if (i % 200 == 199) {
+        return REPORT_BYTES;
+    }
+    return (i % 3 == 2) ? ODOM_BYTES : IMU_BYTES;
+}
+
+static bool run_throughput(uint32_t messages, bool batched) {
+    static firmware_t fw;
+    link_t link;
+    if (!link_open(&link, messages)) {
+        return false;
+    }
+    fw_init(&fw, &link, batched, 0);
+    pthread_t agent;
+    pthread_create(&agent, NULL, agent_thread, &link);
+
+    uint64_t bytes = 0;
+    uint64_t t0 = bench_now_ns();
+    for (uint32_t seq = 0; seq < messages; seq++) {
+        size_t len = mix_size(seq);
+        bytes += len;
+        fw_publish(&fw, seq, len);
+    }
+    fw_end(&fw);
+    pthread_join(agent, NULL);
+    double s = (double)(link.last_ns - t0) * 1e-9;
+
+    bool ok = link.received == messages && link.corrupt == 0;
+    printf("  %-9s %9.0f msg/s %7.1f MB/s   %.3f link writes/msg   %.3f agent reads/msg   %s\n",
+           batched ? "batched" : "direct", messages / s, bytes / s * 1e-6,
+           (double)fw.link_writes / messages, (double)link.reads / messages, ok ? "ok" : "FAIL");
+    link_close(&link);
+    return ok;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static bool run_latency(uint32_t cycles, bool batched) {
+    static firmware_t fw;
+    uint32_t messages = 2 * cycles;
+    link_t link;
+    if (!link_open(&link, messages)) {
+        return false;
+    }
+    fw_init(&fw, &link, batched, 0);
+    pthread_t agent;
+    pthread_create(&agent, NULL, agent_thread, &link);
+
+    // Sleep between cycles: the agent gets the CPU as it would on its own host
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint32_t c = 0; c < cycles; c++) {
+        next.tv_nsec += CYCLE_NS;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        fw_publish(&fw, 2 * c, IMU_BYTES);
+        fw_publish(&fw, 2 * c + 1, ODOM_BYTES);
+        fw_flush(&fw);
+    }
+    fw_end(&fw);
+    pthread_join(agent, NULL);
+
+    bool ok = link.received == messages && link.corrupt == 0;
+    qsort(link.latency_ns, messages, sizeof(uint64_t), cmp_u64);
+    const uint64_t *l = link.latency_ns;
+    printf("  %-9s p50 %6.1f us   p90 %6.1f us   p99 %6.1f us   p99.9 %6.1f us   max %7.1f us   %s\n",
+           batched ? "batched" : "direct", l[messages / 2] * 1e-3, l[messages * 9 / 10] * 1e-3,
+           l[messages * 99 / 100] * 1e-3, l[messages * 999 / 1000] * 1e-3,
+           l[messages - 1] * 1e-3, ok ? "ok" : "FAIL");
+    link_close(&link);
+    return ok;
+}
+
+static size_t framed_bytes(size_t payload) {
+    // Escapes: about 2 bytes in 256 for a uniform payload
+    return payload + FRAME_OVERHEAD + payload / 128;
+}
+
+static void print_budget(void) {
+    const double imu_hz = 100.0, odom_hz = 50.0, report_hz = 1.0;
+    double load = imu_hz * framed_bytes(IMU_BYTES) + odom_hz * framed_bytes(ODOM_BYTES) +
+                  report_hz * (3 * framed_bytes(REPORT_BYTES) + framed_bytes(I2C_REPORT_BYTES));
+    printf("\nbudget: Imu %.0f Hz + Odometry %.0f Hz + reports = %.1f kB/s\n", imu_hz, odom_hz,
+           load * 1e-3);
+    const struct { const char *name; double bytes_per_s; } links[] = {
+        { "UART 115200", 115200.0 / 10 },
+        { "UART 921600", 921600.0 / 10 },
+        { "UART 2000000", 2000000.0 / 10 },
+        { "USB CDC (full speed)", 1.0e6 },
+    };
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); i++) {
+        printf("  %-22s %7.1f kB/s   %5.0f%% used\n", links[i].name, links[i].bytes_per_s * 1e-3,
+               100.0 * load / links[i].bytes_per_s);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t messages = DEFAULT_MESSAGES;
+    uint32_t cycles = DEFAULT_CYCLES;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--messages") == 0 && i + 1 < argc) {
+            messages = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--messages N] [--cycles N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bool ok = check_stream(messages);
+    printf("\nthroughput (%u messages, Imu/Odometry mix):\n", messages);
+    ok = run_throughput(messages, false) && ok;
+    ok = run_throughput(messages, true) && ok;
+    printf("\nlatency (%u cycles of Imu + Odometry):\n", cycles);
+    ok = run_latency(cycles, false) && ok;
+    ok = run_latency(cycles, true) && ok;
+    print_budget();
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
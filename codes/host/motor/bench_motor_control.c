@@ -0,0 +1,332 @@
+//=============================================================================================
+// bench_motor_control.c
+//=============================================================================================
+//
+// Wheel velocity control of the combined firmware (motor_control.h) on simulated N20
+// motors, with the gains and limits of microcontroller.ino and its 1 kHz loop:
+//
+//   motor     first order, 25 ms time constant, 7000 counts/s at full duty (500 RPM,
+//             840 CPR) off by -10% (left) and +10% (right) from the feedforward,
+//             Coulomb friction worth 4% of the duty; 840 CPR encoder counts
+//   loop      the control period of control_wheels(): the command goes through the
+//             seqlock snapshot, a stale one is a stop, the duty is applied until the
+//             next period
+//
+// Scenarios and checks:
+//
+//   step      0.3 m/s from standstill: the setpoint never changes faster than the
+//             acceleration limit, the first duty leaves within one period of the command,
+//             and after the ramp each wheel holds the speed within 2% on average
+//   ff only   the same with kp = ki = 0: the feedforward alone is off by the motor
+//             mismatch, which the PI must remove (at least 5x smaller error)
+//   turn      0.5 m/s and 4 rad/s: over the speed limit, both wheels scale down and the
+//             turn keeps its curvature
+//   deadman   cmd_vel at 20 Hz for 1 s, then nothing: the wheels must be stopped within
+//             the timeout plus the deceleration ramp plus 50 ms, and the loop idle
+//   stall     a wheel held for 1 s at 0.3 m/s, then released: the integral must stay
+//             within its bound, and the overshoot at release must be at least 3x below
+//             that of an integral bounded only by the duty limit
+//
+// Usage: bench_motor_control
+// Exits 1 if a check fails.
+//
+//=============================================================================================
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "motor_control.h"
+
+// As in microcontroller.ino
+#define WHEEL_RADIUS    (0.065 / 2)
+#define WHEEL_BASE      0.138
+#define CPR             840
+#define MOTOR_RPM       500
+#define CONTROL_HZ      1000
+#define CMD_TIMEOUT_MS  500
+#define SPEED_MAX       0.5
+#define ACCEL_MAX       0.5
+#define DECEL_MAX       1.0
+#define MOTOR_KP        1.0e-4
+#define MOTOR_KI        4.0e-3
+#define MOTOR_KSTATIC   0.05
+#define MOTOR_TRIM_MAX  0.1
+
+// Simulated motors
+#define MOTOR_TAU_S     0.025
+#define FRICTION_DUTY   0.04
+#define SUBSTEPS        20          // plant steps per control period
+
+static const float DIST_PER_COUNT = (float)(2.0 * M_PI * WHEEL_RADIUS / CPR);
+static const float FULL_DUTY_RATE = MOTOR_RPM * CPR / 60.0f;
+
+typedef struct {
+    double gain;        // counts/s at full duty
+    double rate;        // counts/s
+    double pos;         // counts
+    bool held;          // stalled by the load
+} plant_t;
+
+// Duty over one control period (the PWM is far faster than the motor)
+static void plant_run(plant_t *p, double duty, double dt) {
+    double h = dt / SUBSTEPS;
+    for (int i = 0; i < SUBSTEPS; i++) {
+        if (p->held) {
+            p->rate = 0;
+            continue;
+        }
+        double drive = duty;
+        if (p->rate > 0) {
+            drive -= FRICTION_DUTY;
+        } else if (p->rate < 0) {
+            drive += FRICTION_DUTY;
+        } else if (fabs(duty) <= FRICTION_DUTY) {
+            continue;           // not enough to break away
+        } else {
+            drive -= duty > 0 ? FRICTION_DUTY : -FRICTION_DUTY;
+        }
+        double next = p->rate + h * (p->gain * drive - p->rate) / MOTOR_TAU_S;
+        if ((p->rate > 0 && next < 0) || (p->rate < 0 && next > 0)) {
+            next = 0;           // friction stops the wheel, it does not reverse it
+        }
+        p->rate = next;
+        p->pos += p->rate * h;
+    }
+}
+
+static int64_t plant_count(const plant_t *p) {
+    return (int64_t)floor(p->pos);
+}
+
+// Firmware side: controllers, command snapshot and the loop of control_wheels()
+typedef struct {
+    motor_control_config_t cfg;
+    motor_wheel_t left, right;
+    motor_command_snapshot_t shared;
+    motor_command_t cmd;
+    plant_t motor_left, motor_right;
+    int64_t now_us;
+    float target_left, target_right;
+    float duty_left, duty_right;
+    bool idle;
+} rover_t;
+
+static motor_control_config_t firmware_config(void) {
+    motor_control_config_t cfg = {
+        .kp = MOTOR_KP,
+        .ki = MOTOR_KI,
+        .kff = 1.0f / FULL_DUTY_RATE,
+        .kstatic = MOTOR_KSTATIC,
+        .accel_max = ACCEL_MAX / DIST_PER_COUNT,
+        .decel_max = DECEL_MAX / DIST_PER_COUNT,
+        .integral_max = MOTOR_TRIM_MAX,
+        .rate_max = SPEED_MAX / DIST_PER_COUNT,
+        .duty_max = 1.0f
+    };
+    return cfg;
+}
+
+static void rover_init(rover_t *r, const motor_control_config_t *cfg) {
+    memset(r, 0, sizeof(*r));
+    r->cfg = *cfg;
+    r->motor_left.gain = 0.9 * FULL_DUTY_RATE;
+    r->motor_right.gain = 1.1 * FULL_DUTY_RATE;
+    r->now_us = 1000000;
+    motor_wheel_reset(&r->left, 0, r->now_us);
+    motor_wheel_reset(&r->right, 0, r->now_us);
+    r->idle = true;
+}
+
+static void rover_command(rover_t *r, float v, float omega) {
+    motor_command_t cmd = { v, omega, r->now_us };
+    motor_command_publish(&r->shared, &cmd);
+}
+
+static void rover_period(rover_t *r) {
+    const float dt = 1.0f / CONTROL_HZ;
+    r->now_us += 1000000 / CONTROL_HZ;
+    motor_command_try_read(&r->shared, &r->cmd);
+    bool fresh = r->cmd.stamp_us != 0 && r->now_us - r->cmd.stamp_us < CMD_TIMEOUT_MS * 1000LL;
+    r->target_left = r->target_right = 0;
+    if (fresh) {
+        motor_control_wheel_rates(&r->cfg, r->cmd.v, r->cmd.omega, (float)WHEEL_BASE, DIST_PER_COUNT,
+                                  &r->target_left, &r->target_right);
+    }
+    r->duty_left = motor_control_step(&r->cfg, &r->left, r->target_left,
+                                      plant_count(&r->motor_left), r->now_us, dt);
+    r->duty_right = motor_control_step(&r->cfg, &r->right, r->target_right,
+                                       plant_count(&r->motor_right), r->now_us, dt);
+    r->idle = r->left.setpoint == 0 && r->right.setpoint == 0 &&
+              r->target_left == 0 && r->target_right == 0;
+    plant_run(&r->motor_left, r->duty_left, dt);
+    plant_run(&r->motor_right, r->duty_right, dt);
+}
+
+//-------------------------------------------------------------------------------------------
+// Scenarios
+
+typedef struct {
+    double mean_error;      // relative, after the ramp
+    double ripple;          // relative RMS, after the ramp
+    double max_accel;       // of the setpoint, counts/s^2
+    double first_duty_ms;   // from the command to the first duty
+} step_result_t;
+
+static step_result_t run_step(const motor_control_config_t *cfg) {
+    rover_t r;
+    rover_init(&r, cfg);
+    step_result_t res = { 0, 0, 0, -1 };
+    const float v = 0.3f;
+    rover_command(&r, v, 0);
+    float target = v / DIST_PER_COUNT;
+    double ramp_s = target / cfg->accel_max;
+    double sum[2] = { 0, 0 }, sum2 = 0;
+    int n = 0;
+    float last_setpoint = 0;
+    for (int k = 1; k <= 2 * CONTROL_HZ; k++) {
+        if (k % 50 == 0) {
+            rover_command(&r, v, 0);        // 20 Hz, like a planner
+        }
+        rover_period(&r);
+        double accel = fabs(r.left.setpoint - last_setpoint) * CONTROL_HZ;
+        last_setpoint = r.left.setpoint;
+        if (accel > res.max_accel) {
+            res.max_accel = accel;
+        }
+        if (res.first_duty_ms < 0 && r.duty_left != 0) {
+            res.first_duty_ms = (double)k * 1000.0 / CONTROL_HZ;
+        }
+        double t = (double)k / CONTROL_HZ;
+        if (t > ramp_s + 0.3) {
+            for (int w = 0; w < 2; w++) {
+                double rate = w == 0 ? r.motor_left.rate : r.motor_right.rate;
+                double e = (rate - target) / target;
+                sum[w] += e;
+                sum2 += e * e;
+            }
+            n++;
+        }
+    }
+    res.mean_error = fmax(fabs(sum[0]), fabs(sum[1])) / n;
+    res.ripple = sqrt(sum2 / (2 * n));
+    return res;
+}
+
+static bool check_step(void) {
+    motor_control_config_t cfg = firmware_config();
+    step_result_t pi = run_step(&cfg);
+    motor_control_config_t ff_cfg = cfg;
+    ff_cfg.kp = ff_cfg.ki = 0;
+    step_result_t ff = run_step(&ff_cfg);
+
+    bool accel_ok = pi.max_accel <= cfg.accel_max * 1.001;
+    bool latency_ok = pi.first_duty_ms > 0 && pi.first_duty_ms <= 1000.0 / CONTROL_HZ;
+    bool ok = accel_ok && latency_ok && pi.mean_error < 0.02;
+    printf("step:    0.3 m/s   first duty after %.1f ms, setpoint %.0f counts/s^2 (limit %.0f), "
+           "speed error %.2f%% (ripple %.1f%%)   %s\n",
+           pi.first_duty_ms, pi.max_accel, cfg.accel_max, 100 * pi.mean_error, 100 * pi.ripple,
+           ok ? "ok" : "FAIL");
+    bool ff_ok = pi.mean_error * 5 < ff.mean_error;
+    printf("ff only: speed error %.2f%% without the PI   %s\n", 100 * ff.mean_error,
+           ff_ok ? "ok" : "FAIL");
+    return ok && ff_ok;
+}
+
+static bool check_turn(void) {
+    motor_control_config_t cfg = firmware_config();
+    const float v = 0.5f, omega = 4.0f;
+    float left, right;
+    motor_control_wheel_rates(&cfg, v, omega, (float)WHEEL_BASE, DIST_PER_COUNT, &left, &right);
+    float peak = fmaxf(fabsf(left), fabsf(right));
+    // Curvature omega / v from the wheel rates
+    float curvature = (right - left) / (float)WHEEL_BASE / (0.5f * (right + left));
+    bool ok = peak <= cfg.rate_max * 1.0001f && fabsf(curvature - omega / v) < 1e-3f * (omega / v);
+    printf("turn:    0.5 m/s 4 rad/s   wheels %.0f / %.0f counts/s (limit %.0f), curvature %.3f "
+           "for %.3f 1/m   %s\n",
+           left, right, cfg.rate_max, curvature, omega / v, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static bool check_deadman(void) {
+    motor_control_config_t cfg = firmware_config();
+    rover_t r;
+    rover_init(&r, &cfg);
+    const float v = 0.3f;
+    int last_cmd_k = 0;
+    for (int k = 1; k <= CONTROL_HZ; k++) {
+        if (k % 50 == 1) {
+            rover_command(&r, v, 0);
+            last_cmd_k = k;
+        }
+        rover_period(&r);
+    }
+    double stop_ms = -1, idle_ms = -1;
+    for (int k = CONTROL_HZ + 1; k <= 3 * CONTROL_HZ; k++) {
+        rover_period(&r);
+        double since_ms = (double)(k - last_cmd_k) * 1000.0 / CONTROL_HZ;
+        if (stop_ms < 0 && r.motor_left.rate == 0 && r.motor_right.rate == 0) {
+            stop_ms = since_ms;
+        }
+        if (idle_ms < 0 && r.idle) {
+            idle_ms = since_ms;
+        }
+    }
+    double bound_ms = CMD_TIMEOUT_MS + 1000.0 * v / DECEL_MAX + 50;
+    bool ok = stop_ms > 0 && stop_ms <= bound_ms && idle_ms > 0 && r.idle &&
+              r.left.integral == 0 && r.right.integral == 0;
+    printf("deadman: last cmd_vel at 0.3 m/s, wheels stopped after %.0f ms, idle after %.0f ms "
+           "(bound %.0f ms)   %s\n", stop_ms, idle_ms, bound_ms, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+typedef struct {
+    double overshoot;       // relative, after the release
+    float max_integral;     // while held, duty
+} stall_result_t;
+
+static stall_result_t run_stall(const motor_control_config_t *cfg) {
+    rover_t r;
+    rover_init(&r, cfg);
+    const float v = 0.3f;
+    float target = v / DIST_PER_COUNT;
+    double peak = 0;
+    float max_integral = 0;
+    for (int k = 1; k <= 4 * CONTROL_HZ; k++) {
+        if (k % 50 == 1) {
+            rover_command(&r, v, 0);
+        }
+        r.motor_left.held = k > CONTROL_HZ && k <= 2 * CONTROL_HZ;
+        rover_period(&r);
+        if (r.motor_left.held && fabsf(r.left.integral) > max_integral) {
+            max_integral = fabsf(r.left.integral);
+        }
+        if (k > 2 * CONTROL_HZ && r.motor_left.rate > peak) {
+            peak = r.motor_left.rate;
+        }
+    }
+    stall_result_t res = { (peak - target) / target, max_integral };
+    return res;
+}
+
+static bool check_stall(void) {
+    motor_control_config_t cfg = firmware_config();
+    stall_result_t bounded = run_stall(&cfg);
+    motor_control_config_t wide_cfg = cfg;
+    wide_cfg.integral_max = wide_cfg.duty_max;
+    stall_result_t wide = run_stall(&wide_cfg);
+    bool ok = bounded.max_integral <= cfg.integral_max && bounded.overshoot * 3 < wide.overshoot;
+    printf("stall:   left wheel held 1 s at 0.3 m/s, integral at most %.2f duty, overshoot %.0f%% "
+           "after release (%.0f%% bounded at the duty limit only)   %s\n", bounded.max_integral,
+           100 * bounded.overshoot, 100 * wide.overshoot, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(void) {
+    bool ok = check_step();
+    ok = check_turn() && ok;
+    ok = check_deadman() && ok;
+    ok = check_stall() && ok;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
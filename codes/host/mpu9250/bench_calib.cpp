@@ -0,0 +1,498 @@
+//=============================================================================================
+// bench_calib.cpp
+//=============================================================================================
+//
+// Checks and times the MPU9250 conversion kernel and calibration fits (mpu9250_calib.c):
+//
+//   convert   mpu9250_calib_apply_block() against the per-axis mpu9250_*_to_*() path
+//             (a range check, table lookup and division per axis), same values with no
+//             calibration, and the time per sample of each
+//   gyro      the stationary bias capture recovers a known bias, and rejects a capture
+//             taken while the sensor turns
+//   mag       the ellipsoid fit recovers a known hard-iron offset and soft-iron matrix
+//             from a simulated hand rotation, and rejects a rotation about one axis only
+//   filter    the log is replayed as the sensor would report it with the gyroscope bias
+//             of the log and a distorted magnetometer, raw and calibrated, through
+//             madgwick_ahrs at several beta, reporting the error against the reference
+//             orientation and the time until it stays below 2 degrees (a log of a
+//             minute or more shows the small beta settling, see README.md)
+//
+// Usage: bench_calib [log.csv|log.bin] [--calls N]
+// Exits 1 if a check fails.
+//
+//=============================================================================================
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "bench_clock.h"
+#include "imu_log.h"
+#include "madgwick_ahrs.h"
+#include "mpu9250_calib.h"
+#include "mpu9250_driver.hpp"
+
+#ifndef HOST_DATA_DIR
+#define HOST_DATA_DIR "data"
+#endif
+
+#define DEFAULT_LOG     HOST_DATA_DIR "/imu_synthetic.csv"
+#define DEFAULT_CALLS   5000000u
+
+namespace {
+
+// Simulated sensor imperfections, in counts at the default ranges
+const double kHardIron[3] = { 40.0, -25.0, 60.0 };
+const double kSoftIron[9] = {
+    1.15, 0.08, -0.03,
+    0.08, 0.92, 0.05,
+    -0.03, 0.05, 1.05,
+};
+const double kMagNoise = 2.0;       // 0.3 µT
+const double kGyroNoise = 6.5;      // 0.05 deg/s
+
+unsigned long long s_rng_state = 1;
+
+double rng_uniform() {
+    s_rng_state = s_rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return ((s_rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+double rng_gauss() {
+    double u1 = rng_uniform();
+    double u2 = rng_uniform();
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+int16_t clamp16(double v) {
+    v = round(v);
+    return (int16_t)(v > 32767.0 ? 32767.0 : (v < -32768.0 ? -32768.0 : v));
+}
+
+// What the AK8963 reports for a field of f counts: distorted, noisy, quantized
+void distort_mag(const double f[3], int16_t out[3]) {
+    for (int i = 0; i < 3; i++) {
+        double v = kHardIron[i] + kMagNoise * rng_gauss();
+        for (int j = 0; j < 3; j++) {
+            v += kSoftIron[3 * i + j] * f[j];
+        }
+        out[i] = clamp16(v);
+    }
+}
+
+bool check(bool ok, const char *what, size_t *failures) {
+    printf("  %-58s %s\n", what, ok ? "ok" : "FAIL");
+    if (!ok) (*failures)++;
+    return ok;
+}
+
+//-------------------------------------------------------------------------------------------
+// convert
+
+// The per-axis conversion of mpu9250.cpp (mpu9250_accel_to_g() and friends)
+float accel_to_g(int16_t raw, uint8_t range) {
+    if (range > 3) range = 0;
+    return (float)raw / mpu9250::accel_lsb_per_g(range);
+}
+
+float gyro_to_dps(int16_t raw, uint8_t range) {
+    if (range > 3) range = 0;
+    return (float)raw / mpu9250::gyro_lsb_per_dps(range);
+}
+
+float mag_to_ut(int16_t raw) {
+    return (float)raw * mpu9250::kMagUtPerLsb;
+}
+
+struct Soa {
+    std::vector<float> v[9];
+    explicit Soa(size_t n) {
+        for (auto &a : v) a.assign(n, 0.0f);
+    }
+    mpu9250_calib_block_t block(size_t offset) {
+        mpu9250_calib_block_t b = {
+            &v[0][offset], &v[1][offset], &v[2][offset], &v[3][offset], &v[4][offset],
+            &v[5][offset], &v[6][offset], &v[7][offset], &v[8][offset],
+        };
+        return b;
+    }
+};
+
+void bench_convert(const std::vector<mpu9250_data_t> &raw, size_t calls, size_t *failures) {
+    printf("convert\n");
+    const size_t n = raw.size();
+    mpu9250_calib_kernel_t kernel;
+    mpu9250_calib_kernel_init(&kernel, NULL, MPU9250_ACCEL_RANGE_2G, MPU9250_GYRO_RANGE_250DPS);
+
+    Soa per_axis(n), fused(n);
+    for (size_t i = 0; i < n; i++) {
+        const mpu9250_data_t &r = raw[i];
+        per_axis.v[0][i] = accel_to_g(r.ax, 0);
+        per_axis.v[1][i] = accel_to_g(r.ay, 0);
+        per_axis.v[2][i] = accel_to_g(r.az, 0);
+        per_axis.v[3][i] = gyro_to_dps(r.gx, 0);
+        per_axis.v[4][i] = gyro_to_dps(r.gy, 0);
+        per_axis.v[5][i] = gyro_to_dps(r.gz, 0);
+        per_axis.v[6][i] = mag_to_ut(r.mx);
+        per_axis.v[7][i] = mag_to_ut(r.my);
+        per_axis.v[8][i] = mag_to_ut(r.mz);
+    }
+    mpu9250_calib_block_t out = fused.block(0);
+    mpu9250_calib_apply_block(&kernel, raw.data(), n, &out);
+
+    // Multiplying by 1/lsb instead of dividing by lsb: at most one rounding apart
+    double max_rel = 0.0;
+    for (int a = 0; a < 9; a++) {
+        for (size_t i = 0; i < n; i++) {
+            double want = per_axis.v[a][i];
+            double err = fabs(fused.v[a][i] - want);
+            if (want != 0.0) err /= fabs(want);
+            if (err > max_rel) max_rel = err;
+        }
+    }
+    char line[96];
+    snprintf(line, sizeof(line), "uncalibrated kernel = per-axis path (max rel. diff %.1e)", max_rel);
+    check(max_rel <= 2.0 * FLT_EPSILON, line, failures);
+
+    // Blocks of 10, as the firmware's batch
+    const size_t block = 10;
+    Soa sink(block);
+    float sum = 0.0f;
+    uint64_t t0 = bench_now_ns();
+    for (size_t k = 0, i = 0; k < calls; k += block) {
+        for (size_t j = 0; j < block; j++) {
+            const mpu9250_data_t &r = raw[(i + j) % n];
+            sink.v[0][j] = accel_to_g(r.ax, MPU9250_ACCEL_RANGE_DEFAULT);
+            sink.v[1][j] = accel_to_g(r.ay, MPU9250_ACCEL_RANGE_DEFAULT);
+            sink.v[2][j] = accel_to_g(r.az, MPU9250_ACCEL_RANGE_DEFAULT);
+            sink.v[3][j] = gyro_to_dps(r.gx, MPU9250_GYRO_RANGE_DEFAULT);
+            sink.v[4][j] = gyro_to_dps(r.gy, MPU9250_GYRO_RANGE_DEFAULT);
+            sink.v[5][j] = gyro_to_dps(r.gz, MPU9250_GYRO_RANGE_DEFAULT);
+            sink.v[6][j] = mag_to_ut(r.mx);
+            sink.v[7][j] = mag_to_ut(r.my);
+            sink.v[8][j] = mag_to_ut(r.mz);
+        }
+        sum += sink.v[0][0] + sink.v[8][block - 1];
+        i = (i + block) % n;
+    }
+    double per_axis_ns = (double)(bench_now_ns() - t0) / calls;
+
+    mpu9250_calib_t calib;
+    mpu9250_calib_defaults(&calib);
+    calib.gyro_bias[0] = 39.3f;
+    calib.mag_bias[2] = 60.0f;
+    mpu9250_calib_kernel_init(&kernel, &calib, MPU9250_ACCEL_RANGE_DEFAULT, MPU9250_GYRO_RANGE_DEFAULT);
+    mpu9250_calib_block_t sb = sink.block(0);
+    t0 = bench_now_ns();
+    for (size_t k = 0, i = 0; k < calls; k += block) {
+        size_t m = (i + block <= n) ? block : n - i;
+        mpu9250_calib_apply_block(&kernel, &raw[i], m, &sb);
+        sum += sink.v[0][0] + sink.v[8][m - 1];
+        i = (i + m) % n;
+    }
+    double fused_ns = (double)(bench_now_ns() - t0) / calls;
+    bench_consume_float(sum);
+
+    printf("  per-axis mpu9250_*_to_*()          %6.2f ns/sample (uncalibrated)\n", per_axis_ns);
+    printf("  mpu9250_calib_apply_block()        %6.2f ns/sample (bias + 3x3 soft iron)\n", fused_ns);
+}
+
+//-------------------------------------------------------------------------------------------
+// gyro
+
+// Bias in counts of the synthetic log (gen_imu_log: 0.30, -0.20, 0.10 deg/s)
+const double kLogGyroBias[3] = { 0.30 * 131.0, -0.20 * 131.0, 0.10 * 131.0 };
+
+bool capture_gyro(mpu9250_calib_t *calib, double turn_counts, size_t *failures) {
+    mpu9250_calib_still_t still;
+    mpu9250_calib_still_reset(&still);
+    for (int i = 0; i < 200; i++) {
+        mpu9250_data_t r = mpu9250_data_t();
+        double turn = turn_counts * sin(i * 0.1);
+        r.gx = clamp16(kLogGyroBias[0] + turn + kGyroNoise * rng_gauss());
+        r.gy = clamp16(kLogGyroBias[1] + kGyroNoise * rng_gauss());
+        r.gz = clamp16(kLogGyroBias[2] + kGyroNoise * rng_gauss());
+        r.ax = clamp16(16384.0 * 0.02 + 20.0 * rng_gauss());
+        r.ay = clamp16(16384.0 * -0.01 + 20.0 * rng_gauss());
+        r.az = clamp16(16384.0 * 0.999 + 20.0 * rng_gauss());
+        mpu9250_calib_still_add(&still, &r);
+    }
+    esp_err_t ret = mpu9250_calib_still_gyro_bias(&still, 50.0f, calib, MPU9250_GYRO_RANGE_250DPS);
+    (void)failures;
+    return ret == ESP_OK;
+}
+
+void bench_gyro(mpu9250_calib_t *calib, size_t *failures) {
+    printf("gyro\n");
+    bool ok = capture_gyro(calib, 0.0, failures);
+    double err = 0.0;
+    for (int i = 0; i < 3; i++) {
+        err = fmax(err, fabs(calib->gyro_bias[i] - kLogGyroBias[i]));
+    }
+    char line[96];
+    snprintf(line, sizeof(line), "stationary bias recovered (max error %.2f counts)", err);
+    check(ok && err < 1.5, line, failures);
+
+    mpu9250_calib_t moved = *calib;
+    check(!capture_gyro(&moved, 300.0, failures), "capture while turning rejected", failures);
+}
+
+//-------------------------------------------------------------------------------------------
+// mag
+
+// Field strength of the log (gen_imu_log: 22, 0, -12 µT), in counts
+const double kFieldCounts = sqrt(22.0 * 22.0 + 12.0 * 12.0) / 0.15;
+
+void field_spread(const std::vector<int16_t> &m, const mpu9250_calib_kernel_t &k, double *rel_std) {
+    double sum = 0.0, sq = 0.0;
+    size_t n = m.size() / 3;
+    for (size_t i = 0; i < n; i++) {
+        mpu9250_data_t r = mpu9250_data_t();
+        r.mx = m[3 * i];
+        r.my = m[3 * i + 1];
+        r.mz = m[3 * i + 2];
+        mpu9250_calib_sample_t s;
+        mpu9250_calib_apply(&k, &r, &s);
+        double f = sqrt((double)s.mx * s.mx + (double)s.my * s.my + (double)s.mz * s.mz);
+        sum += f;
+        sq += f * f;
+    }
+    double mean = sum / n;
+    *rel_std = sqrt(fmax(sq / n - mean * mean, 0.0)) / mean;
+}
+
+void bench_mag(mpu9250_calib_t *calib, size_t *failures) {
+    printf("mag\n");
+
+    // A hand rotation: directions spread over the sphere (Fibonacci lattice)
+    const size_t n = 600;
+    std::vector<int16_t> readings(3 * n);
+    mpu9250_calib_mag_fit_t fit;
+    mpu9250_calib_mag_reset(&fit);
+    for (size_t i = 0; i < n; i++) {
+        double z = 1.0 - (2.0 * i + 1.0) / n;
+        double r = sqrt(1.0 - z * z);
+        double phi = i * M_PI * (3.0 - sqrt(5.0));
+        const double f[3] = { kFieldCounts * r * cos(phi), kFieldCounts * r * sin(phi),
+                              kFieldCounts * z };
+        distort_mag(f, &readings[3 * i]);
+        mpu9250_calib_mag_add(&fit, readings[3 * i], readings[3 * i + 1], readings[3 * i + 2]);
+    }
+    bool ok = mpu9250_calib_mag_solve(&fit, calib) == ESP_OK;
+
+    double bias_err = 0.0;
+    for (int i = 0; i < 3; i++) {
+        bias_err = fmax(bias_err, fabs(calib->mag_bias[i] - kHardIron[i]));
+    }
+    // W S should be a multiple of the identity (the fit keeps the volume, not the scale)
+    double ws[9], scale = 0.0, shape_err = 0.0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double v = 0.0;
+            for (int k = 0; k < 3; k++) v += calib->mag_soft_iron[3 * i + k] * kSoftIron[3 * k + j];
+            ws[3 * i + j] = v;
+        }
+        scale += ws[4 * i] / 3.0;
+    }
+    for (int i = 0; i < 9; i++) {
+        shape_err = fmax(shape_err, fabs(ws[i] / scale - (i % 4 == 0 ? 1.0 : 0.0)));
+    }
+
+    mpu9250_calib_kernel_t raw_kernel, cal_kernel;
+    mpu9250_calib_kernel_init(&raw_kernel, NULL, 0, 0);
+    mpu9250_calib_kernel_init(&cal_kernel, calib, 0, 0);
+    double spread_raw, spread_cal;
+    field_spread(readings, raw_kernel, &spread_raw);
+    field_spread(readings, cal_kernel, &spread_cal);
+
+    char line[96];
+    snprintf(line, sizeof(line), "hard iron recovered (max error %.2f counts)", bias_err);
+    check(ok && bias_err < 2.0, line, failures);
+    snprintf(line, sizeof(line), "soft iron recovered (max error of W S %.4f)", shape_err);
+    check(ok && shape_err < 0.02, line, failures);
+    snprintf(line, sizeof(line), "field strength spread %.2f%% raw, %.2f%% calibrated",
+             100.0 * spread_raw, 100.0 * spread_cal);
+    check(spread_cal < 0.2 * spread_raw, line, failures);
+
+    // Turning about the vertical only leaves the ellipsoid undetermined
+    mpu9250_calib_mag_reset(&fit);
+    for (size_t i = 0; i < n; i++) {
+        double a = 2.0 * M_PI * i / n;
+        const double f[3] = { 22.0 / 0.15 * cos(a), 22.0 / 0.15 * sin(a), -12.0 / 0.15 };
+        int16_t m[3];
+        distort_mag(f, m);
+        mpu9250_calib_mag_add(&fit, m[0], m[1], m[2]);
+    }
+    mpu9250_calib_t planar = *calib;
+    check(mpu9250_calib_mag_solve(&fit, &planar) != ESP_OK, "rotation about one axis rejected",
+          failures);
+}
+
+//-------------------------------------------------------------------------------------------
+// filter
+
+float quat_angle_deg(const float a[4], const float b[4]) {
+    float dot = fabsf(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+    if (dot > 1.0f) dot = 1.0f;
+    return 2.0f * acosf(dot) * 57.29578f;
+}
+
+struct Run {
+    float maxErr;       // second half of the log
+    float settleS;      // time until the error stays below 2 deg
+};
+
+Run replay(const imu_log_t &log, const std::vector<mpu9250_data_t> &raw,
+           const mpu9250_calib_kernel_t &kernel, float beta) {
+    madgwick_ahrs_t filter;
+    madgwick_ahrs_init(&filter);
+    madgwick_ahrs_begin(&filter, 100.0f);
+    madgwick_ahrs_set_beta(&filter, beta);
+
+    Run run = { 0.0f, -1.0f };
+    int64_t settled = -1;
+    for (size_t i = 0; i < log.count; i++) {
+        mpu9250_calib_sample_t s;
+        mpu9250_calib_apply(&kernel, &raw[i], &s);
+        madgwick_ahrs_update(&filter, s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.mx, s.my, s.mz);
+
+        float q[4], t[4] = { log.samples[i].q0, log.samples[i].q1, log.samples[i].q2,
+                             log.samples[i].q3 };
+        madgwick_ahrs_get_quaternion(&filter, &q[0], &q[1], &q[2], &q[3]);
+        float err = quat_angle_deg(q, t);
+        if (i >= log.count / 2 && err > run.maxErr) run.maxErr = err;
+        if (err >= 2.0f) {
+            settled = -1;
+        } else if (settled < 0) {
+            settled = log.samples[i].t_us;
+        }
+    }
+    if (settled >= 0) {
+        run.settleS = (float)(settled - log.samples[0].t_us) * 1e-6f;
+    }
+    return run;
+}
+
+void bench_filter(const imu_log_t &log, const std::vector<mpu9250_data_t> &clean,
+                  const mpu9250_calib_t &calib, size_t *failures) {
+    printf("filter (error vs reference: max over the second half / settled below 2 deg)\n");
+    if (!log.has_truth) {
+        printf("  log has no reference orientation, skipped\n");
+        return;
+    }
+
+    // The log as the sensor would report it, magnetometer distorted
+    std::vector<mpu9250_data_t> raw(clean);
+    for (size_t i = 0; i < raw.size(); i++) {
+        if (raw[i].mx == 0 && raw[i].my == 0 && raw[i].mz == 0) {
+            continue;
+        }
+        const double f[3] = { (double)raw[i].mx, (double)raw[i].my, (double)raw[i].mz };
+        int16_t m[3];
+        distort_mag(f, m);
+        raw[i].mx = m[0];
+        raw[i].my = m[1];
+        raw[i].mz = m[2];
+    }
+
+    mpu9250_calib_kernel_t raw_kernel, cal_kernel;
+    mpu9250_calib_kernel_init(&raw_kernel, NULL, 0, 0);
+    mpu9250_calib_kernel_init(&cal_kernel, &calib, 0, 0);
+
+    // Rows where the calibrated run has not settled by the end of the log are not judged:
+    // at a small beta a short log ends before the filter converges from the identity
+    const float betas[] = { 0.1f, 0.05f, 0.02f };
+    bool better = true;
+    size_t judged = 0;
+    printf("  %-6s %22s %22s %22s\n", "beta", "log as recorded", "distorted, raw", "calibrated");
+    for (float beta : betas) {
+        Run runs[3] = {
+            replay(log, clean, raw_kernel, beta),
+            replay(log, raw, raw_kernel, beta),
+            replay(log, raw, cal_kernel, beta),
+        };
+        printf("  %-6.3f", beta);
+        for (const Run &r : runs) {
+            char cell[32];
+            if (r.settleS < 0) {
+                snprintf(cell, sizeof(cell), "%6.2f deg / never", r.maxErr);
+            } else {
+                snprintf(cell, sizeof(cell), "%6.2f deg / %5.1f s", r.maxErr, r.settleS);
+            }
+            printf(" %22s", cell);
+        }
+        printf("\n");
+        if (runs[2].settleS >= 0) {
+            judged++;
+            better = better && runs[2].maxErr < runs[1].maxErr;
+        }
+    }
+    check(better && judged > 0, "calibrated inputs track the reference closer once settled",
+          failures);
+}
+
+std::vector<mpu9250_data_t> quantize_log(const imu_log_t &log) {
+    std::vector<mpu9250_data_t> raw(log.count);
+    for (size_t i = 0; i < log.count; i++) {
+        const imu_log_sample_t &s = log.samples[i];
+        mpu9250_data_t &r = raw[i];
+        r.ax = clamp16(s.ax * 16384.0);
+        r.ay = clamp16(s.ay * 16384.0);
+        r.az = clamp16(s.az * 16384.0);
+        r.gx = clamp16(s.gx * 131.0);
+        r.gy = clamp16(s.gy * 131.0);
+        r.gz = clamp16(s.gz * 131.0);
+        r.mx = clamp16(s.mx / 0.15);
+        r.my = clamp16(s.my / 0.15);
+        r.mz = clamp16(s.mz / 0.15);
+    }
+    return raw;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *log_path = DEFAULT_LOG;
+    size_t calls = DEFAULT_CALLS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-') {
+            log_path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [log.csv|log.bin] [--calls N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (calls == 0) {
+        fprintf(stderr, "--calls must be positive\n");
+        return 2;
+    }
+
+    imu_log_t log;
+    if (imu_log_load(log_path, &log) != 0) {
+        return 1;
+    }
+    if (log.count == 0) {
+        fprintf(stderr, "%s: empty log\n", log_path);
+        imu_log_free(&log);
+        return 1;
+    }
+    std::vector<mpu9250_data_t> raw = quantize_log(log);
+    printf("%s: %zu samples\n\n", log_path, log.count);
+
+    size_t failures = 0;
+    mpu9250_calib_t calib;
+    mpu9250_calib_defaults(&calib);
+    bench_convert(raw, calls, &failures);
+    bench_gyro(&calib, &failures);
+    bench_mag(&calib, &failures);
+    bench_filter(log, raw, calib, &failures);
+
+    printf("\n%zu failures\n", failures);
+    imu_log_free(&log);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,525 @@
+//=============================================================================================
+// bench_mpu9250.cpp
+//=============================================================================================
+//
+// Runs the firmware's MPU9250 driver core (mpu9250_driver.hpp) against the mock bus
+// (mock_bus.hpp): a sensor log is quantized to register counts, replayed through the
+// register file and read back in each acquisition mode the firmware uses:
+//
+//   bypass   readAll(): IMU burst, plus AK8963 ST1..ST2 when a measurement is due
+//   aux      readAll(): one burst with the aux I2C master, 21 bytes when due, else 14
+//   fifo     fifoRead() every --drain samples plus a magnetometer read when due
+//
+// The direct modes also run with the IMU read --oversample times per log sample (the
+// magnetometer keeps the log's rate), as when the IMU is sampled faster than the AK8963.
+//
+// For each mode it reports the I2C bytes and transactions per sample and the magnetometer
+// reads per new measurement, with the Wire (120-byte reads) and ESP-IDF (whole FIFO) bus
+// limits, and checks that every value read back is the count that was written and
+// converts to within half an LSB of the log, and that each new magnetometer measurement
+// is returned exactly once. A FIFO overflow is provoked and must be reported with the
+// 42 samples kept.
+// Then decoding + unit conversion is timed on its own and through the driver.
+//
+// Usage: bench_mpu9250 [log.csv|log.bin] [--drain N] [--oversample N] [--calls N]
+// Exits 1 if a check fails.
+//
+//=============================================================================================
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "bench_clock.h"
+#include "imu_log.h"
+#include "mock_bus.hpp"
+#include "mpu9250_driver.hpp"
+
+#ifndef HOST_DATA_DIR
+#define HOST_DATA_DIR "data"
+#endif
+
+#define DEFAULT_LOG     HOST_DATA_DIR "/imu_synthetic.csv"
+#define DEFAULT_DRAIN   10u
+#define DEFAULT_OVERSAMPLE 10u
+#define DEFAULT_CALLS   5000000u
+
+using mpu9250::Driver;
+using mpu9250::MockBus;
+using mpu9250::RawSample;
+using mpu9250::Status;
+
+namespace {
+
+typedef MockBus<120> WireMock;                                              // Arduino Wire
+typedef MockBus<mpu9250::kFifoMaxSamples * mpu9250::kFifoFrameSize> IdfMock; // ESP-IDF
+
+// A log sample as the chip would report it, at the default ranges (±2 g, ±250 °/s)
+struct Replayed {
+    RawSample raw;
+    bool magNew;
+    bool clipped;
+    const imu_log_sample_t *src;
+};
+
+struct Physical {
+    float ax, ay, az, gx, gy, gz, mx, my, mz;
+};
+
+struct Checker {
+    size_t checked = 0;
+    size_t failures = 0;
+    double maxErrLsb = 0.0;     // largest conversion error, in LSB
+
+    void fail(const char *mode, size_t i, const char *what) {
+        if (failures++ < 5) {
+            fprintf(stderr, "%s: sample %zu: %s\n", mode, i, what);
+        }
+    }
+
+    void bound(const char *mode, size_t i, float got, float want, float scale) {
+        double err = fabs((double)got - want) / scale;
+        if (err > maxErrLsb) maxErrLsb = err;
+        // Half an LSB of quantization plus float rounding of the conversion
+        if (err > 0.5 + 1e-3) {
+            fail(mode, i, "conversion error above half an LSB");
+        }
+    }
+};
+
+int16_t quantize(float value, float lsbPerUnit, bool *clipped) {
+    float counts = roundf(value * lsbPerUnit);
+    if (counts > 32767.0f || counts < -32768.0f) {
+        *clipped = true;
+        return counts > 0.0f ? 32767 : -32768;
+    }
+    return (int16_t)counts;
+}
+
+std::vector<Replayed> quantize_log(const imu_log_t &log) {
+    std::vector<Replayed> out(log.count);
+    const float a = mpu9250::accel_lsb_per_g(0);
+    const float g = mpu9250::gyro_lsb_per_dps(0);
+    const float m = 1.0f / mpu9250::kMagUtPerLsb;
+    for (size_t i = 0; i < log.count; i++) {
+        const imu_log_sample_t &s = log.samples[i];
+        Replayed &r = out[i];
+        r.clipped = false;
+        r.src = &s;
+        r.magNew = !(s.mx == 0.0f && s.my == 0.0f && s.mz == 0.0f);
+        r.raw.ax = quantize(s.ax, a, &r.clipped);
+        r.raw.ay = quantize(s.ay, a, &r.clipped);
+        r.raw.az = quantize(s.az, a, &r.clipped);
+        r.raw.gx = quantize(s.gx, g, &r.clipped);
+        r.raw.gy = quantize(s.gy, g, &r.clipped);
+        r.raw.gz = quantize(s.gz, g, &r.clipped);
+        r.raw.mx = r.magNew ? quantize(s.mx, m, &r.clipped) : 0;
+        r.raw.my = r.magNew ? quantize(s.my, m, &r.clipped) : 0;
+        r.raw.mz = r.magNew ? quantize(s.mz, m, &r.clipped) : 0;
+    }
+    return out;
+}
+
+// The conversion done by the firmware after a read: counts times the scale of the range
+template <typename Bus>
+inline void convert(const Driver<Bus> &drv, const RawSample &raw, Physical &p) {
+    const float as = drv.accelScale();
+    const float gs = drv.gyroScale();
+    const float ms = Driver<Bus>::magScale();
+    p.ax = raw.ax * as;
+    p.ay = raw.ay * as;
+    p.az = raw.az * as;
+    p.gx = raw.gx * gs;
+    p.gy = raw.gy * gs;
+    p.gz = raw.gz * gs;
+    p.mx = raw.mx * ms;
+    p.my = raw.my * ms;
+    p.mz = raw.mz * ms;
+}
+
+template <typename Bus>
+void check_imu(const char *mode, size_t i, const Driver<Bus> &drv, const RawSample &got,
+               const Replayed &want, Checker &c) {
+    c.checked++;
+    if (got.ax != want.raw.ax || got.ay != want.raw.ay || got.az != want.raw.az ||
+        got.gx != want.raw.gx || got.gy != want.raw.gy || got.gz != want.raw.gz) {
+        c.fail(mode, i, "accelerometer/gyroscope counts differ from the replayed ones");
+        return;
+    }
+    if (want.clipped) {
+        return;
+    }
+    Physical p;
+    convert(drv, got, p);
+    const imu_log_sample_t &s = *want.src;
+    c.bound(mode, i, p.ax, s.ax, drv.accelScale());
+    c.bound(mode, i, p.ay, s.ay, drv.accelScale());
+    c.bound(mode, i, p.az, s.az, drv.accelScale());
+    c.bound(mode, i, p.gx, s.gx, drv.gyroScale());
+    c.bound(mode, i, p.gy, s.gy, drv.gyroScale());
+    c.bound(mode, i, p.gz, s.gz, drv.gyroScale());
+}
+
+template <typename Bus>
+void check_mag(const char *mode, size_t i, const Driver<Bus> &drv, const RawSample &got,
+               const Replayed &want, Checker &c) {
+    if (got.mx != want.raw.mx || got.my != want.raw.my || got.mz != want.raw.mz) {
+        c.fail(mode, i, "magnetometer counts differ from the last measurement");
+        return;
+    }
+    if (want.clipped) {
+        return;
+    }
+    Physical p;
+    convert(drv, got, p);
+    const float ms = Driver<Bus>::magScale();
+    c.bound(mode, i, p.mx, want.src->mx, ms);
+    c.bound(mode, i, p.my, want.src->my, ms);
+    c.bound(mode, i, p.mz, want.src->mz, ms);
+}
+
+struct Traffic {
+    char mode[48];                  // longest label with a 20-digit size_t count
+    const char *bus;
+    size_t samples;
+    mpu9250::BusStats stats;
+    size_t magReads;        // magnetometer reads (due), fresh or not
+    size_t magFresh;        // new readings returned
+};
+
+void report(const Traffic &t) {
+    printf("%-26s %-5s %10.2f %16.3f %12.2f\n", t.mode, t.bus, (double)t.stats.bytes / t.samples,
+           (double)t.stats.transactions / t.samples,
+           t.magFresh ? (double)t.magReads / t.magFresh : 0.0);
+}
+
+// Whether a new reading must come back: every measurement with bypass (ST1.DRDY), one
+// that differs from the last with the aux master copy (value dedupe)
+bool expect_fresh(const Replayed *mag, const Replayed *returned, bool aux) {
+    if (mag == NULL) {
+        return false;
+    }
+    if (!aux || returned == NULL) {
+        return true;
+    }
+    return mag->raw.mx != returned->raw.mx || mag->raw.my != returned->raw.my ||
+           mag->raw.mz != returned->raw.mz;
+}
+
+// Nominal interval of the log, for placing the oversampled reads
+int64_t log_period_us(const std::vector<Replayed> &log) {
+    if (log.size() < 2) {
+        return mpu9250::kAkPeriodUs;
+    }
+    return (log.back().src->t_us - log.front().src->t_us) / (int64_t)(log.size() - 1);
+}
+
+mpu9250::Config default_config() {
+    mpu9250::Config config;
+    config.accelRange = 0;
+    config.gyroRange = 0;
+    config.dlpfCfg = 4;
+    config.sampleRateDiv = 9;
+    return config;
+}
+
+template <typename Bus>
+bool begin(Bus &bus, Driver<Bus> &drv, bool aux) {
+    if (drv.beginImu(default_config()) != Status::Ok || drv.beginMag() != Status::Ok) {
+        return false;
+    }
+    if (aux && drv.enableAuxMaster() != Status::Ok) {
+        return false;
+    }
+    bus.clearStats();
+    return true;
+}
+
+// One readAll() per IMU sample, oversample IMU samples per log sample
+template <typename Bus>
+Traffic run_direct(const std::vector<Replayed> &log, bool aux, size_t oversample,
+                   const char *busName, Checker &c) {
+    Traffic t = Traffic();
+    if (oversample > 1) {
+        snprintf(t.mode, sizeof(t.mode), "%s readAll x%zu", aux ? "aux" : "bypass", oversample);
+    } else {
+        snprintf(t.mode, sizeof(t.mode), "%s readAll", aux ? "aux" : "bypass");
+    }
+    t.bus = busName;
+    t.samples = log.size() * oversample;
+    const char *mode = t.mode;
+    Bus bus;
+    Driver<Bus> drv(bus);
+    if (!begin(bus, drv, aux)) {
+        c.fail(mode, 0, "setup failed");
+        return t;
+    }
+
+    const int64_t step = log_period_us(log) / (int64_t)oversample;
+    const Replayed *pending = NULL;     // measured, not returned yet
+    const Replayed *returned = NULL;    // last returned
+    for (size_t i = 0; i < log.size(); i++) {
+        for (size_t k = 0; k < oversample; k++) {
+            const int64_t now = log[i].src->t_us + (int64_t)k * step;
+            const bool magNew = k == 0 && log[i].magNew;
+            bus.push(log[i].raw, magNew);
+            if (magNew) pending = &log[i];
+
+            bool due = drv.magDue(now);
+            RawSample got;
+            bool magFresh;
+            if (drv.readAll(got, now, &magFresh) != Status::Ok) {
+                c.fail(mode, i, "readAll failed");
+                continue;
+            }
+            check_imu(mode, i, drv, got, log[i], c);
+            t.magReads += due;
+            if (!due) {
+                if (magFresh) c.fail(mode, i, "magnetometer returned without a read");
+                continue;
+            }
+            if (magFresh != expect_fresh(pending, returned, aux)) {
+                c.fail(mode, i, magFresh ? "stale magnetometer reading returned"
+                                         : "new magnetometer reading missed");
+            } else if (magFresh) {
+                check_mag(mode, i, drv, got, *pending, c);
+                returned = pending;
+                t.magFresh++;
+            }
+            pending = NULL;
+        }
+    }
+    t.stats = bus.stats();
+    return t;
+}
+
+// Timer-driven FIFO drain with the aux master, as the firmware's FIFO task
+template <typename Bus>
+Traffic run_fifo(const std::vector<Replayed> &log, size_t drain, const char *busName, Checker &c) {
+    Traffic t = Traffic();
+    snprintf(t.mode, sizeof(t.mode), "fifo drain %zu + mag", drain);
+    t.bus = busName;
+    t.samples = log.size();
+    const char *mode = t.mode;
+    Bus bus;
+    Driver<Bus> drv(bus);
+    if (!begin(bus, drv, true) || drv.fifoEnable() != Status::Ok) {
+        c.fail(mode, 0, "setup failed");
+        return t;
+    }
+    bus.clearStats();
+
+    const Replayed *pending = NULL;
+    const Replayed *returned = NULL;
+    std::vector<RawSample> got;
+    size_t next = 0;
+    for (size_t i = 0; i < log.size(); i++) {
+        bus.push(log[i].raw, log[i].magNew);
+        if (log[i].magNew) pending = &log[i];
+        if ((i + 1) % drain != 0 && i + 1 != log.size()) {
+            continue;
+        }
+
+        got.clear();
+        size_t count;
+        bool overflow;
+        Status st = drv.fifoRead(mpu9250::kFifoMaxSamples,
+                                 [&got](const RawSample &s) { got.push_back(s); }, &count, &overflow);
+        if (st != Status::Ok || overflow || count != i + 1 - next) {
+            c.fail(mode, i, "FIFO drain lost samples");
+            next = i + 1;
+            continue;
+        }
+        for (size_t k = 0; k < count; k++) {
+            check_imu(mode, next + k, drv, got[k], log[next + k], c);
+        }
+        next = i + 1;
+
+        // The aux copy holds the newest measurement; readMag() returns it once
+        const int64_t now = log[i].src->t_us;
+        if (!drv.magDue(now)) {
+            continue;
+        }
+        t.magReads++;
+        RawSample mag;
+        st = drv.readMag(mag, now);
+        if (st != Status::Ok && st != Status::NotReady) {
+            c.fail(mode, i, "readMag failed");
+        } else if ((st == Status::Ok) != expect_fresh(pending, returned, true)) {
+            c.fail(mode, i, st == Status::Ok ? "stale magnetometer reading returned"
+                                             : "new magnetometer reading missed");
+        } else if (st == Status::Ok) {
+            check_mag(mode, i, drv, mag, *pending, c);
+            returned = pending;
+            t.magFresh++;
+        }
+        pending = NULL;
+    }
+    t.stats = bus.stats();
+    return t;
+}
+
+// More samples than the FIFO holds: the first 42 come back, then the overflow is reported
+template <typename Bus>
+bool check_overflow(const std::vector<Replayed> &log) {
+    Bus bus;
+    Driver<Bus> drv(bus);
+    if (!begin(bus, drv, true) || drv.fifoEnable() != Status::Ok) {
+        return false;
+    }
+    const size_t pushed = mpu9250::kFifoMaxSamples + 8;
+    for (size_t i = 0; i < pushed; i++) {
+        bus.push(log[i % log.size()].raw, false);
+    }
+
+    size_t count;
+    bool overflow;
+    bool ordered = true;
+    size_t idx = 0;
+    Status st = drv.fifoRead(mpu9250::kFifoMaxSamples, [&](const RawSample &s) {
+        const RawSample &want = log[idx++ % log.size()].raw;
+        if (s.ax != want.ax || s.gz != want.gz) ordered = false;
+    }, &count, &overflow);
+    return st == Status::Ok && overflow && ordered && count == mpu9250::kFifoMaxSamples &&
+           bus.fifoBytes() == 0;
+}
+
+template <typename Body>
+double time_ns(size_t calls, Body body) {
+    uint64_t t0 = bench_now_ns();
+    body();
+    return (double)(bench_now_ns() - t0) / calls;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *log_path = DEFAULT_LOG;
+    size_t drain = DEFAULT_DRAIN;
+    size_t oversample = DEFAULT_OVERSAMPLE;
+    size_t calls = DEFAULT_CALLS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--drain") == 0 && i + 1 < argc) {
+            drain = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--oversample") == 0 && i + 1 < argc) {
+            oversample = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-') {
+            log_path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [log.csv|log.bin] [--drain N] [--oversample N] [--calls N]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (drain == 0 || drain > mpu9250::kFifoMaxSamples || oversample == 0 || calls == 0) {
+        fprintf(stderr, "--drain must be 1..%zu, --oversample and --calls positive\n",
+                mpu9250::kFifoMaxSamples);
+        return 2;
+    }
+
+    imu_log_t log;
+    if (imu_log_load(log_path, &log) != 0) {
+        return 1;
+    }
+    if (log.count == 0) {
+        fprintf(stderr, "%s: empty log\n", log_path);
+        imu_log_free(&log);
+        return 1;
+    }
+    std::vector<Replayed> replay = quantize_log(log);
+    size_t clipped = 0;
+    for (const Replayed &r : replay) clipped += r.clipped;
+
+    printf("%s: %zu samples replayed (%zu clipped at the default ranges)\n\n", log_path, log.count,
+           clipped);
+
+    Checker c;
+    std::vector<Traffic> traffic;
+    traffic.push_back(run_direct<WireMock>(replay, false, 1, "Wire", c));
+    traffic.push_back(run_direct<WireMock>(replay, true, 1, "Wire", c));
+    if (oversample > 1) {
+        traffic.push_back(run_direct<WireMock>(replay, false, oversample, "Wire", c));
+        traffic.push_back(run_direct<WireMock>(replay, true, oversample, "Wire", c));
+    }
+    traffic.push_back(run_fifo<WireMock>(replay, drain, "Wire", c));
+    traffic.push_back(run_fifo<IdfMock>(replay, drain, "IDF", c));
+    traffic.push_back(run_fifo<WireMock>(replay, mpu9250::kFifoMaxSamples - 2, "Wire", c));
+    traffic.push_back(run_fifo<IdfMock>(replay, mpu9250::kFifoMaxSamples - 2, "IDF", c));
+    bool overflow_ok = check_overflow<WireMock>(replay) && check_overflow<IdfMock>(replay);
+
+    printf("%-26s %-5s %10s %16s %12s\n", "mode", "bus", "bytes/smp", "transactions/smp",
+           "mag reads/new");
+    for (const Traffic &t : traffic) {
+        report(t);
+    }
+    printf("\nround trip: %zu samples checked, max conversion error %.3f LSB, %zu failures\n",
+           c.checked, c.maxErrLsb, c.failures);
+    printf("FIFO overflow: %s\n\n", overflow_ok ? "reported, 42 samples kept" : "FAILED");
+
+    // Register images of the replayed samples, as the reads return them
+    std::vector<uint8_t> bursts(replay.size() * mpu9250::kBurstSize);
+    std::vector<uint8_t> frames(replay.size() * mpu9250::kFifoFrameSize);
+    {
+        IdfMock bus;
+        Driver<IdfMock> drv(bus);
+        begin(bus, drv, true);
+        drv.fifoEnable();
+        for (size_t i = 0; i < replay.size(); i++) {
+            bus.push(replay[i].raw, true);
+            bus.read(mpu9250::kMpuAddr, mpu9250::reg::ACCEL_XOUT_H, &bursts[i * mpu9250::kBurstSize],
+                     mpu9250::kBurstSize);
+            bus.read(mpu9250::kMpuAddr, mpu9250::reg::FIFO_R_W, &frames[i * mpu9250::kFifoFrameSize],
+                     mpu9250::kFifoFrameSize);
+        }
+    }
+
+    IdfMock bus;
+    Driver<IdfMock> drv(bus);
+    begin(bus, drv, true);
+    bus.push(replay[0].raw, true);
+    const size_t n = replay.size();
+
+    float sum = 0.0f;
+    double burst_ns = time_ns(calls, [&]() {
+        for (size_t k = 0, i = 0; k < calls; k++) {
+            RawSample raw;
+            Physical p;
+            mpu9250::decode_burst(&bursts[i * mpu9250::kBurstSize], raw);
+            convert(drv, raw, p);
+            sum += p.ax + p.gz + p.mx;
+            if (++i == n) i = 0;
+        }
+    });
+    double frame_ns = time_ns(calls, [&]() {
+        for (size_t k = 0, i = 0; k < calls; k++) {
+            RawSample raw;
+            Physical p;
+            mpu9250::decode_fifo_frame(&frames[i * mpu9250::kFifoFrameSize], raw);
+            convert(drv, raw, p);
+            sum += p.ax + p.gz;
+            if (++i == n) i = 0;
+        }
+    });
+    double driver_ns = time_ns(calls, [&]() {
+        for (size_t k = 0; k < calls; k++) {
+            RawSample raw;
+            Physical p;
+            bool magFresh;
+            drv.readAll(raw, 0, &magFresh);
+            convert(drv, raw, p);
+            sum += p.ax + p.gz + p.mx;
+        }
+    });
+    bench_consume_float(sum);
+
+    printf("decode_burst + convert            %8.2f ns/sample\n", burst_ns);
+    printf("decode_fifo_frame + convert       %8.2f ns/sample\n", frame_ns);
+    printf("Driver<MockBus>::readAll + convert %7.2f ns/sample (register copy included)\n", driver_ns);
+
+    imu_log_free(&log);
+    return (c.failures == 0 && overflow_ok) ? 0 : 1;
+}
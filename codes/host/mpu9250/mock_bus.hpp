@@ -0,0 +1,211 @@
+//=============================================================================================
+// mock_bus.hpp
+//=============================================================================================
+//
+// Host bus policy for mpu9250::Driver (mpu9250_driver.hpp): an in-memory model of the
+// MPU9250 and AK8963 register files that sensor samples are replayed into, and that
+// counts the transactions and bytes the driver puts on the I2C bus.
+//
+// Modelled: register auto-increment, the FIFO (FIFO_R_W port, FIFO_COUNT, FIFO_MODE
+// overflow with INT_STATUS.FIFO_OFLOW_INT cleared on read, FIFO_RST), I2C bypass (the
+// AK8963 only answers with INT_PIN_CFG.BYPASS_EN set), ST1.DRDY cleared by reading ST2,
+// and the aux I2C master copying HXL..ST2 into EXT_SENS_DATA on every sample, whether
+// or not the AK8963 has measured. Sample rate dividers and I2C_MST_DLY are not: each
+// push() is one output sample.
+//
+// Bytes are counted as they appear on the wire: a register write is address, register
+// and value (3 bytes); a read is address+W, register, address+R and the data (len + 3).
+//
+//=============================================================================================
+#ifndef MPU9250_MOCK_BUS_HPP
+#define MPU9250_MOCK_BUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include "mpu9250_driver.hpp"
+
+namespace mpu9250 {
+
+struct BusStats {
+    uint64_t transactions;
+    uint64_t bytes;
+    uint64_t failed;        // e.g. AK8963 addressed with bypass off
+};
+
+// MaxRead mirrors the platform: 120 for Arduino Wire, the whole FIFO for ESP-IDF
+template <size_t MaxRead>
+class MockBus {
+public:
+    static constexpr size_t kMaxRead = MaxRead;
+
+    MockBus() { reset(); }
+
+    void reset() {
+        memset(mpu_, 0, sizeof(mpu_));
+        memset(ak_, 0, sizeof(ak_));
+        fifo_.clear();
+        mpu_[reg::PWR_MGMT_1] = 0x01;
+        stats_ = BusStats();
+    }
+
+    const BusStats &stats() const { return stats_; }
+    void clearStats() { stats_ = BusStats(); }
+    size_t fifoBytes() const { return fifo_.size(); }
+
+    //-----------------------------------------------------------------------------------------
+    // Sensor side
+
+    /**
+     * @brief Latch one output sample: data registers, FIFO and the aux master copy
+     *
+     * @param raw Counts as the chip would report them
+     * @param magNew The AK8963 finished a measurement (raw.mx..mz are used)
+     * @param magOverflow That measurement overflowed (ST2.HOFL)
+     */
+    void push(const RawSample &raw, bool magNew, bool magOverflow = false) {
+        put_be16(&mpu_[reg::ACCEL_XOUT_H + 0], raw.ax);
+        put_be16(&mpu_[reg::ACCEL_XOUT_H + 2], raw.ay);
+        put_be16(&mpu_[reg::ACCEL_XOUT_H + 4], raw.az);
+        put_be16(&mpu_[reg::ACCEL_XOUT_H + 6], 0);      // temperature
+        put_be16(&mpu_[reg::ACCEL_XOUT_H + 8], raw.gx);
+        put_be16(&mpu_[reg::ACCEL_XOUT_H + 10], raw.gy);
+        put_be16(&mpu_[reg::ACCEL_XOUT_H + 12], raw.gz);
+        mpu_[reg::INT_STATUS] |= kIntDataReady;
+
+        if (magNew) {
+            put_le16(&ak_[ak::HXL + 0], raw.mx);
+            put_le16(&ak_[ak::HXL + 2], raw.my);
+            put_le16(&ak_[ak::HXL + 4], raw.mz);
+            ak_[ak::ST1] |= kAkSt1DataReady;
+            ak_[ak::ST2] = magOverflow ? kAkSt2Overflow : 0x00;
+        }
+
+        // SLV0 enabled as a read of the AK8963: copy its registers, which also reads ST2
+        if ((mpu_[reg::USER_CTRL] & kUserI2cMasterEnable) && (mpu_[reg::I2C_SLV0_CTRL] & 0x80) &&
+            mpu_[reg::I2C_SLV0_ADDR] == (0x80 | kAkAddr)) {
+            size_t len = mpu_[reg::I2C_SLV0_CTRL] & 0x0F;
+            uint8_t start = mpu_[reg::I2C_SLV0_REG];
+            for (size_t i = 0; i < len; i++) {
+                mpu_[reg::EXT_SENS_DATA_00 + i] = ak_read(start + i);
+            }
+        }
+
+        if ((mpu_[reg::USER_CTRL] & kUserFifoEnable) && mpu_[reg::FIFO_EN] == kFifoAccelGyro) {
+            if (fifo_.size() + kFifoFrameSize > kFifoSize) {
+                // FIFO_MODE set: the sample is dropped; otherwise the oldest bytes go
+                if (mpu_[reg::CONFIG] & kConfigFifoMode) {
+                    mpu_[reg::INT_STATUS] |= kIntFifoOverflow;
+                    return;
+                }
+                for (size_t i = 0; i < kFifoFrameSize; i++) fifo_.pop_front();
+                mpu_[reg::INT_STATUS] |= kIntFifoOverflow;
+            }
+            const uint8_t *a = &mpu_[reg::ACCEL_XOUT_H];
+            fifo_.insert(fifo_.end(), a, a + 6);
+            fifo_.insert(fifo_.end(), a + 8, a + 14);
+        }
+    }
+
+    //-----------------------------------------------------------------------------------------
+    // Bus policy
+
+    bool write(uint8_t addr, uint8_t r, uint8_t value) {
+        stats_.transactions++;
+        stats_.bytes += 3;
+        if (addr == kAkAddr) {
+            if (!bypass()) {
+                stats_.failed++;
+                return false;
+            }
+            ak_[r & 0x1F] = value;
+            return true;
+        }
+
+        if (r == reg::USER_CTRL && (value & kUserFifoReset)) {
+            fifo_.clear();
+            value &= ~kUserFifoReset;       // self-clearing
+        }
+        if (r == reg::FIFO_R_W) {
+            return true;
+        }
+        mpu_[r & 0x7F] = value;
+        return true;
+    }
+
+    bool read(uint8_t addr, uint8_t r, uint8_t *data, size_t len) {
+        stats_.transactions++;
+        stats_.bytes += len + 3;
+        if (len > kMaxRead) {
+            stats_.failed++;
+            return false;
+        }
+        if (addr == kAkAddr) {
+            if (!bypass()) {
+                stats_.failed++;
+                return false;
+            }
+            for (size_t i = 0; i < len; i++) {
+                data[i] = ak_read(r + i);
+            }
+            return true;
+        }
+
+        // FIFO_R_W does not auto-increment
+        if (r == reg::FIFO_R_W) {
+            for (size_t i = 0; i < len; i++) {
+                data[i] = fifo_.empty() ? 0xFF : fifo_.front();
+                if (!fifo_.empty()) fifo_.pop_front();
+            }
+            return true;
+        }
+
+        for (size_t i = 0; i < len; i++) {
+            uint8_t a = (uint8_t)((r + i) & 0x7F);
+            if (a == reg::FIFO_COUNTH) {
+                data[i] = (uint8_t)(fifo_.size() >> 8);
+            } else if (a == reg::FIFO_COUNTH + 1) {
+                data[i] = (uint8_t)fifo_.size();
+            } else if (a == reg::INT_STATUS) {
+                data[i] = mpu_[a];
+                mpu_[a] = 0;                // cleared on read
+            } else {
+                data[i] = mpu_[a];
+            }
+        }
+        return true;
+    }
+
+    void delay_ms(uint32_t) {}
+
+private:
+    bool bypass() const { return (mpu_[reg::INT_PIN_CFG] & kBypassEnable) != 0; }
+
+    uint8_t ak_read(size_t a) {
+        uint8_t v = ak_[a & 0x1F];
+        if (a == ak::ST2) {
+            ak_[ak::ST1] &= ~kAkSt1DataReady;   // end of the data read
+        }
+        return v;
+    }
+
+    static void put_be16(uint8_t *p, int16_t v) {
+        p[0] = (uint8_t)((uint16_t)v >> 8);
+        p[1] = (uint8_t)v;
+    }
+
+    static void put_le16(uint8_t *p, int16_t v) {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)((uint16_t)v >> 8);
+    }
+
+    uint8_t mpu_[128];
+    uint8_t ak_[32];
+    std::deque<uint8_t> fifo_;
+    BusStats stats_;
+};
+
+} // namespace mpu9250
+
+#endif // MPU9250_MOCK_BUS_HPP
@@ -0,0 +1,17 @@
+//=============================================================================================
+// driver/gpio.h (host shim)
+//=============================================================================================
+//
+// Only the types that mpu9250.h declares its API with, so that portable modules built on
+// it (mpu9250_calib.c) compile on the host. No GPIO functions are provided.
+//
+//=============================================================================================
+#ifndef HOST_SHIM_DRIVER_GPIO_H
+#define HOST_SHIM_DRIVER_GPIO_H
+
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_23 = 23,
+} gpio_num_t;
+
+#endif // HOST_SHIM_DRIVER_GPIO_H
@@ -0,0 +1,14 @@
+//=============================================================================================
+// driver/i2c_master.h (host shim)
+//=============================================================================================
+//
+// Only the types that mpu9250.h declares its API with, so that portable modules built on
+// it (mpu9250_calib.c) compile on the host. No I2C functions are provided.
+//
+//=============================================================================================
+#ifndef HOST_SHIM_DRIVER_I2C_MASTER_H
+#define HOST_SHIM_DRIVER_I2C_MASTER_H
+
+typedef struct i2c_master_bus_t *i2c_master_bus_handle_t;
+
+#endif // HOST_SHIM_DRIVER_I2C_MASTER_H
@@ -0,0 +1,105 @@
+//=============================================================================================
+// madgwick_lanes.hpp
+//=============================================================================================
+//
+// SIMD lane type for running several Madgwick filters side by side with the firmware
+// template (madgwick_ahrs.hpp): Madgwick<Mode, Units, Lanes<N>> advances N filters per
+// call, one per lane, each with its own beta and dt.
+//
+// Lanes<N> wraps a GCC vector extension type, so the compiler emits SSE/AVX on x86 and
+// NEON on ARM (the BTT Pi) from the same source. Every lane performs exactly the
+// operations of the scalar float filter, including the inverse square root bit hack, so
+// a lane is bit-identical to madgwick_ahrs_update() as long as both are built without
+// floating-point contraction (-ffp-contract=off).
+//
+//=============================================================================================
+#ifndef MADGWICK_LANES_HPP
+#define MADGWICK_LANES_HPP
+
+#include <cmath>
+#include <cstdint>
+#include "madgwick_ahrs.hpp"
+
+namespace madgwick {
+
+namespace detail {
+
+// GCC ignores vector_size on dependent typedefs, hence one specialisation per width
+template <int N>
+struct LaneVector;
+
+template <>
+struct LaneVector<4> {
+    typedef float type __attribute__((vector_size(16)));
+    typedef int32_t int_type __attribute__((vector_size(16)));
+};
+
+template <>
+struct LaneVector<8> {
+    typedef float type __attribute__((vector_size(32)));
+    typedef int32_t int_type __attribute__((vector_size(32)));
+};
+
+template <>
+struct LaneVector<16> {
+    typedef float type __attribute__((vector_size(64)));
+    typedef int32_t int_type __attribute__((vector_size(64)));
+};
+
+} // namespace detail
+
+template <int N>
+struct Lanes {
+    typedef typename detail::LaneVector<N>::type vec_type;
+    typedef typename detail::LaneVector<N>::int_type ivec_type;
+
+    static constexpr int size() { return N; }
+
+    vec_type v;
+
+    Lanes() = default;
+    // Broadcast: the sensor sample is the same for every lane
+    Lanes(float s) : v(vec_type{} + s) {}
+    explicit Lanes(vec_type x) : v(x) {}
+
+    float operator[](int i) const { return v[i]; }
+    void set(int i, float x) { v[i] = x; }
+
+    friend Lanes operator+(Lanes a, Lanes b) { return Lanes(a.v + b.v); }
+    friend Lanes operator-(Lanes a, Lanes b) { return Lanes(a.v - b.v); }
+    friend Lanes operator*(Lanes a, Lanes b) { return Lanes(a.v * b.v); }
+    friend Lanes operator/(Lanes a, Lanes b) { return Lanes(a.v / b.v); }
+    friend Lanes operator-(Lanes a) { return Lanes(-a.v); }
+    Lanes &operator+=(Lanes b) { v += b.v; return *this; }
+    Lanes &operator-=(Lanes b) { v -= b.v; return *this; }
+    Lanes &operator*=(Lanes b) { v *= b.v; return *this; }
+};
+
+template <int N>
+struct RealTraits<Lanes<N> > {
+    typedef typename Lanes<N>::vec_type vec_type;
+    typedef typename Lanes<N>::ivec_type ivec_type;
+
+    // Lane-wise copy of RealTraits<float>::inv_sqrt()
+    static inline Lanes<N> inv_sqrt(Lanes<N> x) {
+        vec_type halfx = 0.5f * x.v;
+        ivec_type i = (ivec_type)x.v;
+        i = 0x5f3759df - (i >> 1);
+        vec_type y = (vec_type)i;
+        y = y * (1.5f - (halfx * y * y));
+        y = y * (1.5f - (halfx * y * y));
+        return Lanes<N>(y);
+    }
+
+    static inline Lanes<N> sqrt(Lanes<N> x) {
+        Lanes<N> r;
+        for (int i = 0; i < N; i++) {
+            r.v[i] = sqrtf(x.v[i]);
+        }
+        return r;
+    }
+};
+
+} // namespace madgwick
+
+#endif // MADGWICK_LANES_HPP
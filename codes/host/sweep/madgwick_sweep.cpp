@@ -0,0 +1,210 @@
+//=============================================================================================
+// madgwick_sweep.cpp
+//=============================================================================================
+//
+// See madgwick_sweep.hpp.
+//
+//=============================================================================================
+
+#include "madgwick_sweep.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include "madgwick_lanes.hpp"
+
+namespace madgwick {
+namespace sweep {
+
+namespace {
+
+typedef Lanes<kLanes> lanes_t;
+typedef Madgwick<Mode::Imu, Units::Degrees, lanes_t> imu_lanes_t;
+typedef Madgwick<Mode::Marg, Units::Degrees, lanes_t> marg_lanes_t;
+
+const double kRadToDeg = 57.29577951308232;
+
+// Up to kLanes betas replayed at one decimation factor
+struct Job {
+    size_t decimation;
+    float rateHz;
+    size_t first;       // index of the first result written by this job
+    int count;          // lanes in use
+    float betas[kLanes];
+};
+
+// Running error statistics of one lane
+struct LaneStats {
+    long lastBad = -1;      // last evaluation index above the threshold
+    double sumSq = 0.0;
+    size_t n = 0;
+    double prevYaw = 0.0;   // unwrapped yaw error
+    bool hasYaw = false;
+    double st = 0.0, sy = 0.0, stt = 0.0, sty = 0.0;
+};
+
+double wrap_deg(double a) {
+    while (a > 180.0) a -= 360.0;
+    while (a <= -180.0) a += 360.0;
+    return a;
+}
+
+/**
+ * @brief Attitude and yaw error of a filter quaternion against the reference (deg)
+ *
+ * Relative rotation conj(ref) * q, as quat_angle_deg() in imu_log.c; the yaw error is
+ * its rotation about the sensor z axis.
+ */
+void quat_errors(const float a[4], const imu_log_sample_t &ref, double *angle, double *yaw) {
+    double b0 = ref.q0, b1 = ref.q1, b2 = ref.q2, b3 = ref.q3;
+    double r0 = b0 * a[0] + b1 * a[1] + b2 * a[2] + b3 * a[3];
+    double r1 = b0 * a[1] - b1 * a[0] - b2 * a[3] + b3 * a[2];
+    double r2 = b0 * a[2] + b1 * a[3] - b2 * a[0] - b3 * a[1];
+    double r3 = b0 * a[3] - b1 * a[2] + b2 * a[1] - b3 * a[0];
+    if (r0 < 0.0) {
+        r0 = -r0; r1 = -r1; r2 = -r2; r3 = -r3;
+    }
+    *angle = 2.0 * atan2(sqrt(r1 * r1 + r2 * r2 + r3 * r3), r0) * kRadToDeg;
+    *yaw = 2.0 * atan2(r3, r0) * kRadToDeg;
+}
+
+void run_job(const imu_log_t &log, const Job &job, const Options &options,
+             Result *out) {
+    Quaternion<lanes_t> q = { lanes_t(1.0f), lanes_t(0.0f), lanes_t(0.0f), lanes_t(0.0f) };
+    lanes_t beta;
+    for (int l = 0; l < kLanes; l++) {
+        beta.set(l, job.betas[l < job.count ? l : job.count - 1]);
+    }
+    // Same expression as madgwick_ahrs_begin() so that lanes match the C filter bit for bit
+    const lanes_t dt(1.0f / job.rateHz);
+
+    size_t evalStride = (size_t)std::max(1L, lround(job.rateHz / options.evalHz));
+    const int64_t t0 = log.samples[0].t_us;
+    const double tMid = (log.samples[log.count - 1].t_us - t0) * 0.5e-6;
+    LaneStats stats[kLanes];
+    std::vector<double> evalTimes;
+
+    size_t step = 0;
+    for (size_t i = 0; i < log.count; i += job.decimation, step++) {
+        const imu_log_sample_t &s = log.samples[i];
+        bool accValid = !(s.ax == 0.0f && s.ay == 0.0f && s.az == 0.0f);
+        bool magValid = !options.imuOnly && !(s.mx == 0.0f && s.my == 0.0f && s.mz == 0.0f);
+
+        // The sample is shared by all lanes, so these branches never diverge
+        if (!accValid) {
+            imu_lanes_t::propagate(q, dt, s.gx, s.gy, s.gz);
+        } else if (magValid) {
+            marg_lanes_t::step(q, beta, dt, s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.mx, s.my, s.mz);
+        } else {
+            imu_lanes_t::step(q, beta, dt, s.gx, s.gy, s.gz, s.ax, s.ay, s.az);
+        }
+
+        if (!log.has_truth || step % evalStride != 0) {
+            continue;
+        }
+        double t = (s.t_us - t0) * 1e-6;
+        long evalIndex = (long)evalTimes.size();
+        evalTimes.push_back(t);
+        for (int l = 0; l < job.count; l++) {
+            float a[4] = { q.q0[l], q.q1[l], q.q2[l], q.q3[l] };
+            double angle, yaw;
+            quat_errors(a, s, &angle, &yaw);
+            LaneStats &st = stats[l];
+            if (angle > options.thresholdDeg) {
+                st.lastBad = evalIndex;
+            }
+            st.prevYaw = st.hasYaw ? st.prevYaw + wrap_deg(yaw - st.prevYaw) : yaw;
+            st.hasYaw = true;
+            if (t >= tMid) {
+                double y = st.prevYaw;
+                st.sumSq += angle * angle;
+                st.n++;
+                st.st += t;
+                st.sy += y;
+                st.stt += t * t;
+                st.sty += t * y;
+            }
+        }
+    }
+
+    for (int l = 0; l < job.count; l++) {
+        const LaneStats &st = stats[l];
+        Result &r = out[l];
+        r.beta = job.betas[l];
+        r.rateHz = job.rateHz;
+        r.q0 = q.q0[l];
+        r.q1 = q.q1[l];
+        r.q2 = q.q2[l];
+        r.q3 = q.q3[l];
+        r.convergeS = -1.0;
+        r.rmsDeg = NAN;
+        r.yawDriftDegPerMin = NAN;
+        r.finalYawDeg = st.hasYaw ? wrap_deg(st.prevYaw) : NAN;
+        long evals = (long)evalTimes.size();
+        if (evals > 0 && st.lastBad < evals - 1) {
+            r.convergeS = evalTimes[(size_t)(st.lastBad + 1)];
+        }
+        if (st.n > 0) {
+            r.rmsDeg = sqrt(st.sumSq / st.n);
+        }
+        double den = st.n * st.stt - st.st * st.st;
+        if (st.n > 1 && den > 0.0) {
+            r.yawDriftDegPerMin = (st.n * st.sty - st.st * st.sy) / den * 60.0;
+        }
+    }
+}
+
+} // namespace
+
+double log_rate(const imu_log_t &log) {
+    if (log.count < 2) {
+        return 0.0;
+    }
+    int64_t span = log.samples[log.count - 1].t_us - log.samples[0].t_us;
+    return span > 0 ? (log.count - 1) * 1e6 / (double)span : 0.0;
+}
+
+std::vector<Result> run(const imu_log_t &log, const std::vector<float> &betas,
+                        const std::vector<float> &rates, const Options &options) {
+    std::vector<Result> results;
+    double logRate = log_rate(log);
+    if (logRate <= 0.0 || betas.empty() || rates.empty()) {
+        return results;
+    }
+
+    std::vector<Job> jobs;
+    for (float rate : rates) {
+        Job job;
+        job.decimation = (size_t)std::max(1L, lround(logRate / rate));
+        job.rateHz = (float)(logRate / job.decimation);
+        for (size_t b = 0; b < betas.size(); b += kLanes) {
+            job.first = results.size() + b;
+            job.count = (int)std::min<size_t>(kLanes, betas.size() - b);
+            std::copy(betas.begin() + b, betas.begin() + b + job.count, job.betas);
+            jobs.push_back(job);
+        }
+        results.resize(results.size() + betas.size());
+    }
+
+    unsigned threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+    threads = std::max(1u, std::min<unsigned>(threads, (unsigned)jobs.size()));
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t j = next++; j < jobs.size(); j = next++) {
+            run_job(log, jobs[j], options, &results[jobs[j].first]);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &t : pool) {
+        t.join();
+    }
+    return results;
+}
+
+} // namespace sweep
+} // namespace madgwick
@@ -0,0 +1,66 @@
+//=============================================================================================
+// madgwick_sweep.hpp
+//=============================================================================================
+//
+// Offboard replay of one recorded log through many Madgwick filters at once, to tune
+// beta and the sample rate without reflashing. Parameter sets sharing a sample rate
+// run together in the lanes of Madgwick<..., Lanes<kLanes>>, and those groups are
+// spread over worker threads.
+//
+// A lower sample rate is simulated by keeping every k-th sample of the log, so the
+// requested rates are rounded to log rate / k. The error metrics need a log with a
+// reference orientation (e.g. from gen_imu_log).
+//
+//=============================================================================================
+#ifndef MADGWICK_SWEEP_HPP
+#define MADGWICK_SWEEP_HPP
+
+#include <vector>
+#include "imu_log.h"
+
+namespace madgwick {
+namespace sweep {
+
+// Filters advanced per vector step (8 x float = one AVX register, two SSE/NEON ones)
+constexpr int kLanes = 8;
+
+struct Options {
+    bool imuOnly = false;           // never use the magnetometer
+    float thresholdDeg = 2.0f;      // attitude error that counts as converged
+    float evalHz = 20.0f;           // how often the error against the reference is sampled
+    unsigned threads = 0;           // worker threads, 0 = one per core
+};
+
+struct Result {
+    float beta;
+    float rateHz;                   // effective sample rate (log rate / decimation)
+    double convergeS;               // time after which the error stays below the threshold, < 0 if never
+    double rmsDeg;                  // RMS attitude error over the second half of the log
+    double yawDriftDegPerMin;       // slope of the yaw error over the second half of the log
+    double finalYawDeg;             // yaw error at the end of the log
+    float q0, q1, q2, q3;           // final quaternion
+};
+
+/**
+ * @brief Mean sample rate of a log from its timestamps
+ *
+ * @return Rate in Hz, 0 if the log has fewer than two samples or no time span
+ */
+double log_rate(const imu_log_t &log);
+
+/**
+ * @brief Replay the log for every combination of betas and rates
+ *
+ * @param log Log with reference orientation
+ * @param betas Filter gains
+ * @param rates Requested sample rates (Hz); each is rounded to log rate / k
+ * @param options Metric and threading options
+ * @return One result per (rate, beta) pair, rates outermost
+ */
+std::vector<Result> run(const imu_log_t &log, const std::vector<float> &betas,
+                        const std::vector<float> &rates, const Options &options);
+
+} // namespace sweep
+} // namespace madgwick
+
+#endif // MADGWICK_SWEEP_HPP
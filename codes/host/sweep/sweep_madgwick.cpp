@@ -0,0 +1,227 @@
+//=============================================================================================
+// sweep_madgwick.cpp
+//=============================================================================================
+//
+// Sweeps beta and the sample rate of the Madgwick filter over a recorded log with a
+// reference orientation, and ranks the parameter sets by their error metrics.
+//
+// Usage: sweep_madgwick <log.csv|log.bin> [--beta MIN:MAX:N] [--log-beta] [--rates R1,R2,...]
+//                       [--threads N] [--imu-only] [--threshold DEG] [--eval-hz HZ]
+//                       [--sort rms|drift|converge] [--top N] [--out results.csv]
+//   --beta       beta range, N values (default 0.01:1:256)
+//   --log-beta   space the beta values logarithmically instead of linearly
+//   --rates      sample rates to simulate by decimating the log (default: log rate)
+//   --threshold  attitude error below which the filter counts as converged (default 2 deg)
+//
+// Before the sweep, one lane is replayed against the scalar C filter
+// (madgwick_ahrs_update) and must match it bit for bit.
+//
+//=============================================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bench_clock.h"
+#include "imu_log.h"
+#include "madgwick_ahrs.h"
+#include "madgwick_sweep.hpp"
+
+using madgwick::sweep::Options;
+using madgwick::sweep::Result;
+
+namespace {
+
+void usage(const char *prog) {
+    fprintf(stderr, "usage: %s <log.csv|log.bin> [--beta MIN:MAX:N] [--log-beta] [--rates R1,R2,...]\n"
+                    "          [--threads N] [--imu-only] [--threshold DEG] [--eval-hz HZ]\n"
+                    "          [--sort rms|drift|converge] [--top N] [--out results.csv]\n", prog);
+}
+
+bool parse_range(const char *text, float *lo, float *hi, int *n) {
+    return sscanf(text, "%f:%f:%d", lo, hi, n) == 3 && *n > 0 && *lo >= 0.0f && *hi >= *lo;
+}
+
+bool parse_list(const char *text, std::vector<float> *out) {
+    std::string s(text);
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos) end = s.size();
+        float v = strtof(s.substr(pos, end - pos).c_str(), NULL);
+        if (v <= 0.0f) return false;
+        out->push_back(v);
+        pos = end + 1;
+    }
+    return !out->empty();
+}
+
+// The C API on the same log, for the first beta at the log rate
+bool matches_scalar_filter(const imu_log_t &log, float beta, bool imuOnly, const Result &lane) {
+    madgwick_ahrs_t filter;
+    madgwick_ahrs_init(&filter);
+    madgwick_ahrs_begin(&filter, lane.rateHz);
+    madgwick_ahrs_set_beta(&filter, beta);
+    for (size_t i = 0; i < log.count; i++) {
+        const imu_log_sample_t &s = log.samples[i];
+        if (imuOnly) {
+            madgwick_ahrs_update_imu(&filter, s.gx, s.gy, s.gz, s.ax, s.ay, s.az);
+        } else {
+            madgwick_ahrs_update(&filter, s.gx, s.gy, s.gz, s.ax, s.ay, s.az, s.mx, s.my, s.mz);
+        }
+    }
+    float q0, q1, q2, q3;
+    madgwick_ahrs_get_quaternion(&filter, &q0, &q1, &q2, &q3);
+    return q0 == lane.q0 && q1 == lane.q1 && q2 == lane.q2 && q3 == lane.q3;
+}
+
+// NaN and "never converged" sort last
+double sort_key(const Result &r, const std::string &by) {
+    double k;
+    if (by == "drift") {
+        k = fabs(r.yawDriftDegPerMin);
+    } else if (by == "converge") {
+        k = r.convergeS < 0.0 ? INFINITY : r.convergeS;
+    } else {
+        k = r.rmsDeg;
+    }
+    return std::isnan(k) ? INFINITY : k;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const char *log_path = argv[1];
+    const char *out_path = NULL;
+    float beta_lo = 0.01f, beta_hi = 1.0f;
+    int beta_n = 256;
+    bool log_beta = false;
+    std::vector<float> rates;
+    std::string sort_by = "rms";
+    size_t top = 10;
+    Options options;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--beta") == 0 && i + 1 < argc) {
+            if (!parse_range(argv[++i], &beta_lo, &beta_hi, &beta_n)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--log-beta") == 0) {
+            log_beta = true;
+        } else if (strcmp(argv[i], "--rates") == 0 && i + 1 < argc) {
+            if (!parse_list(argv[++i], &rates)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--imu-only") == 0) {
+            options.imuOnly = true;
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            options.thresholdDeg = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--eval-hz") == 0 && i + 1 < argc) {
+            options.evalHz = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--sort") == 0 && i + 1 < argc) {
+            sort_by = argv[++i];
+        } else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+            top = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (log_beta && beta_lo <= 0.0f) {
+        fprintf(stderr, "--log-beta needs a positive lower bound\n");
+        return 2;
+    }
+    if (options.evalHz <= 0.0f) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    imu_log_t log;
+    if (imu_log_load(log_path, &log) != 0) {
+        return 1;
+    }
+    double log_rate = madgwick::sweep::log_rate(log);
+    if (!log.has_truth || log_rate <= 0.0) {
+        fprintf(stderr, "%s: the sweep needs a log with timestamps and a reference orientation\n", log_path);
+        imu_log_free(&log);
+        return 1;
+    }
+    if (rates.empty()) {
+        rates.push_back((float)log_rate);
+    }
+
+    std::vector<float> betas;
+    for (int i = 0; i < beta_n; i++) {
+        float f = beta_n > 1 ? (float)i / (beta_n - 1) : 0.0f;
+        betas.push_back(log_beta ? beta_lo * powf(beta_hi / beta_lo, f) : beta_lo + (beta_hi - beta_lo) * f);
+    }
+
+    // One lane against the scalar filter first: the sweep is only useful if it is the same math
+    std::vector<float> probe_rate(1, (float)log_rate);
+    std::vector<float> probe_beta(1, betas[0]);
+    std::vector<Result> probe = madgwick::sweep::run(log, probe_beta, probe_rate, options);
+    bool same = matches_scalar_filter(log, betas[0], options.imuOnly, probe[0]);
+    printf("lane vs madgwick_ahrs_update (beta %.4f, %.1f Hz): %s\n", betas[0], probe[0].rateHz,
+           same ? "identical" : "MISMATCH");
+
+    uint64_t t0 = bench_now_ns();
+    std::vector<Result> results = madgwick::sweep::run(log, betas, rates, options);
+    double elapsed = (bench_now_ns() - t0) * 1e-9;
+
+    double updates = 0.0;
+    for (const Result &r : results) {
+        updates += ceil(log.count / std::max(1.0, round(log_rate / r.rateHz)));
+    }
+    printf("%s: %zu samples @ %.1f Hz, %zu parameter sets (%zu betas x %zu rates), %d lanes\n",
+           log_path, log.count, log_rate, results.size(), betas.size(), rates.size(),
+           madgwick::sweep::kLanes);
+    printf("swept in %.3f s (%.1f M filter updates/s)\n\n", elapsed, updates / elapsed * 1e-6);
+
+    if (out_path != NULL) {
+        FILE *f = fopen(out_path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "cannot create %s\n", out_path);
+        } else {
+            fprintf(f, "rate_hz,beta,converge_s,rms_deg,yaw_drift_deg_per_min,final_yaw_deg\n");
+            for (const Result &r : results) {
+                fprintf(f, "%.3f,%.6f,%.3f,%.4f,%.4f,%.4f\n", r.rateHz, r.beta, r.convergeS,
+                        r.rmsDeg, r.yawDriftDegPerMin, r.finalYawDeg);
+            }
+            fclose(f);
+            printf("results written to %s\n\n", out_path);
+        }
+    }
+
+    std::vector<size_t> order(results.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sort_key(results[a], sort_by) < sort_key(results[b], sort_by);
+    });
+
+    printf("best %zu by %s (second half of the log for rms and drift):\n", std::min(top, order.size()),
+           sort_by.c_str());
+    printf("%9s %9s %11s %9s %14s %10s\n", "rate Hz", "beta", "converge s", "rms deg", "yaw drift/min",
+           "final yaw");
+    for (size_t i = 0; i < order.size() && i < top; i++) {
+        const Result &r = results[order[i]];
+        printf("%9.2f %9.4f %11.2f %9.3f %14.3f %10.3f\n", r.rateHz, r.beta, r.convergeS, r.rmsDeg,
+               r.yawDriftDegPerMin, r.finalYawDeg);
+    }
+
+    imu_log_free(&log);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+//=============================================================================================
+// bench_telemetry.cpp
+//=============================================================================================
+//
+// Checks the telemetry framing (telemetry_frame.h) and the host decoder
+// (telemetry_decoder.hpp), and compares the cost of a binary status update with the
+// former formatted prints:
+//
+//   round trip  every payload length with zero, 0xFF and random bytes frames without
+//               a 0x00 inside and unframes to the same record; every single-bit error
+//               of a pose frame is rejected
+//   stream      20000 records with log lines in between, fed in random chunks, starting
+//               mid-frame, with bit errors, lost bytes and lost frames: every intact
+//               record and line comes out in order with its unwrapped time, and the
+//               sequence gaps account for every damaged frame
+//   cost        bytes, host time and 115200 baud UART time per odometry status update
+//
+// Exits 1 if a check fails.
+//
+// Usage: bench_telemetry
+//
+//=============================================================================================
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_clock.h"
+#include "telemetry_decoder.hpp"
+
+namespace {
+
+constexpr int kStreamRecords = 20000;
+constexpr double kUartBytesPerS = 115200.0 / 10.0;     // 8N1
+
+struct Expected {
+    uint8_t type;
+    uint8_t seq;
+    uint64_t tUs;
+    std::vector<uint8_t> payload;
+};
+
+bool check_round_trip(std::mt19937 &rng) {
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    uint8_t out[TELEMETRY_MAX_PAYLOAD];
+    for (size_t len = 0; len <= TELEMETRY_MAX_PAYLOAD; len++) {
+        for (int pattern = 0; pattern < 3; pattern++) {
+            for (size_t i = 0; i < len; i++) {
+                payload[i] = pattern == 0 ? 0x00 : pattern == 1 ? 0xFF : (uint8_t)rng();
+            }
+            telemetry_header_t h = { TELEMETRY_POSE, (uint8_t)len, 0x00FF00FFu };
+            size_t n = telemetry_frame(&h, payload, len, frame);
+            if (n > TELEMETRY_MAX_FRAME || frame[n - 1] != 0 || memchr(frame, 0, n - 1)) {
+                printf("round trip: bad frame for %zu bytes (pattern %d)\n", len, pattern);
+                return false;
+            }
+            telemetry_header_t d;
+            int got = telemetry_unframe(frame, n - 1, &d, out);
+            if (got != (int)len || d.type != h.type || d.seq != h.seq || d.t_us != h.t_us ||
+                memcmp(out, payload, len) != 0) {
+                printf("round trip: %zu bytes (pattern %d) do not decode\n", len, pattern);
+                return false;
+            }
+        }
+    }
+
+    // Single-bit errors
+    telemetry_pose_t pose = { 1.25f, -0.5f, 3.0f, 0.2f, -1.0f };
+    telemetry_header_t h = { TELEMETRY_POSE, 7, 123456789u };
+    size_t n = telemetry_frame(&h, &pose, sizeof(pose), frame) - 1;
+    for (size_t bit = 0; bit < n * 8; bit++) {
+        uint8_t bad[TELEMETRY_MAX_FRAME];
+        memcpy(bad, frame, n);
+        bad[bit / 8] ^= (uint8_t)(1u << (bit % 8));
+        telemetry_header_t d;
+        if (telemetry_unframe(bad, n, &d, out) >= 0) {
+            printf("round trip: bit error %zu not detected\n", bit);
+            return false;
+        }
+    }
+    printf("round trip: %u payload lengths, %zu single-bit errors rejected   ok\n",
+           TELEMETRY_MAX_PAYLOAD + 1, n * 8);
+    return true;
+}
+
+bool check_stream(std::mt19937 &rng) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    const uint8_t kTypes[] = { TELEMETRY_IMU, TELEMETRY_POSE, TELEMETRY_COUNTS, TELEMETRY_DIAG,
+                               TELEMETRY_TEXT };
+    const size_t kLens[] = { sizeof(telemetry_imu_t), sizeof(telemetry_pose_t),
+                             sizeof(telemetry_counts_t), sizeof(telemetry_diag_t), 40 };
+
+    std::vector<uint8_t> stream;
+    std::vector<Expected> records;
+    std::vector<std::string> lines;
+    uint64_t damaged = 0;
+
+    // Joined mid-frame: the tail of a frame comes first
+    {
+        telemetry_pose_t pose = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f };
+        telemetry_header_t h = { TELEMETRY_POSE, 0xF0, 0 };
+        uint8_t frame[TELEMETRY_MAX_FRAME];
+        size_t n = telemetry_frame(&h, &pose, sizeof(pose), frame);
+        stream.insert(stream.end(), frame + n / 2, frame + n);
+    }
+
+    const uint64_t t0 = 0xFFF00000u;    // wraps the 32-bit time within the stream
+    for (int k = 0; k < kStreamRecords; k++) {
+        int t = (int)(rng() % 5);
+        Expected e;
+        e.type = kTypes[t];
+        e.seq = (uint8_t)k;
+        e.tUs = t0 + (uint64_t)k * 997;
+        e.payload.resize(kLens[t]);
+        for (size_t i = 0; i < e.payload.size(); i++) {
+            e.payload[i] = e.type == TELEMETRY_TEXT ? (uint8_t)('a' + rng() % 26) : (uint8_t)rng();
+        }
+        telemetry_header_t h = { e.type, e.seq, (uint32_t)e.tUs };
+        uint8_t frame[TELEMETRY_MAX_FRAME];
+        size_t n = telemetry_frame(&h, e.payload.data(), e.payload.size(), frame);
+
+        // The first and last records stay intact: only a later record shows a gap
+        double fault = k > 0 && k < kStreamRecords - 1 ? u(rng) : 1.0;
+        if (fault < 0.01) {
+            // Bit error (never to 0x00, which would only split the frame in two)
+            size_t i = rng() % (n - 1);
+            uint8_t flipped;
+            do {
+                flipped = (uint8_t)(frame[i] ^ (1u << (rng() % 8)));
+            } while (flipped == 0);
+            frame[i] = flipped;
+            damaged++;
+        } else if (fault < 0.02) {
+            // Lost bytes inside the frame
+            size_t i = rng() % (n - 1);
+            size_t drop = 1 + rng() % 8;
+            if (drop > n - 1 - i) drop = n - 1 - i;
+            memmove(frame + i, frame + i + drop, n - i - drop);
+            n -= drop;
+            damaged++;
+        } else if (fault < 0.025) {
+            // Lost frame
+            damaged++;
+            continue;
+        } else {
+            records.push_back(e);
+        }
+        stream.insert(stream.end(), frame, frame + n);
+
+        // Log output between two telemetry batches
+        if (u(rng) < 0.02) {
+            char line[64];
+            snprintf(line, sizeof(line), "I (%d) app: log line %zu", k, lines.size());
+            lines.push_back(line);
+            stream.insert(stream.end(), line, line + strlen(line));
+            stream.push_back('\r');
+            stream.push_back('\n');
+            stream.push_back(0);
+        }
+    }
+
+    // Feed in random chunks, as reads from the port return them
+    telemetry::Decoder decoder;
+    std::vector<Expected> gotRecords;
+    std::vector<std::string> gotLines;
+    auto onRecord = [&](const telemetry::Record &r) {
+        Expected e;
+        e.type = r.type;
+        e.seq = r.seq;
+        e.tUs = r.tUs;
+        e.payload.assign(r.payload, r.payload + r.len);
+        gotRecords.push_back(e);
+    };
+    auto onText = [&](const std::string &line) { gotLines.push_back(line); };
+    for (size_t pos = 0; pos < stream.size();) {
+        size_t n = 1 + rng() % 300;
+        if (n > stream.size() - pos) n = stream.size() - pos;
+        decoder.feed(stream.data() + pos, n, onRecord, onText);
+        pos += n;
+    }
+    decoder.flush(onRecord, onText);
+
+    bool ok = gotRecords.size() == records.size() && gotLines == lines;
+    for (size_t i = 0; ok && i < records.size(); i++) {
+        const Expected &a = records[i];
+        const Expected &b = gotRecords[i];
+        ok = a.type == b.type && a.seq == b.seq && a.payload == b.payload &&
+             a.tUs == b.tUs;
+    }
+    const telemetry::Stats &s = decoder.stats();
+    ok = ok && s.lost == damaged;
+    printf("stream: %zu bytes, %llu records (%zu sent intact), %llu lost (%llu damaged), "
+           "%llu bad frames, %llu/%zu log lines   %s\n",
+           stream.size(), (unsigned long long)s.records, records.size(),
+           (unsigned long long)s.lost, (unsigned long long)damaged,
+           (unsigned long long)s.badFrames, (unsigned long long)s.textLines, lines.size(),
+           ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// Former status update: the three printf lines of the print task
+size_t former_update(char *out, size_t size, int k) {
+    float x = 1.2345f + k * 1e-4f, y = -0.5f, theta = 0.785f, v = 0.25f, omega = -0.1f;
+    int n = snprintf(out, size, "Pose: x=%.4f m, y=%.4f m, theta=%.3f rad\n", x, y, theta);
+    n += snprintf(out + n, size - n, "Velocity: v=%.4f m/s, omega=%.4f rad/s\n", v, omega);
+    n += snprintf(out + n, size - n, "Loop: %lu Hz, dt max %lu us (encoder interrupts: %lu)\n\n",
+                  500ul, 2100ul, (unsigned long)k);
+    return (size_t)n;
+}
+
+// Telemetry status update: pose and counts records
+size_t binary_update(uint8_t *out, int k) {
+    telemetry_pose_t pose = { 1.2345f + k * 1e-4f, -0.5f, 0.785f, 0.25f, -0.1f };
+    telemetry_counts_t counts = { 12000 + k, 11500 + k, 420.0f, 400.0f };
+    telemetry_header_t h = { TELEMETRY_POSE, (uint8_t)k, (uint32_t)k * 20000u };
+    size_t n = telemetry_frame(&h, &pose, sizeof(pose), out);
+    h.type = TELEMETRY_COUNTS;
+    h.seq++;
+    return n + telemetry_frame(&h, &counts, sizeof(counts), out + n);
+}
+
+void compare_cost() {
+    const int n = 200000;
+    char text[256];
+    uint8_t bin[2 * TELEMETRY_MAX_FRAME];
+    size_t textBytes = 0, binBytes = 0;
+
+    uint64_t t0 = bench_now_ns();
+    for (int k = 0; k < n; k++) textBytes += former_update(text, sizeof(text), k);
+    uint64_t t1 = bench_now_ns();
+    for (int k = 0; k < n; k++) binBytes += binary_update(bin, k);
+    uint64_t t2 = bench_now_ns();
+    bench_consume_float((float)(text[0] + bin[0]));
+
+    double textPer = (double)textBytes / n, binPer = (double)binBytes / n;
+    printf("\n  %-28s %8s %10s %12s %12s\n", "status update", "bytes", "host ns", "UART ms",
+           "max rate Hz");
+    printf("  %-28s %8.1f %10.1f %12.2f %12.0f\n", "printf pose/velocity/loop", textPer,
+           (double)(t1 - t0) / n, textPer / kUartBytesPerS * 1e3, kUartBytesPerS / textPer);
+    printf("  %-28s %8.1f %10.1f %12.2f %12.0f\n", "binary pose + counts", binPer,
+           (double)(t2 - t1) / n, binPer / kUartBytesPerS * 1e3, kUartBytesPerS / binPer);
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(20240601);
+    bool ok = check_round_trip(rng);
+    ok = check_stream(rng) && ok;
+    compare_cost();
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+//=============================================================================================
+// telemetry_decode.cpp
+//=============================================================================================
+//
+// Decodes the binary telemetry of the firmware (telemetry.h) from a serial port or a
+// capture file, prints the records as text and optionally records them to CSV.
+//
+// Usage: telemetry_decode <port|capture.bin> [--baud N] [--csv PREFIX] [--quiet]
+//   --baud   serial port speed (default 115200; ignored for files)
+//   --csv    write PREFIX_imu.csv, PREFIX_pose.csv, PREFIX_counts.csv, PREFIX_diag.csv
+//   --quiet  print only the text lines and the link statistics
+//
+// Text lines from the port (boot log, printf) are printed as they are. The link
+// statistics (records, lost and bad frames) go to stderr at the end of the stream or
+// on Ctrl-C. A capture is simply the raw bytes: cat /dev/ttyUSB0 > capture.bin
+//
+//=============================================================================================
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "telemetry_decoder.hpp"
+
+namespace {
+
+volatile sig_atomic_t g_stop = 0;
+
+void on_signal(int) { g_stop = 1; }
+
+void usage(const char *prog) {
+    fprintf(stderr, "usage: %s <port|capture.bin> [--baud N] [--csv PREFIX] [--quiet]\n", prog);
+}
+
+speed_t baud_constant(long baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+#ifdef B1500000
+        case 1500000: return B1500000;
+#endif
+#ifdef B2000000
+        case 2000000: return B2000000;
+#endif
+        default: return 0;
+    }
+}
+
+// Raw 8N1, reads return as soon as bytes arrive
+bool configure_port(int fd, long baud) {
+    speed_t speed = baud_constant(baud);
+    termios tio;
+    if (speed == 0 || tcgetattr(fd, &tio) != 0) return false;
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+struct CsvFiles {
+    FILE *imu = NULL, *pose = NULL, *counts = NULL, *diag = NULL;
+
+    bool open(const std::string &prefix) {
+        imu = fopen((prefix + "_imu.csv").c_str(), "w");
+        pose = fopen((prefix + "_pose.csv").c_str(), "w");
+        counts = fopen((prefix + "_counts.csv").c_str(), "w");
+        diag = fopen((prefix + "_diag.csv").c_str(), "w");
+        if (!imu || !pose || !counts || !diag) return false;
+        fprintf(imu, "t_us,seq,roll,pitch,yaw,rate_hz,jitter_ms,dropped,overflows,mag_valid\n");
+        fprintf(pose, "t_us,seq,x,y,theta,v,omega\n");
+        fprintf(counts, "t_us,seq,left,right,rate_left,rate_right\n");
+        fprintf(diag, "t_us,seq,loop_hz,dt_max_us,interrupts,dropped\n");
+        return true;
+    }
+
+    void close() {
+        FILE *files[] = { imu, pose, counts, diag };
+        for (FILE *f : files) {
+            if (f) fclose(f);
+        }
+    }
+};
+
+void print_record(const telemetry::Record &r, bool quiet) {
+    double t = r.tUs * 1e-6;
+    if (r.type == TELEMETRY_TEXT) {
+        printf("[%11.6f] %s\n", t, r.text().c_str());
+        return;
+    }
+    if (quiet) return;
+    telemetry_imu_t imu;
+    telemetry_pose_t pose;
+    telemetry_counts_t counts;
+    telemetry_diag_t diag;
+    if (r.type == TELEMETRY_IMU && r.as(&imu)) {
+        printf("[%11.6f] f: %.2f Hz  jitter: %.3f ms  dropped: %u  overflows: %u  "
+               "Roll: %.2f  Pitch: %.2f  Yaw: %.2f  Mag: %s\n",
+               t, imu.rate_hz, imu.jitter_ms, (unsigned)imu.dropped, (unsigned)imu.overflows,
+               imu.roll, imu.pitch, imu.yaw, imu.mag_valid ? "OK" : "FAIL");
+    } else if (r.type == TELEMETRY_POSE && r.as(&pose)) {
+        printf("[%11.6f] Pose: x=%.4f m, y=%.4f m, theta=%.3f rad  v=%.4f m/s, omega=%.4f rad/s\n",
+               t, pose.x, pose.y, pose.theta, pose.v, pose.omega);
+    } else if (r.type == TELEMETRY_COUNTS && r.as(&counts)) {
+        printf("[%11.6f] Counts: left=%d right=%d  rates: %.1f %.1f counts/s\n", t,
+               (int)counts.left, (int)counts.right, counts.rate_left, counts.rate_right);
+    } else if (r.type == TELEMETRY_DIAG && r.as(&diag)) {
+        printf("[%11.6f] Loop: %u Hz, dt max %u us (encoder interrupts: %u, telemetry dropped: %u)\n",
+               t, (unsigned)diag.loop_hz, (unsigned)diag.dt_max_us, (unsigned)diag.interrupts,
+               (unsigned)diag.dropped);
+    } else {
+        printf("[%11.6f] type 0x%02x, %zu bytes\n", t, r.type, r.len);
+    }
+}
+
+void write_csv(const telemetry::Record &r, CsvFiles *csv) {
+    unsigned long long t = (unsigned long long)r.tUs;
+    telemetry_imu_t imu;
+    telemetry_pose_t pose;
+    telemetry_counts_t counts;
+    telemetry_diag_t diag;
+    if (r.type == TELEMETRY_IMU && r.as(&imu)) {
+        fprintf(csv->imu, "%llu,%u,%.3f,%.3f,%.3f,%.3f,%.4f,%u,%u,%u\n", t, r.seq, imu.roll,
+                imu.pitch, imu.yaw, imu.rate_hz, imu.jitter_ms, (unsigned)imu.dropped,
+                (unsigned)imu.overflows, (unsigned)imu.mag_valid);
+    } else if (r.type == TELEMETRY_POSE && r.as(&pose)) {
+        fprintf(csv->pose, "%llu,%u,%.6f,%.6f,%.6f,%.6f,%.6f\n", t, r.seq, pose.x, pose.y,
+                pose.theta, pose.v, pose.omega);
+    } else if (r.type == TELEMETRY_COUNTS && r.as(&counts)) {
+        fprintf(csv->counts, "%llu,%u,%d,%d,%.3f,%.3f\n", t, r.seq, (int)counts.left,
+                (int)counts.right, counts.rate_left, counts.rate_right);
+    } else if (r.type == TELEMETRY_DIAG && r.as(&diag)) {
+        fprintf(csv->diag, "%llu,%u,%u,%u,%u,%u\n", t, r.seq, (unsigned)diag.loop_hz,
+                (unsigned)diag.dt_max_us, (unsigned)diag.interrupts, (unsigned)diag.dropped);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *path = argv[1];
+    long baud = 115200;
+    const char *csvPrefix = NULL;
+    bool quiet = false;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--baud") && i + 1 < argc) {
+            baud = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csvPrefix = argv[++i];
+        } else if (!strcmp(argv[i], "--quiet")) {
+            quiet = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (isatty(fd) && !configure_port(fd, baud)) {
+        fprintf(stderr, "cannot configure %s at %ld baud\n", path, baud);
+        close(fd);
+        return 1;
+    }
+
+    CsvFiles csv;
+    if (csvPrefix && !csv.open(csvPrefix)) {
+        fprintf(stderr, "cannot create the CSV files %s_*.csv\n", csvPrefix);
+        csv.close();
+        close(fd);
+        return 1;
+    }
+
+    // Ctrl-C ends the capture with the statistics and complete CSV files
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    telemetry::Decoder decoder;
+    auto onRecord = [&](const telemetry::Record &r) {
+        print_record(r, quiet);
+        if (csvPrefix) write_csv(r, &csv);
+    };
+    auto onText = [](const std::string &line) { printf("%s\n", line.c_str()); };
+
+    uint8_t buf[4096];
+    while (!g_stop) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        decoder.feed(buf, (size_t)n, onRecord, onText);
+        fflush(stdout);
+    }
+    decoder.flush(onRecord, onText);
+    csv.close();
+    close(fd);
+
+    const telemetry::Stats &s = decoder.stats();
+    fprintf(stderr, "%llu bytes, %llu records, %llu lost, %llu bad frames, %llu text lines\n",
+            (unsigned long long)s.bytes, (unsigned long long)s.records,
+            (unsigned long long)s.lost, (unsigned long long)s.badFrames,
+            (unsigned long long)s.textLines);
+    return 0;
+}
@@ -0,0 +1,155 @@
+//=============================================================================================
+// telemetry_decoder.hpp
+//=============================================================================================
+//
+// Stream decoder for the binary telemetry of the firmware (telemetry_frame.h).
+//
+// Bytes from the port, in chunks of any size, are split on the 0x00 delimiters. Each
+// chunk that unframes with a good CRC is a record; a chunk that does not but is all
+// printable is text written to the same port (boot log, printf), passed on line by line;
+// anything else is a bad frame. Gaps in the sequence number count the frames lost in
+// between (dropped bytes, corrupted frames), and the 32-bit record time is unwrapped.
+//
+// Header only, so that other tools (a ROS bridge, a plotter) can reuse it as is.
+//
+//=============================================================================================
+#ifndef TELEMETRY_DECODER_HPP
+#define TELEMETRY_DECODER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "telemetry_frame.h"
+
+namespace telemetry {
+
+// A decoded record
+struct Record {
+    uint8_t type;
+    uint8_t seq;
+    uint64_t tUs;                           // record time, unwrapped
+    size_t len;                             // payload length
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+
+    // Payload as one of the telemetry_*_t structs, false if the length does not match
+    template <typename T>
+    bool as(T *out) const {
+        if (len != sizeof(T)) return false;
+        memcpy(out, payload, sizeof(T));
+        return true;
+    }
+
+    std::string text() const { return std::string(reinterpret_cast<const char *>(payload), len); }
+};
+
+struct Stats {
+    uint64_t records = 0;       // good frames
+    uint64_t lost = 0;          // frames missing from the sequence
+    uint64_t badFrames = 0;     // chunks that are neither a frame nor text
+    uint64_t textLines = 0;     // lines of plain text between frames
+    uint64_t bytes = 0;         // bytes fed
+};
+
+class Decoder {
+public:
+    // Longest chunk kept while waiting for a delimiter (text without frames in between)
+    static constexpr size_t kMaxChunk = 4096;
+
+    Decoder() { chunk_.reserve(kMaxChunk); }
+
+    /**
+     * @brief Decode bytes from the port
+     *
+     * @param data Bytes
+     * @param len Length
+     * @param onRecord Called as onRecord(const Record &) for each good frame
+     * @param onText Called as onText(const std::string &) for each line of plain text
+     */
+    template <typename RecordFn, typename TextFn>
+    void feed(const uint8_t *data, size_t len, RecordFn onRecord, TextFn onText) {
+        stats_.bytes += len;
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] != 0) {
+                if (chunk_.size() == kMaxChunk) {
+                    finish_chunk(onRecord, onText);
+                }
+                chunk_.push_back(data[i]);
+                continue;
+            }
+            finish_chunk(onRecord, onText);
+        }
+    }
+
+    // End of the stream: text after the last frame
+    template <typename RecordFn, typename TextFn>
+    void flush(RecordFn onRecord, TextFn onText) {
+        finish_chunk(onRecord, onText);
+    }
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    template <typename RecordFn, typename TextFn>
+    void finish_chunk(RecordFn onRecord, TextFn onText) {
+        if (chunk_.empty()) return;
+        telemetry_header_t header;
+        int n = telemetry_unframe(chunk_.data(), chunk_.size(), &header, record_.payload);
+        if (n >= 0) {
+            if (haveSeq_) {
+                stats_.lost += (uint8_t)(header.seq - lastSeq_ - 1);
+                // Unwrap the 32-bit time (wraps every 71 minutes)
+                if (header.t_us < lastTUs_) tHigh_ += 1ull << 32;
+            }
+            haveSeq_ = true;
+            lastSeq_ = header.seq;
+            lastTUs_ = header.t_us;
+            record_.type = header.type;
+            record_.seq = header.seq;
+            record_.tUs = tHigh_ | header.t_us;
+            record_.len = (size_t)n;
+            stats_.records++;
+            onRecord(record_);
+        } else if (is_text()) {
+            emit_lines(onText);
+        } else {
+            stats_.badFrames++;
+        }
+        chunk_.clear();
+    }
+
+    bool is_text() const {
+        for (size_t i = 0; i < chunk_.size(); i++) {
+            uint8_t c = chunk_[i];
+            if ((c < 0x20 || c > 0x7E) && c != '\n' && c != '\r' && c != '\t' && c != 0x1B) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename TextFn>
+    void emit_lines(TextFn onText) {
+        size_t start = 0;
+        for (size_t i = 0; i <= chunk_.size(); i++) {
+            if (i < chunk_.size() && chunk_[i] != '\n' && chunk_[i] != '\r') continue;
+            if (i > start) {
+                onText(std::string(reinterpret_cast<const char *>(&chunk_[start]), i - start));
+                stats_.textLines++;
+            }
+            start = i + 1;
+        }
+    }
+
+    std::vector<uint8_t> chunk_;
+    Record record_;
+    Stats stats_;
+    bool haveSeq_ = false;
+    uint8_t lastSeq_ = 0;
+    uint32_t lastTUs_ = 0;
+    uint64_t tHigh_ = 0;
+};
+
+} // namespace telemetry
+
+#endif // TELEMETRY_DECODER_HPP
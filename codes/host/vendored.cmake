@@ -0,0 +1,75 @@
+#=============================================================================================
+# vendored.cmake
+#=============================================================================================
+#
+# Firmware sources vendored into the sketches and projects under codes/ (the Arduino IDE
+# only builds the files of the sketch folder). embedded/microcontroller is the source of
+# truth; every copy must be byte for byte the same.
+#
+#   cmake -P vendored.cmake              fails and lists the copies that differ
+#   cmake -DSYNC=ON -P vendored.cmake    overwrites the copies with the source
+#
+# The host build runs the check (target check_vendored).
+#
+#=============================================================================================
+
+get_filename_component(REPO_DIR ${CMAKE_CURRENT_LIST_DIR}/../.. ABSOLUTE)
+set(SOURCE_DIR ${REPO_DIR}/embedded/microcontroller)
+set(IMU_ARDUINO codes/arduino_ide/imu9dof_madgwick)
+set(IMU_IDF codes/platformio_espidf/imu9dof_madgwick)
+set(ODOM_ARDUINO codes/arduino_ide/encoder2odom)
+set(ODOM_IDF codes/platformio_espidf/encoder2odom)
+set(ROS_ARDUINO codes/arduino_ide/micro_ros_publisher)
+
+set(DIFFERENT "")
+
+# vendored(<file> <copy dir>...): <file> of the source against the copy in each dir
+function(vendored file)
+    foreach(dir ${ARGN})
+        set(copy ${REPO_DIR}/${dir}/${file})
+        if(SYNC)
+            configure_file(${SOURCE_DIR}/${file} ${copy} COPYONLY)
+            continue()
+        endif()
+        execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${SOURCE_DIR}/${file} ${copy}
+                        RESULT_VARIABLE differs OUTPUT_QUIET ERROR_QUIET)
+        if(differs)
+            list(APPEND DIFFERENT ${dir}/${file})
+        endif()
+    endforeach()
+    set(DIFFERENT ${DIFFERENT} PARENT_SCOPE)
+endfunction()
+
+# MPU9250 driver and I2C telemetry
+vendored(mpu9250_driver.hpp ${IMU_ARDUINO} ${IMU_IDF}/include)
+vendored(i2c_telemetry.hpp  ${IMU_ARDUINO} ${IMU_IDF}/include)
+vendored(MPU9250.h          ${IMU_ARDUINO})
+vendored(MPU9250.cpp        ${IMU_ARDUINO})
+
+# Madgwick AHRS
+vendored(madgwick_ahrs.h       ${IMU_ARDUINO} ${IMU_IDF}/include)
+vendored(madgwick_ahrs.hpp     ${IMU_ARDUINO} ${IMU_IDF}/include)
+vendored(madgwick_ahrs.cpp     ${IMU_ARDUINO} ${IMU_IDF}/src)
+vendored(madgwick_ahrs_fixed.c ${IMU_ARDUINO} ${IMU_IDF}/src)
+
+# Encoders, odometry and telemetry
+vendored(encoder.h          ${ODOM_ARDUINO} ${ODOM_IDF}/include)
+vendored(encoder.c          ${ODOM_ARDUINO} ${ODOM_IDF}/src)
+vendored(encoder_decode.h   ${ODOM_ARDUINO} ${ODOM_IDF}/include)
+vendored(encoder_velocity.h ${ODOM_ARDUINO} ${ODOM_IDF}/include)
+vendored(odometry.h         ${ODOM_ARDUINO} ${ODOM_IDF}/include)
+vendored(odom_pose.h        ${ODOM_ARDUINO} ${ODOM_IDF}/include)
+vendored(seqlock.h          ${ODOM_ARDUINO} ${ODOM_IDF}/include)
+vendored(telemetry.h        ${ODOM_ARDUINO} ${ODOM_IDF}/include)
+vendored(telemetry.c        ${ODOM_ARDUINO} ${ODOM_IDF}/src)
+vendored(telemetry_frame.h  ${ODOM_ARDUINO} ${ODOM_IDF}/include)
+
+# micro-ROS memory and transport
+vendored(micro_ros_arena.h ${ROS_ARDUINO})
+vendored(micro_ros_batch.h ${ROS_ARDUINO})
+
+if(DIFFERENT)
+    list(JOIN DIFFERENT "\n  " listed)
+    message(FATAL_ERROR "Vendored copies differ from embedded/microcontroller:\n  ${listed}\n"
+                        "Edit the source there, then: cmake -DSYNC=ON -P codes/host/vendored.cmake")
+endif()
@@ -0,0 +1,205 @@
+//=============================================================================================
+// encoder_velocity.h
+//=============================================================================================
+//
+// Wheel speed from edge timestamps at low speed and from counts at high speed, kept
+// free of ESP-IDF headers so that the host tools can check it (encoder.c runs it).
+//
+// Counting over a fixed window gives a handful of counts per window at crawling speed:
+// the speed is quantized to 1 count per window and lags by half a window. Timing the
+// edges instead gives the speed over the last ENCODER_EDGE_SPAN edges whatever the
+// window, and the time since the latest edge bounds it when the wheel slows down or
+// stops. At high speed there are enough counts per window, and timing every edge would
+// cost an interrupt per edge for nothing, so the rate comes from the counts:
+//
+//   edge timing    |rate| < 3/4 max_edge_rate   (span of the last edges, age bound)
+//   counts         |rate| > max_edge_rate       (counts / time since the previous update)
+//
+// The edge log is written by one ISR per wheel and read by the task through a seqlock;
+// the ISR never waits. Counts use the decoder state layout (count << 2, wrapping).
+//
+//=============================================================================================
+#ifndef ENCODER_VELOCITY_H
+#define ENCODER_VELOCITY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "encoder_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ENCODER_EDGE_LOG_LEN 8u     // power of 2, more than ENCODER_EDGE_SPAN
+#define ENCODER_EDGE_SPAN    4u     // edges per timed estimate (a full x4 cycle)
+
+// Latest edges of one wheel, written by its ISR only
+typedef struct {
+    uint32_t seq;                           // odd while the ISR writes
+    uint32_t head;                          // edges recorded so far
+    uint32_t t_us[ENCODER_EDGE_LOG_LEN];    // time of each edge
+    uint32_t n[ENCODER_EDGE_LOG_LEN];       // count after each edge (count << 2)
+} encoder_edge_log_t;
+
+// Oldest and newest edge of a span, read from the log
+typedef struct {
+    uint32_t head;          // edges recorded when read
+    uint32_t edges;         // edges between old and new (0: fewer than two available)
+    uint32_t t_old, t_new;
+    uint32_t n_old, n_new;
+} encoder_edge_span_t;
+
+// Rate estimator of one wheel, run by one task
+typedef struct {
+    float max_edge_rate;    // counts/s: above, rates come from counts (0: counts only)
+    uint32_t timeout_us;    // edge timing: no edge for this long is standstill
+    bool edge_mode;         // edge timing in use
+    bool timed;             // last rate came from edge times
+    uint32_t since;         // log head when edge timing last started
+    uint32_t last_us;       // previous update
+    uint32_t last_n;        // count at the previous update (count << 2)
+} encoder_rate_t;
+
+/**
+ * @brief Record an edge (ISR, single writer per log)
+ *
+ * @param log Edge log of the wheel
+ * @param t_us Time of the edge
+ * @param n Count after the edge (count << 2)
+ */
+static inline void encoder_edge_log_record(encoder_edge_log_t *log, uint32_t t_us, uint32_t n) {
+    uint32_t seq = __atomic_load_n(&log->seq, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+    __atomic_store_n(&log->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&log->t_us[head & (ENCODER_EDGE_LOG_LEN - 1)], t_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&log->n[head & (ENCODER_EDGE_LOG_LEN - 1)], n, __ATOMIC_RELAXED);
+    __atomic_store_n(&log->head, head + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&log->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Read the span of the latest edges, ignoring those recorded before a given head
+ *
+ * @param log Edge log of the wheel
+ * @param since Head value of the first edge to consider
+ * @param span Up to ENCODER_EDGE_SPAN edges ending on the latest one
+ */
+static inline void encoder_edge_log_span(const encoder_edge_log_t *log, uint32_t since,
+                                         encoder_edge_span_t *span) {
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&log->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1u) {
+            continue;   // the ISR is a few instructions from done
+        }
+        uint32_t head = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+        uint32_t avail = head - since;
+        span->head = head;
+        span->edges = avail < 2 ? 0 : avail - 1;
+        if (span->edges > ENCODER_EDGE_SPAN) {
+            span->edges = ENCODER_EDGE_SPAN;
+        }
+        if (span->edges > 0) {
+            uint32_t i_new = (head - 1) & (ENCODER_EDGE_LOG_LEN - 1);
+            uint32_t i_old = (head - 1 - span->edges) & (ENCODER_EDGE_LOG_LEN - 1);
+            span->t_new = __atomic_load_n(&log->t_us[i_new], __ATOMIC_RELAXED);
+            span->n_new = __atomic_load_n(&log->n[i_new], __ATOMIC_RELAXED);
+            span->t_old = __atomic_load_n(&log->t_us[i_old], __ATOMIC_RELAXED);
+            span->n_old = __atomic_load_n(&log->n[i_old], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&log->seq, __ATOMIC_RELAXED) == seq) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Set up a rate estimator
+ *
+ * @param r Estimator
+ * @param max_edge_rate Rate in counts/s above which edge timing stops (0: counts only)
+ * @param timeout_us Time without an edge after which the wheel is stopped
+ * @param now_us Current time
+ * @param n Current count (count << 2)
+ * @param head Current head of the edge log
+ */
+static inline void encoder_rate_init(encoder_rate_t *r, float max_edge_rate, uint32_t timeout_us,
+                                     uint32_t now_us, uint32_t n, uint32_t head) {
+    r->max_edge_rate = max_edge_rate;
+    r->timeout_us = timeout_us;
+    r->edge_mode = max_edge_rate > 0.0f;
+    r->timed = false;
+    r->since = head;
+    r->last_us = now_us;
+    r->last_n = n;
+}
+
+/**
+ * @brief Estimate the rate
+ *
+ * Switches between edge timing and counts (see the top of this file). When edge
+ * timing starts, only edges recorded from then on are used; until two have arrived the
+ * rate comes from the counts.
+ *
+ * @param r Estimator
+ * @param log Edge log of the wheel
+ * @param now_us Current time
+ * @param n Current count (count << 2)
+ * @return float Rate in counts/s
+ */
+static inline float encoder_rate_update(encoder_rate_t *r, const encoder_edge_log_t *log,
+                                        uint32_t now_us, uint32_t n) {
+    int32_t counts = encoder_decode_count_delta(n, r->last_n);
+    uint32_t dt_us = now_us - r->last_us;
+    float count_rate = dt_us > 0 ? (float)counts * 1e6f / (float)dt_us : 0.0f;
+    r->last_n = n;
+    r->last_us = now_us;
+    r->timed = false;
+
+    // Hysteresis between the two, so that a steady speed near the limit does not toggle
+    if (r->edge_mode && fabsf(count_rate) > r->max_edge_rate) {
+        r->edge_mode = false;
+    } else if (!r->edge_mode && fabsf(count_rate) < 0.75f * r->max_edge_rate) {
+        r->edge_mode = true;
+        r->since = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+    }
+    if (!r->edge_mode) {
+        return count_rate;
+    }
+
+    encoder_edge_span_t s;
+    encoder_edge_log_span(log, r->since, &s);
+    if (s.edges == 0) {
+        return count_rate;
+    }
+    r->timed = true;
+
+    uint32_t span_us = s.t_new - s.t_old;
+    int32_t dn = encoder_decode_count_delta(s.n_new, s.n_old);
+    int32_t age_us = (int32_t)(now_us - s.t_new);   // < 0 if an edge came after now_us
+    if (age_us < 0) {
+        age_us = 0;
+    }
+    if ((uint32_t)age_us > r->timeout_us || dn == 0 || span_us == 0) {
+        return 0.0f;
+    }
+
+    float rate = (float)dn * 1e6f / (float)span_us;
+    // No edge for 1.5 mean edge intervals (slack for uneven Hall edges): the wheel has
+    // slowed down, to at most 1.5 edge steps per age (continuous with rate at the start)
+    if ((uint64_t)(uint32_t)age_us * s.edges * 2 > (uint64_t)span_us * 3) {
+        float bound = 1.5f * fabsf((float)dn) / (float)s.edges * 1e6f / (float)age_us;
+        if (fabsf(rate) > bound) {
+            rate = copysignf(bound, rate);
+        }
+    }
+    return rate;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENCODER_VELOCITY_H
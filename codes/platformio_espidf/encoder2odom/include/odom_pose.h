@@ -0,0 +1,99 @@
+//=============================================================================================
+// odom_pose.h
+//=============================================================================================
+//
+// Pose and velocity shared from the odometry task to any other task (publishers,
+// logging, a controller) through a seqlock (seqlock.h): a reader always gets the fields
+// of one update, never a mix of two, and the writer is never held up by readers.
+// Readers retry only while an update is being copied.
+//
+//=============================================================================================
+#ifndef ODOM_POSE_H
+#define ODOM_POSE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "seqlock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pose of the base in the odometry frame and its velocity
+typedef struct {
+    float x, y;             // m
+    float theta;            // rad
+    float v;                // linear, m/s
+    float omega;            // angular, rad/s
+    int64_t stamp_us;       // time of the update (esp_timer)
+} odom_pose_t;
+
+#define ODOM_POSE_WORDS SEQLOCK_WORDS(odom_pose_t)
+
+// Run by odom_pose_read() between attempts. A reader that can preempt the writer on
+// its core must let it finish, e.g. #define ODOM_POSE_RELAX() vTaskDelay(1) before
+// including this header; the default just retries.
+#ifndef ODOM_POSE_RELAX
+#define ODOM_POSE_RELAX()
+#endif
+
+// Shared snapshot; zero-initialized is a valid empty snapshot
+typedef struct {
+    uint32_t seq;                       // odd while an update is being written
+    uint32_t words[ODOM_POSE_WORDS];
+} odom_pose_snapshot_t;
+
+/**
+ * @brief Publish a new pose (single writer)
+ *
+ * @param snap Shared snapshot
+ * @param pose Pose to publish
+ */
+static inline void odom_pose_publish(odom_pose_snapshot_t *snap, const odom_pose_t *pose) {
+    uint32_t words[ODOM_POSE_WORDS] = { 0 };
+    memcpy(words, pose, sizeof(*pose));
+    seqlock_publish(&snap->seq, snap->words, words, ODOM_POSE_WORDS);
+}
+
+/**
+ * @brief Read the pose once, without retrying
+ *
+ * @param snap Shared snapshot
+ * @param pose Filled on success
+ * @param update Update number of the pose read, 0 before the first one (may be NULL)
+ * @return bool false if an update was in progress (pose left as is)
+ */
+static inline bool odom_pose_try_read(const odom_pose_snapshot_t *snap, odom_pose_t *pose,
+                                      uint32_t *update) {
+    uint32_t words[ODOM_POSE_WORDS];
+    if (!seqlock_try_read(&snap->seq, snap->words, words, ODOM_POSE_WORDS, update)) {
+        return false;
+    }
+    memcpy(pose, words, sizeof(*pose));
+    return true;
+}
+
+/**
+ * @brief Read a consistent pose
+ *
+ * Retries (with ODOM_POSE_RELAX() in between) while an update is in progress. Must not
+ * be called by the writer task.
+ *
+ * @param snap Shared snapshot
+ * @param pose Latest complete pose
+ * @return uint32_t Update number (0: nothing published yet)
+ */
+static inline uint32_t odom_pose_read(const odom_pose_snapshot_t *snap, odom_pose_t *pose) {
+    uint32_t update;
+    while (!odom_pose_try_read(snap, pose, &update)) {
+        ODOM_POSE_RELAX();
+    }
+    return update;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ODOM_POSE_H
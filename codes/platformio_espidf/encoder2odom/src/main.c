@@ -3,115 +3,203 @@
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "encoder.h"
+#include "odometry.h"
+#include "telemetry.h"
+// Readers of the shared pose may preempt the odometry task: let it finish its update
+#define ODOM_POSE_RELAX() vTaskDelay(1)
+#include "odom_pose.h"
 
 // ----- REAR ENCODER PINS -----
 #define ENC_LEFT_A      23
-#define ENC_LEFT_B      22
+#define ENC_LEFT_B      17
 #define ENC_RIGHT_A     18
 #define ENC_RIGHT_B     19
 
+// ENCODER_BACKEND_PCNT: hardware pulse counters (no interrupt per edge)
+// ENCODER_BACKEND_ISR: GPIO interrupt on every edge
+#define ENC_BACKEND     ENCODER_BACKEND_PCNT
+
 // ----- ROBOT PARAMETERS -----
 #define WHEEL_RADIUS    0.065/2    // meters
 #define WHEEL_BASE      0.138    // meters
 #define CPR             840     // counts per revolution (7x4xreduction)
-#define UPDATE_PERIOD_MS 100    // odometry update interval
 
-// ----- GLOBAL VARIABLES -----
-volatile int32_t count_left = 0;
-volatile int32_t count_right = 0;
+// ----- LOOP TIMING -----
+// The odometry loop runs from a periodic esp_timer: drift-free, and faster than the
+// FreeRTOS tick (100 Hz), which vTaskDelayUntil() could not do
+#define ODOM_RATE_HZ    500     // odometry loop rate
+#define RATE_PERIOD_MS  50      // wheel rates (counts over this period at high speed)
+#define TELEMETRY_PERIOD_MS 20  // pose and counts records
+#define DIAG_PERIOD_MS  1000    // loop health record
+
+// ----- TELEMETRY PORT -----
+// Binary frames on the console UART, decoded by codes/host/telemetry
+#define TELEMETRY_UART  UART_NUM_0
+#define TELEMETRY_BAUD  115200
+#define UART_TX_BUFFER  4096    // driver TX ring buffer, drained by the UART interrupt
 
-volatile int lastLA=0, lastLB=0;
-volatile int lastRA=0, lastRB=0;
+// Geometry, folded at compile time
+static const float DIST_PER_COUNT = 2.0f * (float)M_PI * (float)(WHEEL_RADIUS) / CPR;
+
+// ----- GLOBAL VARIABLES -----
+// Robot pose and velocities, written by the odometry task only
+odom_pose_t pose = { 0 };
+odometry_t odom;
 
-// Robot pose
-float x = 0.0, y = 0.0, theta = 0.0;
+// Latest pose for other tasks: odom_pose_read(&odom_pose_shared, ...)
+odom_pose_snapshot_t odom_pose_shared = { 0 };
 
-// Estimated velocities
-float v = 0.0;      // linear (m/s)
-float omega = 0.0;  // angular (rad/s)
+static TaskHandle_t odometry_task_handle = NULL;
 
-// ----- ENCODER QUADRATURE X4 ISR -----
-static void IRAM_ATTR encoder_isr_handler(void* arg)
+// ----- ODOMETRY FUNCTION -----
+// Pose from the count deltas, velocities from the wheel rates (counts/s)
+void update_odometry(int32_t delta_left, int32_t delta_right, float rate_left, float rate_right,
+                     int64_t now_us)
 {
-    int pin = (int)(intptr_t)arg;
-
-    if(pin == ENC_LEFT_A || pin == ENC_LEFT_B){
-        int a = gpio_get_level(ENC_LEFT_A);
-        int b = gpio_get_level(ENC_LEFT_B);
-        int transition = (lastLA<<3)|(lastLB<<2)|(a<<1)|b;
-        switch(transition){
-            case 0b0001: case 0b0111: case 0b1110: case 0b1000:
-                count_left++; break;
-            case 0b0010: case 0b0100: case 0b1101: case 0b1011:
-                count_left--; break;
-            default: break;
-        }
-        lastLA = a;
-        lastLB = b;
-    } else {
-        int a = gpio_get_level(ENC_RIGHT_A);
-        int b = gpio_get_level(ENC_RIGHT_B);
-        int transition = (lastRA<<3)|(lastRB<<2)|(a<<1)|b;
-        switch(transition){
-            case 0b0001: case 0b0111: case 0b1110: case 0b1000:
-                count_right++; break;
-            case 0b0010: case 0b0100: case 0b1101: case 0b1011:
-                count_right--; break;
-            default: break;
-        }
-        lastRA = a;
-        lastRB = b;
-    }
+    // Exact arc per step (odometry.h)
+    odometry_step(&odom, delta_left, delta_right);
+    pose.x = odom.x;
+    pose.y = odom.y;
+    pose.theta = odom.theta;
+
+    // Velocities: edge-timed at low speed, so not quantized to counts per period
+    pose.v = (rate_right + rate_left) * (0.5f * DIST_PER_COUNT);
+    pose.omega = (rate_right - rate_left) * (DIST_PER_COUNT / (float)WHEEL_BASE);
+    pose.stamp_us = now_us;
+
+    // One consistent update for the readers
+    odom_pose_publish(&odom_pose_shared, &pose);
 }
 
-// ----- ODOMETRY FUNCTION -----
-void update_odometry(int32_t delta_left, int32_t delta_right, float dt)
+// ----- ODOMETRY TIMER -----
+static void odometry_timer_callback(void *arg)
 {
-    float dist_per_count = 2.0 * M_PI * WHEEL_RADIUS / CPR;
+    xTaskNotifyGive(odometry_task_handle);
+}
 
-    float d_left  = delta_left * dist_per_count;
-    float d_right = delta_right * dist_per_count;
+// ----- TELEMETRY -----
+static void telemetry_uart_write(const uint8_t *data, size_t len, void *ctx)
+{
+    uart_write_bytes(TELEMETRY_UART, data, len);
+}
 
-    float ds = (d_right + d_left)/2.0;
-    float dtheta = (d_right - d_left)/WHEEL_BASE;
+static esp_err_t telemetry_uart_init(void)
+{
+    const uart_config_t uart_config = {
+        .baud_rate = TELEMETRY_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    esp_err_t err = uart_driver_install(TELEMETRY_UART, 256, UART_TX_BUFFER, 0, NULL, 0);
+    if (err == ESP_OK) {
+        err = uart_param_config(TELEMETRY_UART, &uart_config);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
 
-    x += ds * cos(theta + dtheta/2.0);
-    y += ds * sin(theta + dtheta/2.0);
-    theta += dtheta;
+    telemetry_config_t tel_conf = TELEMETRY_DEFAULT_CONFIG();
+    tel_conf.write = telemetry_uart_write;
+    return telemetry_init(&tel_conf);
+}
 
-    // Velocities
-    v = ds / dt;
-    omega = dtheta / dt;
+// Pose and counts from the odometry loop
+static void send_odometry(const odom_pose_t *p, int64_t count_left, int64_t count_right,
+                          float rate_left, float rate_right)
+{
+    const telemetry_pose_t pose_rec = {
+        .x = p->x, .y = p->y, .theta = p->theta, .v = p->v, .omega = p->omega
+    };
+    const telemetry_counts_t counts_rec = {
+        .left = (int32_t)count_left, .right = (int32_t)count_right,
+        .rate_left = rate_left, .rate_right = rate_right
+    };
+    telemetry_send(TELEMETRY_POSE, &pose_rec, sizeof(pose_rec));
+    telemetry_send(TELEMETRY_COUNTS, &counts_rec, sizeof(counts_rec));
 }
 
 // ----- FREERTOS ODOMETRY TASK -----
 static void odometry_task(void *pvParameters)
 {
-    int32_t last_count_left = 0;
-    int32_t last_count_right = 0;
+    int64_t count_left = 0, count_right = 0;
+    int64_t last_count_left = 0;
+    int64_t last_count_right = 0;
+    float rate_left = 0, rate_right = 0;
+    const uint32_t rate_every = ODOM_RATE_HZ * RATE_PERIOD_MS / 1000;
+    const uint32_t telemetry_every = ODOM_RATE_HZ * TELEMETRY_PERIOD_MS / 1000;
+    uint32_t loops = 0, telemetry_loops = 0, diag_loops = 0;
+    uint32_t dt_max_us = 0;
     
-    printf("Odometry task started\n");
+    telemetry_text("Odometry task started");
+    
+    odometry_init(&odom, DIST_PER_COUNT, WHEEL_BASE);
+    odometry_task_handle = xTaskGetCurrentTaskHandle();
+    const esp_timer_create_args_t timer_args = {
+        .callback = odometry_timer_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "odometry",
+        .skip_unhandled_events = true
+    };
+    esp_timer_handle_t timer;
+    if (esp_timer_create(&timer_args, &timer) != ESP_OK ||
+        esp_timer_start_periodic(timer, 1000000 / ODOM_RATE_HZ) != ESP_OK) {
+        telemetry_text("Failed to start the odometry timer");
+        vTaskDelete(NULL);
+    }
+    int64_t last_us = esp_timer_get_time();
+    int64_t diag_start_us = last_us;
     
     while(1) {
-        // Wait for the specified period
-        vTaskDelay(pdMS_TO_TICKS(UPDATE_PERIOD_MS));
+        // Wait for the next period; periods missed while late are caught up in one step
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int64_t now_us = esp_timer_get_time();
+        uint32_t dt_us = (uint32_t)(now_us - last_us);
+        last_us = now_us;
+        if (dt_us > dt_max_us) {
+            dt_max_us = dt_us;
+        }
         
         // Calculate deltas
-        int32_t delta_left  = count_left - last_count_left;
-        int32_t delta_right = count_right - last_count_right;
+        encoder_get_counts(&count_left, &count_right);
+        int32_t delta_left  = (int32_t)(count_left - last_count_left);
+        int32_t delta_right = (int32_t)(count_right - last_count_right);
 
         last_count_left  = count_left;
         last_count_right = count_right;
 
-        float dt = UPDATE_PERIOD_MS / 1000.0; // time in seconds
+        if (++loops >= rate_every) {
+            loops = 0;
+            encoder_get_rates(&rate_left, &rate_right);
+        }
 
         // Update odometry
-        update_odometry(delta_left, delta_right, dt);
+        update_odometry(delta_left, delta_right, rate_left, rate_right, now_us);
 
-        // Print odometry
-        printf("Pose: x=%.4f m, y=%.4f m, theta=%.3f rad\n", x, y, theta);
-        printf("Velocity: v=%.4f m/s, omega=%.4f rad/s\n", v, omega);
-        printf("Counts: Left=%ld Right=%ld\n\n", count_left, count_right);
+        // Records are queued, never waited on: the telemetry task writes them
+        if (++telemetry_loops >= telemetry_every) {
+            telemetry_loops = 0;
+            send_odometry(&pose, count_left, count_right, rate_left, rate_right);
+        }
+        diag_loops++;
+        if (now_us - diag_start_us >= DIAG_PERIOD_MS * 1000) {
+            const telemetry_diag_t diag = {
+                .loop_hz = (uint16_t)(diag_loops * 1000000LL / (now_us - diag_start_us)),
+                .dt_max_us = dt_max_us,
+                .interrupts = encoder_get_interrupt_count(),
+                .dropped = telemetry_get_dropped()
+            };
+            telemetry_send(TELEMETRY_DIAG, &diag, sizeof(diag));
+            diag_loops = 0;
+            dt_max_us = 0;
+            diag_start_us = now_us;
+        }
     }
 }
 
@@ -120,43 +208,39 @@ void app_main(void)
 {
     printf("Encoder to Odometry - Starting...\n");
     
-    // Configure pins
-    gpio_config_t io_conf = {
-        .intr_type = GPIO_INTR_ANYEDGE,
-        .mode = GPIO_MODE_INPUT,
-        .pin_bit_mask = ((1ULL<<ENC_LEFT_A)|(1ULL<<ENC_LEFT_B)|(1ULL<<ENC_RIGHT_A)|(1ULL<<ENC_RIGHT_B)),
-        .pull_up_en = 1,
-        .pull_down_en = 0
-    };
-    gpio_config(&io_conf);
-
-    // Initialize last states
-    lastLA = gpio_get_level(ENC_LEFT_A);
-    lastLB = gpio_get_level(ENC_LEFT_B);
-    lastRA = gpio_get_level(ENC_RIGHT_A);
-    lastRB = gpio_get_level(ENC_RIGHT_B);
-
-    // Install ISR
-    gpio_install_isr_service(0);
-    gpio_isr_handler_add(ENC_LEFT_A, encoder_isr_handler, (void*)(intptr_t)ENC_LEFT_A);
-    gpio_isr_handler_add(ENC_LEFT_B, encoder_isr_handler, (void*)(intptr_t)ENC_LEFT_B);
-    gpio_isr_handler_add(ENC_RIGHT_A, encoder_isr_handler, (void*)(intptr_t)ENC_RIGHT_A);
-    gpio_isr_handler_add(ENC_RIGHT_B, encoder_isr_handler, (void*)(intptr_t)ENC_RIGHT_B);
-
-    printf("Encoder interrupts configured\n");
+    // Start the wheel encoders
+    encoder_config_t enc_conf = ENCODER_DEFAULT_CONFIG();
+    enc_conf.left_a = ENC_LEFT_A;
+    enc_conf.left_b = ENC_LEFT_B;
+    enc_conf.right_a = ENC_RIGHT_A;
+    enc_conf.right_b = ENC_RIGHT_B;
+    enc_conf.backend = ENC_BACKEND;
+    if (encoder_init(&enc_conf) != ESP_OK) {
+        printf("Failed to initialize encoders\n");
+        return;
+    }
+
+    printf("Encoders configured (%s)\n",
+           encoder_get_backend() == ENCODER_BACKEND_PCNT ? "PCNT" : "GPIO interrupts");
     
-    // Create FreeRTOS task for odometry processing
+    // Console UART and the telemetry task: text ends here, binary frames follow
+    printf("Starting telemetry (%d baud)\n", TELEMETRY_BAUD);
+    if (telemetry_uart_init() != ESP_OK) {
+        printf("Failed to start telemetry\n");
+        return;
+    }
+    
+    // Create FreeRTOS task for odometry processing (above the telemetry)
     xTaskCreate(
         odometry_task,           // Task function
         "OdometryTask",          // Task name
         2048,                    // Stack size (words)
         NULL,                    // Task parameters
-        1,                       // Task priority
+        5,                       // Task priority
         NULL                     // Task handle
     );
-    
-    printf("Odometry task created\n");
-    printf("System ready!\n");
+
+    telemetry_text("System ready!");
     
     // Main function can now return - FreeRTOS scheduler will handle the rest
 }
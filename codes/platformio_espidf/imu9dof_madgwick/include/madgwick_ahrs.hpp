@@ -0,0 +1,416 @@
+//=============================================================================================
+// madgwick_ahrs.hpp
+//=============================================================================================
+//
+// Header-only C++ version of the Madgwick IMU and AHRS algorithms, specialised at compile
+// time on the sensor mode (6-DOF IMU or 9-DOF MARG), the gyroscope units and the number
+// type. madgwick_ahrs.cpp implements the C API of madgwick_ahrs.h on top of it.
+//
+// Unlike the C API, the update functions here do no validity checks: the IMU and MARG
+// paths are separate instantiations and the degree to radian factor is a constant of
+// the instantiation (nothing at all for Units::Radians). Callers that may see an all-zero
+// accelerometer or magnetometer reading (sensor not ready) must test for it and use
+// propagate() or the IMU instantiation themselves, as madgwick_ahrs.cpp does.
+//
+// Usage, e.g. inlined into a sensor task:
+//
+//   madgwick::Madgwick<madgwick::Mode::Marg> filter(100.0f);
+//   filter.update(gx, gy, gz, ax, ay, az, mx, my, mz);
+//   const madgwick::Quaternion<float> &q = filter.quaternion();
+//
+// The file also holds the quaternion to Euler angle conversion, with an optional fast
+// polynomial atan2/asin (see fast_atan2() and fast_asin() for the error bounds).
+//
+// Requires C++11.
+//
+//=============================================================================================
+#ifndef MADGWICK_AHRS_HPP
+#define MADGWICK_AHRS_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace madgwick {
+
+enum class Mode {
+    Imu,    // gyroscope + accelerometer
+    Marg,   // gyroscope + accelerometer + magnetometer
+};
+
+enum class Units {
+    Degrees,    // gyroscope in degrees/sec, as returned by the MPU9250 drivers
+    Radians,    // gyroscope in radians/sec
+};
+
+template <typename Real>
+struct Quaternion {
+    Real q0, q1, q2, q3;
+};
+
+/**
+ * @brief Operations the filter needs besides + - * on Real
+ *
+ * Specialise for other number types (e.g. SIMD lanes running several filters at once).
+ */
+template <typename Real>
+struct RealTraits;
+
+template <>
+struct RealTraits<float> {
+    /**
+     * @brief Fast inverse square root
+     * See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
+     */
+    static inline float inv_sqrt(float x) {
+        float halfx = 0.5f * x;
+        int32_t i;
+        std::memcpy(&i, &x, sizeof(i));
+        i = 0x5f3759df - (i >> 1);
+        float y;
+        std::memcpy(&y, &i, sizeof(y));
+        y = y * (1.5f - (halfx * y * y));
+        y = y * (1.5f - (halfx * y * y));
+        return y;
+    }
+
+    static inline float sqrt(float x) {
+        return sqrtf(x);
+    }
+};
+
+template <>
+struct RealTraits<double> {
+    static inline double inv_sqrt(double x) {
+        return 1.0 / std::sqrt(x);
+    }
+
+    static inline double sqrt(double x) {
+        return std::sqrt(x);
+    }
+};
+
+namespace detail {
+
+/**
+ * @brief State and the steps shared by both modes
+ */
+template <Units U, typename Real>
+class MadgwickBase {
+public:
+    typedef Quaternion<Real> quat_type;
+
+    static constexpr Real default_beta() { return Real(0.1); }      // 2 * proportional gain
+    static constexpr Real gyro_scale() { return U == Units::Degrees ? Real(0.0174533f) : Real(1); }
+
+    constexpr MadgwickBase(Real sampleFrequency, Real beta)
+        : q_{ Real(1), Real(0), Real(0), Real(0) }, beta_(beta), dt_(Real(1) / sampleFrequency) {}
+
+    const quat_type &quaternion() const { return q_; }
+    void set_quaternion(const quat_type &q) { q_ = q; }
+    Real beta() const { return beta_; }
+    void set_beta(Real beta) { beta_ = beta; }
+    Real dt() const { return dt_; }
+    void set_sample_frequency(Real sampleFrequency) { dt_ = Real(1) / sampleFrequency; }
+
+    /**
+     * @brief Integrate the gyroscope alone (no accelerometer feedback)
+     */
+    static inline __attribute__((always_inline))
+    void propagate(quat_type &q, Real dt, Real gx, Real gy, Real gz) {
+        Real qDot[4];
+        rate(q, gx, gy, gz, qDot);
+        integrate(q, qDot, dt);
+    }
+
+    void propagate(Real gx, Real gy, Real gz) {
+        propagate(q_, dt_, gx, gy, gz);
+    }
+
+protected:
+    /**
+     * @brief Rate of change of quaternion from gyroscope
+     */
+    static inline __attribute__((always_inline))
+    void rate(const quat_type &q, Real gx, Real gy, Real gz, Real qDot[4]) {
+        gx *= gyro_scale();
+        gy *= gyro_scale();
+        gz *= gyro_scale();
+
+        qDot[0] = Real(0.5) * (-q.q1 * gx - q.q2 * gy - q.q3 * gz);
+        qDot[1] = Real(0.5) * (q.q0 * gx + q.q2 * gz - q.q3 * gy);
+        qDot[2] = Real(0.5) * (q.q0 * gy - q.q1 * gz + q.q3 * gx);
+        qDot[3] = Real(0.5) * (q.q0 * gz + q.q1 * gy - q.q2 * gx);
+    }
+
+    /**
+     * @brief Apply the normalised gradient step s scaled by beta
+     */
+    static inline __attribute__((always_inline))
+    void feedback(Real qDot[4], Real beta, Real s0, Real s1, Real s2, Real s3) {
+        Real recipNorm = RealTraits<Real>::inv_sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        s0 *= recipNorm;
+        s1 *= recipNorm;
+        s2 *= recipNorm;
+        s3 *= recipNorm;
+
+        qDot[0] -= beta * s0;
+        qDot[1] -= beta * s1;
+        qDot[2] -= beta * s2;
+        qDot[3] -= beta * s3;
+    }
+
+    /**
+     * @brief Integrate quaternion rate of change and normalise
+     */
+    static inline __attribute__((always_inline))
+    void integrate(quat_type &q, const Real qDot[4], Real dt) {
+        q.q0 += qDot[0] * dt;
+        q.q1 += qDot[1] * dt;
+        q.q2 += qDot[2] * dt;
+        q.q3 += qDot[3] * dt;
+
+        Real recipNorm = RealTraits<Real>::inv_sqrt(q.q0 * q.q0 + q.q1 * q.q1 + q.q2 * q.q2 + q.q3 * q.q3);
+        q.q0 *= recipNorm;
+        q.q1 *= recipNorm;
+        q.q2 *= recipNorm;
+        q.q3 *= recipNorm;
+    }
+
+    quat_type q_;
+    Real beta_;
+    Real dt_;
+};
+
+} // namespace detail
+
+template <Mode M, Units U = Units::Degrees, typename Real = float>
+class Madgwick;
+
+/**
+ * @brief 6-DOF filter: gyroscope + accelerometer
+ */
+template <Units U, typename Real>
+class Madgwick<Mode::Imu, U, Real> : public detail::MadgwickBase<U, Real> {
+    typedef detail::MadgwickBase<U, Real> base;
+
+public:
+    typedef typename base::quat_type quat_type;
+
+    constexpr explicit Madgwick(Real sampleFrequency = Real(512), Real beta = base::default_beta())
+        : base(sampleFrequency, beta) {}
+
+    /**
+     * @brief One filter step; the accelerometer reading must not be all zero
+     */
+    static inline __attribute__((always_inline))
+    void step(quat_type &q, Real beta, Real dt,
+              Real gx, Real gy, Real gz,
+              Real ax, Real ay, Real az) {
+        Real qDot[4];
+        base::rate(q, gx, gy, gz, qDot);
+
+        // Normalize accelerometer measurement
+        Real recipNorm = RealTraits<Real>::inv_sqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        // Auxiliary variables to avoid repeated arithmetic
+        Real _2q0 = Real(2) * q.q0;
+        Real _2q1 = Real(2) * q.q1;
+        Real _2q2 = Real(2) * q.q2;
+        Real _2q3 = Real(2) * q.q3;
+        Real _4q0 = Real(4) * q.q0;
+        Real _4q1 = Real(4) * q.q1;
+        Real _4q2 = Real(4) * q.q2;
+        Real _8q1 = Real(8) * q.q1;
+        Real _8q2 = Real(8) * q.q2;
+        Real q0q0 = q.q0 * q.q0;
+        Real q1q1 = q.q1 * q.q1;
+        Real q2q2 = q.q2 * q.q2;
+        Real q3q3 = q.q3 * q.q3;
+
+        // Gradient decent algorithm corrective step
+        Real s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        Real s1 = _4q1 * q3q3 - _2q3 * ax + Real(4) * q0q0 * q.q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        Real s2 = Real(4) * q0q0 * q.q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        Real s3 = Real(4) * q1q1 * q.q3 - _2q1 * ax + Real(4) * q2q2 * q.q3 - _2q2 * ay;
+        base::feedback(qDot, beta, s0, s1, s2, s3);
+
+        base::integrate(q, qDot, dt);
+    }
+
+    void update(Real gx, Real gy, Real gz, Real ax, Real ay, Real az) {
+        step(this->q_, this->beta_, this->dt_, gx, gy, gz, ax, ay, az);
+    }
+};
+
+/**
+ * @brief 9-DOF filter: gyroscope + accelerometer + magnetometer
+ */
+template <Units U, typename Real>
+class Madgwick<Mode::Marg, U, Real> : public detail::MadgwickBase<U, Real> {
+    typedef detail::MadgwickBase<U, Real> base;
+
+public:
+    typedef typename base::quat_type quat_type;
+
+    constexpr explicit Madgwick(Real sampleFrequency = Real(512), Real beta = base::default_beta())
+        : base(sampleFrequency, beta) {}
+
+    /**
+     * @brief One filter step; neither the accelerometer nor the magnetometer reading may be all zero
+     */
+    static inline __attribute__((always_inline))
+    void step(quat_type &q, Real beta, Real dt,
+              Real gx, Real gy, Real gz,
+              Real ax, Real ay, Real az,
+              Real mx, Real my, Real mz) {
+        Real qDot[4];
+        base::rate(q, gx, gy, gz, qDot);
+
+        // Normalize accelerometer measurement
+        Real recipNorm = RealTraits<Real>::inv_sqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        // Normalize magnetometer measurement
+        recipNorm = RealTraits<Real>::inv_sqrt(mx * mx + my * my + mz * mz);
+        mx *= recipNorm;
+        my *= recipNorm;
+        mz *= recipNorm;
+
+        // Auxiliary variables to avoid repeated arithmetic
+        Real _2q0mx = Real(2) * q.q0 * mx;
+        Real _2q0my = Real(2) * q.q0 * my;
+        Real _2q0mz = Real(2) * q.q0 * mz;
+        Real _2q1mx = Real(2) * q.q1 * mx;
+        Real _2q0 = Real(2) * q.q0;
+        Real _2q1 = Real(2) * q.q1;
+        Real _2q2 = Real(2) * q.q2;
+        Real _2q3 = Real(2) * q.q3;
+        Real _2q0q2 = Real(2) * q.q0 * q.q2;
+        Real _2q2q3 = Real(2) * q.q2 * q.q3;
+        Real q0q0 = q.q0 * q.q0;
+        Real q0q1 = q.q0 * q.q1;
+        Real q0q2 = q.q0 * q.q2;
+        Real q0q3 = q.q0 * q.q3;
+        Real q1q1 = q.q1 * q.q1;
+        Real q1q2 = q.q1 * q.q2;
+        Real q1q3 = q.q1 * q.q3;
+        Real q2q2 = q.q2 * q.q2;
+        Real q2q3 = q.q2 * q.q3;
+        Real q3q3 = q.q3 * q.q3;
+
+        // Reference direction of Earth's magnetic field
+        Real hx = mx * q0q0 - _2q0my * q.q3 + _2q0mz * q.q2 + mx * q1q1 + _2q1 * my * q.q2 + _2q1 * mz * q.q3 - mx * q2q2 - mx * q3q3;
+        Real hy = _2q0mx * q.q3 + my * q0q0 - _2q0mz * q.q1 + _2q1mx * q.q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q.q3 - my * q3q3;
+        Real _2bx = RealTraits<Real>::sqrt(hx * hx + hy * hy);
+        Real _2bz = -_2q0mx * q.q2 + _2q0my * q.q1 + mz * q0q0 + _2q1mx * q.q3 - mz * q1q1 + _2q2 * my * q.q3 - mz * q2q2 + mz * q3q3;
+        Real _4bx = Real(2) * _2bx;
+        Real _4bz = Real(2) * _2bz;
+
+        // Gradient decent algorithm corrective step
+        Real s0 = -_2q2 * (Real(2) * q1q3 - _2q0q2 - ax) + _2q1 * (Real(2) * q0q1 + _2q2q3 - ay) - _2bz * q.q2 * (_2bx * (Real(0.5) - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q.q3 + _2bz * q.q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q.q2 * (_2bx * (q0q2 + q1q3) + _2bz * (Real(0.5) - q1q1 - q2q2) - mz);
+        Real s1 = _2q3 * (Real(2) * q1q3 - _2q0q2 - ax) + _2q0 * (Real(2) * q0q1 + _2q2q3 - ay) - Real(4) * q.q1 * (1 - Real(2) * q1q1 - Real(2) * q2q2 - az) + _2bz * q.q3 * (_2bx * (Real(0.5) - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q.q2 + _2bz * q.q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q.q3 - _4bz * q.q1) * (_2bx * (q0q2 + q1q3) + _2bz * (Real(0.5) - q1q1 - q2q2) - mz);
+        Real s2 = -_2q0 * (Real(2) * q1q3 - _2q0q2 - ax) + _2q3 * (Real(2) * q0q1 + _2q2q3 - ay) - Real(4) * q.q2 * (1 - Real(2) * q1q1 - Real(2) * q2q2 - az) + (-_4bx * q.q2 - _2bz * q.q0) * (_2bx * (Real(0.5) - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q.q1 + _2bz * q.q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q.q0 - _4bz * q.q2) * (_2bx * (q0q2 + q1q3) + _2bz * (Real(0.5) - q1q1 - q2q2) - mz);
+        Real s3 = _2q1 * (Real(2) * q1q3 - _2q0q2 - ax) + _2q2 * (Real(2) * q0q1 + _2q2q3 - ay) + (-_4bx * q.q3 + _2bz * q.q1) * (_2bx * (Real(0.5) - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q.q0 + _2bz * q.q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q.q1 * (_2bx * (q0q2 + q1q3) + _2bz * (Real(0.5) - q1q1 - q2q2) - mz);
+        base::feedback(qDot, beta, s0, s1, s2, s3);
+
+        base::integrate(q, qDot, dt);
+    }
+
+    void update(Real gx, Real gy, Real gz, Real ax, Real ay, Real az, Real mx, Real my, Real mz) {
+        step(this->q_, this->beta_, this->dt_, gx, gy, gz, ax, ay, az, mx, my, mz);
+    }
+};
+
+//-------------------------------------------------------------------------------------------
+// Euler angles
+
+// Largest error of fast_atan2() and fast_asin() against the exact functions (rad)
+constexpr float fast_angle_max_error() { return 1e-5f; }
+
+/**
+ * @brief Polynomial atan2, at most 1e-5 rad (0.0006 deg) from atan2f
+ *
+ * Degree 11 odd minimax polynomial for atan on [0, 1] after reducing by octant;
+ * measured maximum error 3.7e-6 rad. Returns 0 for atan2(0, 0).
+ */
+inline float fast_atan2(float y, float x) {
+    float ax = std::fabs(x);
+    float ay = std::fabs(y);
+    float mx = ax > ay ? ax : ay;
+    float mn = ax > ay ? ay : ax;
+    if (mx == 0.0f) {
+        return 0.0f;
+    }
+    float t = mn / mx;
+    float t2 = t * t;
+    float p = -0.013480470f;
+    p = p * t2 + 0.057477314f;
+    p = p * t2 - 0.121239071f;
+    p = p * t2 + 0.195635925f;
+    p = p * t2 - 0.332994597f;
+    p = p * t2 + 0.999995630f;
+    float r = p * t;
+    if (ay > ax) {
+        r = 1.57079637f - r;
+    }
+    if (x < 0.0f) {
+        r = 3.14159274f - r;
+    }
+    return y < 0.0f ? -r : r;
+}
+
+/**
+ * @brief Polynomial asin, at most 1e-5 rad (0.0006 deg) from asinf
+ *
+ * asin(x) = pi/2 - sqrt(1 - x) P(x) (Abramowitz & Stegun 4.4.46) with the square root
+ * from the fast inverse square root; measured maximum error 7.4e-6 rad. Inputs just
+ * outside [-1, 1] from rounding return +-pi/2 instead of NaN.
+ */
+inline float fast_asin(float x) {
+    float a = std::fabs(x);
+    float p = -0.0012624911f;
+    p = p * a + 0.0066700901f;
+    p = p * a - 0.0170881256f;
+    p = p * a + 0.0308918810f;
+    p = p * a - 0.0501743046f;
+    p = p * a + 0.0889789874f;
+    p = p * a - 0.2145988016f;
+    p = p * a + 1.5707963050f;
+    float s = 1.0f - a;
+    float root = s > 0.0f ? s * RealTraits<float>::inv_sqrt(s) : 0.0f;
+    float r = 1.57079637f - root * p;
+    return x < 0.0f ? -r : r;
+}
+
+/**
+ * @brief Roll, pitch and yaw (rad) of a unit quaternion
+ *
+ * Fast selects fast_atan2()/fast_asin() instead of atan2f/asinf.
+ */
+template <bool Fast>
+inline void euler_angles(const Quaternion<float> &q, float &roll, float &pitch, float &yaw) {
+    float sr = q.q0 * q.q1 + q.q2 * q.q3;
+    float cr = 0.5f - q.q1 * q.q1 - q.q2 * q.q2;
+    float sp = -2.0f * (q.q1 * q.q3 - q.q0 * q.q2);
+    float sy = q.q1 * q.q2 + q.q0 * q.q3;
+    float cy = 0.5f - q.q2 * q.q2 - q.q3 * q.q3;
+    if (Fast) {
+        roll = fast_atan2(sr, cr);
+        pitch = fast_asin(sp);
+        yaw = fast_atan2(sy, cy);
+    } else {
+        roll = atan2f(sr, cr);
+        pitch = asinf(sp);
+        yaw = atan2f(sy, cy);
+    }
+}
+
+} // namespace madgwick
+
+#endif // MADGWICK_AHRS_HPP
@@ -3,8 +3,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
-#include "driver/i2c.h"
+#include "driver/i2c_master.h"
 #include "driver/gpio.h"
 
 #ifdef __cplusplus
@@ -53,6 +54,11 @@ extern "C" {
 #define MPU9250_SAMPLE_RATE_25HZ  39  // 25Hz
 #define MPU9250_SAMPLE_RATE_10HZ  99  // 10Hz
 
+// On-chip FIFO (accelerometer + gyroscope only, the magnetometer is read separately)
+#define MPU9250_FIFO_SIZE          512 // bytes
+#define MPU9250_FIFO_FRAME_SIZE    12  // ax, ay, az, gx, gy, gz (big-endian int16)
+#define MPU9250_FIFO_MAX_SAMPLES   (MPU9250_FIFO_SIZE / MPU9250_FIFO_FRAME_SIZE)
+
 // Structure for MPU9250 data (9DOF)
 typedef struct {
     int16_t ax, ay, az;  // Accelerometer
@@ -62,21 +68,64 @@ typedef struct {
 
 // MPU9250 configuration structure
 typedef struct {
-    i2c_port_t i2c_port;
+    i2c_master_bus_handle_t bus;  // bus created by the caller (i2c_new_master_bus)
     gpio_num_t int_pin;
     uint32_t i2c_freq;
+    uint32_t timeout_ms;  // margin added to the bus time of each transfer
+    bool aux_i2c_master;  // MPU9250 polls the AK8963 itself (false: I2C bypass)
 } mpu9250_config_t;
 
-// Default configuration
+// Default configuration; .bus must be set by the caller
 #define MPU9250_DEFAULT_CONFIG() { \
-    .i2c_port = I2C_NUM_0, \
+    .bus = NULL, \
     .int_pin = GPIO_NUM_23, \
-    .i2c_freq = 400000 \
+    .i2c_freq = 400000, \
+    .timeout_ms = 5, \
+    .aux_i2c_master = true \
 }
 
+// I2C telemetry: latency histogram bucket b counts transfers of [2^b, 2^(b+1)) µs
+#define MPU9250_I2C_LATENCY_BUCKETS 16
+
+// Transfer statistics of one device on the bus (MPU9250_ADDR or AK8963_ADDR)
+typedef struct {
+    uint32_t transactions;
+    uint64_t bytes;             // on the wire, address and register bytes included
+    uint32_t nacks;
+    uint32_t timeouts;
+    uint32_t errors;            // other failures
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint32_t busy_us;           // sum of all transfer durations
+    uint32_t latency_hist[MPU9250_I2C_LATENCY_BUCKETS];
+} mpu9250_i2c_stats_t;
+
+// Stuck-bus detections and recoveries
+typedef struct {
+    uint32_t stuck;             // 3 timeouts or errors in a row
+    uint32_t recoveries;
+    uint32_t recovery_failures;
+} mpu9250_i2c_bus_stats_t;
+
+// Bytes of one mpu9250_read_all() burst in aux I2C master mode:
+// accel, temperature, gyro (14) + AK8963 HXL..HZH, ST2 (7)
+#define MPU9250_BURST_SIZE 21
+
 /**
  * @brief Initialize MPU9250 sensor
  * 
+ * The MPU9250 and AK8963 are added as devices on config->bus. Transfers use static
+ * driver buffers (no allocation per transfer) and give up after config->timeout_ms
+ * plus the time the bytes need on the bus. If the bus was created with
+ * trans_queue_depth > 0, i2c_master runs the transfers to both devices asynchronously;
+ * the blocking calls wait for the completion, and the *_start() / *_finish() reads let
+ * the caller work while a transfer is in flight.
+ * 
+ * With config->aux_i2c_master the AK8963 is set up through bypass once, then bypass
+ * is turned off and the MPU9250's auxiliary I2C master copies the magnetometer
+ * registers into EXT_SENS_DATA at 100 Hz. The AK8963 is then no longer visible on
+ * the main bus and a 9-axis sample is a single MPU9250_BURST_SIZE read.
+ * 
  * @param config Configuration structure
  * @return esp_err_t ESP_OK on success
  */
@@ -100,19 +149,68 @@ esp_err_t mpu9250_read_imu(mpu9250_data_t *data);
 /**
  * @brief Read magnetometer data from AK8963
  * 
- * @param data Pointer to data structure
- * @return esp_err_t ESP_OK on success
+ * Reads now, due or not (see mpu9250_magnetometer_due()). Only a new measurement is
+ * returned: in aux I2C master mode the EXT_SENS_DATA copy repeats until the AK8963
+ * has measured again, and a repeated copy counts as not ready.
+ * 
+ * @param data Pointer to data structure (only the magnetometer fields are written)
+ * @return esp_err_t ESP_OK for a new reading, ESP_ERR_TIMEOUT if there is none,
+ *         ESP_ERR_INVALID_RESPONSE if it overflowed
  */
 esp_err_t mpu9250_read_magnetometer(mpu9250_data_t *data);
 
 /**
  * @brief Read all sensor data (IMU + magnetometer)
  * 
+ * The magnetometer is only read when a new measurement is due, so that the bus
+ * time spent on it follows the AK8963's rate rather than the IMU's. In aux I2C
+ * master mode this is one MPU9250_BURST_SIZE read when due and a 14-byte read
+ * otherwise; with bypass a second transaction when due. The magnetometer fields
+ * are 0 unless they hold a new reading, so each reading reaches the filter once
+ * (madgwick_ahrs falls back to the IMU update for all-zero magnetometer data).
+ * 
  * @param data Pointer to data structure
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t mpu9250_read_all(mpu9250_data_t *data);
 
+/**
+ * @brief Start mpu9250_read_all() without waiting for the transfer
+ * 
+ * Only the matching mpu9250_read_all_finish() may be called in between: any other
+ * driver call reuses the transfer buffer and cancels the read. Without the aux I2C
+ * master or an asynchronous bus the transfer happens in the finish call or here.
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mpu9250_read_all_start(void);
+
+/**
+ * @brief Wait for the read begun by mpu9250_read_all_start()
+ * 
+ * @param data Pointer to data structure
+ * @return esp_err_t ESP_OK on success, ESP_ERR_TIMEOUT if the transfer did not finish
+ *         in time, ESP_ERR_INVALID_STATE if no read was started
+ */
+esp_err_t mpu9250_read_all_finish(mpu9250_data_t *data);
+
+/**
+ * @brief Start mpu9250_read_magnetometer() without waiting for the transfer
+ * 
+ * Same rules as mpu9250_read_all_start().
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mpu9250_read_magnetometer_start(void);
+
+/**
+ * @brief Wait for the read begun by mpu9250_read_magnetometer_start()
+ * 
+ * @param data Pointer to data structure (only the magnetometer fields are written)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mpu9250_read_magnetometer_finish(mpu9250_data_t *data);
+
 /**
  * @brief Configure MPU9250 settings
  * 
@@ -139,6 +237,57 @@ esp_err_t mpu9250_enable_interrupt(void);
  */
 esp_err_t mpu9250_disable_interrupt(void);
 
+/**
+ * @brief Get the output data rate set by the DLPF and sample rate divider
+ * 
+ * @return float Sample rate in Hz
+ */
+float mpu9250_get_sample_rate(void);
+
+/**
+ * @brief Switch to FIFO mode
+ * 
+ * Accelerometer and gyroscope samples are queued in the on-chip FIFO at the sample
+ * rate and drained in bursts with mpu9250_fifo_read(). The data ready interrupt is
+ * replaced by the FIFO overflow interrupt, so the caller drains on a timer: the FIFO
+ * holds MPU9250_FIFO_MAX_SAMPLES samples (42 ms at MPU9250_SAMPLE_RATE_1KHZ).
+ * When full it stops accepting samples instead of overwriting old ones.
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mpu9250_fifo_enable(void);
+
+/**
+ * @brief Leave FIFO mode and re-enable the data ready interrupt
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mpu9250_fifo_disable(void);
+
+/**
+ * @brief Discard the FIFO contents
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mpu9250_fifo_reset(void);
+
+/**
+ * @brief Read the queued samples in a single burst
+ * 
+ * Reads up to max_samples of the oldest samples (accelerometer and gyroscope only,
+ * the magnetometer fields are set to 0). If the FIFO overflowed since the last read,
+ * the complete samples still in it are returned, the FIFO is reset and *overflow is
+ * set: the samples that did not fit are lost, so the next read starts after a gap.
+ * 
+ * @param samples Caller-provided buffer, oldest sample first
+ * @param max_samples Capacity of the buffer
+ * @param count Number of samples written
+ * @param overflow Set if samples were lost (may be NULL)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mpu9250_fifo_read(mpu9250_data_t *samples, size_t max_samples, size_t *count,
+                            bool *overflow);
+
 /**
  * @brief Get interrupt pin number
  * 
@@ -149,6 +298,9 @@ gpio_num_t mpu9250_get_int_pin(void);
 /**
  * @brief Convert raw accelerometer data to g
  * 
+ * One axis, no calibration. For whole samples mpu9250_calib_apply() (mpu9250_calib.h)
+ * converts all nine axes with bias and soft-iron correction, without divisions.
+ * 
  * @param raw Raw accelerometer value
  * @param range Accelerometer range setting
  * @return float Acceleration in g
@@ -172,13 +324,90 @@ float mpu9250_gyro_to_dps(int16_t raw, uint8_t range);
  */
 float mpu9250_mag_to_ut(int16_t raw);
 
+/**
+ * @brief Check whether a new magnetometer measurement is expected
+ * 
+ * True from one estimated AK8963 period after the last new reading, and again a
+ * short step after a read that found nothing new. The period estimate follows the
+ * measured interval between readings (mpu9250_get_magnetometer_rate()).
+ * 
+ * @return bool True if a magnetometer read is worthwhile
+ */
+bool mpu9250_magnetometer_due(void);
+
+/**
+ * @brief Get the last valid magnetometer reading without a bus transfer
+ * 
+ * @param data Pointer to data structure (only the magnetometer fields are written)
+ * @param age_us Time since the read that returned it (may be NULL)
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if there is no reading yet
+ */
+esp_err_t mpu9250_get_magnetometer(mpu9250_data_t *data, int64_t *age_us);
+
+/**
+ * @brief Get the AK8963 output rate measured from the readings
+ * 
+ * @return float Rate in Hz (100 Hz nominal)
+ */
+float mpu9250_get_magnetometer_rate(void);
+
 /**
  * @brief Check if magnetometer data is available
  * 
+ * In aux I2C master mode the AK8963 is only reachable by the MPU9250, so this
+ * returns true as long as the copied reading is valid.
+ * 
  * @return bool True if magnetometer is ready
  */
 bool mpu9250_magnetometer_ready(void);
 
+/**
+ * @brief Get the transfer statistics of one device
+ * 
+ * Every transfer the driver makes is timed and counted. Three timeouts or bus errors
+ * in a row (on either device) count as a stuck bus: the driver then clocks SCL until
+ * the slave holding SDA releases it and resets the controller (see
+ * mpu9250_get_i2c_bus_stats()). A NACK alone does not trigger this.
+ * 
+ * @param addr Device address (MPU9250_ADDR or AK8963_ADDR)
+ * @param stats Filled on success
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if the device saw no transfer
+ */
+esp_err_t mpu9250_get_i2c_stats(uint8_t addr, mpu9250_i2c_stats_t *stats);
+
+/**
+ * @brief Get the stuck-bus and recovery counters
+ * 
+ * @param stats Filled with the counters
+ */
+void mpu9250_get_i2c_bus_stats(mpu9250_i2c_bus_stats_t *stats);
+
+/**
+ * @brief Clear all I2C statistics
+ */
+void mpu9250_reset_i2c_stats(void);
+
+/**
+ * @brief Print the I2C statistics as text
+ * 
+ * Two lines per device (counters and latencies, then the non-empty histogram buckets)
+ * and one for the bus, each passed to print() without a trailing newline.
+ * 
+ * @param print Line callback
+ * @param ctx Passed to print()
+ */
+void mpu9250_dump_i2c_stats(void (*print)(const char *line, void *ctx), void *ctx);
+
+/**
+ * @brief Recover the I2C bus now
+ * 
+ * Same recovery as after a stuck bus is detected, e.g. for a caller that found the
+ * bus unusable otherwise.
+ * 
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t mpu9250_i2c_recover(void);
+
 #ifdef __cplusplus
 }
 #endif
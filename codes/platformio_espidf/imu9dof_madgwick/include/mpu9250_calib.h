@@ -0,0 +1,255 @@
+//=============================================================================================
+// mpu9250_calib.h
+//=============================================================================================
+//
+// Raw MPU9250 samples to calibrated, filter-ready units in one pass.
+//
+// The calibration (mpu9250_calib_t) holds what the sensor needs corrected: accelerometer
+// and gyroscope biases in counts, the magnetometer hard-iron offset in counts and its
+// soft-iron matrix. mpu9250_calib_kernel_init() folds it together with the full-scale
+// ranges into a kernel whose per-sample work is multiply-add only:
+//
+//   accel (g)     = raw * accel_scale + accel_offset          (offset = -bias * scale)
+//   gyro (deg/s)  = raw * gyro_scale  + gyro_offset
+//   mag (µT)      = mag_matrix * (raw - mag_bias)              (matrix includes µT/LSB)
+//
+// The calibration comes from the routines at the end of this header: a stationary
+// capture for the gyroscope bias, and a capture while the sensor is rotated through as
+// many orientations as possible for the magnetometer, fitted with an ellipsoid. Both are
+// kept in NVS.
+//
+// The kernel and the fit are portable C (mpu9250_calib.c); the captures and the NVS
+// storage use the driver and ESP-IDF (mpu9250_calib_nvs.c).
+//
+//=============================================================================================
+#ifndef MPU9250_CALIB_H
+#define MPU9250_CALIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "mpu9250.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//--------------------------------------------------------------------------------------------
+// Calibration and kernel
+
+// Calibration parameters, independent of the configured ranges (biases in counts at the
+// ranges they were measured with, see accel_range / gyro_range)
+typedef struct {
+    uint8_t accel_range;        // range the accelerometer bias was measured at
+    uint8_t gyro_range;         // range the gyroscope bias was measured at
+    float accel_bias[3];        // counts
+    float gyro_bias[3];         // counts
+    float mag_bias[3];          // hard-iron offset, counts
+    float mag_soft_iron[9];     // row-major, unitless (identity: none)
+} mpu9250_calib_t;
+
+// Precomputed conversion, built by mpu9250_calib_kernel_init()
+typedef struct {
+    float accel_scale, accel_offset[3];
+    float gyro_scale, gyro_offset[3];
+    float mag_bias[3];
+    float mag_matrix[9];        // soft iron times µT/LSB
+} mpu9250_calib_kernel_t;
+
+// One converted sample
+typedef struct {
+    float ax, ay, az;           // g
+    float gx, gy, gz;           // deg/s
+    float mx, my, mz;           // µT, all 0 if the sample had no magnetometer reading
+} mpu9250_calib_sample_t;
+
+// Destination of mpu9250_calib_apply_block() in structure-of-arrays layout, e.g. the
+// arrays behind a madgwick_ahrs_batch_t
+typedef struct {
+    float *ax, *ay, *az;
+    float *gx, *gy, *gz;
+    float *mx, *my, *mz;
+} mpu9250_calib_block_t;
+
+/**
+ * @brief No correction: zero biases and an identity soft-iron matrix
+ *
+ * @param calib Calibration to reset
+ */
+void mpu9250_calib_defaults(mpu9250_calib_t *calib);
+
+/**
+ * @brief Precompute the conversion for the configured ranges
+ *
+ * Biases measured at another range are rescaled to the configured one.
+ *
+ * @param kernel Kernel to fill
+ * @param calib Calibration to apply (NULL: none)
+ * @param accel_range Configured accelerometer range (MPU9250_ACCEL_RANGE_*)
+ * @param gyro_range Configured gyroscope range (MPU9250_GYRO_RANGE_*)
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG for an unknown range
+ */
+esp_err_t mpu9250_calib_kernel_init(mpu9250_calib_kernel_t *kernel, const mpu9250_calib_t *calib,
+                                    uint8_t accel_range, uint8_t gyro_range);
+
+/**
+ * @brief Convert one raw sample
+ *
+ * An all-zero magnetometer (no new reading) stays all-zero so that madgwick_ahrs falls
+ * back to its IMU update.
+ *
+ * @param kernel Kernel from mpu9250_calib_kernel_init()
+ * @param raw Raw sample
+ * @param out Converted sample
+ */
+void mpu9250_calib_apply(const mpu9250_calib_kernel_t *kernel, const mpu9250_data_t *raw,
+                         mpu9250_calib_sample_t *out);
+
+/**
+ * @brief Convert a block of raw samples into arrays
+ *
+ * Same conversion as mpu9250_calib_apply(), element i of each array for raw[i].
+ *
+ * @param kernel Kernel from mpu9250_calib_kernel_init()
+ * @param raw Raw samples
+ * @param count Number of samples
+ * @param out Arrays holding at least count elements each
+ */
+void mpu9250_calib_apply_block(const mpu9250_calib_kernel_t *kernel, const mpu9250_data_t *raw,
+                               size_t count, const mpu9250_calib_block_t *out);
+
+//--------------------------------------------------------------------------------------------
+// Gyroscope bias (stationary)
+
+// Running mean and spread of gyroscope and accelerometer counts
+typedef struct {
+    uint32_t count;
+    double gyro_sum[3], gyro_sq[3];
+    double accel_sum[3], accel_sq[3];
+} mpu9250_calib_still_t;
+
+/**
+ * @brief Start a stationary capture
+ *
+ * @param still Accumulator to reset
+ */
+void mpu9250_calib_still_reset(mpu9250_calib_still_t *still);
+
+/**
+ * @brief Add one sample to a stationary capture
+ *
+ * @param still Accumulator
+ * @param raw Raw sample (the magnetometer fields are ignored)
+ */
+void mpu9250_calib_still_add(mpu9250_calib_still_t *still, const mpu9250_data_t *raw);
+
+/**
+ * @brief Gyroscope bias from a stationary capture
+ *
+ * The capture is rejected if the sensor moved: a gyroscope or accelerometer axis whose
+ * standard deviation exceeds the given limit.
+ *
+ * @param still Accumulator with at least 2 samples
+ * @param max_std_counts Largest standard deviation of any axis, in counts
+ * @param calib gyro_bias is set on success, the rest is left as is
+ * @param gyro_range Range the capture was taken at
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_SIZE without enough samples,
+ *         ESP_ERR_INVALID_STATE if the sensor moved
+ */
+esp_err_t mpu9250_calib_still_gyro_bias(const mpu9250_calib_still_t *still, float max_std_counts,
+                                        mpu9250_calib_t *calib, uint8_t gyro_range);
+
+//--------------------------------------------------------------------------------------------
+// Magnetometer hard and soft iron (rotation)
+
+// Least-squares ellipsoid fit, accumulated one reading at a time (no samples are kept)
+typedef struct {
+    uint32_t count;
+    double ata[9][9];           // normal equations of the quadric a.x = 1
+    double atb[9];
+    int16_t min[3], max[3];     // coverage of each axis
+} mpu9250_calib_mag_fit_t;
+
+/**
+ * @brief Start a magnetometer capture
+ *
+ * @param fit Accumulator to reset
+ */
+void mpu9250_calib_mag_reset(mpu9250_calib_mag_fit_t *fit);
+
+/**
+ * @brief Add one magnetometer reading
+ *
+ * @param fit Accumulator
+ * @param mx Raw X, as in mpu9250_data_t
+ * @param my Raw Y
+ * @param mz Raw Z
+ */
+void mpu9250_calib_mag_add(mpu9250_calib_mag_fit_t *fit, int16_t mx, int16_t my, int16_t mz);
+
+/**
+ * @brief Fit the hard-iron offset and soft-iron matrix
+ *
+ * The readings are fitted with an ellipsoid; the offset is its centre and the matrix
+ * maps it onto a sphere of the same volume, so the corrected field keeps its strength.
+ *
+ * @param fit Accumulator
+ * @param calib mag_bias and mag_soft_iron are set on success, the rest is left as is
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_SIZE with fewer than 50 readings,
+ *         ESP_ERR_INVALID_STATE if the rotation did not cover enough orientations for a
+ *         well-conditioned fit
+ */
+esp_err_t mpu9250_calib_mag_solve(const mpu9250_calib_mag_fit_t *fit, mpu9250_calib_t *calib);
+
+//--------------------------------------------------------------------------------------------
+// Onboard captures and NVS storage (ESP-IDF only)
+
+/**
+ * @brief Measure the gyroscope bias with the sensor at rest
+ *
+ * Reads samples with mpu9250_read_imu() at the configured sample rate.
+ *
+ * @param calib gyro_bias is set on success
+ * @param samples Number of samples to average
+ * @param gyro_range Configured gyroscope range
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if the sensor moved
+ */
+esp_err_t mpu9250_calib_capture_gyro_bias(mpu9250_calib_t *calib, size_t samples,
+                                          uint8_t gyro_range);
+
+/**
+ * @brief Fit the magnetometer while the sensor is rotated by hand
+ *
+ * Collects every new magnetometer reading for duration_ms; the sensor should be turned
+ * through all orientations (a slow figure of eight on each axis) meanwhile.
+ *
+ * @param calib mag_bias and mag_soft_iron are set on success
+ * @param duration_ms Capture length
+ * @return esp_err_t ESP_OK on success, see mpu9250_calib_mag_solve() otherwise
+ */
+esp_err_t mpu9250_calib_capture_mag(mpu9250_calib_t *calib, uint32_t duration_ms);
+
+/**
+ * @brief Load the calibration stored by mpu9250_calib_save()
+ *
+ * The NVS flash partition must have been initialised (nvs_flash_init()).
+ *
+ * @param calib Filled on success, left as is otherwise
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if nothing (compatible) is stored
+ */
+esp_err_t mpu9250_calib_load(mpu9250_calib_t *calib);
+
+/**
+ * @brief Store the calibration in NVS
+ *
+ * @param calib Calibration to store
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mpu9250_calib_save(const mpu9250_calib_t *calib);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MPU9250_CALIB_H
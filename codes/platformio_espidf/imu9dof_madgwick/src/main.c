@@ -4,12 +4,14 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
-#include "driver/i2c.h"
+#include "driver/i2c_master.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "nvs_flash.h"
 #include "madgwick_ahrs.h"
 #include "mpu9250.h"
+#include "mpu9250_calib.h"
 
 static const char *TAG = "AHRS_MPU9250";
 
@@ -18,49 +20,84 @@ static const char *TAG = "AHRS_MPU9250";
 #define I2C_MASTER_SDA_IO 21
 #define I2C_MASTER_NUM I2C_NUM_0
 #define I2C_MASTER_FREQ_HZ 400000
-#define I2C_MASTER_TX_BUF_DISABLE 0
-#define I2C_MASTER_RX_BUF_DISABLE 0
+#define I2C_MASTER_QUEUE_DEPTH 4   // > 0: asynchronous transfers
 
-// Queue for communication between interrupt and task
-static QueueHandle_t mpu_queue = NULL;
+static i2c_master_bus_handle_t s_i2c_bus = NULL;
 
 // AHRS filter instance
 static madgwick_ahrs_t filter;
 
-// Timing variables
-static uint64_t last_read_time = 0;
+// Number of samples accumulated before the filter runs over them
+#define MPU_BATCH_SIZE 10
+
+// 1: sample at 1 kHz into the MPU9250 FIFO and drain it every MPU_FIFO_DRAIN_MS
+// 0: read one sample per data ready interrupt at the default 100 Hz
+#define MPU_USE_FIFO 1
+#define MPU_FIFO_SAMPLE_RATE_DIV MPU9250_SAMPLE_RATE_1KHZ
+#define MPU_FIFO_DRAIN_MS 10
+
+// Interval between printed results
+#define PRINT_PERIOD_US 100000
+
+// Interval between I2C statistics reports (transfers, errors, latency histogram)
+#define I2C_STATS_PERIOD_US 10000000
+
+// Calibration, kept in NVS. The gyroscope bias is measured at every boot when the rover
+// stands still (the stored one is used otherwise); the magnetometer fit needs the board
+// turned through all orientations by hand for MPU_CALIB_MAG_MS, so it only runs when
+// MPU_CALIB_MAG is set
+#define MPU_CALIB_GYRO_SAMPLES 200
+#define MPU_CALIB_MAG 0
+#define MPU_CALIB_MAG_MS 30000
+
+#if !MPU_USE_FIFO
+// Data ready timestamps (esp_timer, µs), from the interrupt to the task
+static QueueHandle_t mpu_queue = NULL;
+#endif
+
+// Converted samples waiting for the next batch update (structure of arrays)
+typedef struct {
+    float gx[MPU_BATCH_SIZE], gy[MPU_BATCH_SIZE], gz[MPU_BATCH_SIZE];
+    float ax[MPU_BATCH_SIZE], ay[MPU_BATCH_SIZE], az[MPU_BATCH_SIZE];
+    float mx[MPU_BATCH_SIZE], my[MPU_BATCH_SIZE], mz[MPU_BATCH_SIZE];
+    float dt[MPU_BATCH_SIZE];
+    size_t count;
+} sample_block_t;
+
+static sample_block_t s_block;
+
+// Raw counts to calibrated filter units
+static mpu9250_calib_kernel_t s_calib_kernel;
 
 /**
  * @brief Initialize I2C master
  */
 static esp_err_t i2c_master_init(void) {
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
+    i2c_master_bus_config_t conf = {
+        .i2c_port = I2C_MASTER_NUM,
         .sda_io_num = I2C_MASTER_SDA_IO,
         .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .trans_queue_depth = I2C_MASTER_QUEUE_DEPTH,
+        .flags.enable_internal_pullup = true,
     };
     
-    esp_err_t ret = i2c_param_config(I2C_MASTER_NUM, &conf);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-    
-    return i2c_driver_install(I2C_MASTER_NUM, conf.mode, 
-                             I2C_MASTER_RX_BUF_DISABLE, 
-                             I2C_MASTER_TX_BUF_DISABLE, 0);
+    return i2c_new_master_bus(&conf, &s_i2c_bus);
 }
 
 
+#if !MPU_USE_FIFO
 /**
  * @brief MPU9250 interrupt handler
+ * 
+ * Stamps the data ready edge, i.e. the sample, before the task is scheduled: the
+ * stamps carry no scheduling or I2C delay
  */
 static void IRAM_ATTR mpu_intr_handler(void *arg) {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    uint32_t dummy = 1;
-    xQueueSendFromISR(mpu_queue, &dummy, &xHigherPriorityTaskWoken);
+    int64_t stamp = esp_timer_get_time();
+    xQueueSendFromISR(mpu_queue, &stamp, &xHigherPriorityTaskWoken);
     if (xHigherPriorityTaskWoken) {
         portYIELD_FROM_ISR();
     }
@@ -86,67 +123,243 @@ static esp_err_t setup_interrupt_pin(void) {
     
     return gpio_install_isr_service(0);
 }
+#endif
+
+// Samples and samples with a new magnetometer reading since the last print
+static size_t s_samples = 0;
+static size_t s_mag_ok = 0;
+
+/**
+ * @brief Convert one sample into the block
+ * 
+ * @return true once the block is full and run_block() should be called
+ */
+static bool add_sample(const mpu9250_data_t *mpu_data, int64_t timestamp) {
+    size_t n = s_block.count;
+    if (madgwick_ahrs_timestamp_dt(&filter, timestamp, &s_block.dt[n]) != ESP_OK) {
+        return false;
+    }
+    
+    // Calibrated g, deg/s and µT in one pass; the driver leaves the magnetometer
+    // all-zero unless the reading is new, and the conversion keeps it so, which makes
+    // the filter fall back to IMU-only mode for that sample
+    mpu9250_calib_block_t out = {
+        .ax = &s_block.ax[n], .ay = &s_block.ay[n], .az = &s_block.az[n],
+        .gx = &s_block.gx[n], .gy = &s_block.gy[n], .gz = &s_block.gz[n],
+        .mx = &s_block.mx[n], .my = &s_block.my[n], .mz = &s_block.mz[n],
+    };
+    mpu9250_calib_apply_block(&s_calib_kernel, mpu_data, 1, &out);
+    
+    if (mpu_data->mx != 0 || mpu_data->my != 0 || mpu_data->mz != 0) {
+        s_mag_ok++;
+    }
+    s_samples++;
+    s_block.count = n + 1;
+    
+    return s_block.count == MPU_BATCH_SIZE;
+}
 
+/**
+ * @brief Line callback of mpu9250_dump_i2c_stats()
+ */
+static void print_line(const char *line, void *ctx) {
+    printf("%s\n", line);
+}
+
+/**
+ * @brief Run the filter over the block and print the result every PRINT_PERIOD_US
+ * (and the I2C statistics every I2C_STATS_PERIOD_US)
+ * 
+ * The filter runs over the whole block in one madgwick_ahrs_update_batch() call,
+ * integrating each sample over the real interval measured from its timestamp.
+ */
+static void run_block(int64_t now) {
+    static int64_t last_print = 0;
+    static int64_t last_i2c_stats = 0;
+    
+    if (s_block.count == 0) {
+        return;
+    }
+    
+    // Update AHRS filter with the whole block
+    madgwick_ahrs_batch_t batch = {
+        .gx = s_block.gx, .gy = s_block.gy, .gz = s_block.gz,
+        .ax = s_block.ax, .ay = s_block.ay, .az = s_block.az,
+        .mx = s_block.mx, .my = s_block.my, .mz = s_block.mz,
+        .dt = s_block.dt,
+    };
+    madgwick_ahrs_update_batch(&filter, &batch, s_block.count);
+    s_block.count = 0;
+    
+    if (now - last_print < PRINT_PERIOD_US) {
+        return;
+    }
+    last_print = now;
+    
+    // Get Euler angles (in degrees), all three from one angle computation
+    float roll, pitch, yaw;
+    madgwick_ahrs_get_euler(&filter, &roll, &pitch, &yaw);
+    
+    // Real sampling frequency, jitter and dropped samples since start
+    madgwick_ahrs_timing_t timing;
+    float jitter;
+    madgwick_ahrs_get_timing(&filter, &timing, &jitter);
+    float freq = (timing.dtMean > 0) ? (1.0f / timing.dtMean) : 0;
+    
+    // Display results
+    printf("f: %.2f Hz  jitter: %.3f ms  dropped: %lu  Roll: %.2f  Pitch: %.2f  Yaw: %.2f  Mag: %u/%u (%.1f Hz)\n", 
+           freq, jitter * 1e3f, (unsigned long)timing.dropped, roll, pitch, yaw,
+           (unsigned)s_mag_ok, (unsigned)s_samples, mpu9250_get_magnetometer_rate());
+    
+    s_mag_ok = 0;
+    s_samples = 0;
+    
+    if (now - last_i2c_stats >= I2C_STATS_PERIOD_US) {
+        last_i2c_stats = now;
+        mpu9250_dump_i2c_stats(print_line, NULL);
+    }
+}
 
+#if MPU_USE_FIFO
+/**
+ * @brief Main task to process MPU9250 data, FIFO mode
+ * 
+ * Wakes every MPU_FIFO_DRAIN_MS and reads everything queued in the FIFO in one I2C
+ * burst. Samples are evenly spaced at the sensor rate, so their timestamps are
+ * reconstructed back from the drain time. The magnetometer (100 Hz) is read when
+ * the driver expects a new measurement and a new reading is attached to the newest
+ * sample; that read runs while the older samples go through the filter.
+ */
+static void mpu_task(void *pvParameters) {
+    static mpu9250_data_t fifo_samples[MPU9250_FIFO_MAX_SAMPLES];
+    mpu9250_data_t mag_data;
+    const int64_t period_us = (int64_t)(1e6f / mpu9250_get_sample_rate());
+    uint32_t overflows = 0;
+    TickType_t last_wake = xTaskGetTickCount();
+    
+    while (1) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(MPU_FIFO_DRAIN_MS));
+        int64_t now = esp_timer_get_time();
+        
+        size_t count = 0;
+        bool overflow = false;
+        if (mpu9250_fifo_read(fifo_samples, MPU9250_FIFO_MAX_SAMPLES, &count, &overflow) != ESP_OK
+            && !overflow) {
+            continue;
+        }
+        if (overflow) {
+            overflows++;
+            ESP_LOGW(TAG, "FIFO overflow (%lu so far)", (unsigned long)overflows);
+        }
+        if (count == 0) {
+            continue;
+        }
+        
+        bool mag_started = mpu9250_magnetometer_due() && mpu9250_read_magnetometer_start() == ESP_OK;
+        
+        for (size_t i = 0; i + 1 < count; i++) {
+            if (add_sample(&fifo_samples[i], now - (int64_t)(count - 1 - i) * period_us)) {
+                run_block(now);
+            }
+        }
+        
+        if (mag_started && mpu9250_read_magnetometer_finish(&mag_data) == ESP_OK) {
+            fifo_samples[count - 1].mx = mag_data.mx;
+            fifo_samples[count - 1].my = mag_data.my;
+            fifo_samples[count - 1].mz = mag_data.mz;
+        }
+        if (add_sample(&fifo_samples[count - 1], now)) {
+            run_block(now);
+        }
+    }
+}
+#else
 /**
- * @brief Main task to process MPU9250 data
+ * @brief Main task to process MPU9250 data, one sample per data ready interrupt
+ * 
+ * A full block is filtered while the transfer of the next sample is in flight. The
+ * driver adds the magnetometer to the read only when a new measurement is due.
  */
 static void mpu_task(void *pvParameters) {
     mpu9250_data_t mpu_data;
-    uint32_t dummy;
+    int64_t stamp;
+    bool block_full = false;
     
     while (1) {
-        // Wait for interrupt signal
-        if (xQueueReceive(mpu_queue, &dummy, portMAX_DELAY)) {
-            uint64_t now = esp_timer_get_time();
-            float dt = (now - last_read_time) / 1e6f;
-            last_read_time = now;
-            
+        // Wait for interrupt signal, with the time of the sample
+        if (xQueueReceive(mpu_queue, &stamp, portMAX_DELAY)) {
             // Read all MPU9250 data (IMU + magnetometer)
-            if (mpu9250_read_all(&mpu_data) == ESP_OK) {
-                // Convert to physical units using library functions with default ranges
-                float axg = mpu9250_accel_to_g(mpu_data.ax, MPU9250_ACCEL_RANGE_DEFAULT);
-                float ayg = mpu9250_accel_to_g(mpu_data.ay, MPU9250_ACCEL_RANGE_DEFAULT);
-                float azg = mpu9250_accel_to_g(mpu_data.az, MPU9250_ACCEL_RANGE_DEFAULT);
-                float gxds = mpu9250_gyro_to_dps(mpu_data.gx, MPU9250_GYRO_RANGE_DEFAULT);
-                float gyds = mpu9250_gyro_to_dps(mpu_data.gy, MPU9250_GYRO_RANGE_DEFAULT);
-                float gzds = mpu9250_gyro_to_dps(mpu_data.gz, MPU9250_GYRO_RANGE_DEFAULT);
-                
-                // Convert magnetometer to microtesla (µT)
-                float mx_ut = mpu9250_mag_to_ut(mpu_data.mx);
-                float my_ut = mpu9250_mag_to_ut(mpu_data.my);
-                float mz_ut = mpu9250_mag_to_ut(mpu_data.mz);
-                
-                // Check if magnetometer data is valid
-                bool mag_valid = (mpu_data.mx != 0 || mpu_data.my != 0 || mpu_data.mz != 0);
-                
-                // Update AHRS filter with magnetometer data if available
-                if (mag_valid) {
-                    madgwick_ahrs_update(&filter, gxds, gyds, gzds, axg, ayg, azg, mx_ut, my_ut, mz_ut);
-                } else {
-                    // Fallback to IMU-only mode if magnetometer fails
-                    madgwick_ahrs_update_imu(&filter, gxds, gyds, gzds, axg, ayg, azg);
-                }
-                
-                // Get Euler angles (in degrees)
-                float roll = madgwick_ahrs_get_roll(&filter);
-                float pitch = madgwick_ahrs_get_pitch(&filter);
-                float yaw = madgwick_ahrs_get_yaw(&filter);
-                
-                // Real sampling frequency
-                float freq = (dt > 0) ? (1.0f / dt) : 0;
-                
-                // Display results
-                printf("f: %.2f Hz  Roll: %.2f  Pitch: %.2f  Yaw: %.2f  Mag: %s\n", 
-                       freq, roll, pitch, yaw, mag_valid ? "OK" : "FAIL");
+            esp_err_t ret = mpu9250_read_all_start();
+            if (block_full) {
+                run_block(stamp);
+                block_full = false;
             }
+            if (ret != ESP_OK || mpu9250_read_all_finish(&mpu_data) != ESP_OK) {
+                continue;
+            }
+            
+            block_full = add_sample(&mpu_data, stamp);
+        }
+    }
+}
+#endif
+
+/**
+ * @brief Load the stored calibration, refresh it and build the conversion kernel
+ * 
+ * Runs before the FIFO is enabled, at the default sample rate.
+ */
+static esp_err_t calibrate(void) {
+    mpu9250_calib_t calib;
+    mpu9250_calib_defaults(&calib);
+    bool stored = mpu9250_calib_load(&calib) == ESP_OK;
+    bool changed = false;
+    
+    esp_err_t ret = mpu9250_calib_capture_gyro_bias(&calib, MPU_CALIB_GYRO_SAMPLES,
+                                                    MPU9250_GYRO_RANGE_DEFAULT);
+    if (ret == ESP_OK) {
+        changed = true;
+    } else {
+        ESP_LOGW(TAG, "Gyro bias not measured (%s), using the %s one", esp_err_to_name(ret),
+                 stored ? "stored" : "zero");
+    }
+    
+#if MPU_CALIB_MAG
+    ESP_LOGI(TAG, "Magnetometer calibration: turn the board through all orientations for %d s",
+             MPU_CALIB_MAG_MS / 1000);
+    ret = mpu9250_calib_capture_mag(&calib, MPU_CALIB_MAG_MS);
+    if (ret == ESP_OK) {
+        changed = true;
+    } else {
+        ESP_LOGW(TAG, "Magnetometer calibration failed: %s", esp_err_to_name(ret));
+    }
+#endif
+    
+    if (changed) {
+        ret = mpu9250_calib_save(&calib);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to store calibration: %s", esp_err_to_name(ret));
         }
     }
+    
+    return mpu9250_calib_kernel_init(&s_calib_kernel, &calib, MPU9250_ACCEL_RANGE_DEFAULT,
+                                     MPU9250_GYRO_RANGE_DEFAULT);
 }
 
 void app_main(void) {
     esp_err_t ret;
     
+    // Initialize NVS (calibration storage)
+    ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase();
+        ret = nvs_flash_init();
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize NVS: %s", esp_err_to_name(ret));
+        return;
+    }
+    
     // Initialize AHRS filter
     ret = madgwick_ahrs_init(&filter);
     if (ret != ESP_OK) {
@@ -154,7 +367,7 @@ void app_main(void) {
         return;
     }
     
-    ret = madgwick_ahrs_begin(&filter, 100.0f); // 100 Hz
+    ret = madgwick_ahrs_begin(&filter, 100.0f); // nominal rate, real intervals come from timestamps
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to configure filter frequency: %s", esp_err_to_name(ret));
         return;
@@ -169,16 +382,35 @@ void app_main(void) {
     
     // Initialize MPU9250
     mpu9250_config_t mpu_config = MPU9250_DEFAULT_CONFIG();
+    mpu_config.bus = s_i2c_bus;
     mpu_config.int_pin = GPIO_NUM_23;
+    mpu_config.i2c_freq = I2C_MASTER_FREQ_HZ;
     ret = mpu9250_init(&mpu_config);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize MPU9250: %s", esp_err_to_name(ret));
         return;
     }
     
+    ret = calibrate();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up calibration: %s", esp_err_to_name(ret));
+        return;
+    }
     
+#if MPU_USE_FIFO
+    ret = mpu9250_configure(MPU9250_ACCEL_RANGE_DEFAULT, MPU9250_GYRO_RANGE_DEFAULT,
+                            MPU9250_DLPF_CFG_DEFAULT, MPU_FIFO_SAMPLE_RATE_DIV);
+    if (ret == ESP_OK) {
+        ret = mpu9250_fifo_enable();
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable MPU9250 FIFO: %s", esp_err_to_name(ret));
+        return;
+    }
+    madgwick_ahrs_begin(&filter, mpu9250_get_sample_rate());
+#else
     // Create queue for interrupt
-    mpu_queue = xQueueCreate(10, sizeof(uint32_t));
+    mpu_queue = xQueueCreate(10, sizeof(int64_t));
     if (mpu_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create queue");
         return;
@@ -198,12 +430,10 @@ void app_main(void) {
         ESP_LOGE(TAG, "Failed to add interrupt handler: %s", esp_err_to_name(ret));
         return;
     }
+#endif
     
     // Create task to process data
     xTaskCreate(mpu_task, "mpu_task", 4096, NULL, 5, NULL);
     
     ESP_LOGI(TAG, "MPU9250 + AHRS initialized!");
-    
-    // Initialize time
-    last_read_time = esp_timer_get_time();
 }
\ No newline at end of file
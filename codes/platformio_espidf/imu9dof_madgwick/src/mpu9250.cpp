@@ -0,0 +1,747 @@
+#include "mpu9250.h"
+#include "mpu9250_driver.hpp"
+#include "i2c_telemetry.hpp"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "MPU9250";
+
+// The C API constants and the driver core describe the same chip
+static_assert(MPU9250_BURST_SIZE == mpu9250::kBurstSize, "burst size");
+static_assert(MPU9250_FIFO_FRAME_SIZE == mpu9250::kFifoFrameSize, "FIFO frame size");
+static_assert(MPU9250_FIFO_MAX_SAMPLES == mpu9250::kFifoMaxSamples, "FIFO capacity");
+static_assert(MPU9250_I2C_LATENCY_BUCKETS == i2c::kLatencyBuckets, "latency histogram");
+
+// Internal state
+static mpu9250_config_t s_config;
+static bool s_initialized = false;
+
+// I2C devices on the caller's bus
+static i2c_master_dev_handle_t s_mpu_dev = NULL;
+static i2c_master_dev_handle_t s_ak_dev = NULL;
+
+// One transfer at a time, to either device. The buffers live here rather than on the
+// caller's stack so that an asynchronous transfer that outlives its wait never touches
+// memory that has gone away; nothing is allocated per transfer. With a transaction
+// queue on the bus, i2c_master runs the transfers of every device on it asynchronously,
+// so the AK8963 goes through the same path as the MPU9250.
+static uint8_t s_tx[2];
+static uint8_t s_rx[MPU9250_FIFO_MAX_SAMPLES * MPU9250_FIFO_FRAME_SIZE];
+static StaticSemaphore_t s_done_storage;
+static SemaphoreHandle_t s_done = NULL;     // given by on_trans_done()
+static bool s_async = false;                // transfers complete in on_trans_done()
+static bool s_pending = false;              // a started transfer has not completed yet
+static volatile esp_err_t s_result = ESP_OK;
+static uint32_t s_wait_ms = 0;
+
+// Read begun by mpu9250_read_all_start() / mpu9250_read_magnetometer_start(); any other
+// transfer reuses s_rx and cancels it
+typedef enum {
+    READ_NONE,
+    READ_ALL,
+    READ_MAG,
+} started_read_t;
+static started_read_t s_started = READ_NONE;
+static size_t s_started_len = 0;
+
+// Telemetry of every transfer on the two devices. A transfer is timed from its start
+// to on_trans_done() (asynchronous) or to the end of the blocking call.
+// The callback may run on a different core from the task, and the cycle counters of the
+// cores are not in step, so both ends are stamped with esp_timer (µs).
+static i2c::Telemetry<2> s_i2c_stats;
+static uint32_t s_trace_start = 0;          // esp_timer at the start of the open transfer
+static uint8_t s_trace_addr = 0;            // device of the open transfer
+static size_t s_trace_bytes = 0;
+static bool s_trace_open = false;           // started and not recorded yet
+static volatile uint32_t s_done_us = 0;     // esp_timer in on_trans_done()
+
+// Timeout of a transfer: the configured margin plus the time the bytes take on the bus
+static uint32_t transfer_timeout_ms(size_t bytes) {
+    uint32_t bus_ms = (uint32_t)((bytes + 2) * 9 * 1000 / s_config.i2c_freq) + 1;
+    return s_config.timeout_ms + bus_ms;
+}
+
+static bool IRAM_ATTR on_trans_done(i2c_master_dev_handle_t dev,
+                                    const i2c_master_event_data_t *evt, void *arg) {
+    BaseType_t woken = pdFALSE;
+    s_done_us = (uint32_t)esp_timer_get_time();
+    // Same codes as the blocking calls
+    switch (evt->event) {
+    case I2C_EVENT_DONE:    s_result = ESP_OK; break;
+    case I2C_EVENT_NACK:    s_result = ESP_ERR_INVALID_RESPONSE; break;
+    case I2C_EVENT_TIMEOUT: s_result = ESP_ERR_TIMEOUT; break;
+    default:                s_result = ESP_FAIL; break;
+    }
+    xSemaphoreGiveFromISR(s_done, &woken);
+    return woken == pdTRUE;
+}
+
+static i2c::Result to_i2c_result(esp_err_t ret) {
+    switch (ret) {
+    case ESP_OK:                    return i2c::Result::Ok;
+    case ESP_ERR_INVALID_RESPONSE:  return i2c::Result::Nack;     // i2c_master: NACK
+    case ESP_ERR_TIMEOUT:           return i2c::Result::Timeout;
+    default:                        return i2c::Result::Error;
+    }
+}
+
+static esp_err_t bus_recover(void);
+
+// Account one transfer; clocks the bus free once it looks stuck
+static void trace(uint8_t addr, size_t bytes, uint32_t start, uint32_t end, esp_err_t ret) {
+    if (s_i2c_stats.record(addr, bytes, end - start, to_i2c_result(ret))) {
+        ESP_LOGW(TAG, "I2C bus stuck (0x%02x: %s), recovering", addr, esp_err_to_name(ret));
+        bus_recover();
+    }
+}
+
+// Record the open transfer, once
+static void trace_transfer(uint32_t end, esp_err_t ret) {
+    if (s_trace_open) {
+        s_trace_open = false;
+        trace(s_trace_addr, s_trace_bytes, s_trace_start, end, ret);
+    }
+}
+
+// Wait for the transfer started by transfer_start()
+static esp_err_t transfer_wait(void) {
+    if (!s_pending) {
+        return s_result;
+    }
+    // One extra tick so that a wait shorter than a tick cannot expire immediately
+    if (xSemaphoreTake(s_done, pdMS_TO_TICKS(s_wait_ms) + 1) != pdTRUE) {
+        // Every expired wait counts, so that a transfer that never completes still
+        // leads to a recovery
+        trace(s_trace_addr, s_trace_open ? s_trace_bytes : 0, s_trace_start,
+              (uint32_t)esp_timer_get_time(), ESP_ERR_TIMEOUT);
+        s_trace_open = false;
+        return ESP_ERR_TIMEOUT;  // still pending, the next transfer waits for it again
+    }
+    s_pending = false;
+    trace_transfer(s_done_us, s_result);
+    return s_result;
+}
+
+// Send s_tx[0..tx_len) to a device and read rx_len bytes into s_rx. Returns as soon as
+// the transfer is queued when the bus runs asynchronously; transfer_wait() collects
+// the result.
+static esp_err_t transfer_start(i2c_master_dev_handle_t dev, uint8_t addr, size_t tx_len,
+                                size_t rx_len) {
+    esp_err_t ret = transfer_wait();
+    if (ret == ESP_ERR_TIMEOUT) {
+        return ret;
+    }
+
+    s_started = READ_NONE;
+    s_wait_ms = transfer_timeout_ms(tx_len + rx_len);
+    s_pending = s_async;
+    // Address byte(s) on the wire: one for a write, two with the repeated start
+    s_trace_addr = addr;
+    s_trace_bytes = tx_len + rx_len + (rx_len > 0 ? 2 : 1);
+    s_trace_open = true;
+    s_trace_start = (uint32_t)esp_timer_get_time();
+    if (rx_len > 0) {
+        ret = i2c_master_transmit_receive(dev, s_tx, tx_len, s_rx, rx_len, s_wait_ms);
+    } else {
+        ret = i2c_master_transmit(dev, s_tx, tx_len, s_wait_ms);
+    }
+    if (ret != ESP_OK) {
+        s_pending = false;
+    }
+    if (!s_pending) {
+        s_result = ret;
+        trace_transfer((uint32_t)esp_timer_get_time(), ret);
+    }
+    return ret;
+}
+
+// Helper function to write a byte to MPU9250
+static esp_err_t write_mpu(uint8_t reg, uint8_t data) {
+    s_tx[0] = reg;
+    s_tx[1] = data;
+    esp_err_t ret = transfer_start(s_mpu_dev, MPU9250_ADDR, 2, 0);
+    return (ret == ESP_OK) ? transfer_wait() : ret;
+}
+
+// Helper function to read consecutive registers (or the FIFO port) into s_rx
+static esp_err_t read_mpu_rx(uint8_t reg, size_t len) {
+    s_tx[0] = reg;
+    esp_err_t ret = transfer_start(s_mpu_dev, MPU9250_ADDR, 1, len);
+    return (ret == ESP_OK) ? transfer_wait() : ret;
+}
+
+// Helper function to read consecutive registers from MPU9250
+static esp_err_t read_mpu(uint8_t reg, uint8_t *data, size_t len) {
+    esp_err_t ret = read_mpu_rx(reg, len);
+    if (ret == ESP_OK) {
+        memcpy(data, s_rx, len);
+    }
+    return ret;
+}
+
+// Helper function to write a byte to AK8963 magnetometer (bypass mode, waits)
+static esp_err_t write_ak8963(uint8_t reg, uint8_t data) {
+    s_tx[0] = reg;
+    s_tx[1] = data;
+    esp_err_t ret = transfer_start(s_ak_dev, AK8963_ADDR, 2, 0);
+    return (ret == ESP_OK) ? transfer_wait() : ret;
+}
+
+// Helper function to read consecutive AK8963 registers (bypass mode, waits)
+static esp_err_t read_ak8963(uint8_t reg, uint8_t *data, size_t len) {
+    s_tx[0] = reg;
+    esp_err_t ret = transfer_start(s_ak_dev, AK8963_ADDR, 1, len);
+    if (ret == ESP_OK) {
+        ret = transfer_wait();
+    }
+    if (ret == ESP_OK) {
+        memcpy(data, s_rx, len);
+    }
+    return ret;
+}
+
+// Clock a stuck bus free: i2c_master_bus_reset() sends up to nine SCL pulses until the
+// device holding SDA low lets go, then a STOP, and resets the controller. A transfer
+// still queued is dropped first so that its late completion is not taken for the next.
+static esp_err_t bus_recover(void) {
+    i2c_master_bus_wait_all_done(s_config.bus, (int)s_wait_ms);
+    esp_err_t ret = i2c_master_bus_reset(s_config.bus);
+    if (s_done != NULL) {
+        xSemaphoreTake(s_done, 0);
+    }
+    s_pending = false;
+    s_trace_open = false;
+    s_i2c_stats.recovered(ret == ESP_OK);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "I2C bus recovery failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+// Add both devices to the bus. Transfers to both become asynchronous if the bus was
+// created with a transaction queue (trans_queue_depth > 0): each device gets the
+// completion callback.
+static esp_err_t transport_init(void) {
+    i2c_device_config_t dev_cfg;
+    memset(&dev_cfg, 0, sizeof(dev_cfg));
+    dev_cfg.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+    dev_cfg.device_address = MPU9250_ADDR;
+    dev_cfg.scl_speed_hz = s_config.i2c_freq;
+    esp_err_t ret = i2c_master_bus_add_device(s_config.bus, &dev_cfg, &s_mpu_dev);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    dev_cfg.device_address = AK8963_ADDR;
+    ret = i2c_master_bus_add_device(s_config.bus, &dev_cfg, &s_ak_dev);
+    if (ret != ESP_OK) {
+        i2c_master_bus_rm_device(s_mpu_dev);
+        s_mpu_dev = NULL;
+        return ret;
+    }
+
+    if (s_done == NULL) {
+        s_done = xSemaphoreCreateBinaryStatic(&s_done_storage);
+    }
+    s_pending = false;
+    s_result = ESP_OK;
+    s_trace_open = false;
+
+    i2c_master_event_callbacks_t cbs;
+    memset(&cbs, 0, sizeof(cbs));
+    cbs.on_trans_done = on_trans_done;
+    s_async = (i2c_master_register_event_callbacks(s_mpu_dev, &cbs, NULL) == ESP_OK) &&
+              (i2c_master_register_event_callbacks(s_ak_dev, &cbs, NULL) == ESP_OK);
+    ESP_LOGI(TAG, "%s I2C transfers", s_async ? "Asynchronous" : "Blocking");
+    return ESP_OK;
+}
+
+static void transport_deinit(void) {
+    transfer_wait();
+    s_pending = false;
+    s_async = false;
+    if (s_mpu_dev != NULL) {
+        i2c_master_bus_rm_device(s_mpu_dev);
+        s_mpu_dev = NULL;
+    }
+    if (s_ak_dev != NULL) {
+        i2c_master_bus_rm_device(s_ak_dev);
+        s_ak_dev = NULL;
+    }
+}
+
+// Bus policy of the shared driver core (mpu9250_driver.hpp) on top of the transfers
+// above. Reads are copied out of s_rx; the FIFO fits in a single read.
+struct IdfBus {
+    static constexpr size_t kMaxRead = sizeof(s_rx);
+
+    esp_err_t error = ESP_OK;   // result of the last transfer
+
+    bool write(uint8_t addr, uint8_t reg, uint8_t value) {
+        error = (addr == MPU9250_ADDR) ? write_mpu(reg, value) : write_ak8963(reg, value);
+        return error == ESP_OK;
+    }
+
+    bool read(uint8_t addr, uint8_t reg, uint8_t *data, size_t len) {
+        error = (addr == MPU9250_ADDR) ? read_mpu(reg, data, len) : read_ak8963(reg, data, len);
+        return error == ESP_OK;
+    }
+
+    void delay_ms(uint32_t ms) {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+    }
+};
+
+static IdfBus s_bus;
+static mpu9250::Driver<IdfBus> s_driver(s_bus);
+
+// Driver core status to esp_err_t; bus errors keep the transfer's own code
+static esp_err_t to_esp_err(mpu9250::Status st) {
+    switch (st) {
+    case mpu9250::Status::Ok:           return ESP_OK;
+    case mpu9250::Status::BusError:     return s_bus.error != ESP_OK ? s_bus.error : ESP_FAIL;
+    case mpu9250::Status::InvalidArg:   return ESP_ERR_INVALID_ARG;
+    case mpu9250::Status::InvalidState: return ESP_ERR_INVALID_STATE;
+    case mpu9250::Status::NotReady:     return ESP_ERR_TIMEOUT;             // Data not ready
+    case mpu9250::Status::Overflow:     return ESP_ERR_INVALID_RESPONSE;    // Magnetic sensor overflow
+    }
+    return ESP_FAIL;
+}
+
+static mpu9250::Config make_config(uint8_t accel_range, uint8_t gyro_range,
+                                   uint8_t dlpf_cfg, uint8_t sample_rate_div) {
+    mpu9250::Config config;
+    config.accelRange = accel_range;
+    config.gyroRange = gyro_range;
+    config.dlpfCfg = dlpf_cfg;
+    config.sampleRateDiv = sample_rate_div;
+    return config;
+}
+
+// Sensor setup of mpu9250_init()
+static esp_err_t init_registers(void) {
+    // Wake up, configure with the defaults and enable the data ready interrupt
+    esp_err_t ret = to_esp_err(s_driver.beginImu(make_config(MPU9250_ACCEL_RANGE_DEFAULT,
+                                                             MPU9250_GYRO_RANGE_DEFAULT,
+                                                             MPU9250_DLPF_CFG_DEFAULT,
+                                                             MPU9250_SAMPLE_RATE_DIV_DEFAULT)));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up MPU9250: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    // AK8963 through I2C bypass: 16-bit output, continuous mode 2
+    ret = to_esp_err(s_driver.beginMag());
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure magnetometer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    // Hand the AK8963 over to the MPU9250's own I2C master
+    if (s_config.aux_i2c_master) {
+        ret = to_esp_err(s_driver.enableAuxMaster());
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to enable aux I2C master: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+    
+    return ESP_OK;
+}
+
+esp_err_t mpu9250_init(const mpu9250_config_t *config) {
+    if (config == NULL || config->bus == NULL) {
+        ESP_LOGE(TAG, "Configuration or I2C bus is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (s_initialized) {
+        ESP_LOGW(TAG, "MPU9250 already initialized");
+        return ESP_OK;
+    }
+    
+    // Store configuration
+    memcpy(&s_config, config, sizeof(mpu9250_config_t));
+    
+    esp_err_t ret = transport_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add MPU9250 to the I2C bus: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ret = init_registers();
+    if (ret != ESP_OK) {
+        transport_deinit();
+        return ret;
+    }
+    
+    s_initialized = true;
+    ESP_LOGI(TAG, "MPU9250 initialized successfully");
+    
+    return ESP_OK;
+}
+
+esp_err_t mpu9250_deinit(void) {
+    if (!s_initialized) {
+        return ESP_OK;
+    }
+    
+    // Stop the aux I2C master and put MPU9250 to sleep
+    s_driver.sleep();
+    
+    transport_deinit();
+    s_initialized = false;
+    ESP_LOGI(TAG, "MPU9250 deinitialized");
+    
+    return ESP_OK;
+}
+
+esp_err_t mpu9250_read_imu(mpu9250_data_t *data) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (data == NULL) {
+        ESP_LOGE(TAG, "Data pointer is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    return to_esp_err(s_driver.readImu(*data));
+}
+
+esp_err_t mpu9250_read_magnetometer(mpu9250_data_t *data) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (data == NULL) {
+        ESP_LOGE(TAG, "Data pointer is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    return to_esp_err(s_driver.readMag(*data, esp_timer_get_time()));
+}
+
+esp_err_t mpu9250_read_all(mpu9250_data_t *data) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (data == NULL) {
+        ESP_LOGE(TAG, "Data pointer is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    bool mag_fresh;
+    return to_esp_err(s_driver.readAll(*data, esp_timer_get_time(), &mag_fresh));
+}
+
+// Begin a read of len bytes from reg that the matching *_finish() completes
+static esp_err_t read_start(started_read_t kind, uint8_t reg, size_t len) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    esp_err_t ret = ESP_OK;
+    if (s_driver.auxMaster()) {
+        s_tx[0] = reg;
+        ret = transfer_start(s_mpu_dev, MPU9250_ADDR, 1, len);
+    }
+    // With bypass the AK8963 needs its own transactions, done in *_finish()
+    s_started = (ret == ESP_OK) ? kind : READ_NONE;
+    s_started_len = len;
+    return ret;
+}
+
+// Wait for the read begun by read_start(kind)
+static esp_err_t read_finish(started_read_t kind, mpu9250_data_t *data) {
+    if (data == NULL) {
+        ESP_LOGE(TAG, "Data pointer is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (!s_initialized || s_started != kind) {
+        ESP_LOGE(TAG, "No read started");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    s_started = READ_NONE;
+    if (!s_driver.auxMaster()) {
+        return (kind == READ_ALL) ? mpu9250_read_all(data) : mpu9250_read_magnetometer(data);
+    }
+    
+    esp_err_t ret = transfer_wait();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    int64_t now = esp_timer_get_time();
+    if (kind == READ_MAG) {
+        return to_esp_err(s_driver.acceptMag(s_rx, true, now, *data));
+    }
+    
+    mpu9250::decode_imu(s_rx, *data);
+    data->mx = 0;
+    data->my = 0;
+    data->mz = 0;
+    if (s_started_len == mpu9250::kBurstSize) {
+        s_driver.acceptMag(&s_rx[mpu9250::kImuSize], true, now, *data);
+    }
+    return ESP_OK;
+}
+
+esp_err_t mpu9250_read_all_start(void) {
+    // The EXT_SENS_DATA part only when a magnetometer measurement is due
+    bool due = s_driver.magDue(esp_timer_get_time());
+    return read_start(READ_ALL, mpu9250::reg::ACCEL_XOUT_H,
+                      due ? mpu9250::kBurstSize : mpu9250::kImuSize);
+}
+
+esp_err_t mpu9250_read_all_finish(mpu9250_data_t *data) {
+    return read_finish(READ_ALL, data);
+}
+
+esp_err_t mpu9250_read_magnetometer_start(void) {
+    return read_start(READ_MAG, mpu9250::reg::EXT_SENS_DATA_00, mpu9250::kExtMagSize);
+}
+
+esp_err_t mpu9250_read_magnetometer_finish(mpu9250_data_t *data) {
+    return read_finish(READ_MAG, data);
+}
+
+esp_err_t mpu9250_configure(uint8_t accel_range, uint8_t gyro_range,
+                           uint8_t dlpf_cfg, uint8_t sample_rate_div) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    esp_err_t ret = to_esp_err(s_driver.configure(make_config(accel_range, gyro_range,
+                                                              dlpf_cfg, sample_rate_div)));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure MPU9250 (accel_range=%d, gyro_range=%d, dlpf=%d): %s",
+                 accel_range, gyro_range, dlpf_cfg, esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "MPU9250 configured: accel_range=%d, gyro_range=%d, dlpf=%d, div=%d",
+             accel_range, gyro_range, dlpf_cfg, sample_rate_div);
+    
+    return ESP_OK;
+}
+
+esp_err_t mpu9250_enable_interrupt(void) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    return to_esp_err(s_driver.setDataReadyInterrupt(true));
+}
+
+esp_err_t mpu9250_disable_interrupt(void) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    return to_esp_err(s_driver.setDataReadyInterrupt(false));
+}
+
+float mpu9250_get_sample_rate(void) {
+    return s_driver.sampleRate();
+}
+
+esp_err_t mpu9250_fifo_enable(void) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    esp_err_t ret = to_esp_err(s_driver.fifoEnable());
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable FIFO: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "FIFO enabled at %.1f Hz", mpu9250_get_sample_rate());
+    return ESP_OK;
+}
+
+esp_err_t mpu9250_fifo_disable(void) {
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "MPU9250 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    return to_esp_err(s_driver.fifoDisable());
+}
+
+esp_err_t mpu9250_fifo_reset(void) {
+    if (!s_initialized || !s_driver.fifoEnabled()) {
+        ESP_LOGE(TAG, "FIFO not enabled");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    return to_esp_err(s_driver.fifoReset());
+}
+
+esp_err_t mpu9250_fifo_read(mpu9250_data_t *samples, size_t max_samples, size_t *count,
+                            bool *overflow) {
+    if (!s_initialized || !s_driver.fifoEnabled()) {
+        ESP_LOGE(TAG, "FIFO not enabled");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (samples == NULL || count == NULL) {
+        ESP_LOGE(TAG, "Data pointer is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    bool lost = false;
+    mpu9250_data_t *out = samples;
+    mpu9250::Status st = s_driver.fifoRead(max_samples, [&out](const mpu9250::RawSample &s) {
+        out->ax = s.ax;
+        out->ay = s.ay;
+        out->az = s.az;
+        out->gx = s.gx;
+        out->gy = s.gy;
+        out->gz = s.gz;
+        out->mx = 0;
+        out->my = 0;
+        out->mz = 0;
+        out++;
+    }, count, &lost);
+    
+    if (lost) {
+        // Samples were dropped while the FIFO was full; the driver started over from an empty FIFO
+        ESP_LOGW(TAG, "FIFO overflow, %u samples recovered", (unsigned)*count);
+    }
+    if (overflow != NULL) {
+        *overflow = lost;
+    }
+    
+    return to_esp_err(st);
+}
+
+gpio_num_t mpu9250_get_int_pin(void) {
+    return s_config.int_pin;
+}
+
+float mpu9250_accel_to_g(int16_t raw, uint8_t range) {
+    if (range > 3) range = 0;
+    return (float)raw / mpu9250::accel_lsb_per_g(range);
+}
+
+float mpu9250_gyro_to_dps(int16_t raw, uint8_t range) {
+    if (range > 3) range = 0;
+    return (float)raw / mpu9250::gyro_lsb_per_dps(range);
+}
+
+float mpu9250_mag_to_ut(int16_t raw) {
+    // AK8963 sensitivity: 0.15 µT/LSB in 16-bit mode
+    return (float)raw * mpu9250::kMagUtPerLsb;
+}
+
+bool mpu9250_magnetometer_due(void) {
+    return s_initialized && s_driver.magDue(esp_timer_get_time());
+}
+
+esp_err_t mpu9250_get_magnetometer(mpu9250_data_t *data, int64_t *age_us) {
+    if (data == NULL) {
+        ESP_LOGE(TAG, "Data pointer is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    const mpu9250::MagCache &cache = s_driver.magCache();
+    if (!s_initialized || !cache.valid) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    data->mx = cache.mx;
+    data->my = cache.my;
+    data->mz = cache.mz;
+    if (age_us != NULL) {
+        *age_us = s_driver.magAgeUs(esp_timer_get_time());
+    }
+    return ESP_OK;
+}
+
+float mpu9250_get_magnetometer_rate(void) {
+    return 1e6f / s_driver.magPeriodUs();
+}
+
+bool mpu9250_magnetometer_ready(void) {
+    if (!s_initialized) {
+        return false;
+    }
+    
+    if (s_driver.auxMaster()) {
+        // EXT_SENS_DATA_06 holds the copied ST2
+        uint8_t st2;
+        return s_bus.read(MPU9250_ADDR, mpu9250::reg::EXT_SENS_DATA_00 + 6, &st2, 1) &&
+               !(st2 & mpu9250::kAkSt2Overflow);
+    }
+    
+    uint8_t st1;
+    return s_bus.read(AK8963_ADDR, mpu9250::ak::ST1, &st1, 1) && (st1 & mpu9250::kAkSt1DataReady);
+}
+
+esp_err_t mpu9250_get_i2c_stats(uint8_t addr, mpu9250_i2c_stats_t *stats) {
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    const i2c::DeviceStats *d = s_i2c_stats.device(addr);
+    if (d == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    stats->transactions = d->transactions;
+    stats->bytes = d->bytes;
+    stats->nacks = d->nacks;
+    stats->timeouts = d->timeouts;
+    stats->errors = d->errors;
+    stats->latency_min_us = d->minUs;
+    stats->latency_max_us = d->maxUs;
+    stats->busy_us = (uint32_t)d->busyUs;
+    memcpy(stats->latency_hist, d->latency, sizeof(stats->latency_hist));
+    return ESP_OK;
+}
+
+void mpu9250_get_i2c_bus_stats(mpu9250_i2c_bus_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+    
+    const i2c::BusStats &bus = s_i2c_stats.bus();
+    stats->stuck = bus.stuck;
+    stats->recoveries = bus.recoveries;
+    stats->recovery_failures = bus.failedRecoveries;
+}
+
+void mpu9250_reset_i2c_stats(void) {
+    s_i2c_stats.reset();
+}
+
+void mpu9250_dump_i2c_stats(void (*print)(const char *line, void *ctx), void *ctx) {
+    if (print == NULL) {
+        return;
+    }
+    
+    s_i2c_stats.dump([print, ctx](const char *line) { print(line, ctx); });
+}
+
+esp_err_t mpu9250_i2c_recover(void) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    return bus_recover();
+}
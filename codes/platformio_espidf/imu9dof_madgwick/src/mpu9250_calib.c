@@ -0,0 +1,367 @@
+//=============================================================================================
+// mpu9250_calib.c
+//=============================================================================================
+//
+// Conversion kernel and calibration fits of mpu9250_calib.h. Portable C: no driver or
+// ESP-IDF calls, so the host build can check it against synthetic data.
+//
+// Magnetometer fit: the readings x of a distorted field lie on an ellipsoid
+// (x - c)' M (x - c) = 1. Writing it as the general quadric
+//
+//   A x² + B y² + C z² + 2D xy + 2E xz + 2F yz + 2G x + 2H y + 2I z = 1
+//
+// makes it linear in the nine coefficients, solved by least squares from normal
+// equations accumulated reading by reading. With Q = [A D E; D B F; E F C] and
+// g = [G H I], the centre is c = -Q⁻¹ g and M = Q / (1 + c' Q c). The soft-iron matrix
+// is W = R · M^½ (from the eigen decomposition of M), R being the geometric mean of the
+// radii: W (x - c) then lies on a sphere of radius R.
+//
+//=============================================================================================
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "mpu9250_calib.h"
+#include <math.h>
+#include <string.h>
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+// Sensitivities of the full-scale ranges, as in mpu9250_driver.hpp
+static const float accel_lsb_per_g[4] = { 16384.0f, 8192.0f, 4096.0f, 2048.0f };
+static const float gyro_lsb_per_dps[4] = { 131.0f, 65.5f, 32.8f, 16.4f };
+#define MAG_UT_PER_LSB  0.15f
+
+// The fit runs on counts / MAG_FIT_UNIT so that the x⁴ terms of the normal equations stay
+// close to the others (a power of two: the scaling is exact)
+#define MAG_FIT_UNIT    256.0
+
+#define MAG_FIT_MIN_READINGS    50
+#define MAG_FIT_MAX_AXIS_RATIO  3.0     // longest / shortest ellipsoid radius
+#define MAG_FIT_MIN_SPAN        1.0     // span of each axis, in fitted radii
+
+//-------------------------------------------------------------------------------------------
+// Calibration and kernel
+
+void mpu9250_calib_defaults(mpu9250_calib_t *calib) {
+    memset(calib, 0, sizeof(*calib));
+    calib->accel_range = MPU9250_ACCEL_RANGE_DEFAULT;
+    calib->gyro_range = MPU9250_GYRO_RANGE_DEFAULT;
+    calib->mag_soft_iron[0] = 1.0f;
+    calib->mag_soft_iron[4] = 1.0f;
+    calib->mag_soft_iron[8] = 1.0f;
+}
+
+esp_err_t mpu9250_calib_kernel_init(mpu9250_calib_kernel_t *kernel, const mpu9250_calib_t *calib,
+                                    uint8_t accel_range, uint8_t gyro_range) {
+    mpu9250_calib_t none;
+    if (calib == NULL) {
+        mpu9250_calib_defaults(&none);
+        calib = &none;
+    }
+    if (kernel == NULL || accel_range > 3 || gyro_range > 3 ||
+        calib->accel_range > 3 || calib->gyro_range > 3) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The only divisions: once here instead of once per axis and sample
+    kernel->accel_scale = 1.0f / accel_lsb_per_g[accel_range];
+    kernel->gyro_scale = 1.0f / gyro_lsb_per_dps[gyro_range];
+    float accel_rescale = accel_lsb_per_g[accel_range] / accel_lsb_per_g[calib->accel_range];
+    float gyro_rescale = gyro_lsb_per_dps[gyro_range] / gyro_lsb_per_dps[calib->gyro_range];
+    for (int i = 0; i < 3; i++) {
+        kernel->accel_offset[i] = -calib->accel_bias[i] * accel_rescale * kernel->accel_scale;
+        kernel->gyro_offset[i] = -calib->gyro_bias[i] * gyro_rescale * kernel->gyro_scale;
+        kernel->mag_bias[i] = calib->mag_bias[i];
+    }
+    for (int i = 0; i < 9; i++) {
+        kernel->mag_matrix[i] = calib->mag_soft_iron[i] * MAG_UT_PER_LSB;
+    }
+    return ESP_OK;
+}
+
+void mpu9250_calib_apply(const mpu9250_calib_kernel_t *kernel, const mpu9250_data_t *raw,
+                         mpu9250_calib_sample_t *out) {
+    const float as = kernel->accel_scale;
+    const float gs = kernel->gyro_scale;
+    out->ax = (float)raw->ax * as + kernel->accel_offset[0];
+    out->ay = (float)raw->ay * as + kernel->accel_offset[1];
+    out->az = (float)raw->az * as + kernel->accel_offset[2];
+    out->gx = (float)raw->gx * gs + kernel->gyro_offset[0];
+    out->gy = (float)raw->gy * gs + kernel->gyro_offset[1];
+    out->gz = (float)raw->gz * gs + kernel->gyro_offset[2];
+
+    if (raw->mx == 0 && raw->my == 0 && raw->mz == 0) {
+        out->mx = 0.0f;
+        out->my = 0.0f;
+        out->mz = 0.0f;
+        return;
+    }
+    const float *m = kernel->mag_matrix;
+    float x = (float)raw->mx - kernel->mag_bias[0];
+    float y = (float)raw->my - kernel->mag_bias[1];
+    float z = (float)raw->mz - kernel->mag_bias[2];
+    out->mx = m[0] * x + m[1] * y + m[2] * z;
+    out->my = m[3] * x + m[4] * y + m[5] * z;
+    out->mz = m[6] * x + m[7] * y + m[8] * z;
+}
+
+void mpu9250_calib_apply_block(const mpu9250_calib_kernel_t *kernel, const mpu9250_data_t *raw,
+                               size_t count, const mpu9250_calib_block_t *out) {
+    for (size_t i = 0; i < count; i++) {
+        mpu9250_calib_sample_t s;
+        mpu9250_calib_apply(kernel, &raw[i], &s);
+        out->ax[i] = s.ax;
+        out->ay[i] = s.ay;
+        out->az[i] = s.az;
+        out->gx[i] = s.gx;
+        out->gy[i] = s.gy;
+        out->gz[i] = s.gz;
+        out->mx[i] = s.mx;
+        out->my[i] = s.my;
+        out->mz[i] = s.mz;
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+// Gyroscope bias
+
+void mpu9250_calib_still_reset(mpu9250_calib_still_t *still) {
+    memset(still, 0, sizeof(*still));
+}
+
+void mpu9250_calib_still_add(mpu9250_calib_still_t *still, const mpu9250_data_t *raw) {
+    const int16_t g[3] = { raw->gx, raw->gy, raw->gz };
+    const int16_t a[3] = { raw->ax, raw->ay, raw->az };
+    for (int i = 0; i < 3; i++) {
+        still->gyro_sum[i] += g[i];
+        still->gyro_sq[i] += (double)g[i] * g[i];
+        still->accel_sum[i] += a[i];
+        still->accel_sq[i] += (double)a[i] * a[i];
+    }
+    still->count++;
+}
+
+// Sample standard deviation from a sum and a sum of squares
+static double spread(double sum, double sq, uint32_t n) {
+    double var = (sq - sum * sum / n) / (n - 1);
+    return var > 0.0 ? sqrt(var) : 0.0;
+}
+
+esp_err_t mpu9250_calib_still_gyro_bias(const mpu9250_calib_still_t *still, float max_std_counts,
+                                        mpu9250_calib_t *calib, uint8_t gyro_range) {
+    if (still->count < 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (gyro_range > 3) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (spread(still->gyro_sum[i], still->gyro_sq[i], still->count) > max_std_counts ||
+            spread(still->accel_sum[i], still->accel_sq[i], still->count) > max_std_counts) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        calib->gyro_bias[i] = (float)(still->gyro_sum[i] / still->count);
+    }
+    calib->gyro_range = gyro_range;
+    return ESP_OK;
+}
+
+//-------------------------------------------------------------------------------------------
+// Magnetometer fit
+
+void mpu9250_calib_mag_reset(mpu9250_calib_mag_fit_t *fit) {
+    memset(fit, 0, sizeof(*fit));
+    for (int i = 0; i < 3; i++) {
+        fit->min[i] = INT16_MAX;
+        fit->max[i] = INT16_MIN;
+    }
+}
+
+void mpu9250_calib_mag_add(mpu9250_calib_mag_fit_t *fit, int16_t mx, int16_t my, int16_t mz) {
+    const int16_t r[3] = { mx, my, mz };
+    for (int i = 0; i < 3; i++) {
+        if (r[i] < fit->min[i]) fit->min[i] = r[i];
+        if (r[i] > fit->max[i]) fit->max[i] = r[i];
+    }
+
+    double x = mx / MAG_FIT_UNIT, y = my / MAG_FIT_UNIT, z = mz / MAG_FIT_UNIT;
+    const double v[9] = { x * x, y * y, z * z, 2 * x * y, 2 * x * z, 2 * y * z, 2 * x, 2 * y, 2 * z };
+    for (int i = 0; i < 9; i++) {
+        for (int j = i; j < 9; j++) {
+            fit->ata[i][j] += v[i] * v[j];
+        }
+        fit->atb[i] += v[i];
+    }
+    fit->count++;
+}
+
+// Solve a x = b (n <= 9) by Gaussian elimination with partial pivoting; false if singular
+static bool solve(int n, double a[9][9], double b[9], double x[9]) {
+    double scale = 0.0;
+    for (int i = 0; i < n; i++) {
+        if (fabs(a[i][i]) > scale) scale = fabs(a[i][i]);
+    }
+    for (int col = 0; col < n; col++) {
+        int pivot = col;
+        for (int r = col + 1; r < n; r++) {
+            if (fabs(a[r][col]) > fabs(a[pivot][col])) pivot = r;
+        }
+        if (fabs(a[pivot][col]) <= 1e-12 * scale) {
+            return false;
+        }
+        if (pivot != col) {
+            for (int k = 0; k < n; k++) {
+                double t = a[col][k]; a[col][k] = a[pivot][k]; a[pivot][k] = t;
+            }
+            double t = b[col]; b[col] = b[pivot]; b[pivot] = t;
+        }
+        for (int r = col + 1; r < n; r++) {
+            double f = a[r][col] / a[col][col];
+            for (int k = col; k < n; k++) {
+                a[r][k] -= f * a[col][k];
+            }
+            b[r] -= f * b[col];
+        }
+    }
+    for (int r = n - 1; r >= 0; r--) {
+        double s = b[r];
+        for (int k = r + 1; k < n; k++) {
+            s -= a[r][k] * x[k];
+        }
+        x[r] = s / a[r][r];
+    }
+    return true;
+}
+
+// Eigen decomposition of a symmetric 3x3 matrix by cyclic Jacobi rotations: on return
+// the diagonal of a holds the eigenvalues and the columns of v the eigenvectors
+static void jacobi3(double a[3][3], double v[3][3]) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            v[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+    for (int sweep = 0; sweep < 50; sweep++) {
+        double off = fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+        if (off < 1e-15 * (fabs(a[0][0]) + fabs(a[1][1]) + fabs(a[2][2]))) {
+            return;
+        }
+        for (int p = 0; p < 2; p++) {
+            for (int q = p + 1; q < 3; q++) {
+                if (a[p][q] == 0.0) {
+                    continue;
+                }
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < 3; k++) {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++) {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++) {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+esp_err_t mpu9250_calib_mag_solve(const mpu9250_calib_mag_fit_t *fit, mpu9250_calib_t *calib) {
+    if (fit->count < MAG_FIT_MIN_READINGS) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Quadric coefficients A..I
+    double n[9][9], b[9], p[9];
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 9; j++) {
+            n[i][j] = (j >= i) ? fit->ata[i][j] : fit->ata[j][i];
+        }
+        b[i] = fit->atb[i];
+    }
+    if (!solve(9, n, b, p)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Centre c = -Q⁻¹ g
+    double q[9][9] = {
+        { p[0], p[3], p[4] },
+        { p[3], p[1], p[5] },
+        { p[4], p[5], p[2] },
+    };
+    double g[9] = { -p[6], -p[7], -p[8] };
+    double c[9];
+    if (!solve(3, q, g, c)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // M = Q / (1 + c' Q c)
+    const double qm[3][3] = {
+        { p[0], p[3], p[4] },
+        { p[3], p[1], p[5] },
+        { p[4], p[5], p[2] },
+    };
+    double k = 1.0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            k += c[i] * qm[i][j] * c[j];
+        }
+    }
+    double m[3][3], v[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            m[i][j] = qm[i][j] / k;
+        }
+    }
+    jacobi3(m, v);
+
+    // Radii 1/sqrt(eigenvalue); all positive for an ellipsoid
+    double radius[3], mean_radius = 1.0, rmin = INFINITY, rmax = 0.0;
+    for (int i = 0; i < 3; i++) {
+        if (!(m[i][i] > 0.0)) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        radius[i] = 1.0 / sqrt(m[i][i]);
+        mean_radius *= radius[i];
+        if (radius[i] < rmin) rmin = radius[i];
+        if (radius[i] > rmax) rmax = radius[i];
+    }
+    mean_radius = cbrt(mean_radius);
+    if (rmax > MAG_FIT_MAX_AXIS_RATIO * rmin) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Every axis must have been swept across a good part of the field sphere
+    for (int i = 0; i < 3; i++) {
+        double span = (fit->max[i] - fit->min[i]) / MAG_FIT_UNIT;
+        if (span < MAG_FIT_MIN_SPAN * mean_radius) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    // W = V diag(R / r) V'
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double w = 0.0;
+            for (int e = 0; e < 3; e++) {
+                w += v[i][e] * (mean_radius / radius[e]) * v[j][e];
+            }
+            calib->mag_soft_iron[3 * i + j] = (float)w;
+        }
+        calib->mag_bias[i] = (float)(c[i] * MAG_FIT_UNIT);
+    }
+    return ESP_OK;
+}
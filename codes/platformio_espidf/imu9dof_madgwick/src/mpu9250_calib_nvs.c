@@ -0,0 +1,157 @@
+//=============================================================================================
+// mpu9250_calib_nvs.c
+//=============================================================================================
+//
+// Onboard calibration captures (through the MPU9250 driver) and their NVS storage, see
+// mpu9250_calib.h. The fits themselves are in mpu9250_calib.c.
+//
+//=============================================================================================
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "mpu9250_calib.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+static const char *TAG = "MPU9250_CALIB";
+
+#define NVS_NAMESPACE   "mpu9250"
+#define NVS_KEY         "calib"
+#define CALIB_VERSION   1
+
+// Largest standard deviation of a stationary capture (counts): about 0.4 deg/s and 3 mg
+// at the default ranges, well above the sensor noise at the 20 Hz DLPF
+#define STILL_MAX_STD_COUNTS 50.0f
+
+// Stored blob: the layout version guards against reading a different mpu9250_calib_t
+typedef struct {
+    uint32_t version;
+    mpu9250_calib_t calib;
+} calib_blob_t;
+
+//-------------------------------------------------------------------------------------------
+// Captures
+
+// Time between two output samples, at least one tick
+static TickType_t sample_ticks(void) {
+    TickType_t ticks = pdMS_TO_TICKS((uint32_t)(1000.0f / mpu9250_get_sample_rate()));
+    return ticks > 0 ? ticks : 1;
+}
+
+esp_err_t mpu9250_calib_capture_gyro_bias(mpu9250_calib_t *calib, size_t samples,
+                                          uint8_t gyro_range) {
+    if (calib == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mpu9250_calib_still_t still;
+    mpu9250_calib_still_reset(&still);
+    TickType_t period = sample_ticks();
+    TickType_t last_wake = xTaskGetTickCount();
+    for (size_t i = 0; i < samples; i++) {
+        vTaskDelayUntil(&last_wake, period);
+        mpu9250_data_t raw;
+        esp_err_t ret = mpu9250_read_imu(&raw);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        mpu9250_calib_still_add(&still, &raw);
+    }
+
+    esp_err_t ret = mpu9250_calib_still_gyro_bias(&still, STILL_MAX_STD_COUNTS, calib, gyro_range);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Gyro bias: %.1f %.1f %.1f counts", calib->gyro_bias[0],
+                 calib->gyro_bias[1], calib->gyro_bias[2]);
+    }
+    return ret;
+}
+
+esp_err_t mpu9250_calib_capture_mag(mpu9250_calib_t *calib, uint32_t duration_ms) {
+    if (calib == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // About 2.4 kB: kept off the caller's stack
+    static mpu9250_calib_mag_fit_t fit;
+    mpu9250_calib_mag_reset(&fit);
+
+    int64_t end = esp_timer_get_time() + (int64_t)duration_ms * 1000;
+    while (esp_timer_get_time() < end) {
+        mpu9250_data_t raw;
+        if (mpu9250_magnetometer_due() && mpu9250_read_magnetometer(&raw) == ESP_OK) {
+            mpu9250_calib_mag_add(&fit, raw.mx, raw.my, raw.mz);
+        }
+        vTaskDelay(1);
+    }
+
+    esp_err_t ret = mpu9250_calib_mag_solve(&fit, calib);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Mag hard iron: %.1f %.1f %.1f counts (%lu readings)", calib->mag_bias[0],
+                 calib->mag_bias[1], calib->mag_bias[2], (unsigned long)fit.count);
+    }
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------
+// NVS storage
+
+esp_err_t mpu9250_calib_load(mpu9250_calib_t *calib) {
+    if (calib == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    calib_blob_t blob;
+    size_t len = sizeof(blob);
+    ret = nvs_get_blob(handle, NVS_KEY, &blob, &len);
+    nvs_close(handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND || ret == ESP_ERR_NVS_INVALID_LENGTH ||
+        (ret == ESP_OK && (len != sizeof(blob) || blob.version != CALIB_VERSION))) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    *calib = blob.calib;
+    return ESP_OK;
+}
+
+esp_err_t mpu9250_calib_save(const mpu9250_calib_t *calib) {
+    if (calib == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    calib_blob_t blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = CALIB_VERSION;
+    blob.calib = *calib;
+    ret = nvs_set_blob(handle, NVS_KEY, &blob, sizeof(blob));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
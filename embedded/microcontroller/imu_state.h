@@ -0,0 +1,73 @@
+//=============================================================================================
+// imu_state.h
+//=============================================================================================
+//
+// Attitude and the latest inertial sample, shared from the IMU task to the publishers
+// through a seqlock (seqlock.h): one writer that never waits, readers that fail only
+// while an update is being copied.
+//
+//=============================================================================================
+#ifndef IMU_STATE_H
+#define IMU_STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "seqlock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Body frame of the MPU9250, ROS units
+typedef struct {
+    float qw, qx, qy, qz;   // Madgwick attitude
+    float gx, gy, gz;       // angular velocity, rad/s
+    float ax, ay, az;       // linear acceleration, m/s^2 (with gravity)
+    uint8_t mag_valid;      // the last update used the magnetometer
+    int64_t stamp_us;       // time of the newest sample (esp_timer)
+} imu_state_t;
+
+#define IMU_STATE_WORDS SEQLOCK_WORDS(imu_state_t)
+
+// Shared snapshot; zero-initialized is a valid empty snapshot
+typedef struct {
+    uint32_t seq;                       // odd while an update is being written
+    uint32_t words[IMU_STATE_WORDS];
+} imu_state_snapshot_t;
+
+/**
+ * @brief Publish a new state (single writer)
+ *
+ * @param snap Shared snapshot
+ * @param state State to publish
+ */
+static inline void imu_state_publish(imu_state_snapshot_t *snap, const imu_state_t *state) {
+    uint32_t words[IMU_STATE_WORDS] = { 0 };
+    memcpy(words, state, sizeof(*state));
+    seqlock_publish(&snap->seq, snap->words, words, IMU_STATE_WORDS);
+}
+
+/**
+ * @brief Read the state once, without retrying
+ *
+ * @param snap Shared snapshot
+ * @param state Filled on success
+ * @param update Update number of the state read, 0 before the first one
+ * @return bool false if an update was in progress (state left as is)
+ */
+static inline bool imu_state_try_read(const imu_state_snapshot_t *snap, imu_state_t *state,
+                                      uint32_t *update) {
+    uint32_t words[IMU_STATE_WORDS];
+    if (!seqlock_try_read(&snap->seq, snap->words, words, IMU_STATE_WORDS, update)) {
+        return false;
+    }
+    memcpy(state, words, sizeof(*state));
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMU_STATE_H
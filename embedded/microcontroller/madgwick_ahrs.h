@@ -0,0 +1,343 @@
+//=============================================================================================
+// madgwick_ahrs.h
+//=============================================================================================
+//
+// Implementation of Madgwick IMU and AHRS algorithms for ESP-IDF.
+// Based on: http://www.x-io.co.uk/open-source-imu-and-ahrs-algorithms/
+//
+// From x-io website: "Open source resources available on this site are
+// provided under the GNU General Public License, unless an alternative
+// license is provided in the source code."
+//
+// Date			Author          Notes
+// 29/09/2011	SOH Madgwick    Initial release
+// 02/10/2011	SOH Madgwick	Optimized to reduce CPU load
+// 19/02/2012	SOH Madgwick	Magnetometer measurement is normalized
+// [Current date]	Adapted for ESP-IDF
+//
+//=============================================================================================
+#ifndef MADGWICK_AHRS_H
+#define MADGWICK_AHRS_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//--------------------------------------------------------------------------------------------
+// Build options
+
+// Set to 1 (e.g. build_flags = -DMADGWICK_AHRS_FIXED_POINT=1) to run the filter in
+// Q1.30 fixed point (madgwick_ahrs_fixed.c) instead of single precision float.
+// The API is the same; only the quaternion storage type changes.
+#ifndef MADGWICK_AHRS_FIXED_POINT
+#define MADGWICK_AHRS_FIXED_POINT 0
+#endif
+
+// Set to 1 to compute the Euler angles with polynomial atan2/asin instead of libm.
+// The angles then differ from the exact ones by at most 1e-5 rad (0.0006 deg).
+#ifndef MADGWICK_AHRS_FAST_ANGLES
+#define MADGWICK_AHRS_FAST_ANGLES 0
+#endif
+
+#if MADGWICK_AHRS_FIXED_POINT
+typedef int32_t madgwick_ahrs_quat_t;           // Q1.30
+#define MADGWICK_AHRS_QUAT_ONE  (1 << 30)
+#else
+typedef float madgwick_ahrs_quat_t;
+#define MADGWICK_AHRS_QUAT_ONE  1.0f
+#endif
+
+// Longest interval integrated in one step (s); longer gaps are integrated as this
+#define MADGWICK_AHRS_DT_MAX    0.25f
+
+//--------------------------------------------------------------------------------------------
+// Variable declarations
+
+// Sample timing statistics gathered by the timestamped updates
+typedef struct {
+    uint32_t samples;       // timestamped samples integrated
+    uint32_t dropped;       // samples estimated missing from gaps longer than 1.5 nominal periods
+    uint32_t rejected;      // samples with a timestamp not after the previous one
+    float dtMin;            // shortest interval (s)
+    float dtMax;            // longest interval (s)
+    float dtMean;           // mean interval (s)
+    float dtM2;             // running sum of squared deviations (Welford)
+} madgwick_ahrs_timing_t;
+
+typedef struct {
+    float beta;				// algorithm gain
+    madgwick_ahrs_quat_t q0;
+    madgwick_ahrs_quat_t q1;
+    madgwick_ahrs_quat_t q2;
+    madgwick_ahrs_quat_t q3;	// quaternion of sensor frame relative to auxiliary frame
+    float invSampleFreq;
+    float roll;
+    float pitch;
+    float yaw;
+    uint8_t anglesComputed;
+    uint8_t hasTimestamp;   // lastTimestamp holds a valid sample time
+    int64_t lastTimestamp;  // time of the previous timestamped sample (µs)
+    madgwick_ahrs_timing_t timing;
+} madgwick_ahrs_t;
+
+// Block of samples in structure-of-arrays layout for madgwick_ahrs_update_batch()
+typedef struct {
+    const float *gx, *gy, *gz;  // Gyroscope (degrees/sec)
+    const float *ax, *ay, *az;  // Accelerometer (g)
+    const float *mx, *my, *mz;  // Magnetometer (µT), all NULL for an IMU-only block
+    const float *dt;            // Per-sample interval (s), NULL to use the configured sample frequency
+} madgwick_ahrs_batch_t;
+
+//-------------------------------------------------------------------------------------------
+// Function declarations
+
+/**
+ * @brief Initialize Madgwick AHRS structure
+ * 
+ * @param filter Pointer to the filter structure
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_init(madgwick_ahrs_t *filter);
+
+/**
+ * @brief Configure sampling frequency
+ * 
+ * @param filter Pointer to the filter structure
+ * @param sampleFrequency Sampling frequency in Hz
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_begin(madgwick_ahrs_t *filter, float sampleFrequency);
+
+/**
+ * @brief Update filter with gyroscope, accelerometer and magnetometer data
+ * 
+ * @param filter Pointer to the filter structure
+ * @param gx Gyroscope angular velocity on X axis (degrees/sec)
+ * @param gy Gyroscope angular velocity on Y axis (degrees/sec)
+ * @param gz Gyroscope angular velocity on Z axis (degrees/sec)
+ * @param ax Acceleration on X axis (g)
+ * @param ay Acceleration on Y axis (g)
+ * @param az Acceleration on Z axis (g)
+ * @param mx Magnetic field on X axis (µT)
+ * @param my Magnetic field on Y axis (µT)
+ * @param mz Magnetic field on Z axis (µT)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_update(madgwick_ahrs_t *filter, 
+                               float gx, float gy, float gz, 
+                               float ax, float ay, float az, 
+                               float mx, float my, float mz);
+
+/**
+ * @brief Update filter with gyroscope and accelerometer data only (without magnetometer)
+ * 
+ * @param filter Pointer to the filter structure
+ * @param gx Gyroscope angular velocity on X axis (degrees/sec)
+ * @param gy Gyroscope angular velocity on Y axis (degrees/sec)
+ * @param gz Gyroscope angular velocity on Z axis (degrees/sec)
+ * @param ax Acceleration on X axis (g)
+ * @param ay Acceleration on Y axis (g)
+ * @param az Acceleration on Z axis (g)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_update_imu(madgwick_ahrs_t *filter, 
+                                   float gx, float gy, float gz, 
+                                   float ax, float ay, float az);
+
+/**
+ * @brief Run the filter over a block of samples in one call
+ * 
+ * Equivalent to calling madgwick_ahrs_update() (or madgwick_ahrs_update_imu() when
+ * the block has no magnetometer arrays) once per sample, but the quaternion stays
+ * in registers for the whole block. Samples whose magnetometer reading is all zero
+ * fall back to the IMU update, as in madgwick_ahrs_update().
+ * 
+ * @param filter Pointer to the filter structure
+ * @param batch Sample arrays, each holding at least count elements
+ * @param count Number of samples in the block
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_update_batch(madgwick_ahrs_t *filter,
+                                     const madgwick_ahrs_batch_t *batch,
+                                     size_t count);
+
+/**
+ * @brief Turn a sample timestamp into the interval to integrate over
+ * 
+ * The first timestamp after init (or after madgwick_ahrs_reset_timing()) yields the
+ * nominal period set by madgwick_ahrs_begin(). Longer gaps are counted as dropped
+ * samples and the interval is capped at 0.25 s so that a stalled task cannot make
+ * the quaternion jump. Use this to fill madgwick_ahrs_batch_t::dt.
+ * 
+ * @param filter Pointer to the filter structure
+ * @param timestampUs Sample time in microseconds (e.g. esp_timer_get_time())
+ * @param dt Interval in seconds
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if the timestamp does not advance
+ */
+esp_err_t madgwick_ahrs_timestamp_dt(madgwick_ahrs_t *filter, int64_t timestampUs, float *dt);
+
+/**
+ * @brief Update filter with timestamped gyroscope, accelerometer and magnetometer data
+ * 
+ * Same as madgwick_ahrs_update() but integrates over the real interval since the
+ * previous timestamped sample instead of the fixed sample period.
+ * 
+ * @param filter Pointer to the filter structure
+ * @param timestampUs Sample time in microseconds
+ * @param gx Gyroscope angular velocity on X axis (degrees/sec)
+ * @param gy Gyroscope angular velocity on Y axis (degrees/sec)
+ * @param gz Gyroscope angular velocity on Z axis (degrees/sec)
+ * @param ax Acceleration on X axis (g)
+ * @param ay Acceleration on Y axis (g)
+ * @param az Acceleration on Z axis (g)
+ * @param mx Magnetic field on X axis (µT)
+ * @param my Magnetic field on Y axis (µT)
+ * @param mz Magnetic field on Z axis (µT)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_update_timestamped(madgwick_ahrs_t *filter, int64_t timestampUs,
+                                           float gx, float gy, float gz,
+                                           float ax, float ay, float az,
+                                           float mx, float my, float mz);
+
+/**
+ * @brief Update filter with timestamped gyroscope and accelerometer data only
+ * 
+ * @param filter Pointer to the filter structure
+ * @param timestampUs Sample time in microseconds
+ * @param gx Gyroscope angular velocity on X axis (degrees/sec)
+ * @param gy Gyroscope angular velocity on Y axis (degrees/sec)
+ * @param gz Gyroscope angular velocity on Z axis (degrees/sec)
+ * @param ax Acceleration on X axis (g)
+ * @param ay Acceleration on Y axis (g)
+ * @param az Acceleration on Z axis (g)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_update_imu_timestamped(madgwick_ahrs_t *filter, int64_t timestampUs,
+                                               float gx, float gy, float gz,
+                                               float ax, float ay, float az);
+
+/**
+ * @brief Get sample timing statistics
+ * 
+ * @param filter Pointer to the filter structure
+ * @param timing Copy of the statistics
+ * @param jitter Standard deviation of the sample interval in seconds (may be NULL)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_get_timing(const madgwick_ahrs_t *filter, madgwick_ahrs_timing_t *timing,
+                                   float *jitter);
+
+/**
+ * @brief Clear the timing statistics and forget the previous timestamp
+ * 
+ * @param filter Pointer to the filter structure
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_reset_timing(madgwick_ahrs_t *filter);
+
+/**
+ * @brief Get the orientation quaternion as floats, whatever the build's number format
+ * 
+ * @param filter Pointer to the filter structure
+ * @param q0 Scalar component
+ * @param q1 X component
+ * @param q2 Y component
+ * @param q3 Z component
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_get_quaternion(const madgwick_ahrs_t *filter,
+                                       float *q0, float *q1, float *q2, float *q3);
+
+/**
+ * @brief Get roll, pitch and yaw in degrees with a single angle computation
+ * 
+ * Same values as madgwick_ahrs_get_roll(), madgwick_ahrs_get_pitch() and
+ * madgwick_ahrs_get_yaw(). Any output pointer may be NULL.
+ * 
+ * @param filter Pointer to the filter structure
+ * @param roll Roll angle in degrees
+ * @param pitch Pitch angle in degrees
+ * @param yaw Yaw angle in degrees (0 to 360)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_get_euler(madgwick_ahrs_t *filter, float *roll, float *pitch, float *yaw);
+
+/**
+ * @brief Get roll angle in degrees
+ * 
+ * @param filter Pointer to the filter structure
+ * @return float Roll angle in degrees
+ */
+float madgwick_ahrs_get_roll(madgwick_ahrs_t *filter);
+
+/**
+ * @brief Get pitch angle in degrees
+ * 
+ * @param filter Pointer to the filter structure
+ * @return float Pitch angle in degrees
+ */
+float madgwick_ahrs_get_pitch(madgwick_ahrs_t *filter);
+
+/**
+ * @brief Get yaw angle in degrees
+ * 
+ * @param filter Pointer to the filter structure
+ * @return float Yaw angle in degrees
+ */
+float madgwick_ahrs_get_yaw(madgwick_ahrs_t *filter);
+
+/**
+ * @brief Get roll angle in radians
+ * 
+ * @param filter Pointer to the filter structure
+ * @return float Roll angle in radians
+ */
+float madgwick_ahrs_get_roll_radians(madgwick_ahrs_t *filter);
+
+/**
+ * @brief Get pitch angle in radians
+ * 
+ * @param filter Pointer to the filter structure
+ * @return float Pitch angle in radians
+ */
+float madgwick_ahrs_get_pitch_radians(madgwick_ahrs_t *filter);
+
+/**
+ * @brief Get yaw angle in radians
+ * 
+ * @param filter Pointer to the filter structure
+ * @return float Yaw angle in radians
+ */
+float madgwick_ahrs_get_yaw_radians(madgwick_ahrs_t *filter);
+
+/**
+ * @brief Set algorithm beta gain
+ * 
+ * @param filter Pointer to the filter structure
+ * @param beta Beta gain value
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t madgwick_ahrs_set_beta(madgwick_ahrs_t *filter, float beta);
+
+/**
+ * @brief Get algorithm beta gain
+ * 
+ * @param filter Pointer to the filter structure
+ * @return float Beta gain value
+ */
+float madgwick_ahrs_get_beta(madgwick_ahrs_t *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MADGWICK_AHRS_H
+
+
@@ -0,0 +1,205 @@
+//=============================================================================================
+// micro_ros_arena.h
+//=============================================================================================
+//
+// Static memory for micro-ROS: an arena in a fixed buffer behind the rcutils allocator
+// interface (allocate, deallocate, reallocate, zero_allocate), so rcl, rclc and the
+// type supports never reach the heap.
+//
+// Blocks are carved from the buffer in order, each with a small size header. Freeing
+// the most recent block gives its space back (and any freed blocks under it), so
+// scratch allocations made and released in order do not grow the arena; other freed
+// blocks stay where they are until everything above them is freed. That fits micro-ROS,
+// which allocates its entities once at init and little or nothing afterwards.
+//
+// micro_ros_arena_lock() marks the end of the init: the arena keeps serving requests,
+// but counts them, so that allocations in the running loop show up in the report.
+//
+//=============================================================================================
+#ifndef MICRO_ROS_ARENA_H
+#define MICRO_ROS_ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Block alignment and size of the header in front of each block
+#define MICRO_ROS_ARENA_ALIGN 8u
+
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;                // end of the last block
+    size_t high_water;          // most ever used
+    uint32_t allocs;            // successful allocations (with reallocations that moved)
+    uint32_t failed;            // requests that did not fit
+    uint32_t allocs_locked;     // allocations and reallocations after the lock
+    bool locked;
+} micro_ros_arena_t;
+
+// Block header: payload size, and whether the block was freed out of order
+typedef struct {
+    uint32_t size;
+    uint32_t freed;
+} micro_ros_arena_block_t;
+
+/**
+ * @brief Set up an arena on a buffer
+ *
+ * @param arena Arena
+ * @param buffer Buffer, aligned to MICRO_ROS_ARENA_ALIGN
+ * @param size Buffer size
+ */
+static inline void micro_ros_arena_init(micro_ros_arena_t *arena, void *buffer, size_t size) {
+    memset(arena, 0, sizeof(*arena));
+    arena->base = (uint8_t *)buffer;
+    arena->size = size;
+}
+
+static inline micro_ros_arena_block_t *micro_ros_arena_header(void *ptr) {
+    return (micro_ros_arena_block_t *)((uint8_t *)ptr - sizeof(micro_ros_arena_block_t));
+}
+
+static inline size_t micro_ros_arena_round(size_t size) {
+    return (size + MICRO_ROS_ARENA_ALIGN - 1) & ~(size_t)(MICRO_ROS_ARENA_ALIGN - 1);
+}
+
+/**
+ * @brief Allocate a block
+ *
+ * @param arena Arena
+ * @param size Bytes
+ * @return void* Block aligned to MICRO_ROS_ARENA_ALIGN, NULL if it does not fit
+ */
+static inline void *micro_ros_arena_alloc(micro_ros_arena_t *arena, size_t size) {
+    size_t need = sizeof(micro_ros_arena_block_t) + micro_ros_arena_round(size);
+    if (size > UINT32_MAX || need > arena->size - arena->used) {
+        arena->failed++;
+        return NULL;
+    }
+    micro_ros_arena_block_t *block = (micro_ros_arena_block_t *)(arena->base + arena->used);
+    block->size = (uint32_t)size;
+    block->freed = 0;
+    arena->used += need;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
+    arena->allocs++;
+    if (arena->locked) {
+        arena->allocs_locked++;
+    }
+    return block + 1;
+}
+
+static inline bool micro_ros_arena_is_last(const micro_ros_arena_t *arena, void *ptr) {
+    micro_ros_arena_block_t *block = micro_ros_arena_header(ptr);
+    return (uint8_t *)ptr + micro_ros_arena_round(block->size) == arena->base + arena->used;
+}
+
+/**
+ * @brief Free a block (NULL is ignored)
+ *
+ * @param arena Arena
+ * @param ptr Block from this arena
+ */
+static inline void micro_ros_arena_free(micro_ros_arena_t *arena, void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    micro_ros_arena_block_t *block = micro_ros_arena_header(ptr);
+    if (!micro_ros_arena_is_last(arena, ptr)) {
+        block->freed = 1;
+        return;
+    }
+
+    // Give back this block and the freed blocks right under it. Walking down needs the
+    // block starts, so rescan from the base (a few dozen blocks, at free time only)
+    arena->used = (size_t)((uint8_t *)block - arena->base);
+    size_t keep = 0;
+    for (size_t pos = 0; pos < arena->used;) {
+        micro_ros_arena_block_t *b = (micro_ros_arena_block_t *)(arena->base + pos);
+        pos += sizeof(*b) + micro_ros_arena_round(b->size);
+        if (!b->freed) {
+            keep = pos;
+        }
+    }
+    arena->used = keep;
+}
+
+/**
+ * @brief Resize a block: in place when it is the last one, else moved
+ *
+ * @param arena Arena
+ * @param ptr Block from this arena, or NULL to allocate
+ * @param size New size
+ * @return void* Block with the old contents (up to the smaller size), NULL if it does
+ *         not fit (the old block is kept)
+ */
+static inline void *micro_ros_arena_realloc(micro_ros_arena_t *arena, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return micro_ros_arena_alloc(arena, size);
+    }
+    micro_ros_arena_block_t *block = micro_ros_arena_header(ptr);
+    if (micro_ros_arena_is_last(arena, ptr)) {
+        size_t start = (size_t)((uint8_t *)ptr - arena->base);
+        if (size <= UINT32_MAX && micro_ros_arena_round(size) <= arena->size - start) {
+            block->size = (uint32_t)size;
+            arena->used = start + micro_ros_arena_round(size);
+            if (arena->used > arena->high_water) {
+                arena->high_water = arena->used;
+            }
+            if (arena->locked) {
+                arena->allocs_locked++;
+            }
+            return ptr;
+        }
+        arena->failed++;
+        return NULL;
+    }
+    void *moved = micro_ros_arena_alloc(arena, size);
+    if (moved != NULL) {
+        memcpy(moved, ptr, block->size < size ? block->size : size);
+        micro_ros_arena_free(arena, ptr);
+    }
+    return moved;
+}
+
+/**
+ * @brief Allocate a zeroed array
+ *
+ * @param arena Arena
+ * @param count Elements
+ * @param size Element size
+ * @return void* Zeroed block, NULL if it does not fit
+ */
+static inline void *micro_ros_arena_calloc(micro_ros_arena_t *arena, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        arena->failed++;
+        return NULL;
+    }
+    void *ptr = micro_ros_arena_alloc(arena, count * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+/**
+ * @brief Mark the end of the init: later allocations are counted in allocs_locked
+ *
+ * @param arena Arena
+ */
+static inline void micro_ros_arena_lock(micro_ros_arena_t *arena) {
+    arena->locked = true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MICRO_ROS_ARENA_H
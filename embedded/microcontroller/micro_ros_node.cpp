@@ -0,0 +1,501 @@
+//=============================================================================================
+// micro_ros_node.cpp
+//=============================================================================================
+//
+// micro-ROS publishers of the IMU and the odometry, see micro_ros_node.h.
+//
+//=============================================================================================
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "micro_ros_node.h"
+
+// Arduino builds every file of the sketch: without the library this file is left out
+#if __has_include(<micro_ros_arduino.h>)
+
+#include <math.h>
+#include <string.h>
+#include <micro_ros_arduino.h>
+#include <rcl/rcl.h>
+#include <rclc/rclc.h>
+#include <rclc/executor.h>
+#include <rcutils/allocator.h>
+#include <rmw_microros/rmw_microros.h>
+#include <sensor_msgs/msg/imu.h>
+#include <nav_msgs/msg/odometry.h>
+#include <geometry_msgs/msg/twist.h>
+#include <std_msgs/msg/u_int32_multi_array.h>
+#include <Arduino.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "micro_ros_arena.h"
+#include "micro_ros_batch.h"
+#include "time_sync.h"
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+#define AGENT_TIMEOUT_MS    100
+#define TIME_SYNC_TIMEOUT_MS 100
+
+// Static memory of rcl/rmw; the memory report gives the high-water mark to size it by
+#ifndef MICRO_ROS_NODE_ARENA_SIZE
+#define MICRO_ROS_NODE_ARENA_SIZE 16384
+#endif
+
+// Coalescing buffer: the messages of a publish cycle (Imu ~340 B, Odometry ~750 B).
+// The driver's TX ring buffer holds two batches, the RX one a few agent replies
+#ifndef MICRO_ROS_NODE_BATCH_SIZE
+#define MICRO_ROS_NODE_BATCH_SIZE 2048
+#endif
+#define SERIAL_TX_RING      (2 * MICRO_ROS_NODE_BATCH_SIZE)
+#define SERIAL_RX_RING      1024
+
+// Executor handles: the report timer and the cmd_vel subscription
+#define EXECUTOR_HANDLES    2
+#define MEMORY_WORDS        (sizeof(micro_ros_node_memory_t) / sizeof(uint32_t))
+#define LINK_WORDS          (sizeof(micro_ros_node_link_t) / sizeof(uint32_t))
+#define CLOCK_WORDS         (sizeof(micro_ros_node_clock_t) / sizeof(uint32_t))
+#define I2C_WORDS           (sizeof(micro_ros_node_i2c_t) / sizeof(uint32_t))
+
+// Measurement variances (REP 145: 2D, so z, roll and pitch motion are not measured)
+#define UNMEASURED_VAR      1e6
+#define GYRO_VAR            3.0e-6      // MPU9250 0.1 deg/s RMS noise, (rad/s)^2
+#define ACCEL_VAR           6.2e-3      // 8 mg RMS at 1 kHz, (m/s^2)^2
+#define TILT_VAR            3.0e-4      // Madgwick roll/pitch, 1 deg, rad^2
+#define YAW_VAR_MAG         7.6e-3      // with the magnetometer, 5 deg
+#define YAW_VAR_NO_MAG      0.3         // gyro only: drifts
+#define ODOM_XY_VAR         1e-3        // m^2
+#define ODOM_YAW_VAR        1e-2        // rad^2
+#define ODOM_V_VAR          1e-4        // 0.01 m/s, (m/s)^2 (also lateral: no side slip)
+#define ODOM_OMEGA_VAR      2.5e-3      // 0.05 rad/s, (rad/s)^2
+
+#define RC_TRY(fn) do { if ((fn) != RCL_RET_OK) return ESP_FAIL; } while (0)
+
+static uint32_t s_baud = 115200;
+static uint8_t s_arena_buffer[MICRO_ROS_NODE_ARENA_SIZE] __attribute__((aligned(MICRO_ROS_ARENA_ALIGN)));
+static micro_ros_arena_t s_arena;
+static uint32_t s_heap_free_after_init = 0;
+static rcl_allocator_t s_allocator;
+static rclc_support_t s_support;
+static rcl_node_t s_node;
+static rcl_publisher_t s_imu_pub;
+static rcl_publisher_t s_odom_pub;
+static rcl_publisher_t s_memory_pub;
+static rcl_publisher_t s_link_pub;
+static rcl_publisher_t s_clock_pub;
+static rcl_publisher_t s_i2c_pub;
+static micro_ros_node_i2c_report_t s_get_i2c = NULL;
+static rcl_timer_t s_report_timer;
+static rcl_subscription_t s_cmd_vel_sub;
+static micro_ros_node_cmd_vel_t s_on_cmd_vel = NULL;
+static rclc_executor_t s_executor;
+
+// Preallocated messages
+static sensor_msgs__msg__Imu s_imu_msg;
+static nav_msgs__msg__Odometry s_odom_msg;
+static std_msgs__msg__UInt32MultiArray s_memory_msg;
+static uint32_t s_memory_data[MEMORY_WORDS];
+static std_msgs__msg__UInt32MultiArray s_link_msg;
+static uint32_t s_link_data[LINK_WORDS];
+static std_msgs__msg__UInt32MultiArray s_clock_msg;
+static uint32_t s_clock_data[CLOCK_WORDS];
+static std_msgs__msg__UInt32MultiArray s_i2c_msg;
+static uint32_t s_i2c_data[I2C_WORDS];
+static geometry_msgs__msg__Twist s_cmd_vel_msg;     // no strings or arrays: nothing to allocate
+
+// Link
+static uint8_t s_batch_buffer[MICRO_ROS_NODE_BATCH_SIZE];
+static micro_ros_batch_t s_batch;
+static bool s_batch_drop = false;       // drop a batch when the TX buffer is full
+static uint32_t s_rx_bytes = 0;
+static uint32_t s_tx_rate = 0;          // bytes/s over the last report period
+static uint32_t s_tx_rate_bytes = 0;
+static int64_t s_tx_rate_us = 0;
+
+// esp_timer to host time; kept over a re-init, the clock did not change
+static time_sync_t s_clock;
+static int64_t s_last_sync_us = 0;
+
+//-------------------------------------------------------------------------------------------
+// Serial transport
+
+// Link write of the batch. Once the node runs, a batch that does not fit in the TX ring
+// buffer is refused rather than waited for: the publishing task never blocks on the
+// link. Until then the entity creation is reliable and may wait
+static size_t link_write(void *ctx, const uint8_t *buf, size_t len) {
+    if (s_batch_drop && (size_t)Serial.availableForWrite() < len) {
+        return 0;
+    }
+    return Serial.write(buf, len);
+}
+
+// The ring buffer sizes only take effect on a stopped port
+static bool serial_open(struct uxrCustomTransport *transport) {
+    Serial.end();
+    Serial.setTxBufferSize(SERIAL_TX_RING);
+    Serial.setRxBufferSize(SERIAL_RX_RING);
+    Serial.begin(s_baud);
+    return true;
+}
+
+static bool serial_close(struct uxrCustomTransport *transport) {
+    micro_ros_batch_flush(&s_batch);
+    Serial.end();
+    return true;
+}
+
+static size_t serial_write(struct uxrCustomTransport *transport, const uint8_t *buf, size_t len,
+                           uint8_t *err) {
+    return micro_ros_batch_push(&s_batch, buf, len);
+}
+
+// The client reads when it waits for an answer or spins: what it wrote goes out first
+static size_t serial_read(struct uxrCustomTransport *transport, uint8_t *buf, size_t len,
+                          int timeout, uint8_t *err) {
+    micro_ros_batch_flush(&s_batch);
+    Serial.setTimeout(timeout);
+    size_t n = Serial.readBytes((char *)buf, len);
+    s_rx_bytes += (uint32_t)n;
+    return n;
+}
+
+//-------------------------------------------------------------------------------------------
+// Arena allocator (rcutils interface)
+
+static void *arena_allocate(size_t size, void *state) {
+    return micro_ros_arena_alloc((micro_ros_arena_t *)state, size);
+}
+
+static void arena_deallocate(void *pointer, void *state) {
+    micro_ros_arena_free((micro_ros_arena_t *)state, pointer);
+}
+
+static void *arena_reallocate(void *pointer, size_t size, void *state) {
+    return micro_ros_arena_realloc((micro_ros_arena_t *)state, pointer, size);
+}
+
+static void *arena_zero_allocate(size_t count, size_t size, void *state) {
+    return micro_ros_arena_calloc((micro_ros_arena_t *)state, count, size);
+}
+
+// Default allocator of rcl and the type supports, before anything is created
+static bool install_arena(void) {
+    micro_ros_arena_init(&s_arena, s_arena_buffer, sizeof(s_arena_buffer));
+    rcutils_allocator_t allocator = rcutils_get_zero_initialized_allocator();
+    allocator.allocate = arena_allocate;
+    allocator.deallocate = arena_deallocate;
+    allocator.reallocate = arena_reallocate;
+    allocator.zero_allocate = arena_zero_allocate;
+    allocator.state = &s_arena;
+    return rcutils_set_default_allocator(&allocator);
+}
+
+//-------------------------------------------------------------------------------------------
+// Message helpers
+
+// Points a message string at a constant: nothing is allocated, nothing to free
+static void set_string(rosidl_runtime_c__String *str, const char *text) {
+    str->data = (char *)text;
+    str->size = strlen(text);
+    str->capacity = str->size + 1;
+}
+
+static void set_stamp(builtin_interfaces__msg__Time *stamp, int64_t stamp_us) {
+    int64_t ns = time_sync_to_host_ns(&s_clock, stamp_us);
+    stamp->sec = (int32_t)(ns / 1000000000);
+    stamp->nanosec = (uint32_t)(ns % 1000000000);
+}
+
+// Diagonal 3x3 covariance
+static void set_diagonal3(double *cov, double a, double b, double c) {
+    memset(cov, 0, 9 * sizeof(double));
+    cov[0] = a;
+    cov[4] = b;
+    cov[8] = c;
+}
+
+// Diagonal 6x6 covariance (x, y, z, roll, pitch, yaw)
+static void set_diagonal6(double *cov, const double diag[6]) {
+    memset(cov, 0, 36 * sizeof(double));
+    for (int i = 0; i < 6; i++) {
+        cov[i * 7] = diag[i];
+    }
+}
+
+static void set_report(std_msgs__msg__UInt32MultiArray *msg, uint32_t *data, size_t words) {
+    memset(msg, 0, sizeof(*msg));
+    msg->data.data = data;
+    msg->data.size = words;
+    msg->data.capacity = words;
+}
+
+static void report_timer_callback(rcl_timer_t *timer, int64_t last_call_time) {
+    if (timer == NULL) {
+        return;
+    }
+    micro_ros_node_memory_t memory;
+    micro_ros_node_get_memory(&memory);
+    memcpy(s_memory_data, &memory, sizeof(s_memory_data));
+    rcl_publish(&s_memory_pub, &s_memory_msg, NULL);
+
+    int64_t now_us = esp_timer_get_time();
+    if (now_us > s_tx_rate_us) {
+        s_tx_rate = (uint32_t)((uint64_t)(s_batch.stats.bytes - s_tx_rate_bytes) * 1000000 /
+                               (uint64_t)(now_us - s_tx_rate_us));
+    }
+    s_tx_rate_bytes = s_batch.stats.bytes;
+    s_tx_rate_us = now_us;
+    micro_ros_node_link_t link;
+    micro_ros_node_get_link(&link);
+    memcpy(s_link_data, &link, sizeof(s_link_data));
+    rcl_publish(&s_link_pub, &s_link_msg, NULL);
+
+    micro_ros_node_clock_t clock;
+    micro_ros_node_get_clock(&clock);
+    memcpy(s_clock_data, &clock, sizeof(s_clock_data));
+    rcl_publish(&s_clock_pub, &s_clock_msg, NULL);
+
+    if (s_get_i2c != NULL) {
+        micro_ros_node_i2c_t i2c;
+        memset(&i2c, 0, sizeof(i2c));
+        s_get_i2c(&i2c);
+        memcpy(s_i2c_data, &i2c, sizeof(s_i2c_data));
+        rcl_publish(&s_i2c_pub, &s_i2c_msg, NULL);
+    }
+}
+
+// A planar base: only the forward and yaw components apply
+static void cmd_vel_callback(const void *msgin) {
+    const geometry_msgs__msg__Twist *msg = (const geometry_msgs__msg__Twist *)msgin;
+    if (s_on_cmd_vel != NULL) {
+        s_on_cmd_vel((float)msg->linear.x, (float)msg->angular.z);
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+// Entities
+
+// Node, publishers, report timer, executor and cmd_vel subscription. Stops at the first
+// error; what was created by then is left for destroy_entities()
+static esp_err_t create_entities(const micro_ros_node_config_t *config) {
+    memset(&s_support, 0, sizeof(s_support));
+    s_node = rcl_get_zero_initialized_node();
+    s_imu_pub = rcl_get_zero_initialized_publisher();
+    s_odom_pub = rcl_get_zero_initialized_publisher();
+    s_memory_pub = rcl_get_zero_initialized_publisher();
+    s_link_pub = rcl_get_zero_initialized_publisher();
+    s_clock_pub = rcl_get_zero_initialized_publisher();
+    s_i2c_pub = rcl_get_zero_initialized_publisher();
+    s_report_timer = rcl_get_zero_initialized_timer();
+    s_cmd_vel_sub = rcl_get_zero_initialized_subscription();
+    s_executor = rclc_executor_get_zero_initialized_executor();
+
+    RC_TRY(rclc_support_init(&s_support, 0, NULL, &s_allocator));
+    RC_TRY(rclc_node_init_default(&s_node, config->node_name, "", &s_support));
+    RC_TRY(rclc_publisher_init_best_effort(&s_imu_pub, &s_node,
+                                           ROSIDL_GET_MSG_TYPE_SUPPORT(sensor_msgs, msg, Imu),
+                                           config->imu_topic));
+    RC_TRY(rclc_publisher_init_best_effort(&s_odom_pub, &s_node,
+                                           ROSIDL_GET_MSG_TYPE_SUPPORT(nav_msgs, msg, Odometry),
+                                           config->odom_topic));
+    RC_TRY(rclc_publisher_init_best_effort(&s_memory_pub, &s_node,
+                                           ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt32MultiArray),
+                                           config->memory_topic));
+    RC_TRY(rclc_publisher_init_best_effort(&s_link_pub, &s_node,
+                                           ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt32MultiArray),
+                                           config->link_topic));
+    RC_TRY(rclc_publisher_init_best_effort(&s_clock_pub, &s_node,
+                                           ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt32MultiArray),
+                                           config->clock_topic));
+    s_get_i2c = config->get_i2c;
+    if (s_get_i2c != NULL) {
+        RC_TRY(rclc_publisher_init_best_effort(&s_i2c_pub, &s_node,
+                                               ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt32MultiArray),
+                                               config->i2c_topic));
+    }
+    RC_TRY(rclc_timer_init_default(&s_report_timer, &s_support,
+                                   RCL_MS_TO_NS(config->report_period_ms), report_timer_callback));
+    RC_TRY(rclc_executor_init(&s_executor, &s_support.context, EXECUTOR_HANDLES, &s_allocator));
+    RC_TRY(rclc_executor_add_timer(&s_executor, &s_report_timer));
+    s_on_cmd_vel = config->on_cmd_vel;
+    if (s_on_cmd_vel != NULL) {
+        RC_TRY(rclc_subscription_init_best_effort(&s_cmd_vel_sub, &s_node,
+                                                  ROSIDL_GET_MSG_TYPE_SUPPORT(geometry_msgs, msg, Twist),
+                                                  config->cmd_vel_topic));
+        memset(&s_cmd_vel_msg, 0, sizeof(s_cmd_vel_msg));
+        RC_TRY(rclc_executor_add_subscription(&s_executor, &s_cmd_vel_sub, &s_cmd_vel_msg,
+                                              cmd_vel_callback, ON_NEW_DATA));
+    }
+    return ESP_OK;
+}
+
+// Finalize in the reverse order of creation; the fini calls skip what is still zero
+// initialized. Their memory goes back to the arena before install_arena() resets it, and
+// the session is not waited on: the agent may be the reason the creation failed
+static void destroy_entities(void) {
+    rmw_context_t *rmw_context = rcl_context_get_rmw_context(&s_support.context);
+    if (rmw_context != NULL) {
+        rmw_uros_set_context_entity_destroy_session_timeout(rmw_context, 0);
+    }
+    rcl_subscription_fini(&s_cmd_vel_sub, &s_node);
+    rclc_executor_fini(&s_executor);
+    rcl_timer_fini(&s_report_timer);
+    rcl_publisher_fini(&s_i2c_pub, &s_node);
+    rcl_publisher_fini(&s_clock_pub, &s_node);
+    rcl_publisher_fini(&s_link_pub, &s_node);
+    rcl_publisher_fini(&s_memory_pub, &s_node);
+    rcl_publisher_fini(&s_odom_pub, &s_node);
+    rcl_publisher_fini(&s_imu_pub, &s_node);
+    rcl_node_fini(&s_node);
+    if (s_support.init_options.impl != NULL) {
+        rclc_support_fini(&s_support);
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+// API
+
+void micro_ros_node_set_serial_transport(uint32_t baud) {
+    s_baud = baud;
+    micro_ros_batch_init(&s_batch, s_batch_buffer, sizeof(s_batch_buffer), link_write, NULL);
+    rmw_uros_set_custom_transport(true, NULL, serial_open, serial_close, serial_write,
+                                  serial_read);
+}
+
+esp_err_t micro_ros_node_init(const micro_ros_node_config_t *config) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_batch_drop = false;
+    if (rmw_uros_ping_agent(AGENT_TIMEOUT_MS, 1) != RMW_RET_OK) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Each attempt starts the arena over, once the entities of a failed one are finalized
+    if (!install_arena()) {
+        return ESP_FAIL;
+    }
+    s_allocator = rcl_get_default_allocator();
+    if (create_entities(config) != ESP_OK) {
+        destroy_entities();
+        return ESP_FAIL;
+    }
+
+    // Constant parts of the messages, set once
+    memset(&s_imu_msg, 0, sizeof(s_imu_msg));
+    set_string(&s_imu_msg.header.frame_id, config->imu_frame);
+    set_diagonal3(s_imu_msg.angular_velocity_covariance, GYRO_VAR, GYRO_VAR, GYRO_VAR);
+    set_diagonal3(s_imu_msg.linear_acceleration_covariance, ACCEL_VAR, ACCEL_VAR, ACCEL_VAR);
+
+    memset(&s_odom_msg, 0, sizeof(s_odom_msg));
+    set_string(&s_odom_msg.header.frame_id, config->odom_frame);
+    set_string(&s_odom_msg.child_frame_id, config->base_frame);
+    const double pose_var[6] = { ODOM_XY_VAR, ODOM_XY_VAR, UNMEASURED_VAR,
+                                 UNMEASURED_VAR, UNMEASURED_VAR, ODOM_YAW_VAR };
+    const double twist_var[6] = { ODOM_V_VAR, ODOM_V_VAR, UNMEASURED_VAR,
+                                  UNMEASURED_VAR, UNMEASURED_VAR, ODOM_OMEGA_VAR };
+    set_diagonal6(s_odom_msg.pose.covariance, pose_var);
+    set_diagonal6(s_odom_msg.twist.covariance, twist_var);
+
+    set_report(&s_memory_msg, s_memory_data, MEMORY_WORDS);
+    set_report(&s_link_msg, s_link_data, LINK_WORDS);
+    set_report(&s_clock_msg, s_clock_data, CLOCK_WORDS);
+    set_report(&s_i2c_msg, s_i2c_data, I2C_WORDS);
+
+    // Without an answer the stamps stay in boot time until the next sync
+    micro_ros_node_sync_time();
+
+    // From here on, allocations are counted in the memory report
+    micro_ros_arena_lock(&s_arena);
+    s_heap_free_after_init = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    s_batch_drop = true;
+    s_tx_rate_bytes = s_batch.stats.bytes;
+    s_tx_rate_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+void micro_ros_node_flush(void) {
+    micro_ros_batch_flush(&s_batch);
+}
+
+esp_err_t micro_ros_node_spin(uint32_t budget_us) {
+    rcl_ret_t ret = rclc_executor_spin_some(&s_executor, (uint64_t)budget_us * 1000);
+    return ret == RCL_RET_OK || ret == RCL_RET_TIMEOUT ? ESP_OK : ESP_FAIL;
+}
+
+void micro_ros_node_get_memory(micro_ros_node_memory_t *memory) {
+    memory->arena_size = (uint32_t)s_arena.size;
+    memory->arena_high_water = (uint32_t)s_arena.high_water;
+    memory->arena_allocs_after_init = s_arena.allocs_locked;
+    memory->heap_free_after_init = s_heap_free_after_init;
+    memory->heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    memory->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+}
+
+void micro_ros_node_get_link(micro_ros_node_link_t *link) {
+    link->tx_bytes_per_s = s_tx_rate;
+    link->tx_bytes = s_batch.stats.bytes;
+    link->tx_writes = s_batch.stats.writes;
+    link->tx_flushes = s_batch.stats.flushes;
+    link->tx_max_flush = s_batch.stats.max_flush;
+    link->dropped_writes = s_batch.stats.dropped_writes;
+    link->dropped_bytes = s_batch.stats.dropped_bytes;
+    link->rx_bytes = s_rx_bytes;
+}
+
+void micro_ros_node_get_clock(micro_ros_node_clock_t *clock) {
+    clock->syncs_used = s_clock.accepted;
+    clock->syncs_rejected = s_clock.rejected;
+    clock->best_rtt_us = s_clock.min_rtt_us;
+    clock->error_bound_us = time_sync_error_bound_us(&s_clock);
+    clock->skew_ppb = (int32_t)(s_clock.skew * 1e9);
+    clock->since_sync_ms = s_clock.valid ? (uint32_t)((esp_timer_get_time() - s_last_sync_us) / 1000)
+                                         : UINT32_MAX;
+}
+
+esp_err_t micro_ros_node_sync_time(void) {
+    // The session sync is an NTP-style exchange; its round trip bounds the offset error
+    int64_t start_us = esp_timer_get_time();
+    if (rmw_uros_sync_session(TIME_SYNC_TIMEOUT_MS) != RMW_RET_OK) {
+        return ESP_ERR_TIMEOUT;
+    }
+    int64_t local_us = esp_timer_get_time();
+    int64_t host_ns = rmw_uros_epoch_nanos();
+    if (!time_sync_add(&s_clock, local_us, host_ns, (uint32_t)(local_us - start_us))) {
+        return ESP_ERR_TIMEOUT;
+    }
+    s_last_sync_us = local_us;
+    return ESP_OK;
+}
+
+esp_err_t micro_ros_node_publish_imu(const imu_state_t *state) {
+    set_stamp(&s_imu_msg.header.stamp, state->stamp_us);
+    s_imu_msg.orientation.w = state->qw;
+    s_imu_msg.orientation.x = state->qx;
+    s_imu_msg.orientation.y = state->qy;
+    s_imu_msg.orientation.z = state->qz;
+    set_diagonal3(s_imu_msg.orientation_covariance, TILT_VAR, TILT_VAR,
+                  state->mag_valid ? YAW_VAR_MAG : YAW_VAR_NO_MAG);
+    s_imu_msg.angular_velocity.x = state->gx;
+    s_imu_msg.angular_velocity.y = state->gy;
+    s_imu_msg.angular_velocity.z = state->gz;
+    s_imu_msg.linear_acceleration.x = state->ax;
+    s_imu_msg.linear_acceleration.y = state->ay;
+    s_imu_msg.linear_acceleration.z = state->az;
+    return rcl_publish(&s_imu_pub, &s_imu_msg, NULL) == RCL_RET_OK ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t micro_ros_node_publish_odom(const odom_pose_t *pose) {
+    set_stamp(&s_odom_msg.header.stamp, pose->stamp_us);
+    s_odom_msg.pose.pose.position.x = pose->x;
+    s_odom_msg.pose.pose.position.y = pose->y;
+    s_odom_msg.pose.pose.orientation.z = sinf(0.5f * pose->theta);
+    s_odom_msg.pose.pose.orientation.w = cosf(0.5f * pose->theta);
+    s_odom_msg.twist.twist.linear.x = pose->v;
+    s_odom_msg.twist.twist.angular.z = pose->omega;
+    return rcl_publish(&s_odom_pub, &s_odom_msg, NULL) == RCL_RET_OK ? ESP_OK : ESP_FAIL;
+}
+
+#endif // __has_include(<micro_ros_arduino.h>)
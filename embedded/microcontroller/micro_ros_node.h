@@ -0,0 +1,249 @@
+//=============================================================================================
+// micro_ros_node.h
+//=============================================================================================
+//
+// micro-ROS node of the robot: sensor_msgs/Imu on "imu" and nav_msgs/Odometry on
+// "odom", the topics the EKF (rover_vacuum_cleaner/config/ekf.yaml) reads from the
+// simulator, in the same frames.
+//
+// The publishers are best-effort: a late message is dropped by the transport rather
+// than resent behind newer ones. Messages are stamped with the time of the data
+// (esp_timer, taken when the sample was made) mapped to host time. The mapping
+// (time_sync.h) fits the offset and the drift of the local clock over the last time
+// syncs with the agent, and leaves out the syncs with a late reply; the node reports
+// its state (micro_ros_node_clock_t) with the memory report.
+//
+// The default serial transport of micro_ros_arduino runs at 115200 baud, where one
+// Odometry message (~750 bytes with its covariances) takes 65 ms on the wire;
+// micro_ros_node_set_serial_transport() runs the same link at a higher rate, or over
+// the native USB of an ESP32-S3 (where Serial is the USB CDC port and the rate does
+// not matter). Its writes are coalesced (micro_ros_batch.h): the messages of a publish
+// cycle reach the driver's TX ring buffer in one copy, and the UART interrupt feeds the
+// FIFO from there. The node reports the link counters (micro_ros_node_link_t) on a
+// timer with the memory report.
+//
+// With an I2C callback in the configuration, the node also reports the I2C telemetry of
+// the IMU bus (i2c_telemetry.hpp) on "mcu/i2c": per device the counters, the latency and
+// its histogram, then the bus recoveries. Serial belongs to the agent, so this is the
+// way to read them in the micro-ROS build.
+//
+// With a velocity callback in the configuration, the node also subscribes to
+// geometry_msgs/Twist on "cmd_vel" (best-effort, compatible with reliable publishers),
+// the topic the simulator bridges to its diff drive; the callback runs from the executor.
+//
+// Memory is static: rcl, rclc and the type supports allocate from a fixed arena
+// (micro_ros_arena.h) installed as the rcutils default allocator, and the messages are
+// preallocated with their strings and arrays pointing at constants. The node publishes
+// its memory use (micro_ros_node_memory_t, as std_msgs/UInt32MultiArray), which shows
+// that nothing is allocated once the init is done.
+//
+// Not thread-safe: init and all the calls from one task, which also runs the executor
+// with micro_ros_node_spin(). Needs the micro_ros_arduino library.
+//
+//=============================================================================================
+#ifndef MICRO_ROS_NODE_H
+#define MICRO_ROS_NODE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "imu_state.h"
+#include "odom_pose.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Velocity command from cmd_vel, called from micro_ros_node_spin()
+ *
+ * @param v Linear velocity along x (m/s)
+ * @param omega Angular velocity about z (rad/s)
+ */
+typedef void (*micro_ros_node_cmd_vel_t)(float v, float omega);
+
+#define MICRO_ROS_NODE_I2C_DEVICES  2   // MPU9250 and AK8963
+#define MICRO_ROS_NODE_I2C_BUCKETS  16  // latency histogram of i2c_telemetry.hpp
+
+// I2C report of one device
+typedef struct {
+    uint32_t addr;                      // 7-bit address, 0: no device in this slot
+    uint32_t transactions;
+    uint32_t nacks;
+    uint32_t timeouts;
+    uint32_t errors;
+    uint32_t latency_min_us;
+    uint32_t latency_mean_us;
+    uint32_t latency_max_us;
+    uint32_t latency[MICRO_ROS_NODE_I2C_BUCKETS];   // bucket b: [2^b, 2^(b+1)) µs
+} micro_ros_node_i2c_device_t;
+
+// I2C report, in this order in the UInt32MultiArray (counters wrap around)
+typedef struct {
+    micro_ros_node_i2c_device_t devices[MICRO_ROS_NODE_I2C_DEVICES];
+    uint32_t stuck;                     // stuck-bus detections
+    uint32_t recoveries;                // successful recoveries
+    uint32_t failed_recoveries;
+} micro_ros_node_i2c_t;
+
+/**
+ * @brief Fill the I2C report, called from micro_ros_node_spin() with the other reports
+ *
+ * @param report Report, zeroed
+ */
+typedef void (*micro_ros_node_i2c_report_t)(micro_ros_node_i2c_t *report);
+
+// Node configuration structure
+typedef struct {
+    const char *node_name;
+    const char *imu_topic;
+    const char *odom_topic;
+    const char *odom_frame;     // odometry header frame
+    const char *base_frame;     // odometry child frame
+    const char *imu_frame;      // frame of the MPU9250 axes
+    const char *memory_topic;   // memory report
+    const char *link_topic;     // link report
+    const char *clock_topic;    // clock report
+    const char *i2c_topic;      // I2C report
+    const char *cmd_vel_topic;  // velocity commands
+    micro_ros_node_cmd_vel_t on_cmd_vel;    // NULL: no subscription
+    micro_ros_node_i2c_report_t get_i2c;    // NULL: no I2C report
+    uint32_t report_period_ms;  // memory, link, clock and I2C report period
+} micro_ros_node_config_t;
+
+// Memory report, in this order in the UInt32MultiArray
+typedef struct {
+    uint32_t arena_size;                // static arena for rcl/rmw
+    uint32_t arena_high_water;          // most of the arena ever used
+    uint32_t arena_allocs_after_init;   // allocations in the running loop (0 expected)
+    uint32_t heap_free_after_init;      // free heap when the init finished
+    uint32_t heap_free;                 // free heap now
+    uint32_t heap_min_free;             // lowest free heap since boot
+} micro_ros_node_memory_t;
+
+// Link report, in this order in the UInt32MultiArray (counters wrap around)
+typedef struct {
+    uint32_t tx_bytes_per_s;            // over the last report period
+    uint32_t tx_bytes;                  // bytes written to the link
+    uint32_t tx_writes;                 // writes of the XRCE client
+    uint32_t tx_flushes;                // link writes they were coalesced into
+    uint32_t tx_max_flush;              // largest link write
+    uint32_t dropped_writes;            // client writes lost to a full TX buffer
+    uint32_t dropped_bytes;
+    uint32_t rx_bytes;                  // bytes read from the link
+} micro_ros_node_link_t;
+
+// Clock report, in this order in the UInt32MultiArray
+typedef struct {
+    uint32_t syncs_used;                // syncs in the fit
+    uint32_t syncs_rejected;            // syncs left out for their round trip
+    uint32_t best_rtt_us;               // best round trip in the fit
+    uint32_t error_bound_us;            // stamp error bound (UINT32_MAX before a sync)
+    int32_t skew_ppb;                   // local clock rate error (two's complement)
+    uint32_t since_sync_ms;             // time since the last used sync
+} micro_ros_node_clock_t;
+
+// Default configuration: topics and frames of the simulated rover
+#define MICRO_ROS_NODE_DEFAULT_CONFIG() { \
+    .node_name = "rover_base", \
+    .imu_topic = "imu", \
+    .odom_topic = "odom", \
+    .odom_frame = "rover/odom", \
+    .base_frame = "rover/base_link", \
+    .imu_frame = "rover/base_link", \
+    .memory_topic = "mcu/memory", \
+    .link_topic = "mcu/link", \
+    .clock_topic = "mcu/clock", \
+    .i2c_topic = "mcu/i2c", \
+    .cmd_vel_topic = "cmd_vel", \
+    .on_cmd_vel = NULL, \
+    .get_i2c = NULL, \
+    .report_period_ms = 1000 \
+}
+
+/**
+ * @brief Use Serial at the given rate, with coalesced writes, as the micro-ROS transport
+ *        (before the init)
+ *
+ * The agent must use the same rate: micro_ros_agent serial --dev /dev/ttyUSB0 -b 921600
+ * (over USB CDC: --dev /dev/ttyACM0, any rate).
+ *
+ * @param baud Baud rate
+ */
+void micro_ros_node_set_serial_transport(uint32_t baud);
+
+/**
+ * @brief Connect to the agent, create the node, the publishers and the cmd_vel
+ *        subscription, sync the time
+ *
+ * May be called again after a failure: a failed call finalizes what it created.
+ *
+ * @param config Configuration structure
+ * @return esp_err_t ESP_OK on success, ESP_ERR_TIMEOUT if the agent does not answer,
+ *         ESP_FAIL on another micro-ROS error (e.g. the arena is too small)
+ */
+esp_err_t micro_ros_node_init(const micro_ros_node_config_t *config);
+
+/**
+ * @brief Pass the coalesced messages to the link, at the end of a publish cycle
+ */
+void micro_ros_node_flush(void);
+
+/**
+ * @brief Run the executor (report timer, velocity commands) for a bounded time
+ *
+ * @param budget_us Longest wait for incoming data
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t micro_ros_node_spin(uint32_t budget_us);
+
+/**
+ * @brief Get the memory use of the node
+ *
+ * @param memory Filled with the current figures
+ */
+void micro_ros_node_get_memory(micro_ros_node_memory_t *memory);
+
+/**
+ * @brief Get the link counters
+ *
+ * @param link Filled with the current figures
+ */
+void micro_ros_node_get_link(micro_ros_node_link_t *link);
+
+/**
+ * @brief Get the state of the clock mapping
+ *
+ * @param clock Filled with the current figures
+ */
+void micro_ros_node_get_clock(micro_ros_node_clock_t *clock);
+
+/**
+ * @brief Sync with the agent and add the result to the clock mapping; call it every few
+ *        seconds so that the drift (~1-2 ms/min) is followed
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_TIMEOUT if the agent does not answer or
+ *         answers too late to be used
+ */
+esp_err_t micro_ros_node_sync_time(void);
+
+/**
+ * @brief Publish the IMU state
+ *
+ * @param state Attitude and latest sample
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t micro_ros_node_publish_imu(const imu_state_t *state);
+
+/**
+ * @brief Publish the odometry
+ *
+ * @param pose Pose and velocity
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t micro_ros_node_publish_odom(const odom_pose_t *pose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MICRO_ROS_NODE_H
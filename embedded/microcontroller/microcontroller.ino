@@ -1,9 +1,38 @@
 #include <Wire.h>
-#include <MadgwickAHRS.h>
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "MPU9250.h"
+#include "madgwick_ahrs.h"
+#include "encoder.h"
+#include "odometry.h"
+#include "telemetry.h"
+#include "imu_state.h"
+#include "motor.h"
+#include "motor_control.h"
+// Readers of the shared pose may preempt the odometry task: let it finish its update
+#define ODOM_POSE_RELAX() vTaskDelay(1)
+#include "odom_pose.h"
+
+// ----- MICRO-ROS -----
+// 1: publish imu and odom to a micro-ROS agent on Serial, which then belongs to the
+//    agent (no binary telemetry, no 'i' command: the I2C statistics go to mcu/i2c):
+//    ros2 run micro_ros_agent micro_ros_agent serial --dev /dev/ttyUSB0 -b 921600
+//    (ESP32-S3 with "USB CDC On Boot": Serial is the native USB port, /dev/ttyACM0)
+// 0: binary telemetry on Serial (codes/host/telemetry)
+#define USE_MICRO_ROS   1
+#define MICRO_ROS_BAUD  921600    // imu + odom take ~71 kB/s of its 92 kB/s
+#define IMU_PUBLISH_HZ  100       // divides the IMU update rate (1000 / IMU_FIFO_DRAIN_MS)
+#define ODOM_PUBLISH_HZ 50        // divides ODOM_RATE_HZ
+#define TIME_SYNC_PERIOD_S 10     // time sync with the agent (drift fit, time_sync.h)
+#define ROS_SPIN_PERIOD_MS 10     // executor runs at least this often
+#define ROS_SPIN_BUDGET_US 1000   // longest executor wait per run
+#define ROS_CORE        0         // the ROS task runs on this core only
+
+#if USE_MICRO_ROS
+#include <micro_ros_arduino.h>     // also makes the IDE build micro_ros_node.cpp with it
+#include "micro_ros_node.h"
+#endif
 
 // ----- I2C CONFIGURATION -----
 #define I2C_SDA_PIN 21
@@ -11,30 +40,77 @@
 #define I2C_FREQ 400000
 
 // ----- MPU9250 CONFIGURATION -----
-#define MPU_INT_PIN 23
+// Samples queue in the MPU9250 FIFO and are drained on a timer, so the INT pin is
+// not used (GPIO 23 belongs to the left encoder)
+#define IMU_FIFO_DRAIN_MS 10
+#define IMU_TELEMETRY_PERIOD_US 20000
 
 // ----- ENCODERS PINS -----
+// Clear of the I2C bus (21/22); both channels of a wheel below GPIO 32, in the one
+// input register the ISR backend reads
 #define ENC_LEFT_A      23
-#define ENC_LEFT_B      22
+#define ENC_LEFT_B      17
 #define ENC_RIGHT_A     18
 #define ENC_RIGHT_B     19
 
+// ENCODER_BACKEND_PCNT: hardware pulse counters (no interrupt per edge)
+// ENCODER_BACKEND_ISR: GPIO interrupt on every edge
+#define ENC_BACKEND     ENCODER_BACKEND_PCNT
+
+// ----- MOTOR DRIVER PINS -----
+// TB6612FNG: A is the left motor, B the right one
+#define MOTOR_PWMA      25
+#define MOTOR_AIN1      26
+#define MOTOR_AIN2      27
+#define MOTOR_PWMB      32
+#define MOTOR_BIN1      33
+#define MOTOR_BIN2      14
+#define MOTOR_STBY      13
+
 // ----- ROBOT PARAMETERS -----
 #define WHEEL_RADIUS    0.065/2    // meters
 #define WHEEL_BASE      0.138     // meters
 #define CPR             840       // counts per revolution (7x4xreduction)
-#define UPDATE_PERIOD_MS 100      // odometry and IMU update interval
+#define MOTOR_RPM       500       // N20 at 6 V, no load
+#define IMU_SAMPLE_RATE_HZ 1000   // MPU9250 FIFO sample rate (SMPLRT_DIV = 0)
+
+// ----- LOOP TIMING -----
+// The odometry loop runs from a periodic esp_timer: drift-free, independent of the
+// FreeRTOS tick; its records go out as binary telemetry (telemetry.h)
+#define ODOM_RATE_HZ    1000      // odometry and wheel control loop rate
+#define RATE_PERIOD_MS  50        // wheel rates (counts over this period at high speed)
+#define TELEMETRY_PERIOD_MS 20   // pose and counts records
+#define DIAG_PERIOD_MS  1000      // loop health record
+
+// ----- WHEEL CONTROL -----
+// cmd_vel drives the wheels through a PI + feedforward loop per wheel, run by the
+// odometry loop (motor_control.h). Without a command for CMD_TIMEOUT_MS the wheels ramp
+// down and the driver goes to standby; a commanded stop brakes instead
+#define CMD_TIMEOUT_MS  500       // deadman
+#define SPEED_MAX       0.5       // m/s per wheel
+#define ACCEL_MAX       0.5       // m/s^2 per wheel, speeding up
+#define DECEL_MAX       1.0       // m/s^2 per wheel, slowing down (also on timeout)
+#define MOTOR_KP        1.0e-4    // duty per count/s (~30 rad/s with a 25 ms motor)
+#define MOTOR_KI        4.0e-3    // duty per count (zero at the motor time constant)
+#define MOTOR_KSTATIC   0.05      // duty to get the wheel moving
+#define MOTOR_TRIM_MAX  0.1       // integral bound: load and motor spread, not a stall
+#define MOTOR_DUTY_MAX  1.0
+
+// ----- TELEMETRY PORT -----
+// Binary frames on Serial, decoded by codes/host/telemetry
+#define TELEMETRY_BAUD  115200
+#define SERIAL_TX_BUFFER 4096     // Serial TX ring buffer, drained by the UART interrupt
+
+// Geometry, computed at compile time
+constexpr float WHEEL_BASE_M = WHEEL_BASE;
+constexpr float DIST_PER_COUNT = 2.0f * (float)PI * (float)(WHEEL_RADIUS) / CPR;
+constexpr float FULL_DUTY_RATE = MOTOR_RPM * CPR / 60.0f;   // counts/s
 
 // ----- GLOBAL VARIABLES -----
 // MPU9250
-Madgwick filter;
-
-QueueHandle_t mpu_queue = NULL;
+madgwick_ahrs_t filter;
 
-unsigned long lastReadTime = 0;
-
-float ax, ay, az;  // Accelerometer (g)
-float gx, gy, gz;  // Gyroscope (deg/s)
+MPU9250Sample imu_samples[FIFO_MAX_SAMPLES];
 float mx, my, mz;  // Magnetometer (µT)
 
 float roll, pitch, yaw;
@@ -42,193 +118,424 @@ float roll, pitch, yaw;
 MPU9250 imu;
 
 // ENCODERS
-volatile int32_t count_left = 0;
-volatile int32_t count_right = 0;
-
-volatile int lastLA = 0, lastLB = 0;
-volatile int lastRA = 0, lastRB = 0;
-
-// Robot pose
-float x = 0.0, y = 0.0, theta = 0.0;
-
-// Estimated velocities
-float v = 0.0;      // linear (m/s)
-float omega = 0.0;   // angular (rad/s)
-
-// ----- IMU MPU9250 ISR -----
-void IRAM_ATTR mpu_intr_handler() {
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    uint32_t dummy = 1;
-    xQueueSendFromISR(mpu_queue, &dummy, &xHigherPriorityTaskWoken);
-    if (xHigherPriorityTaskWoken) {
-        portYIELD_FROM_ISR();
-    }
-}
-
-// ----- ENCODER QUADRATURE X4 ISR -----
-void IRAM_ATTR encoder_isr_handler() {
-  int a = digitalRead(ENC_LEFT_A);
-  int b = digitalRead(ENC_LEFT_B);
-  int transition = (lastLA << 3) | (lastLB << 2) | (a << 1) | b;
-  
-  switch (transition) {
-    case 0b0001: case 0b0111: case 0b1110: case 0b1000:
-      count_left++; 
-      break;
-    case 0b0010: case 0b0100: case 0b1101: case 0b1011:
-      count_left--; 
-      break;
-    default: 
-      break;
+// Robot pose and velocities, written by the odometry task only
+odom_pose_t pose = { 0 };
+odometry_t odom;
+
+// Latest pose for other tasks: odom_pose_read(&odom_pose_shared, ...)
+odom_pose_snapshot_t odom_pose_shared = { 0 };
+
+// Latest attitude and sample, written by the IMU task only
+imu_state_snapshot_t imu_state_shared = { 0 };
+
+// Latest cmd_vel, written by the micro-ROS task only
+motor_command_snapshot_t motor_cmd_shared = { 0 };
+
+// Wheel controllers, run by the odometry task only
+const motor_control_config_t motor_ctrl = {
+  .kp = MOTOR_KP,
+  .ki = MOTOR_KI,
+  .kff = 1.0f / FULL_DUTY_RATE,
+  .kstatic = MOTOR_KSTATIC,
+  .accel_max = ACCEL_MAX / DIST_PER_COUNT,
+  .decel_max = DECEL_MAX / DIST_PER_COUNT,
+  .integral_max = MOTOR_TRIM_MAX,
+  .rate_max = SPEED_MAX / DIST_PER_COUNT,
+  .duty_max = MOTOR_DUTY_MAX
+};
+motor_wheel_t wheel_left, wheel_right;
+
+// Woken by the IMU and odometry tasks when there is something to publish
+TaskHandle_t ros_task_handle = NULL;
+
+TaskHandle_t odometry_task_handle = NULL;
+
+// ----- IMU STATE -----
+// Attitude and newest sample in ROS units, for the publishers
+void publish_imu_state(const MPU9250Sample &s, int64_t stamp_us, bool magValid) {
+  constexpr float DEG_TO_RAD_F = (float)PI / 180.0f;
+  constexpr float G_TO_MS2 = 9.80665f;
+  imu_state_t state;
+  madgwick_ahrs_get_quaternion(&filter, &state.qw, &state.qx, &state.qy, &state.qz);
+  state.gx = s.gx * DEG_TO_RAD_F;
+  state.gy = s.gy * DEG_TO_RAD_F;
+  state.gz = s.gz * DEG_TO_RAD_F;
+  state.ax = s.ax * G_TO_MS2;
+  state.ay = s.ay * G_TO_MS2;
+  state.az = s.az * G_TO_MS2;
+  state.mag_valid = magValid;
+  state.stamp_us = stamp_us;
+  imu_state_publish(&imu_state_shared, &state);
+  if (ros_task_handle != NULL) {
+    xTaskNotifyGive(ros_task_handle);
   }
-  lastLA = a;
-  lastLB = b;
 }
 
-void IRAM_ATTR encoder_right_isr_handler() {
-  int a = digitalRead(ENC_RIGHT_A);
-  int b = digitalRead(ENC_RIGHT_B);
-  int transition = (lastRA << 3) | (lastRB << 2) | (a << 1) | b;
-  
-  switch (transition) {
-    case 0b0001: case 0b0111: case 0b1110: case 0b1000:
-      count_right++; 
-      break;
-    case 0b0010: case 0b0100: case 0b1101: case 0b1011:
-      count_right--; 
-      break;
-    default: 
-      break;
+// ----- FREERTOS IMU TASK -----
+// Sample interval within half and twice the nominal period
+int64_t clamp_sample_ns(int64_t ns, int64_t period_us) {
+  if (ns < period_us * 500) {
+    return period_us * 500;
   }
-  lastRA = a;
-  lastRB = b;
+  return ns > period_us * 2000 ? period_us * 2000 : ns;
 }
 
-// ----- FREERTOS IMU TASK -----
 void imu_task(void *parameter) {
-  Serial.println("IMU task started");
-  uint32_t dummy;
+  telemetry_text("IMU task started");
+  const int64_t period_us = 1000000 / IMU_SAMPLE_RATE_HZ;
+  uint32_t overflows = 0;
+  int64_t last_send = 0;
+  int64_t last_stamp_ns = 0;    // sample clock: newest sample integrated (0: none yet)
+  int64_t sample_ns = period_us * 1000;   // and the sample period against esp_timer
+  TickType_t last_wake = xTaskGetTickCount();
   
   while (true) {
-    // Wait for interrupt signal (same as ESP-IDF)
-    if (xQueueReceive(mpu_queue, &dummy, portMAX_DELAY)) {
-      unsigned long now = micros();
-      float dt = (now - lastReadTime) / 1000000.0f;
-      lastReadTime = now;
-      
-      // Read IMU data (accelerometer + gyroscope) in one transaction
-      bool dataValid = imu.readIMU(&ax, &ay, &az, &gx, &gy, &gz);
-      
-      // Read magnetometer data
-      bool magValid = imu.readMag(&mx, &my, &mz);
-      
-      if (dataValid) {
-        // Update Madgwick filter
-        if (magValid) {
-          // Use full 9DOF data (IMU + magnetometer)
-          filter.update(gx, gy, gz, ax, ay, az, mx, my, mz);
-        } else {
-          // Fallback to IMU-only mode
-          filter.updateIMU(gx, gy, gz, ax, ay, az);
-        }
-        
-        // Get Euler angles (in degrees)
-        roll = filter.getRoll();
-        pitch = filter.getPitch();
-        yaw = filter.getYaw();
-        
-        // Calculate actual sampling frequency
-        float freq = (dt > 0) ? (1.0f / dt) : 0;
-        
-        // Display results
-        Serial.print("f: ");
-        Serial.print(freq, 2);
-        Serial.print(" Hz  Roll: ");
-        Serial.print(roll, 2);
-        Serial.print("  Pitch: ");
-        Serial.print(pitch, 2);
-        Serial.print("  Yaw: ");
-        Serial.print(yaw, 2);
-        Serial.print("  Mag: ");
-        Serial.println(magValid ? "OK" : "FAIL");
+    // Drain everything queued since the last wake-up in one burst
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(IMU_FIFO_DRAIN_MS));
+    int64_t now = esp_timer_get_time();
+    
+    bool overflow;
+    int count = imu.readFIFO(imu_samples, FIFO_MAX_SAMPLES, &overflow);
+    if (overflow) {
+      overflows++;
+    }
+    if (count < 0) {
+      telemetry_text("Failed to read IMU FIFO (I2C statistics: send 'i', or mcu/i2c)");
+      continue;
+    }
+    
+    // Magnetometer runs at 100 Hz: read only when a new measurement is due and use
+    // a new reading with the newest sample
+    bool magValid = imu.magDue() && imu.readMag(&mx, &my, &mz);
+    
+    // Samples are evenly spaced at the sensor rate. The newest one was taken in the
+    // last period before the FIFO count was read, right after now, so the drain puts
+    // it in the middle of that period, within half a period (0.5 ms) of its real time.
+    // The stamps come from a sample clock that follows on from the previous drain: its
+    // period tracks the MPU9250 oscillator against esp_timer and its phase is pulled a
+    // quarter of the way toward the drain's estimate. A drain then never stamps a
+    // sample at or before the previous one, which the filter would leave out. After an
+    // overflow samples are lost, and the clock starts over from the estimate.
+    int64_t estimate_ns = (now - period_us / 2) * 1000;
+    int64_t step_ns = sample_ns;
+    if (last_stamp_ns == 0 || overflow) {
+      last_stamp_ns = estimate_ns - (int64_t)count * sample_ns;
+    } else if (count > 0) {
+      int64_t run_ns = last_stamp_ns + (int64_t)count * sample_ns;
+      int64_t error_ns = estimate_ns - run_ns;
+      sample_ns = clamp_sample_ns(sample_ns + error_ns / (count * 16), period_us);
+      step_ns = clamp_sample_ns((run_ns + error_ns / 4 - last_stamp_ns) / count, period_us);
+    }
+    for (int i = 0; i < count; i++) {
+      const MPU9250Sample &s = imu_samples[i];
+      int64_t t = (last_stamp_ns + (int64_t)(i + 1) * step_ns) / 1000;
+      if (magValid && i == count - 1) {
+        // Use full 9DOF data (IMU + magnetometer)
+        madgwick_ahrs_update_timestamped(&filter, t, s.gx, s.gy, s.gz, s.ax, s.ay, s.az, mx, my, mz);
       } else {
-        Serial.println("Failed to read IMU data");
+        // IMU-only update
+        madgwick_ahrs_update_imu_timestamped(&filter, t, s.gx, s.gy, s.gz, s.ax, s.ay, s.az);
       }
     }
+    if (count > 0) {
+      last_stamp_ns += (int64_t)count * step_ns;
+      publish_imu_state(imu_samples[count - 1], last_stamp_ns / 1000, magValid);
+    }
+    
+    if (now - last_send < IMU_TELEMETRY_PERIOD_US) {
+      continue;
+    }
+    last_send = now;
+    
+    // Get Euler angles (in degrees), all three from one angle computation
+    madgwick_ahrs_get_euler(&filter, &roll, &pitch, &yaw);
+    
+    // Actual sampling frequency, jitter and dropped samples since start
+    madgwick_ahrs_timing_t timing;
+    float jitter;
+    madgwick_ahrs_get_timing(&filter, &timing, &jitter);
+    float freq = (timing.dtMean > 0) ? (1.0f / timing.dtMean) : 0;
+    
+    // Queue the record, the telemetry task writes it
+    telemetry_imu_t rec;
+    rec.roll = roll;
+    rec.pitch = pitch;
+    rec.yaw = yaw;
+    rec.rate_hz = freq;
+    rec.jitter_ms = jitter * 1e3f;
+    rec.dropped = timing.dropped;
+    rec.overflows = overflows;
+    rec.mag_valid = magValid;
+    telemetry_send(TELEMETRY_IMU, &rec, sizeof(rec));
   }
 }
 
 // ----- ODOMETRY FUNCTION -----
-void update_odometry(int32_t delta_left, int32_t delta_right, float dt) {
-  float dist_per_count = 2.0 * PI * WHEEL_RADIUS / CPR;
+// Pose from the count deltas, velocities from the wheel rates (counts/s)
+void update_odometry(int32_t delta_left, int32_t delta_right, float rate_left, float rate_right,
+                     int64_t now_us) {
+  // Exact arc per step (odometry.h)
+  odometry_step(&odom, delta_left, delta_right);
+  pose.x = odom.x;
+  pose.y = odom.y;
+  pose.theta = odom.theta;
+
+  // Velocities: edge-timed at low speed, so not quantized to counts per period
+  pose.v = (rate_right + rate_left) * (0.5f * DIST_PER_COUNT);
+  pose.omega = (rate_right - rate_left) * (DIST_PER_COUNT / WHEEL_BASE_M);
+  pose.stamp_us = now_us;
+
+  // One consistent update for the readers
+  odom_pose_publish(&odom_pose_shared, &pose);
+}
+
+// ----- WHEEL CONTROL -----
+// One control period of both wheels from the latest command
+void control_wheels(int64_t count_left, int64_t count_right, int64_t now_us, float dt) {
+  static motor_command_t cmd = { 0 };   // kept when a read meets an update
+  static bool driving = false;
+  motor_command_try_read(&motor_cmd_shared, &cmd);
+
+  // Deadman: a command older than the timeout (or none yet) is a stop
+  bool fresh = cmd.stamp_us != 0 && now_us - cmd.stamp_us < CMD_TIMEOUT_MS * 1000LL;
+  float target_left = 0, target_right = 0;
+  if (fresh) {
+    motor_control_wheel_rates(&motor_ctrl, cmd.v, cmd.omega, WHEEL_BASE_M, DIST_PER_COUNT,
+                              &target_left, &target_right);
+  }
+  float duty_left = motor_control_step(&motor_ctrl, &wheel_left, target_left, count_left,
+                                       now_us, dt);
+  float duty_right = motor_control_step(&motor_ctrl, &wheel_right, target_right, count_right,
+                                        now_us, dt);
+
+  bool stopped = wheel_left.setpoint == 0 && wheel_right.setpoint == 0 &&
+                 target_left == 0 && target_right == 0;
+  if (!stopped) {
+    motor_set(duty_left, duty_right);
+    driving = true;
+  } else if (fresh) {
+    motor_brake();            // commanded stop: hold the wheels
+    driving = true;
+  } else if (driving) {
+    motor_coast();            // no commands: driver in standby
+    driving = false;
+  }
+}
 
-  float d_left  = delta_left * dist_per_count;
-  float d_right = delta_right * dist_per_count;
+void on_cmd_vel(float v, float omega) {
+  motor_command_t cmd;
+  cmd.v = v;
+  cmd.omega = omega;
+  cmd.stamp_us = esp_timer_get_time();
+  motor_command_publish(&motor_cmd_shared, &cmd);
+}
 
-  float ds = (d_right + d_left) / 2.0;
-  float dtheta = (d_right - d_left) / WHEEL_BASE;
+// ----- ODOMETRY TIMER -----
+void odometry_timer_callback(void *arg) {
+  xTaskNotifyGive(odometry_task_handle);
+}
 
-  x += ds * cos(theta + dtheta / 2.0);
-  y += ds * sin(theta + dtheta / 2.0);
-  theta += dtheta;
+// ----- TELEMETRY -----
+void telemetry_serial_write(const uint8_t *data, size_t len, void *ctx) {
+  Serial.write(data, len);
+}
 
-  // Velocities
-  v = ds / dt;
-  omega = dtheta / dt;
+// Pose and counts from the odometry loop
+void send_odometry(const odom_pose_t &p, int64_t count_left, int64_t count_right,
+                   float rate_left, float rate_right) {
+  telemetry_pose_t pose_rec;
+  pose_rec.x = p.x;
+  pose_rec.y = p.y;
+  pose_rec.theta = p.theta;
+  pose_rec.v = p.v;
+  pose_rec.omega = p.omega;
+  telemetry_send(TELEMETRY_POSE, &pose_rec, sizeof(pose_rec));
+
+  telemetry_counts_t counts_rec;
+  counts_rec.left = (int32_t)count_left;
+  counts_rec.right = (int32_t)count_right;
+  counts_rec.rate_left = rate_left;
+  counts_rec.rate_right = rate_right;
+  telemetry_send(TELEMETRY_COUNTS, &counts_rec, sizeof(counts_rec));
 }
 
 // ----- FREERTOS ODOMETRY TASK -----
 void odometry_task(void *parameter) {
-  int32_t last_count_left = 0;
-  int32_t last_count_right = 0;
+  int64_t count_left = 0, count_right = 0;
+  int64_t last_count_left = 0;
+  int64_t last_count_right = 0;
+  float rate_left = 0, rate_right = 0;
+  constexpr uint32_t rate_every = ODOM_RATE_HZ * RATE_PERIOD_MS / 1000;
+  constexpr uint32_t telemetry_every = ODOM_RATE_HZ * TELEMETRY_PERIOD_MS / 1000;
+  constexpr uint32_t publish_every = ODOM_RATE_HZ / ODOM_PUBLISH_HZ;
+  uint32_t loops = 0, telemetry_loops = 0, diag_loops = 0, publish_loops = 0;
+  uint32_t dt_max_us = 0;
+  
+  telemetry_text("Odometry task started");
   
-  Serial.println("Odometry task started");
+  odometry_init(&odom, DIST_PER_COUNT, WHEEL_BASE_M);
+  odometry_task_handle = xTaskGetCurrentTaskHandle();
+  esp_timer_create_args_t timer_args = {};
+  timer_args.callback = odometry_timer_callback;
+  timer_args.dispatch_method = ESP_TIMER_TASK;
+  timer_args.name = "odometry";
+  timer_args.skip_unhandled_events = true;
+  esp_timer_handle_t timer;
+  if (esp_timer_create(&timer_args, &timer) != ESP_OK ||
+      esp_timer_start_periodic(timer, 1000000 / ODOM_RATE_HZ) != ESP_OK) {
+    telemetry_text("Failed to start the odometry timer!");
+    vTaskDelete(NULL);
+  }
+  int64_t last_us = esp_timer_get_time();
+  int64_t diag_start_us = last_us;
+  encoder_get_counts(&count_left, &count_right);
+  last_count_left = count_left;
+  last_count_right = count_right;
+  motor_wheel_reset(&wheel_left, count_left, last_us);
+  motor_wheel_reset(&wheel_right, count_right, last_us);
   
   while (true) {
-    // Wait for the specified period
-    vTaskDelay(pdMS_TO_TICKS(UPDATE_PERIOD_MS));
+    // Wait for the next period; periods missed while late are caught up in one step
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int64_t now_us = esp_timer_get_time();
+    uint32_t dt_us = (uint32_t)(now_us - last_us);
+    last_us = now_us;
+    if (dt_us > dt_max_us) {
+      dt_max_us = dt_us;
+    }
     
     // Calculate deltas
-    int32_t delta_left  = count_left - last_count_left;
-    int32_t delta_right = count_right - last_count_right;
+    encoder_get_counts(&count_left, &count_right);
+    int32_t delta_left  = (int32_t)(count_left - last_count_left);
+    int32_t delta_right = (int32_t)(count_right - last_count_right);
 
     last_count_left  = count_left;
     last_count_right = count_right;
 
-    float dt = UPDATE_PERIOD_MS / 1000.0; // time in seconds
+    if (++loops >= rate_every) {
+      loops = 0;
+      encoder_get_rates(&rate_left, &rate_right);
+    }
+
+    // Wheels first: the control output should not wait for the pose bookkeeping
+    control_wheels(count_left, count_right, now_us, dt_us * 1e-6f);
 
     // Update odometry
-    update_odometry(delta_left, delta_right, dt);
-
-    // Print odometry
-    Serial.print("Pose: x=");
-    Serial.print(x, 4);
-    Serial.print(" m, y=");
-    Serial.print(y, 4);
-    Serial.print(" m, theta=");
-    Serial.print(theta, 3);
-    Serial.println(" rad");
-    
-    Serial.print("Velocity: v=");
-    Serial.print(v, 4);
-    Serial.print(" m/s, omega=");
-    Serial.print(omega, 4);
-    Serial.println(" rad/s");
-    
-    Serial.print("Counts: Left=");
-    Serial.print(count_left);
-    Serial.print(" Right=");
-    Serial.println(count_right);
-    Serial.println();
+    update_odometry(delta_left, delta_right, rate_left, rate_right, now_us);
+
+    // Wake the publisher with a new pose
+    if (++publish_loops >= publish_every) {
+      publish_loops = 0;
+      if (ros_task_handle != NULL) {
+        xTaskNotifyGive(ros_task_handle);
+      }
+    }
+
+    // Records are queued, never waited on: the telemetry task writes them
+    if (++telemetry_loops >= telemetry_every) {
+      telemetry_loops = 0;
+      send_odometry(pose, count_left, count_right, rate_left, rate_right);
+    }
+    diag_loops++;
+    if (now_us - diag_start_us >= DIAG_PERIOD_MS * 1000) {
+      telemetry_diag_t diag;
+      diag.loop_hz = (uint16_t)(diag_loops * 1000000LL / (now_us - diag_start_us));
+      diag.dt_max_us = dt_max_us;
+      diag.interrupts = encoder_get_interrupt_count();
+      diag.dropped = telemetry_get_dropped();
+      telemetry_send(TELEMETRY_DIAG, &diag, sizeof(diag));
+      diag_loops = 0;
+      dt_max_us = 0;
+      diag_start_us = now_us;
+    }
+  }
+}
+
+#if USE_MICRO_ROS
+// ----- I2C REPORT -----
+// The counters belong to the IMU task; a report may be one transaction behind
+static_assert(i2c::kLatencyBuckets == MICRO_ROS_NODE_I2C_BUCKETS, "I2C histogram");
+
+void fill_i2c_report(micro_ros_node_i2c_t *report) {
+  const i2c::Telemetry<2> &stats = imu.i2cStats();
+  for (size_t i = 0; i < stats.deviceCount() && i < MICRO_ROS_NODE_I2C_DEVICES; i++) {
+    const i2c::DeviceStats &d = stats.deviceAt(i);
+    micro_ros_node_i2c_device_t &r = report->devices[i];
+    r.addr = d.addr;
+    r.transactions = d.transactions;
+    r.nacks = d.nacks;
+    r.timeouts = d.timeouts;
+    r.errors = d.errors;
+    r.latency_min_us = d.minUs;
+    r.latency_mean_us = d.transactions ? (uint32_t)(d.busyUs / d.transactions) : 0;
+    r.latency_max_us = d.maxUs;
+    memcpy(r.latency, d.latency, sizeof(r.latency));
+  }
+  report->stuck = stats.bus().stuck;
+  report->recoveries = stats.bus().recoveries;
+  report->failed_recoveries = stats.bus().failedRecoveries;
+}
+
+// ----- MICRO-ROS TASK -----
+// Publishes the shared IMU state and pose when the producers signal new data, so a
+// message leaves as soon as its data exists, then gives the executor a bounded run
+void ros_task(void *parameter) {
+  static_assert((1000 / IMU_FIFO_DRAIN_MS) % IMU_PUBLISH_HZ == 0, "IMU_PUBLISH_HZ");
+  static_assert(ODOM_RATE_HZ % ODOM_PUBLISH_HZ == 0, "ODOM_PUBLISH_HZ");
+  constexpr uint32_t imu_every = (1000 / IMU_FIFO_DRAIN_MS) / IMU_PUBLISH_HZ;
+  constexpr uint32_t odom_every = ODOM_RATE_HZ / ODOM_PUBLISH_HZ;
+
+  // Wait for the agent
+  micro_ros_node_config_t ros_conf = MICRO_ROS_NODE_DEFAULT_CONFIG();
+  ros_conf.on_cmd_vel = on_cmd_vel;
+  ros_conf.get_i2c = fill_i2c_report;
+  micro_ros_node_set_serial_transport(MICRO_ROS_BAUD);
+  while (micro_ros_node_init(&ros_conf) != ESP_OK) {
+    vTaskDelay(pdMS_TO_TICKS(500));
+  }
+  int64_t last_sync_us = esp_timer_get_time();
+
+  uint32_t imu_published = 0, odom_published = 0;
+  ros_task_handle = xTaskGetCurrentTaskHandle();
+  while (true) {
+    // New data, or the executor's turn
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ROS_SPIN_PERIOD_MS));
+
+    imu_state_t state;
+    uint32_t imu_update;
+    if (imu_state_try_read(&imu_state_shared, &state, &imu_update) &&
+        imu_update - imu_published >= imu_every) {
+      imu_published = imu_update;
+      micro_ros_node_publish_imu(&state);
+    }
+
+    odom_pose_t p;
+    uint32_t odom_update = odom_pose_read(&odom_pose_shared, &p);
+    if (odom_update - odom_published >= odom_every) {
+      odom_published = odom_update;
+      micro_ros_node_publish_odom(&p);
+    }
+    micro_ros_node_flush();      // this cycle's messages in one link write
+
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - last_sync_us >= TIME_SYNC_PERIOD_S * 1000000LL) {
+      last_sync_us = now_us;
+      micro_ros_node_sync_time();
+    }
+
+    micro_ros_node_spin(ROS_SPIN_BUDGET_US);
   }
 }
+#endif
 
 void setup() {
-  Serial.begin(115200);
+  Serial.setTxBufferSize(SERIAL_TX_BUFFER);
+  Serial.begin(TELEMETRY_BAUD);
 
   // Initialize I2C
   Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
   Wire.setClock(I2C_FREQ);
+  imu.setBusPins(I2C_SDA_PIN, I2C_SCL_PIN);   // for the stuck-bus recovery
   Serial.println("I2C initialized");
   
   // Initialize MPU9250
@@ -241,43 +548,67 @@ void setup() {
   if (!imu.ak8963_init()) {
     Serial.println("Failed to initialize AK8963 magnetometer!");
     // Continue without magnetometer
+  } else if (!imu.enableAuxMaster()) {
+    // The MPU9250 polls the AK8963 itself, bypass stays off
+    Serial.println("Failed to enable MPU9250 aux I2C master!");
   }
 
-  // Create queue for IMU interrupt communication
-  mpu_queue = xQueueCreate(10, sizeof(uint32_t));
-  if (mpu_queue == NULL) {
-    Serial.println("Failed to create queue");
-    return;
+  // Sample at 1 kHz into the FIFO
+  if (!imu.setSampleRateDivider(SAMPLE_RATE_DIV_1KHZ) || !imu.fifoEnable()) {
+    Serial.println("Failed to enable MPU9250 FIFO!");
+    while (1) {
+      delay(1000);
+    }
   }
-  Serial.println("Queue created");
-  
-  // Configure encoder pins
-  pinMode(ENC_LEFT_A, INPUT_PULLUP);
-  pinMode(ENC_LEFT_B, INPUT_PULLUP);
-  pinMode(ENC_RIGHT_A, INPUT_PULLUP);
-  pinMode(ENC_RIGHT_B, INPUT_PULLUP);
-  // Configure IMU interrupt pin
-  pinMode(MPU_INT_PIN, INPUT_PULLUP);
+  Serial.println("MPU9250 FIFO enabled");
   
-  // Initialize last states
-  lastLA = digitalRead(ENC_LEFT_A);
-  lastLB = digitalRead(ENC_LEFT_B);
-  lastRA = digitalRead(ENC_RIGHT_A);
-  lastRB = digitalRead(ENC_RIGHT_B);
-  
-  // Attach interrupts
-  attachInterrupt(digitalPinToInterrupt(ENC_LEFT_A), encoder_isr_handler, CHANGE);
-  attachInterrupt(digitalPinToInterrupt(ENC_LEFT_B), encoder_isr_handler, CHANGE);
-  attachInterrupt(digitalPinToInterrupt(ENC_RIGHT_A), encoder_right_isr_handler, CHANGE);
-  attachInterrupt(digitalPinToInterrupt(ENC_RIGHT_B), encoder_right_isr_handler, CHANGE);
-  attachInterrupt(digitalPinToInterrupt(MPU_INT_PIN), mpu_intr_handler, RISING);
-
-  // Initialize Madgwick filter
-  filter.begin(UPDATE_PERIOD_MS);
+  // Start the wheel encoders
+  encoder_config_t enc_conf = ENCODER_DEFAULT_CONFIG();
+  enc_conf.left_a = (gpio_num_t)ENC_LEFT_A;
+  enc_conf.left_b = (gpio_num_t)ENC_LEFT_B;
+  enc_conf.right_a = (gpio_num_t)ENC_RIGHT_A;
+  enc_conf.right_b = (gpio_num_t)ENC_RIGHT_B;
+  enc_conf.backend = ENC_BACKEND;
+  if (encoder_init(&enc_conf) != ESP_OK) {
+    Serial.println("Failed to initialize encoders!");
+    while (1) {
+      delay(1000);
+    }
+  }
+  Serial.println(encoder_get_backend() == ENCODER_BACKEND_PCNT ? "Encoders on PCNT" : "Encoders on GPIO interrupts");
+
+  // Start the motor driver, in standby until the first command
+  motor_config_t motor_conf = MOTOR_DEFAULT_CONFIG();
+  motor_conf.pwm_a = (gpio_num_t)MOTOR_PWMA;
+  motor_conf.ain1 = (gpio_num_t)MOTOR_AIN1;
+  motor_conf.ain2 = (gpio_num_t)MOTOR_AIN2;
+  motor_conf.pwm_b = (gpio_num_t)MOTOR_PWMB;
+  motor_conf.bin1 = (gpio_num_t)MOTOR_BIN1;
+  motor_conf.bin2 = (gpio_num_t)MOTOR_BIN2;
+  motor_conf.stby = (gpio_num_t)MOTOR_STBY;
+  if (motor_init(&motor_conf) != ESP_OK) {
+    // Sensors and odometry still work; the wheels stay unpowered
+    Serial.println("Failed to initialize motors!");
+  } else {
+    Serial.println("Motors in standby");
+  }
+
+  // Initialize Madgwick filter (nominal rate; real intervals come from timestamps)
+  madgwick_ahrs_init(&filter);
+  madgwick_ahrs_begin(&filter, IMU_SAMPLE_RATE_HZ);
   Serial.println("Madgwick filter initialized");
   
-  // Initialize timing
-  lastReadTime = micros();
+#if !USE_MICRO_ROS
+  // Telemetry task: text ends here, binary frames follow
+  telemetry_config_t tel_conf = TELEMETRY_DEFAULT_CONFIG();
+  tel_conf.write = telemetry_serial_write;
+  if (telemetry_init(&tel_conf) != ESP_OK) {
+    Serial.println("Failed to start telemetry!");
+    while (1) {
+      delay(1000);
+    }
+  }
+#endif
   
   // Create FreeRTOS task for IMU processing
   xTaskCreate(
@@ -289,17 +620,39 @@ void setup() {
     NULL                   // Task handle
   );
 
-  // Create FreeRTOS task for odometry processing
+  // Create FreeRTOS task for odometry and wheel control (above the IMU and loop())
   xTaskCreate(
     odometry_task,           // Task function
     "OdometryTask",          // Task name
     2048,                    // Stack size (words)
     NULL,                    // Task parameters
-    1,                       // Task priority
+    5,                       // Task priority
     NULL                     // Task handle
   );
+
+#if USE_MICRO_ROS
+  // Create FreeRTOS task for micro-ROS (above the IMU), pinned so that its executor
+  // never migrates between cores
+  xTaskCreatePinnedToCore(
+    ros_task,                // Task function
+    "ROSTask",               // Task name
+    8192,                    // Stack size (words)
+    NULL,                    // Task parameters
+    2,                       // Task priority
+    NULL,                    // Task handle
+    ROS_CORE                 // Core
+  );
+#endif
 }
 
 void loop() {
-  delay(1000); // Small delay to prevent watchdog reset
+#if !USE_MICRO_ROS
+  // 'i': I2C transfer counters, latency histograms and bus recoveries
+  while (Serial.available() > 0) {
+    if (Serial.read() == 'i') {
+      imu.i2cStats().dump([](const char* line) { telemetry_text(line); });
+    }
+  }
+#endif
+  delay(100);
 }
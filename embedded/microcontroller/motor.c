@@ -0,0 +1,201 @@
+//=============================================================================================
+// motor.c
+//=============================================================================================
+//
+// TB6612FNG motor driver on LEDC PWM, see motor.h.
+//
+//=============================================================================================
+
+//-------------------------------------------------------------------------------------------
+// Header files
+
+#include "motor.h"
+#include "driver/ledc.h"
+#include "esp_log.h"
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+static const char *TAG = "MOTOR";
+
+// Low-speed mode exists on every ESP32 variant; the timer and channels are taken from
+// the top so that Arduino's ledcAttach()/analogWrite() (which allocate from 0) keep theirs
+#define MOTOR_LEDC_MODE     LEDC_LOW_SPEED_MODE
+#define MOTOR_LEDC_TIMER    LEDC_TIMER_3
+#define MOTOR_LEDC_BITS     LEDC_TIMER_10_BIT
+#define MOTOR_DUTY_FULL     ((1u << 10) - 1)
+
+#define MOTOR_LEFT  0
+#define MOTOR_RIGHT 1
+#define MOTOR_COUNT 2
+
+typedef struct {
+    gpio_num_t pwm, in1, in2;
+    ledc_channel_t channel;
+    bool invert;
+} motor_t;
+
+static motor_t s_motors[MOTOR_COUNT];
+static gpio_num_t s_stby = GPIO_NUM_NC;
+static bool s_awake = false;
+static bool s_initialized = false;
+
+//-------------------------------------------------------------------------------------------
+// Helpers
+
+static void set_standby(bool standby) {
+    if (s_stby != GPIO_NUM_NC) {
+        gpio_set_level(s_stby, standby ? 0 : 1);
+    }
+    s_awake = !standby;
+}
+
+static void motor_write(const motor_t *m, float duty) {
+    if (m->invert) {
+        duty = -duty;
+    }
+    if (duty > 1.0f) {
+        duty = 1.0f;
+    } else if (duty < -1.0f) {
+        duty = -1.0f;
+    }
+    // Direction first: a reversal never passes through a full duty the wrong way
+    gpio_set_level(m->in1, duty > 0.0f ? 1 : 0);
+    gpio_set_level(m->in2, duty < 0.0f ? 1 : 0);
+    uint32_t level = (uint32_t)((duty < 0.0f ? -duty : duty) * MOTOR_DUTY_FULL + 0.5f);
+    ledc_set_duty(MOTOR_LEDC_MODE, m->channel, level);
+    ledc_update_duty(MOTOR_LEDC_MODE, m->channel);
+}
+
+//-------------------------------------------------------------------------------------------
+// API
+
+esp_err_t motor_init(const motor_config_t *config) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_motors[MOTOR_LEFT] = (motor_t){ config->pwm_a, config->ain1, config->ain2,
+                                      LEDC_CHANNEL_6, config->invert_left };
+    s_motors[MOTOR_RIGHT] = (motor_t){ config->pwm_b, config->bin1, config->bin2,
+                                       LEDC_CHANNEL_7, config->invert_right };
+    s_stby = config->stby;
+
+    // Direction and standby outputs, all low: outputs off
+    uint64_t mask = (1ULL<<config->ain1)|(1ULL<<config->ain2)|
+                    (1ULL<<config->bin1)|(1ULL<<config->bin2);
+    if (s_stby != GPIO_NUM_NC) {
+        mask |= 1ULL<<s_stby;
+    }
+    gpio_config_t io_conf = {
+        .intr_type = GPIO_INTR_DISABLE,
+        .mode = GPIO_MODE_OUTPUT,
+        .pin_bit_mask = mask,
+        .pull_up_en = 0,
+        .pull_down_en = 0
+    };
+    esp_err_t ret = gpio_config(&io_conf);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        gpio_set_level(s_motors[i].in1, 0);
+        gpio_set_level(s_motors[i].in2, 0);
+    }
+    set_standby(true);
+
+    ledc_timer_config_t timer_conf = {
+        .speed_mode = MOTOR_LEDC_MODE,
+        .duty_resolution = MOTOR_LEDC_BITS,
+        .timer_num = MOTOR_LEDC_TIMER,
+        .freq_hz = config->pwm_freq_hz,
+        .clk_cfg = LEDC_AUTO_CLK
+    };
+    ret = ledc_timer_config(&timer_conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure the PWM timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        ledc_channel_config_t chan_conf = {
+            .gpio_num = s_motors[i].pwm,
+            .speed_mode = MOTOR_LEDC_MODE,
+            .channel = s_motors[i].channel,
+            .intr_type = LEDC_INTR_DISABLE,
+            .timer_sel = MOTOR_LEDC_TIMER,
+            .duty = 0,
+            .hpoint = 0
+        };
+        ret = ledc_channel_config(&chan_conf);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to configure the PWM channel: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+    s_initialized = true;
+    ESP_LOGI(TAG, "Motors on %u Hz PWM", (unsigned)config->pwm_freq_hz);
+    return ESP_OK;
+}
+
+esp_err_t motor_deinit(void) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    set_standby(true);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        ledc_stop(MOTOR_LEDC_MODE, s_motors[i].channel, 0);
+        gpio_set_level(s_motors[i].in1, 0);
+        gpio_set_level(s_motors[i].in2, 0);
+    }
+    s_initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t motor_set(float left, float right) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    motor_write(&s_motors[MOTOR_LEFT], left);
+    motor_write(&s_motors[MOTOR_RIGHT], right);
+    if (!s_awake) {
+        set_standby(false);
+    }
+    return ESP_OK;
+}
+
+esp_err_t motor_brake(void) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // IN1 = IN2 = high shorts the motor whatever the PWM
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        gpio_set_level(s_motors[i].in1, 1);
+        gpio_set_level(s_motors[i].in2, 1);
+    }
+    if (!s_awake) {
+        set_standby(false);
+    }
+    return ESP_OK;
+}
+
+esp_err_t motor_coast(void) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    set_standby(true);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        ledc_set_duty(MOTOR_LEDC_MODE, s_motors[i].channel, 0);
+        ledc_update_duty(MOTOR_LEDC_MODE, s_motors[i].channel);
+        gpio_set_level(s_motors[i].in1, 0);
+        gpio_set_level(s_motors[i].in2, 0);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,99 @@
+//=============================================================================================
+// motor.h
+//=============================================================================================
+//
+// TB6612FNG dual H-bridge driving the two N20 wheel motors.
+//
+// Each motor takes a PWM input and two direction inputs; STBY low puts both outputs in
+// high impedance. The PWM comes from the LEDC peripheral (one timer, one channel per
+// motor) at 20 kHz, above hearing and within the 100 kHz of the driver, with 10 bits of
+// duty. Duties are signed, positive drives the wheel forward (the direction its encoder
+// counts up); a motor mounted the other way round is inverted in the configuration.
+//
+//   duty != 0      IN1/IN2 set the direction, PWM the duty (drive/short brake)
+//   motor_brake()  IN1 = IN2 = high: short brake, the wheels are held
+//   motor_coast()  STBY low: outputs off, the wheels turn freely, driver idle
+//
+// Not thread-safe: all the calls from one task (the control loop).
+//
+//=============================================================================================
+#ifndef MOTOR_H
+#define MOTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Motor configuration structure
+typedef struct {
+    gpio_num_t pwm_a, ain1, ain2;   // left motor
+    gpio_num_t pwm_b, bin1, bin2;   // right motor
+    gpio_num_t stby;                // standby (GPIO_NUM_NC: tied high)
+    uint32_t pwm_freq_hz;
+    bool invert_left;               // the motor turns backward for a positive duty
+    bool invert_right;
+} motor_config_t;
+
+// Default configuration: pins of the rover, clear of the encoders, the I2C bus, the
+// serial port and the strapping pins
+#define MOTOR_DEFAULT_CONFIG() { \
+    .pwm_a = GPIO_NUM_25, \
+    .ain1 = GPIO_NUM_26, \
+    .ain2 = GPIO_NUM_27, \
+    .pwm_b = GPIO_NUM_32, \
+    .bin1 = GPIO_NUM_33, \
+    .bin2 = GPIO_NUM_14, \
+    .stby = GPIO_NUM_13, \
+    .pwm_freq_hz = 20000, \
+    .invert_left = false, \
+    .invert_right = false \
+}
+
+/**
+ * @brief Configure the pins and the PWM; the motors start coasting
+ *
+ * @param config Configuration structure
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if already initialized
+ */
+esp_err_t motor_init(const motor_config_t *config);
+
+/**
+ * @brief Coast the motors and release the pins and the PWM
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t motor_deinit(void);
+
+/**
+ * @brief Drive both motors (leaves standby)
+ *
+ * @param left Left duty in [-1, 1], positive forward
+ * @param right Right duty in [-1, 1], positive forward
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t motor_set(float left, float right);
+
+/**
+ * @brief Short brake both motors (leaves standby)
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t motor_brake(void);
+
+/**
+ * @brief Outputs off: the wheels turn freely and the driver is in standby
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not initialized
+ */
+esp_err_t motor_coast(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTOR_H
@@ -0,0 +1,247 @@
+//=============================================================================================
+// motor_control.h
+//=============================================================================================
+//
+// Wheel velocity control of the differential drive, kept free of ESP-IDF headers so that
+// the host tools can check it (codes/host/motor). All speeds are in encoder counts/s.
+//
+//   command    body velocity (v, omega) -> wheel rates; a wheel over the speed limit
+//              scales both down, so the path keeps its curvature
+//   ramp       the setpoint follows the command at most accel_max away from zero and
+//              decel_max toward it, so a step in cmd_vel never slips the wheels
+//   feedback   speed over the last MOTOR_SPEED_WINDOW loop periods (count and time
+//              deltas): 1 count of resolution per window, half a window of delay
+//   duty       kff * setpoint + kstatic (static friction, in the direction of the
+//              setpoint) + kp * error + integral
+//
+// The feedforward gives most of the duty (kff = 1 / speed at full duty), so the PI only
+// trims the load and the spread between motors (the 6 V buck holds their supply). The
+// integral is bounded to that trim (integral_max) and stops growing while the duty is at
+// its limit and the error would push it further (conditional integration), so a stalled
+// wheel overshoots little once it is free. A wheel whose command and setpoint are both
+// zero is idle: no duty, integral cleared, nothing to hum about.
+//
+// The command reaches the control loop through a seqlock (seqlock.h) with the time it
+// arrived; the loop treats a command older than its timeout as zero (deadman).
+//
+// Not thread-safe, except the command snapshot: a wheel is run by one task.
+//
+//=============================================================================================
+#ifndef MOTOR_CONTROL_H
+#define MOTOR_CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "seqlock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOTOR_SPEED_WINDOW 10       // loop periods per speed estimate
+
+// Controller parameters, shared by both wheels
+typedef struct {
+    float kp;           // duty per counts/s of error
+    float ki;           // duty per count of error (integral of counts/s)
+    float kff;          // duty per counts/s of setpoint
+    float kstatic;      // duty added in the direction of a non-zero setpoint
+    float accel_max;    // counts/s^2, setpoint moving away from zero
+    float decel_max;    // counts/s^2, setpoint moving toward zero
+    float integral_max; // duty, bound of the integral
+    float rate_max;     // counts/s, wheel speed limit
+    float duty_max;     // duty limit, at most 1
+} motor_control_config_t;
+
+// State of one wheel
+typedef struct {
+    float setpoint;     // ramped command, counts/s
+    float rate;         // measured, counts/s
+    float integral;     // duty
+    float duty;         // last output, in [-duty_max, duty_max]
+    bool saturated;     // last output was at the limit
+    int64_t counts[MOTOR_SPEED_WINDOW];     // count and time of the last periods
+    int64_t t_us[MOTOR_SPEED_WINDOW];
+    uint32_t head;
+} motor_wheel_t;
+
+/**
+ * @brief Reset a wheel: stopped, no integral, speed window filled with the current count
+ *
+ * @param w Wheel
+ * @param count Current count
+ * @param now_us Current time (µs)
+ */
+static inline void motor_wheel_reset(motor_wheel_t *w, int64_t count, int64_t now_us) {
+    memset(w, 0, sizeof(*w));
+    for (uint32_t i = 0; i < MOTOR_SPEED_WINDOW; i++) {
+        w->counts[i] = count;
+        w->t_us[i] = now_us;
+    }
+}
+
+/**
+ * @brief Wheel rates of a body velocity
+ *
+ * @param cfg Controller parameters (rate_max)
+ * @param v Linear velocity (m/s)
+ * @param omega Angular velocity (rad/s, counterclockwise)
+ * @param wheel_base Distance between the wheels (m)
+ * @param dist_per_count Wheel travel per count (m)
+ * @param left Left wheel rate (counts/s)
+ * @param right Right wheel rate (counts/s)
+ */
+static inline void motor_control_wheel_rates(const motor_control_config_t *cfg, float v, float omega,
+                                             float wheel_base, float dist_per_count,
+                                             float *left, float *right) {
+    float l = (v - 0.5f * wheel_base * omega) / dist_per_count;
+    float r = (v + 0.5f * wheel_base * omega) / dist_per_count;
+    float peak = fmaxf(fabsf(l), fabsf(r));
+    if (peak > cfg->rate_max) {
+        float scale = cfg->rate_max / peak;
+        l *= scale;
+        r *= scale;
+    }
+    *left = l;
+    *right = r;
+}
+
+// Setpoint one period closer to the target, within the acceleration limits
+static inline float motor_control_ramp(const motor_control_config_t *cfg, float setpoint,
+                                       float target, float dt) {
+    float delta = target - setpoint;
+    bool toward_zero = (setpoint > 0 && delta < 0) || (setpoint < 0 && delta > 0);
+    float step = (toward_zero ? cfg->decel_max : cfg->accel_max) * dt;
+    if (toward_zero) {
+        // Through zero at the deceleration limit, then away from it at the acceleration one
+        float to_zero = fabsf(setpoint);
+        if (fabsf(delta) > to_zero && step >= to_zero) {
+            return 0.0f;
+        }
+    }
+    if (delta > step) {
+        return setpoint + step;
+    }
+    if (delta < -step) {
+        return setpoint - step;
+    }
+    return target;
+}
+
+/**
+ * @brief Run one control period of a wheel
+ *
+ * @param cfg Controller parameters
+ * @param w Wheel
+ * @param target Commanded rate (counts/s), already within rate_max
+ * @param count Current count
+ * @param now_us Current time (µs)
+ * @param dt Control period (s)
+ * @return float Duty in [-duty_max, duty_max], positive forward (0 when idle)
+ */
+static inline float motor_control_step(const motor_control_config_t *cfg, motor_wheel_t *w,
+                                       float target, int64_t count, int64_t now_us, float dt) {
+    // Speed over the window: the oldest entry is replaced by this period
+    int64_t span_us = now_us - w->t_us[w->head];
+    if (span_us > 0) {
+        w->rate = (float)(count - w->counts[w->head]) * 1e6f / (float)span_us;
+    }
+    w->counts[w->head] = count;
+    w->t_us[w->head] = now_us;
+    w->head = (w->head + 1) % MOTOR_SPEED_WINDOW;
+
+    w->setpoint = motor_control_ramp(cfg, w->setpoint, target, dt);
+    if (w->setpoint == 0.0f && target == 0.0f) {
+        w->integral = 0.0f;
+        w->duty = 0.0f;
+        w->saturated = false;
+        return 0.0f;
+    }
+
+    float error = w->setpoint - w->rate;
+    float ff = cfg->kff * w->setpoint;
+    if (w->setpoint > 0.0f) {
+        ff += cfg->kstatic;
+    } else if (w->setpoint < 0.0f) {
+        ff -= cfg->kstatic;
+    }
+    float duty = ff + cfg->kp * error + w->integral;
+
+    // Integrate unless the output is at the limit and the error pushes it further
+    bool high = duty >= cfg->duty_max && error > 0;
+    bool low = duty <= -cfg->duty_max && error < 0;
+    if (!high && !low) {
+        float integral = w->integral + cfg->ki * error * dt;
+        if (integral > cfg->integral_max) {
+            integral = cfg->integral_max;
+        } else if (integral < -cfg->integral_max) {
+            integral = -cfg->integral_max;
+        }
+        duty += integral - w->integral;
+        w->integral = integral;
+    }
+
+    w->saturated = fabsf(duty) >= cfg->duty_max;
+    if (duty > cfg->duty_max) {
+        duty = cfg->duty_max;
+    } else if (duty < -cfg->duty_max) {
+        duty = -cfg->duty_max;
+    }
+    w->duty = duty;
+    return duty;
+}
+
+//-------------------------------------------------------------------------------------------
+// Command from another task (seqlock.h)
+
+// Body velocity command and its arrival time
+typedef struct {
+    float v;            // m/s
+    float omega;        // rad/s
+    int64_t stamp_us;   // when it arrived (esp_timer); 0: never
+} motor_command_t;
+
+#define MOTOR_COMMAND_WORDS SEQLOCK_WORDS(motor_command_t)
+
+// Shared snapshot; zero-initialized is a valid snapshot (no command yet)
+typedef struct {
+    uint32_t seq;                       // odd while an update is being written
+    uint32_t words[MOTOR_COMMAND_WORDS];
+} motor_command_snapshot_t;
+
+/**
+ * @brief Publish a new command (single writer)
+ *
+ * @param snap Shared snapshot
+ * @param cmd Command to publish
+ */
+static inline void motor_command_publish(motor_command_snapshot_t *snap, const motor_command_t *cmd) {
+    uint32_t words[MOTOR_COMMAND_WORDS] = { 0 };
+    memcpy(words, cmd, sizeof(*cmd));
+    seqlock_publish(&snap->seq, snap->words, words, MOTOR_COMMAND_WORDS);
+}
+
+/**
+ * @brief Read the command once, without retrying (the control loop must not wait on a
+ *        writer it may have preempted)
+ *
+ * @param snap Shared snapshot
+ * @param cmd Filled on success
+ * @return bool false if an update was in progress (command left as is)
+ */
+static inline bool motor_command_try_read(const motor_command_snapshot_t *snap, motor_command_t *cmd) {
+    uint32_t words[MOTOR_COMMAND_WORDS];
+    if (!seqlock_try_read(&snap->seq, snap->words, words, MOTOR_COMMAND_WORDS, NULL)) {
+        return false;
+    }
+    memcpy(cmd, words, sizeof(*cmd));
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTOR_CONTROL_H
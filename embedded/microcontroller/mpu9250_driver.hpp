@@ -0,0 +1,666 @@
+//=============================================================================================
+// mpu9250_driver.hpp
+//=============================================================================================
+//
+// Header-only MPU9250 + AK8963 driver core shared by the ESP-IDF driver (mpu9250.cpp),
+// the Arduino MPU9250 class and the host tools. Register sequences, decoding and unit
+// conversion live here once; the platforms only supply a bus policy:
+//
+//   struct Bus {
+//       static constexpr size_t kMaxRead = ...;   // longest single read in bytes
+//       bool write(uint8_t addr, uint8_t reg, uint8_t value);
+//       bool read(uint8_t addr, uint8_t reg, uint8_t *data, size_t len);
+//       void delay_ms(uint32_t ms);
+//   };
+//
+// Driver<Bus> calls the policy directly (no virtual functions), so the bus calls inline
+// into the platform's own transfer code. Policies in the tree: IdfBus (mpu9250.cpp,
+// i2c_master API), WireBus (MPU9250.cpp, Arduino Wire) and MockBus (host, register
+// file that replays sensor traces and counts bus traffic).
+//
+// Ranges follow the C API: accelerometer 0..3 = ±2/4/8/16 g, gyroscope 0..3 =
+// ±250/500/1000/2000 °/s, DLPF 0..6, sample rate = 1 kHz / (1 + div) with the DLPF on.
+//
+// Requires C++11.
+//
+//=============================================================================================
+#ifndef MPU9250_DRIVER_HPP
+#define MPU9250_DRIVER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mpu9250 {
+
+constexpr uint8_t kMpuAddr = 0x68;
+constexpr uint8_t kAkAddr = 0x0C;
+
+// MPU9250 registers
+namespace reg {
+constexpr uint8_t SMPLRT_DIV         = 0x19;
+constexpr uint8_t CONFIG             = 0x1A;
+constexpr uint8_t GYRO_CONFIG        = 0x1B;
+constexpr uint8_t ACCEL_CONFIG       = 0x1C;
+constexpr uint8_t FIFO_EN            = 0x23;
+constexpr uint8_t I2C_MST_CTRL       = 0x24;
+constexpr uint8_t I2C_SLV0_ADDR      = 0x25;
+constexpr uint8_t I2C_SLV0_REG       = 0x26;
+constexpr uint8_t I2C_SLV0_CTRL      = 0x27;
+constexpr uint8_t I2C_SLV4_CTRL      = 0x34;
+constexpr uint8_t INT_PIN_CFG        = 0x37;
+constexpr uint8_t INT_ENABLE         = 0x38;
+constexpr uint8_t INT_STATUS         = 0x3A;
+constexpr uint8_t ACCEL_XOUT_H       = 0x3B;
+constexpr uint8_t EXT_SENS_DATA_00   = 0x49;
+constexpr uint8_t I2C_MST_DELAY_CTRL = 0x67;
+constexpr uint8_t USER_CTRL          = 0x6A;
+constexpr uint8_t PWR_MGMT_1         = 0x6B;
+constexpr uint8_t FIFO_COUNTH        = 0x72;
+constexpr uint8_t FIFO_R_W           = 0x74;
+} // namespace reg
+
+// AK8963 registers
+namespace ak {
+constexpr uint8_t ST1   = 0x02;
+constexpr uint8_t HXL   = 0x03;
+constexpr uint8_t ST2   = 0x09;
+constexpr uint8_t CNTL1 = 0x0A;
+} // namespace ak
+
+// Register bits
+constexpr uint8_t kConfigFifoMode = 0x40;      // CONFIG: drop new samples when the FIFO is full
+constexpr uint8_t kIntDataReady = 0x01;        // INT_ENABLE / INT_STATUS
+constexpr uint8_t kIntFifoOverflow = 0x10;
+constexpr uint8_t kBypassEnable = 0x02;        // INT_PIN_CFG
+constexpr uint8_t kUserFifoEnable = 0x40;      // USER_CTRL
+constexpr uint8_t kUserI2cMasterEnable = 0x20;
+constexpr uint8_t kUserFifoReset = 0x04;
+constexpr uint8_t kFifoAccelGyro = 0x78;       // FIFO_EN: GYRO_X/Y/Z | ACCEL
+constexpr uint8_t kAkSt1DataReady = 0x01;
+constexpr uint8_t kAkSt2Overflow = 0x08;
+constexpr uint8_t kAkContinuous100Hz16Bit = 0x16;
+constexpr uint32_t kAkPeriodUs = 10000;         // continuous mode 2: 100 Hz
+
+constexpr size_t kFifoSize = 512;
+constexpr size_t kFifoFrameSize = 12;          // ax, ay, az, gx, gy, gz (big-endian)
+constexpr size_t kFifoMaxSamples = kFifoSize / kFifoFrameSize;
+constexpr size_t kImuSize = 14;                // ACCEL_XOUT_H..GYRO_ZOUT_L
+constexpr size_t kExtMagSize = 7;              // HXL..HZH, ST2
+constexpr size_t kBurstSize = kImuSize + kExtMagSize;
+
+enum class Status : uint8_t {
+    Ok,
+    BusError,       // the bus policy reported a failed transfer
+    InvalidArg,
+    InvalidState,   // e.g. FIFO read while the FIFO is off
+    NotReady,       // no new magnetometer measurement
+    Overflow,       // magnetometer overflow (reading discarded)
+};
+
+// Raw sensor counts, same layout as mpu9250_data_t
+struct RawSample {
+    int16_t ax, ay, az;
+    int16_t gx, gy, gz;
+    int16_t mx, my, mz;
+};
+
+// Last magnetometer measurement and when the driver saw it
+struct MagCache {
+    int16_t mx, my, mz;
+    int64_t tUs;        // caller's clock at the read that returned it
+    bool valid;
+};
+
+struct Config {
+    uint8_t accelRange;
+    uint8_t gyroRange;
+    uint8_t dlpfCfg;
+    uint8_t sampleRateDiv;
+};
+
+// Datasheet sensitivities (LSB per g, LSB per °/s) and the AK8963 16-bit scale (µT per LSB)
+inline float accel_lsb_per_g(uint8_t range) {
+    static const float lsb[] = { 16384.0f, 8192.0f, 4096.0f, 2048.0f };
+    return lsb[range & 3];
+}
+
+inline float gyro_lsb_per_dps(uint8_t range) {
+    static const float lsb[] = { 131.0f, 65.5f, 32.8f, 16.4f };
+    return lsb[range & 3];
+}
+
+constexpr float kMagUtPerLsb = 0.15f;
+
+//---------------------------------------------------------------------------------------------
+// Decoding
+
+inline int16_t be16(const uint8_t *p) {
+    return (int16_t)((p[0] << 8) | p[1]);
+}
+
+inline int16_t le16(const uint8_t *p) {
+    return (int16_t)((p[1] << 8) | p[0]);
+}
+
+// ACCEL_XOUT_H..GYRO_ZOUT_L (temperature skipped)
+template <typename Out>
+inline void decode_imu(const uint8_t *raw, Out &out) {
+    out.ax = be16(&raw[0]);
+    out.ay = be16(&raw[2]);
+    out.az = be16(&raw[4]);
+    out.gx = be16(&raw[8]);
+    out.gy = be16(&raw[10]);
+    out.gz = be16(&raw[12]);
+}
+
+// One FIFO frame: accelerometer then gyroscope, no temperature
+template <typename Out>
+inline void decode_fifo_frame(const uint8_t *raw, Out &out) {
+    out.ax = be16(&raw[0]);
+    out.ay = be16(&raw[2]);
+    out.az = be16(&raw[4]);
+    out.gx = be16(&raw[6]);
+    out.gy = be16(&raw[8]);
+    out.gz = be16(&raw[10]);
+}
+
+// HXL..HZH followed by ST2; an overflowed reading is not stored
+template <typename Out>
+inline Status decode_mag(const uint8_t *raw, Out &out) {
+    if (raw[6] & kAkSt2Overflow) {
+        return Status::Overflow;
+    }
+    out.mx = le16(&raw[0]);
+    out.my = le16(&raw[2]);
+    out.mz = le16(&raw[4]);
+    return Status::Ok;
+}
+
+// kBurstSize bytes from ACCEL_XOUT_H in aux master mode; magnetometer 0 on overflow
+template <typename Out>
+inline bool decode_burst(const uint8_t *raw, Out &out) {
+    decode_imu(raw, out);
+    if (decode_mag(&raw[kImuSize], out) != Status::Ok) {
+        out.mx = 0;
+        out.my = 0;
+        out.mz = 0;
+        return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------
+// Driver
+
+template <typename Bus>
+class Driver {
+public:
+    // Reads go through one buffer: the whole FIFO if the bus allows, whole frames otherwise
+    static constexpr size_t kChunkFrames =
+        (Bus::kMaxRead / kFifoFrameSize < kFifoMaxSamples) ? Bus::kMaxRead / kFifoFrameSize
+                                                           : kFifoMaxSamples;
+    static constexpr size_t kBufferSize =
+        (kChunkFrames * kFifoFrameSize > kBurstSize) ? kChunkFrames * kFifoFrameSize : kBurstSize;
+
+    explicit Driver(Bus &bus)
+        : bus_(bus), accelRange_(0), gyroRange_(0), dlpfCfg_(0), sampleRateDiv_(0),
+          userCtrl_(0), fifoEnabled_(false), auxMaster_(false), magNextUs_(0),
+          magLastUs_(-1), magPeriodUs_(kAkPeriodUs), magCache_(), magCopy_(),
+          magCopyValid_(false) {}
+
+    Bus &bus() { return bus_; }
+
+    /**
+     * @brief Wake the MPU9250, apply the configuration and enable the data ready interrupt
+     */
+    Status beginImu(const Config &config) {
+        if (!bus_.write(kMpuAddr, reg::PWR_MGMT_1, 0x00)) {
+            return Status::BusError;
+        }
+        bus_.delay_ms(100);
+
+        Status st = configure(config);
+        if (st != Status::Ok) {
+            return st;
+        }
+        return write(reg::INT_ENABLE, kIntDataReady);
+    }
+
+    /**
+     * @brief Reach the AK8963 through bypass and start 16-bit continuous measurement (100 Hz)
+     */
+    Status beginMag() {
+        Status st = write(reg::INT_PIN_CFG, kBypassEnable);
+        if (st != Status::Ok) {
+            return st;
+        }
+        bus_.delay_ms(10);
+        if (!bus_.write(kAkAddr, ak::CNTL1, kAkContinuous100Hz16Bit)) {
+            return Status::BusError;
+        }
+        bus_.delay_ms(10);
+
+        magNextUs_ = 0;
+        magLastUs_ = -1;
+        magPeriodUs_ = kAkPeriodUs;
+        magCache_ = MagCache();
+        magCopyValid_ = false;
+        return Status::Ok;
+    }
+
+    /**
+     * @brief Ranges, DLPF and sample rate divider
+     */
+    Status configure(const Config &config) {
+        if (config.accelRange > 3 || config.gyroRange > 3 || config.dlpfCfg > 6) {
+            return Status::InvalidArg;
+        }
+        Status st = write(reg::ACCEL_CONFIG, config.accelRange << 3);
+        if (st != Status::Ok) {
+            return st;
+        }
+        accelRange_ = config.accelRange;
+
+        st = write(reg::GYRO_CONFIG, config.gyroRange << 3);
+        if (st != Status::Ok) {
+            return st;
+        }
+        gyroRange_ = config.gyroRange;
+
+        // CONFIG also holds FIFO_MODE, keep it while the FIFO is in use
+        st = write(reg::CONFIG, config.dlpfCfg | (fifoEnabled_ ? kConfigFifoMode : 0));
+        if (st != Status::Ok) {
+            return st;
+        }
+        dlpfCfg_ = config.dlpfCfg;
+
+        return setSampleRateDivider(config.sampleRateDiv);
+    }
+
+    Status setSampleRateDivider(uint8_t div) {
+        Status st = write(reg::SMPLRT_DIV, div);
+        if (st != Status::Ok) {
+            return st;
+        }
+        sampleRateDiv_ = div;
+        // The aux master polls at the sample rate, keep it near the magnetometer's 100 Hz
+        return auxMaster_ ? setAuxMasterRate() : Status::Ok;
+    }
+
+    /**
+     * @brief Output data rate in Hz
+     *
+     * The divider runs off the 1 kHz internal rate only with the DLPF on (cfg 1..6);
+     * with DLPF_CFG 0 the internal rate is 8 kHz.
+     */
+    float sampleRate() const {
+        float internal = (dlpfCfg_ == 0 || dlpfCfg_ == 7) ? 8000.0f : 1000.0f;
+        return internal / (1 + sampleRateDiv_);
+    }
+
+    Status setDataReadyInterrupt(bool enable) {
+        return write(reg::INT_ENABLE, enable ? kIntDataReady : 0x00);
+    }
+
+    /**
+     * @brief Hand the AK8963 (after beginMag) to the MPU9250's aux I2C master
+     *
+     * Bypass off; SLV0 copies HXL..ST2 into EXT_SENS_DATA_00..06 every (1 + I2C_MST_DLY)
+     * samples and the data ready interrupt waits for that copy (WAIT_FOR_ES).
+     */
+    Status enableAuxMaster() {
+        Status st = write(reg::INT_PIN_CFG, 0x00);
+        if (st == Status::Ok) st = write(reg::I2C_MST_CTRL, 0x4D);     // WAIT_FOR_ES, 400 kHz
+        if (st == Status::Ok) st = write(reg::I2C_SLV0_ADDR, 0x80 | kAkAddr);
+        if (st == Status::Ok) st = write(reg::I2C_SLV0_REG, ak::HXL);
+        if (st == Status::Ok) st = write(reg::I2C_SLV0_CTRL, 0x80 | kExtMagSize);
+        if (st != Status::Ok) {
+            return st;
+        }
+
+        userCtrl_ = kUserI2cMasterEnable;
+        auxMaster_ = true;
+        st = write(reg::USER_CTRL, userCtrl_ | (fifoEnabled_ ? kUserFifoEnable : 0));
+        if (st == Status::Ok) {
+            st = setAuxMasterRate();
+        }
+        if (st != Status::Ok) {
+            userCtrl_ = 0;
+            auxMaster_ = false;
+            return st;
+        }
+
+        // First copy lands after the next polled sample
+        bus_.delay_ms(20);
+        return Status::Ok;
+    }
+
+    bool auxMaster() const { return auxMaster_; }
+    bool fifoEnabled() const { return fifoEnabled_; }
+    uint8_t accelRange() const { return accelRange_; }
+    uint8_t gyroRange() const { return gyroRange_; }
+
+    // Physical units per LSB for the current ranges
+    float accelScale() const { return 1.0f / accel_lsb_per_g(accelRange_); }
+    float gyroScale() const { return 1.0f / gyro_lsb_per_dps(gyroRange_); }
+    static constexpr float magScale() { return kMagUtPerLsb; }
+
+    /**
+     * @brief Accelerometer and gyroscope, one 14-byte read
+     */
+    template <typename Out>
+    Status readImu(Out &out) {
+        if (!bus_.read(kMpuAddr, reg::ACCEL_XOUT_H, buffer_, kImuSize)) {
+            return Status::BusError;
+        }
+        decode_imu(buffer_, out);
+        return Status::Ok;
+    }
+
+    //-----------------------------------------------------------------------------------------
+    // Magnetometer scheduling
+    //
+    // The AK8963 measures at its own rate (100 Hz), usually slower than the IMU is read.
+    // The driver reads it only once a new measurement is due: magDue() turns true one
+    // estimated period (less a retry step) after the last new reading, and a read that
+    // finds nothing new retries one step later, or waits for the following measurement
+    // once the expected one is a quarter period late. The period estimate follows the
+    // observed interval between new readings. Times are the caller's clock in µs.
+    //
+    // A reading counts as new if ST1.DRDY is set (bypass) or if the EXT_SENS_DATA copy
+    // (HXL..ST2) differs from the previous one (aux master, which copies at ~100 Hz
+    // whether or not the AK8963 has measured). Two identical consecutive measurements
+    // then count as one, which loses nothing; an overflowed copy read again is not new
+    // either. Every new reading is returned exactly once, so a filter that
+    // fuses what the reads return only fuses fresh magnetometer data.
+
+    bool magDue(int64_t nowUs) const { return nowUs >= magNextUs_; }
+    uint32_t magPeriodUs() const { return magPeriodUs_; }
+    const MagCache &magCache() const { return magCache_; }
+
+    // Age of the cached reading, -1 if there is none yet
+    int64_t magAgeUs(int64_t nowUs) const { return magCache_.valid ? nowUs - magCache_.tUs : -1; }
+
+    /**
+     * @brief Bookkeeping for a magnetometer copy (HXL..HZH, ST2) read by the caller
+     *
+     * For platforms that run the transfer themselves (asynchronous reads). dataReady is
+     * ST1.DRDY with bypass and ignored with the aux master.
+     *
+     * @return Status::Ok and out.mx..mz set for a new reading, NotReady if nothing is
+     *         new, Overflow if the new measurement overflowed (it is not cached)
+     */
+    template <typename Out>
+    Status acceptMag(const uint8_t *raw, bool dataReady, int64_t nowUs, Out &out) {
+        RawSample m = RawSample();
+        Status st = decode_mag(raw, m);
+        bool fresh = dataReady;
+        if (auxMaster_) {
+            fresh = !magCopyValid_;
+            for (size_t i = 0; i < kExtMagSize; i++) {
+                fresh = fresh || raw[i] != magCopy_[i];
+                magCopy_[i] = raw[i];
+            }
+            magCopyValid_ = true;
+        }
+        if (!fresh) {
+            magNextUs_ = nowUs + magRetryUs();
+            // Well past the expected time: that measurement was missed, wait for the next
+            if (magLastUs_ >= 0 && nowUs - magLastUs_ > 5 * (int64_t)magPeriodUs_ / 4) {
+                int64_t periods = (nowUs - magLastUs_) / magPeriodUs_ + 1;
+                magNextUs_ = magLastUs_ + periods * magPeriodUs_ - magRetryUs();
+            }
+            return Status::NotReady;
+        }
+
+        // Track the AK8963's real rate from consecutive new readings; longer gaps
+        // mean a measurement was missed
+        if (magLastUs_ >= 0) {
+            int64_t interval = nowUs - magLastUs_;
+            if (interval > 0 && interval < 3 * (int64_t)magPeriodUs_ / 2) {
+                magPeriodUs_ = (uint32_t)((int64_t)magPeriodUs_ + (interval - (int64_t)magPeriodUs_) / 8);
+            }
+        }
+        magLastUs_ = nowUs;
+        magNextUs_ = nowUs + magPeriodUs_ - magRetryUs();
+        if (st != Status::Ok) {
+            return st;      // overflowed: a measurement, but not one to keep
+        }
+        magCache_.tUs = nowUs;
+        magCache_.mx = m.mx;
+        magCache_.my = m.my;
+        magCache_.mz = m.mz;
+        magCache_.valid = true;
+        out.mx = m.mx;
+        out.my = m.my;
+        out.mz = m.mz;
+        return Status::Ok;
+    }
+
+    /**
+     * @brief Read the magnetometer now, whether or not a measurement is due
+     *
+     * Aux master: the EXT_SENS_DATA copy. Bypass: ST1..ST2 straight from the AK8963
+     * (reading ST2 releases its data registers).
+     *
+     * @return Status::Ok with out.mx..mz set only for a new reading, NotReady otherwise
+     */
+    template <typename Out>
+    Status readMag(Out &out, int64_t nowUs) {
+        if (auxMaster_) {
+            if (!bus_.read(kMpuAddr, reg::EXT_SENS_DATA_00, buffer_, kExtMagSize)) {
+                magNextUs_ = nowUs + magRetryUs();
+                return Status::BusError;
+            }
+            return acceptMag(buffer_, true, nowUs, out);
+        }
+
+        if (!bus_.read(kAkAddr, ak::ST1, buffer_, 1 + kExtMagSize)) {
+            // No AK8963 (or not in bypass): do not retry before the next measurement
+            magNextUs_ = nowUs + magPeriodUs_;
+            return Status::BusError;
+        }
+        return acceptMag(&buffer_[1], (buffer_[0] & kAkSt1DataReady) != 0, nowUs, out);
+    }
+
+    /**
+     * @brief All nine axes, reading the magnetometer only when a measurement is due
+     *
+     * With the aux master that is one read either way, of kBurstSize bytes when due and
+     * kImuSize otherwise; with bypass a second read of the AK8963 when due.
+     *
+     * @param magFresh Set if out.mx..mz hold a new reading; they are 0 otherwise
+     */
+    template <typename Out>
+    Status readAll(Out &out, int64_t nowUs, bool *magFresh) {
+        bool due = magDue(nowUs);
+        *magFresh = false;
+        out.mx = 0;
+        out.my = 0;
+        out.mz = 0;
+
+        if (auxMaster_) {
+            size_t len = due ? kBurstSize : kImuSize;
+            if (!bus_.read(kMpuAddr, reg::ACCEL_XOUT_H, buffer_, len)) {
+                return Status::BusError;
+            }
+            decode_imu(buffer_, out);
+            if (due) {
+                *magFresh = (acceptMag(&buffer_[kImuSize], true, nowUs, out) == Status::Ok);
+            }
+            return Status::Ok;
+        }
+
+        Status st = readImu(out);
+        if (st != Status::Ok) {
+            return st;
+        }
+        if (due) {
+            *magFresh = (readMag(out, nowUs) == Status::Ok);
+        }
+        return Status::Ok;
+    }
+
+    /**
+     * @brief Queue accelerometer + gyroscope samples in the FIFO instead of raising data ready
+     *
+     * FIFO_MODE stops a full FIFO from accepting samples, so what it holds stays frame
+     * aligned; the overflow interrupt replaces data ready.
+     */
+    Status fifoEnable() {
+        Status st = write(reg::INT_ENABLE, 0x00);
+        if (st == Status::Ok) st = write(reg::CONFIG, dlpfCfg_ | kConfigFifoMode);
+        if (st != Status::Ok) {
+            return st;
+        }
+        fifoEnabled_ = true;
+
+        st = fifoReset();
+        if (st != Status::Ok) {
+            fifoEnabled_ = false;
+            return st;
+        }
+
+        // Reading INT_STATUS clears anything pending
+        st = write(reg::INT_ENABLE, kIntFifoOverflow);
+        if (st == Status::Ok && !bus_.read(kMpuAddr, reg::INT_STATUS, buffer_, 1)) {
+            st = Status::BusError;
+        }
+        return st;
+    }
+
+    /**
+     * @brief Leave FIFO mode and re-enable the data ready interrupt
+     */
+    Status fifoDisable() {
+        Status st = write(reg::FIFO_EN, 0x00);
+        if (st == Status::Ok) st = write(reg::USER_CTRL, userCtrl_ | kUserFifoReset);
+        if (st == Status::Ok) st = write(reg::CONFIG, dlpfCfg_);
+        if (st != Status::Ok) {
+            return st;
+        }
+        fifoEnabled_ = false;
+        return write(reg::INT_ENABLE, kIntDataReady);
+    }
+
+    /**
+     * @brief Stop queueing, empty the FIFO, queue accelerometer + gyroscope again
+     */
+    Status fifoReset() {
+        if (!fifoEnabled_) {
+            return Status::InvalidState;
+        }
+        Status st = write(reg::FIFO_EN, 0x00);
+        if (st == Status::Ok) st = write(reg::USER_CTRL, userCtrl_ | kUserFifoEnable | kUserFifoReset);
+        if (st == Status::Ok) st = write(reg::FIFO_EN, kFifoAccelGyro);
+        return st;
+    }
+
+    /**
+     * @brief Drain up to maxSamples of the oldest FIFO samples, passing each to sink
+     *
+     * sink(const RawSample &) is called oldest first (magnetometer fields 0). The
+     * frames are read in as few bursts as Bus::kMaxRead allows. If the FIFO overflowed,
+     * the complete samples still in it are delivered, the FIFO is reset and *overflow
+     * is set: the samples that did not fit are lost.
+     */
+    template <typename Sink>
+    Status fifoRead(size_t maxSamples, Sink sink, size_t *count, bool *overflow) {
+        *count = 0;
+        *overflow = false;
+        if (!fifoEnabled_) {
+            return Status::InvalidState;
+        }
+
+        // INT_STATUS (FIFO_OFLOW_INT, cleared by this read) and FIFO_COUNT
+        uint8_t status;
+        uint8_t countBuf[2];
+        if (!bus_.read(kMpuAddr, reg::INT_STATUS, &status, 1) ||
+            !bus_.read(kMpuAddr, reg::FIFO_COUNTH, countBuf, 2)) {
+            return Status::BusError;
+        }
+
+        size_t bytes = ((countBuf[0] & 0x1F) << 8) | countBuf[1];
+        // A partial frame means the FIFO filled up in the middle of a sample
+        bool lost = (status & kIntFifoOverflow) || (bytes % kFifoFrameSize) != 0;
+        size_t n = bytes / kFifoFrameSize;
+        if (n > maxSamples) {
+            n = maxSamples;
+        }
+
+        RawSample sample = RawSample();
+        while (*count < n) {
+            size_t frames = (n - *count < kChunkFrames) ? n - *count : kChunkFrames;
+            if (!bus_.read(kMpuAddr, reg::FIFO_R_W, buffer_, frames * kFifoFrameSize)) {
+                // The FIFO read pointer moved by an unknown amount
+                fifoReset();
+                return Status::BusError;
+            }
+            for (size_t i = 0; i < frames; i++) {
+                decode_fifo_frame(&buffer_[i * kFifoFrameSize], sample);
+                sink(sample);
+            }
+            *count += frames;
+        }
+
+        if (lost) {
+            *overflow = true;
+            return fifoReset();
+        }
+        return Status::Ok;
+    }
+
+    /**
+     * @brief Stop the aux master and put the MPU9250 to sleep
+     */
+    Status sleep() {
+        Status st = write(reg::USER_CTRL, 0x00);
+        userCtrl_ = 0;
+        auxMaster_ = false;
+        fifoEnabled_ = false;
+        if (st != Status::Ok) {
+            return st;
+        }
+        return write(reg::PWR_MGMT_1, 0x40);
+    }
+
+private:
+    // Step between reads while a due measurement has not arrived yet
+    uint32_t magRetryUs() const { return magPeriodUs_ / 16; }
+
+    Status write(uint8_t r, uint8_t value) {
+        return bus_.write(kMpuAddr, r, value) ? Status::Ok : Status::BusError;
+    }
+
+    // Poll SLV0 every (1 + I2C_MST_DLY) samples, about 100 Hz
+    Status setAuxMasterRate() {
+        int dly = (int)(sampleRate() / 100.0f + 0.5f) - 1;
+        if (dly < 0) dly = 0;
+        if (dly > 31) dly = 31;
+        Status st = write(reg::I2C_SLV4_CTRL, (uint8_t)dly);
+        if (st == Status::Ok) {
+            st = write(reg::I2C_MST_DELAY_CTRL, 0x01);    // SLV0 delayed
+        }
+        return st;
+    }
+
+    Bus &bus_;
+    uint8_t buffer_[kBufferSize];
+    uint8_t accelRange_;
+    uint8_t gyroRange_;
+    uint8_t dlpfCfg_;
+    uint8_t sampleRateDiv_;
+    uint8_t userCtrl_;      // USER_CTRL bits kept by every write (I2C_MST_EN)
+    bool fifoEnabled_;
+    bool auxMaster_;
+    int64_t magNextUs_;     // magnetometer read due from this time on
+    int64_t magLastUs_;     // last new measurement, -1 before the first
+    uint32_t magPeriodUs_;  // estimated AK8963 measurement period
+    MagCache magCache_;
+    uint8_t magCopy_[kExtMagSize];  // aux master: previous EXT_SENS_DATA copy
+    bool magCopyValid_;
+};
+
+} // namespace mpu9250
+
+#endif // MPU9250_DRIVER_HPP
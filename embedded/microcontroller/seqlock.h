@@ -0,0 +1,87 @@
+//=============================================================================================
+// seqlock.h
+//=============================================================================================
+//
+// Sequence lock over a word array, for state handed from one task to others (odom_pose.h,
+// imu_state.h, the wheel command of motor_control.h):
+//
+//   writer   seq odd -> copy -> seq even          one task, never waits
+//   reader   seq -> copy -> seq, fail if it changed or was odd
+//
+// A reader always gets the words of one update, never a mix of two, and the writer is
+// never held up by readers. A read fails only while an update (a few dozen bytes of
+// copy) is in progress. The typed wrappers copy their struct to and from a local word
+// array around these calls.
+//
+// The copies go through relaxed atomic word accesses and fences (GCC __atomic
+// builtins), so the header is race-free by the C11/C++11 memory model and builds as
+// C and C++ (Arduino sketches).
+//
+//=============================================================================================
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Words holding a value of the given type
+#define SEQLOCK_WORDS(type) ((sizeof(type) + 3) / 4)
+
+/**
+ * @brief Publish new words (single writer)
+ *
+ * @param seq Sequence number of the shared words, odd while an update is being written
+ * @param words Shared words
+ * @param src New words
+ * @param count Number of words
+ */
+static inline void seqlock_publish(uint32_t *seq, uint32_t *words, const uint32_t *src,
+                                   size_t count) {
+    uint32_t s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    __atomic_store_n(seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);   // odd seq visible before any new word
+    for (size_t i = 0; i < count; i++) {
+        __atomic_store_n(&words[i], src[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Read the words once, without retrying
+ *
+ * @param seq Sequence number of the shared words
+ * @param words Shared words
+ * @param dst Filled with the words; meaningless when the read fails
+ * @param count Number of words
+ * @param update Update number of the words read, 0 before the first one (may be NULL)
+ * @return bool false if an update was in progress
+ */
+static inline bool seqlock_try_read(const uint32_t *seq, const uint32_t *words, uint32_t *dst,
+                                    size_t count, uint32_t *update) {
+    uint32_t s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+    if (s & 1u) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = __atomic_load_n(&words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);    // words read before seq is checked again
+    if (__atomic_load_n(seq, __ATOMIC_RELAXED) != s) {
+        return false;
+    }
+    if (update != NULL) {
+        *update = s / 2;
+    }
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SEQLOCK_H
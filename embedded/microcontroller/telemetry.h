@@ -0,0 +1,96 @@
+//=============================================================================================
+// telemetry.h
+//=============================================================================================
+//
+// Binary telemetry to the console port, in place of formatted text.
+//
+// Any task hands a record to telemetry_send(): a header and a copy of the payload go
+// into a FreeRTOS ring buffer and the call returns, without formatting and without
+// waiting for the port (a full buffer drops the record and counts it). A dedicated
+// low-priority task frames the queued records (telemetry_frame.h) and writes them in
+// batches through the configured write function, e.g. uart_write_bytes() on the
+// ESP-IDF UART driver or Serial.write() on Arduino. Both queue the bytes in their own
+// TX ring buffer that the UART interrupt drains.
+//
+// Decode on the host with codes/host/telemetry (text, CSV).
+//
+//=============================================================================================
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "telemetry_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Write framed bytes to the port (called from the telemetry task only)
+ *
+ * @param data Bytes
+ * @param len Length
+ * @param ctx User context
+ */
+typedef void (*telemetry_write_t)(const uint8_t *data, size_t len, void *ctx);
+
+// Telemetry configuration structure
+typedef struct {
+    telemetry_write_t write;    // port output
+    void *ctx;                  // passed to write
+    size_t queue_size;          // bytes of queued records
+    UBaseType_t priority;       // telemetry task priority (below the producers)
+    uint32_t stack_size;        // telemetry task stack (bytes)
+} telemetry_config_t;
+
+// Default configuration: ~60 pose-sized records of queue, priority 1
+#define TELEMETRY_DEFAULT_CONFIG() { \
+    .write = NULL, \
+    .ctx = NULL, \
+    .queue_size = 2048, \
+    .priority = 1, \
+    .stack_size = 3072 \
+}
+
+/**
+ * @brief Create the queue and start the telemetry task
+ *
+ * @param config Configuration structure (write is required)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t telemetry_init(const telemetry_config_t *config);
+
+/**
+ * @brief Queue a record (any task, never waits)
+ *
+ * @param type Record type
+ * @param payload Payload (one of the telemetry_*_t structs)
+ * @param len Payload length, at most TELEMETRY_MAX_PAYLOAD
+ * @return bool false if dropped (queue full, not started or too long)
+ */
+bool telemetry_send(telemetry_type_t type, const void *payload, size_t len);
+
+/**
+ * @brief Queue a text line (truncated to TELEMETRY_MAX_PAYLOAD characters)
+ *
+ * @param text Line without newline
+ * @return bool false if dropped
+ */
+bool telemetry_text(const char *text);
+
+/**
+ * @brief Get the number of records dropped since telemetry_init()
+ *
+ * @return uint32_t Dropped records
+ */
+uint32_t telemetry_get_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_H
@@ -0,0 +1,228 @@
+//=============================================================================================
+// telemetry_frame.h
+//=============================================================================================
+//
+// Binary telemetry records and their framing on the serial link, shared by the
+// firmware (telemetry.c) and the host decoder (codes/host/telemetry).
+//
+// One frame per record:
+//
+//   COBS( type | seq | t_us | payload | crc16 ) 0x00
+//
+//   type     telemetry_type_t (1 byte)
+//   seq      frame counter of the sender, wraps at 256: gaps are lost frames
+//   t_us     esp_timer time of the record, low 32 bits (little-endian)
+//   payload  one of the telemetry_*_t structs below (packed, little-endian)
+//   crc16    CRC-16/CCITT-FALSE of everything before it (little-endian)
+//
+// COBS removes every 0x00 from the frame, so 0x00 only ever ends a frame: a receiver
+// that starts mid-stream or loses bytes resynchronizes on the next one. Text that
+// shares the port (boot messages, ESP_LOG) lands between delimiters and fails the CRC;
+// the decoder shows it as text.
+//
+//=============================================================================================
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    TELEMETRY_TEXT = 0x01,      // log line (characters, no terminator)
+    TELEMETRY_IMU = 0x10,       // telemetry_imu_t
+    TELEMETRY_POSE = 0x20,      // telemetry_pose_t
+    TELEMETRY_COUNTS = 0x21,    // telemetry_counts_t
+    TELEMETRY_DIAG = 0x30,      // telemetry_diag_t
+} telemetry_type_t;
+
+#define TELEMETRY_HEADER_LEN  6u
+#define TELEMETRY_MAX_PAYLOAD 120u
+#define TELEMETRY_MAX_RECORD  (TELEMETRY_HEADER_LEN + TELEMETRY_MAX_PAYLOAD)
+// COBS adds one byte per 254 (and one), then the CRC and the delimiter
+#define TELEMETRY_MAX_FRAME   (TELEMETRY_MAX_RECORD + 2u + (TELEMETRY_MAX_RECORD + 2u) / 254u + 2u)
+
+// Attitude of the AHRS and its sampling
+typedef struct __attribute__((packed)) {
+    float roll, pitch, yaw;     // deg
+    float rate_hz;              // mean sample rate
+    float jitter_ms;            // sample interval jitter
+    uint32_t dropped;           // samples missed by the filter
+    uint32_t overflows;         // MPU9250 FIFO overflows
+    uint8_t mag_valid;          // last update used the magnetometer
+} telemetry_imu_t;
+
+// Odometry pose and velocity
+typedef struct __attribute__((packed)) {
+    float x, y;                 // m
+    float theta;                // rad
+    float v;                    // m/s
+    float omega;                // rad/s
+} telemetry_pose_t;
+
+// Wheel encoders
+typedef struct __attribute__((packed)) {
+    int32_t left, right;        // counts since start (low 32 bits)
+    float rate_left, rate_right;    // counts/s
+} telemetry_counts_t;
+
+// Loop and link health
+typedef struct __attribute__((packed)) {
+    uint16_t loop_hz;           // odometry loop rate over the last interval
+    uint32_t dt_max_us;         // longest odometry period over the last interval
+    uint32_t interrupts;        // encoder interrupts since start
+    uint32_t dropped;           // records dropped by the sender (queue full)
+} telemetry_diag_t;
+
+// Header of a decoded record
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint32_t t_us;
+} telemetry_header_t;
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), 4 bits at a time
+ *
+ * @param data Bytes
+ * @param len Length
+ * @return uint16_t CRC
+ */
+static inline uint16_t telemetry_crc16(const uint8_t *data, size_t len) {
+    static const uint16_t kTable[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    };
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 4) ^ kTable[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ kTable[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+/**
+ * @brief COBS-encode a buffer (no delimiter)
+ *
+ * @param in Bytes
+ * @param len Length
+ * @param out Output, at least len + len / 254 + 1 bytes
+ * @return size_t Bytes written
+ */
+static inline size_t telemetry_cobs_encode(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t code_pos = 0;
+    size_t n = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] != 0) {
+            out[n++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF) {
+            out[code_pos] = code;
+            code_pos = n++;
+            code = 1;
+        }
+    }
+    out[code_pos] = code;
+    return n;
+}
+
+/**
+ * @brief COBS-decode a frame (without its delimiter)
+ *
+ * @param in Encoded bytes
+ * @param len Length
+ * @param out Output, at least len bytes
+ * @return size_t Bytes written, 0 if the frame is malformed
+ */
+static inline size_t telemetry_cobs_decode(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t n = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > len) {
+            return 0;
+        }
+        for (uint8_t k = 1; k < code; k++) {
+            if (in[i] == 0) {
+                return 0;
+            }
+            out[n++] = in[i++];
+        }
+        if (code != 0xFF && i < len) {
+            out[n++] = 0;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Frame a record: CRC, COBS and the delimiter
+ *
+ * @param header Record header
+ * @param payload Payload
+ * @param len Payload length, at most TELEMETRY_MAX_PAYLOAD
+ * @param out Output, at least TELEMETRY_MAX_FRAME bytes
+ * @return size_t Frame length including the delimiter
+ */
+static inline size_t telemetry_frame(const telemetry_header_t *header, const void *payload,
+                                     size_t len, uint8_t *out) {
+    uint8_t raw[TELEMETRY_MAX_RECORD + 2];
+    raw[0] = header->type;
+    raw[1] = header->seq;
+    raw[2] = (uint8_t)header->t_us;
+    raw[3] = (uint8_t)(header->t_us >> 8);
+    raw[4] = (uint8_t)(header->t_us >> 16);
+    raw[5] = (uint8_t)(header->t_us >> 24);
+    memcpy(raw + TELEMETRY_HEADER_LEN, payload, len);
+    size_t n = TELEMETRY_HEADER_LEN + len;
+    uint16_t crc = telemetry_crc16(raw, n);
+    raw[n++] = (uint8_t)crc;
+    raw[n++] = (uint8_t)(crc >> 8);
+    n = telemetry_cobs_encode(raw, n, out);
+    out[n++] = 0;
+    return n;
+}
+
+/**
+ * @brief Decode one frame (without its delimiter) and check its CRC
+ *
+ * @param in Encoded bytes
+ * @param len Length
+ * @param header Decoded header
+ * @param payload Payload, at least TELEMETRY_MAX_PAYLOAD bytes
+ * @return int Payload length, -1 if malformed or the CRC does not match
+ */
+static inline int telemetry_unframe(const uint8_t *in, size_t len, telemetry_header_t *header,
+                                    uint8_t *payload) {
+    uint8_t raw[TELEMETRY_MAX_FRAME];
+    if (len > sizeof(raw)) {
+        return -1;
+    }
+    size_t n = telemetry_cobs_decode(in, len, raw);
+    if (n < TELEMETRY_HEADER_LEN + 2 || n > TELEMETRY_MAX_RECORD + 2) {
+        return -1;
+    }
+    uint16_t crc = (uint16_t)(raw[n - 2] | (raw[n - 1] << 8));
+    if (telemetry_crc16(raw, n - 2) != crc) {
+        return -1;
+    }
+    header->type = raw[0];
+    header->seq = raw[1];
+    header->t_us = (uint32_t)raw[2] | ((uint32_t)raw[3] << 8) | ((uint32_t)raw[4] << 16) |
+                   ((uint32_t)raw[5] << 24);
+    size_t payload_len = n - 2 - TELEMETRY_HEADER_LEN;
+    memcpy(payload, raw + TELEMETRY_HEADER_LEN, payload_len);
+    return (int)payload_len;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_FRAME_H
@@ -0,0 +1,184 @@
+//=============================================================================================
+// time_sync.h
+//=============================================================================================
+//
+// Local clock (esp_timer, µs since boot) to host time (ns since the epoch), with drift.
+//
+// Each sync with the host gives one offset sample: host time minus local time, taken
+// right after the exchange, with the round trip of the exchange as its uncertainty
+// (the offset is off by at most half of it). An offset alone goes stale: the ESP32
+// crystal is off by tens of ppm, about 1-2 ms per minute. The last TIME_SYNC_WINDOW
+// samples are fitted with a line, weighted by their round trip, so the skew is followed
+// between syncs; samples whose round trip is well above the best one (a busy link, a
+// late reply) are left out.
+//
+// The residual of the fit plus half the best round trip bounds the error of a stamp.
+//
+// Not thread-safe: samples and conversions from one task.
+//
+//=============================================================================================
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIME_SYNC_WINDOW        8
+#define TIME_SYNC_RTT_SLACK_US  1000    // accepted round trip: below 2x the best + this
+#define TIME_SYNC_MAX_REJECTS   3       // then the link has changed: take the sample
+#define TIME_SYNC_MAX_SKEW      5e-4    // 500 ppm, far beyond any crystal
+
+typedef struct {
+    // Window of accepted samples (oldest first once full)
+    int64_t local_us[TIME_SYNC_WINDOW];
+    int64_t offset_ns[TIME_SYNC_WINDOW];
+    uint32_t rtt_us[TIME_SYNC_WINDOW];
+    uint32_t count;
+    uint32_t head;
+    // Model: offset_ns = ref_offset_ns + skew * (local_us - ref_local_us) * 1000
+    int64_t ref_local_us;
+    int64_t ref_offset_ns;
+    double skew;                // host ns per local ns, minus 1
+    bool valid;
+    // Quality
+    uint32_t min_rtt_us;        // best round trip in the window
+    uint32_t residual_us;       // largest offset of a sample from the fitted line
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t rejects_in_row;
+} time_sync_t;
+
+/**
+ * @brief Reset to no sync: stamps stay in local time
+ *
+ * @param sync Sync state
+ */
+static inline void time_sync_init(time_sync_t *sync) {
+    memset(sync, 0, sizeof(*sync));
+}
+
+// Least-squares line through the window, relative to the newest sample
+static inline void time_sync_fit(time_sync_t *sync) {
+    uint32_t n = sync->count;
+    uint32_t newest = (sync->head + TIME_SYNC_WINDOW - 1) % TIME_SYNC_WINDOW;
+    int64_t x0 = sync->local_us[newest];
+    int64_t y0 = sync->offset_ns[newest];
+
+    // Weighted by 1/rtt^2: the error of a sample grows with its round trip
+    double w[TIME_SYNC_WINDOW];
+    double sw = 0, sx = 0, sy = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        double rtt = sync->rtt_us[i] > 0 ? (double)sync->rtt_us[i] : 1.0;
+        w[i] = 1.0 / (rtt * rtt);
+        sw += w[i];
+        sx += w[i] * (double)(sync->local_us[i] - x0);
+        sy += w[i] * (double)(sync->offset_ns[i] - y0);
+    }
+    double mx = sx / sw, my = sy / sw;
+    double sxx = 0, sxy = 0;
+    uint32_t min_rtt = UINT32_MAX;
+    for (uint32_t i = 0; i < n; i++) {
+        double dx = (double)(sync->local_us[i] - x0) - mx;
+        sxx += w[i] * dx * dx;
+        sxy += w[i] * dx * ((double)(sync->offset_ns[i] - y0) - my);
+        if (sync->rtt_us[i] < min_rtt) {
+            min_rtt = sync->rtt_us[i];
+        }
+    }
+
+    // ns of offset per µs of local time, i.e. 1000 * skew
+    double slope = sxx > 0 ? sxy / sxx : 0;
+    if (slope > 1000 * TIME_SYNC_MAX_SKEW) {
+        slope = 1000 * TIME_SYNC_MAX_SKEW;
+    } else if (slope < -1000 * TIME_SYNC_MAX_SKEW) {
+        slope = -1000 * TIME_SYNC_MAX_SKEW;
+    }
+    double at_newest = my - slope * mx;
+
+    double residual = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        double dx = (double)(sync->local_us[i] - x0);
+        double r = (double)(sync->offset_ns[i] - y0) - (at_newest + slope * dx);
+        if (r < 0) {
+            r = -r;
+        }
+        if (r > residual) {
+            residual = r;
+        }
+    }
+
+    sync->ref_local_us = x0;
+    sync->ref_offset_ns = y0 + (int64_t)at_newest;
+    sync->skew = slope * 1e-3;
+    sync->min_rtt_us = min_rtt;
+    sync->residual_us = (uint32_t)(residual * 1e-3 + 0.5);
+    sync->valid = true;
+}
+
+/**
+ * @brief Add the result of a sync with the host
+ *
+ * @param sync Sync state
+ * @param local_us Local time of the sample
+ * @param host_ns Host time at local_us
+ * @param rtt_us Round trip of the exchange
+ * @return true if the sample was used, false if its round trip was too long
+ */
+static inline bool time_sync_add(time_sync_t *sync, int64_t local_us, int64_t host_ns,
+                                 uint32_t rtt_us) {
+    if (sync->count > 0 && rtt_us > 2 * sync->min_rtt_us + TIME_SYNC_RTT_SLACK_US &&
+        sync->rejects_in_row < TIME_SYNC_MAX_REJECTS) {
+        sync->rejected++;
+        sync->rejects_in_row++;
+        return false;
+    }
+    sync->rejects_in_row = 0;
+    sync->accepted++;
+    sync->local_us[sync->head] = local_us;
+    sync->offset_ns[sync->head] = host_ns - local_us * 1000;
+    sync->rtt_us[sync->head] = rtt_us;
+    sync->head = (sync->head + 1) % TIME_SYNC_WINDOW;
+    if (sync->count < TIME_SYNC_WINDOW) {
+        sync->count++;
+    }
+    time_sync_fit(sync);
+    return true;
+}
+
+/**
+ * @brief Host time of a local time
+ *
+ * @param sync Sync state
+ * @param local_us Local time (e.g. an ISR timestamp)
+ * @return int64_t Host time (ns since the epoch), or the local time in ns before the
+ *         first sync
+ */
+static inline int64_t time_sync_to_host_ns(const time_sync_t *sync, int64_t local_us) {
+    if (!sync->valid) {
+        return local_us * 1000;
+    }
+    double drift_ns = sync->skew * 1000.0 * (double)(local_us - sync->ref_local_us);
+    return local_us * 1000 + sync->ref_offset_ns + (int64_t)drift_ns;
+}
+
+/**
+ * @brief Bound of the stamp error near the window (residual plus half the best round
+ *        trip)
+ *
+ * @param sync Sync state
+ * @return uint32_t Error bound (µs), UINT32_MAX before the first sync
+ */
+static inline uint32_t time_sync_error_bound_us(const time_sync_t *sync) {
+    return sync->valid ? sync->residual_us + sync->min_rtt_us / 2 : UINT32_MAX;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIME_SYNC_H